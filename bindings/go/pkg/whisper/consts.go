@@ -12,6 +12,7 @@ import (
 
 var (
 	ErrUnableToLoadModel    = errors.New("unable to load model")
+	ErrUnableToCreateState  = errors.New("unable to create state")
 	ErrInternalAppError     = errors.New("internal application error")
 	ErrProcessingFailed     = errors.New("processing failed")
 	ErrUnsupportedLanguage  = errors.New("unsupported language")
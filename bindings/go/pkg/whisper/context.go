@@ -17,6 +17,7 @@ import (
 type context struct {
 	n      int
 	model  *model
+	state  *whisper.State // nil for the default state of the model
 	params whisper.Params
 }
 
@@ -26,15 +27,28 @@ var _ Context = (*context)(nil)
 ///////////////////////////////////////////////////////////////////////////////
 // LIFECYCLE
 
-func newContext(model *model, params whisper.Params) (Context, error) {
+func newContext(model *model, params whisper.Params, state *whisper.State) (Context, error) {
 	context := new(context)
 	context.model = model
+	context.state = state
 	context.params = params
 
 	// Return success
 	return context, nil
 }
 
+func (context *context) Close() error {
+	if context.state != nil {
+		context.state.Whisper_free_state()
+	}
+
+	// Release resources
+	context.state = nil
+
+	// Return success
+	return nil
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // PUBLIC METHODS
 
@@ -72,6 +86,9 @@ func (context *context) Language() string {
 }
 
 func (context *context) DetectedLanguage() string {
+	if context.state != nil {
+		return whisper.Whisper_lang_str(context.state.Whisper_full_lang_id_from_state())
+	}
 	return whisper.Whisper_lang_str(context.model.ctx.Whisper_full_lang_id())
 }
 
@@ -200,36 +217,41 @@ func (context *context) Process(
 	if context.model.ctx == nil {
 		return ErrInternalAppError
 	}
+	// NextSegment returns the segments of this call from the first one
+	context.n = 0
+
 	// If the callback is defined then we force on single_segment mode
 	if callNewSegment != nil {
 		context.params.SetSingleSegment(true)
 	}
 
+	newSegment := func(new int) {
+		if callNewSegment != nil {
+			num_segments := context.n_segments()
+			s0 := num_segments - new
+			for i := s0; i < num_segments; i++ {
+				callNewSegment(context.toSegment(i))
+			}
+		}
+	}
+
 	// We don't do parallel processing at the moment
 	processors := 0
-	if processors > 1 {
-		if err := context.model.ctx.Whisper_full_parallel(context.params, data, processors, callEncoderBegin,
-			func(new int) {
-				if callNewSegment != nil {
-					num_segments := context.model.ctx.Whisper_full_n_segments()
-					s0 := num_segments - new
-					for i := s0; i < num_segments; i++ {
-						callNewSegment(toSegment(context.model.ctx, i))
-					}
+	if context.state != nil {
+		if err := context.model.ctx.Whisper_full_with_state(context.state, context.params, data, callEncoderBegin, newSegment,
+			func(progress int) {
+				if callProgress != nil {
+					callProgress(progress)
 				}
 			}); err != nil {
 			return err
 		}
-	} else if err := context.model.ctx.Whisper_full(context.params, data, callEncoderBegin,
-		func(new int) {
-			if callNewSegment != nil {
-				num_segments := context.model.ctx.Whisper_full_n_segments()
-				s0 := num_segments - new
-				for i := s0; i < num_segments; i++ {
-					callNewSegment(toSegment(context.model.ctx, i))
-				}
-			}
-		}, func(progress int) {
+	} else if processors > 1 {
+		if err := context.model.ctx.Whisper_full_parallel(context.params, data, processors, callEncoderBegin, newSegment); err != nil {
+			return err
+		}
+	} else if err := context.model.ctx.Whisper_full(context.params, data, callEncoderBegin, newSegment,
+		func(progress int) {
 			if callProgress != nil {
 				callProgress(progress)
 			}
@@ -246,12 +268,12 @@ func (context *context) NextSegment() (Segment, error) {
 	if context.model.ctx == nil {
 		return Segment{}, ErrInternalAppError
 	}
-	if context.n >= context.model.ctx.Whisper_full_n_segments() {
+	if context.n >= context.n_segments() {
 		return Segment{}, io.EOF
 	}
 
 	// Populate result
-	result := toSegment(context.model.ctx, context.n)
+	result := context.toSegment(context.n)
 
 	// Increment the cursor
 	context.n++
@@ -322,25 +344,61 @@ func (context *context) IsLANG(t Token, lang string) bool {
 ///////////////////////////////////////////////////////////////////////////////
 // PRIVATE METHODS
 
-func toSegment(ctx *whisper.Context, n int) Segment {
+// The results are read from the state of the context, or from the default
+// state of the model
+
+func (context *context) n_segments() int {
+	if context.state != nil {
+		return context.state.Whisper_full_n_segments_from_state()
+	}
+	return context.model.ctx.Whisper_full_n_segments()
+}
+
+func (context *context) toSegment(n int) Segment {
+	ctx, state := context.model.ctx, context.state
+	if state == nil {
+		return Segment{
+			Num:    n,
+			Text:   strings.TrimSpace(ctx.Whisper_full_get_segment_text(n)),
+			Start:  time.Duration(ctx.Whisper_full_get_segment_t0(n)) * time.Millisecond * 10,
+			End:    time.Duration(ctx.Whisper_full_get_segment_t1(n)) * time.Millisecond * 10,
+			Tokens: context.toTokens(n),
+		}
+	}
 	return Segment{
 		Num:    n,
-		Text:   strings.TrimSpace(ctx.Whisper_full_get_segment_text(n)),
-		Start:  time.Duration(ctx.Whisper_full_get_segment_t0(n)) * time.Millisecond * 10,
-		End:    time.Duration(ctx.Whisper_full_get_segment_t1(n)) * time.Millisecond * 10,
-		Tokens: toTokens(ctx, n),
+		Text:   strings.TrimSpace(state.Whisper_full_get_segment_text_from_state(n)),
+		Start:  time.Duration(state.Whisper_full_get_segment_t0_from_state(n)) * time.Millisecond * 10,
+		End:    time.Duration(state.Whisper_full_get_segment_t1_from_state(n)) * time.Millisecond * 10,
+		Tokens: context.toTokens(n),
 	}
 }
 
-func toTokens(ctx *whisper.Context, n int) []Token {
-	result := make([]Token, ctx.Whisper_full_n_tokens(n))
+func (context *context) toTokens(n int) []Token {
+	ctx, state := context.model.ctx, context.state
+	if state == nil {
+		result := make([]Token, ctx.Whisper_full_n_tokens(n))
+		for i := 0; i < len(result); i++ {
+			data := ctx.Whisper_full_get_token_data(n, i)
+
+			result[i] = Token{
+				Id:    int(ctx.Whisper_full_get_token_id(n, i)),
+				Text:  ctx.Whisper_full_get_token_text(n, i),
+				P:     ctx.Whisper_full_get_token_p(n, i),
+				Start: time.Duration(data.T0()) * time.Millisecond * 10,
+				End:   time.Duration(data.T1()) * time.Millisecond * 10,
+			}
+		}
+		return result
+	}
+	result := make([]Token, state.Whisper_full_n_tokens_from_state(n))
 	for i := 0; i < len(result); i++ {
-		data := ctx.Whisper_full_get_token_data(n, i)
+		data := state.Whisper_full_get_token_data_from_state(n, i)
 
 		result[i] = Token{
-			Id:    int(ctx.Whisper_full_get_token_id(n, i)),
-			Text:  ctx.Whisper_full_get_token_text(n, i),
-			P:     ctx.Whisper_full_get_token_p(n, i),
+			Id:    int(state.Whisper_full_get_token_id_from_state(n, i)),
+			Text:  ctx.Whisper_full_get_token_text_from_state(state, n, i),
+			P:     state.Whisper_full_get_token_p_from_state(n, i),
 			Start: time.Duration(data.T0()) * time.Millisecond * 10,
 			End:   time.Duration(data.T1()) * time.Millisecond * 10,
 		}
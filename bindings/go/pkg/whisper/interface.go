@@ -25,9 +25,16 @@ type EncoderBeginCallback func() bool
 type Model interface {
 	io.Closer
 
-	// Return a new speech-to-text context.
+	// Return a new speech-to-text context, which uses the default state of
+	// the model. Only one of these contexts can process audio at a time.
 	NewContext() (Context, error)
 
+	// Return a new speech-to-text context with its own state. The contexts of
+	// a model can then process audio in different goroutines at the same time,
+	// e.g. a pool of goroutines with one context each. Each context is used by
+	// one goroutine at a time and is closed before the model.
+	NewStatefulContext() (Context, error)
+
 	// Return true if the model is multilingual.
 	IsMultilingual() bool
 
@@ -37,6 +44,8 @@ type Model interface {
 
 // Context is the speech recognition context.
 type Context interface {
+	io.Closer // Free the state of a context of NewStatefulContext
+
 	SetLanguage(string) error // Set the language to use for speech recognition, use "auto" for auto detect language.
 	SetTranslate(bool)        // Set translate flag
 	IsMultilingual() bool     // Return true if the model is multilingual.
@@ -63,6 +72,7 @@ type Context interface {
 	// Process mono audio data and return any errors.
 	// If defined, newly generated segments are passed to the
 	// callback function during processing.
+	// The samples are passed to whisper.cpp without a copy.
 	Process([]float32, EncoderBeginCallback, SegmentCallback, ProgressCallback) error
 
 	// After process is called, return segments until the end of the stream
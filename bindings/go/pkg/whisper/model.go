@@ -86,7 +86,30 @@ func (model *model) NewContext() (Context, error) {
 		return nil, ErrInternalAppError
 	}
 
-	// Create new context
+	// Return new context
+	return newContext(model, model.params(), nil)
+}
+
+func (model *model) NewStatefulContext() (Context, error) {
+	if model.ctx == nil {
+		return nil, ErrInternalAppError
+	}
+
+	// The state holds the KV caches and the compute buffers of the context
+	state := model.ctx.Whisper_init_state()
+	if state == nil {
+		return nil, ErrUnableToCreateState
+	}
+
+	// Return new context
+	return newContext(model, model.params(), state)
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// PRIVATE METHODS
+
+// Return the default parameters of a new context
+func (model *model) params() whisper.Params {
 	params := model.ctx.Whisper_full_default_params(whisper.SAMPLING_GREEDY)
 	params.SetTranslate(false)
 	params.SetPrintSpecial(false)
@@ -95,7 +118,5 @@ func (model *model) NewContext() (Context, error) {
 	params.SetPrintTimestamps(false)
 	params.SetThreads(runtime.NumCPU())
 	params.SetNoContext(true)
-
-	// Return new context
-	return newContext(model, params)
+	return params
 }
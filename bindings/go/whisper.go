@@ -2,6 +2,7 @@ package whisper
 
 import (
 	"errors"
+	"sync"
 	"unsafe"
 )
 
@@ -65,6 +66,7 @@ import "C"
 
 type (
 	Context          C.struct_whisper_context
+	State            C.struct_whisper_state
 	Token            C.whisper_token
 	TokenData        C.struct_whisper_token_data
 	SamplingStrategy C.enum_whisper_sampling_strategy
@@ -114,6 +116,22 @@ func (ctx *Context) Whisper_free() {
 	C.whisper_free((*C.struct_whisper_context)(ctx))
 }
 
+// Allocates the memory of a new state for the model of the context: the KV caches
+// and the compute buffers. A context can be used by several goroutines at the same
+// time, each with its own state. Returns nil on failure.
+func (ctx *Context) Whisper_init_state() *State {
+	if state := C.whisper_init_state((*C.struct_whisper_context)(ctx)); state != nil {
+		return (*State)(state)
+	} else {
+		return nil
+	}
+}
+
+// Frees all memory allocated by the state.
+func (state *State) Whisper_free_state() {
+	C.whisper_free_state((*C.struct_whisper_state)(state))
+}
+
 // Convert RAW PCM audio to log mel spectrogram.
 // The resulting spectrogram is stored inside the provided whisper context.
 func (ctx *Context) Whisper_pcm_to_mel(data []float32, threads int) error {
@@ -308,13 +326,9 @@ func (ctx *Context) Whisper_full(
 	newSegmentCallback func(int),
 	progressCallback func(int),
 ) error {
-	registerEncoderBeginCallback(ctx, encoderBeginCallback)
-	registerNewSegmentCallback(ctx, newSegmentCallback)
-	registerProgressCallback(ctx, progressCallback)
-	defer registerEncoderBeginCallback(ctx, nil)
-	defer registerNewSegmentCallback(ctx, nil)
-	defer registerProgressCallback(ctx, nil)
-	if C.whisper_full((*C.struct_whisper_context)(ctx), (C.struct_whisper_full_params)(params), (*C.float)(&samples[0]), C.int(len(samples))) == 0 {
+	registerCallbacks(unsafe.Pointer(ctx), encoderBeginCallback, newSegmentCallback, progressCallback)
+	defer registerCallbacks(unsafe.Pointer(ctx), nil, nil, nil)
+	if C.whisper_full((*C.struct_whisper_context)(ctx), (C.struct_whisper_full_params)(params), samplesPtr(samples), C.int(len(samples))) == 0 {
 		return nil
 	} else {
 		return ErrConversionFailed
@@ -325,12 +339,35 @@ func (ctx *Context) Whisper_full(
 // It seems this approach can offer some speedup in some cases.
 // However, the transcription accuracy can be worse at the beginning and end of each chunk.
 func (ctx *Context) Whisper_full_parallel(params Params, samples []float32, processors int, encoderBeginCallback func() bool, newSegmentCallback func(int)) error {
-	registerEncoderBeginCallback(ctx, encoderBeginCallback)
-	registerNewSegmentCallback(ctx, newSegmentCallback)
-	defer registerEncoderBeginCallback(ctx, nil)
-	defer registerNewSegmentCallback(ctx, nil)
+	registerCallbacks(unsafe.Pointer(ctx), encoderBeginCallback, newSegmentCallback, nil)
+	defer registerCallbacks(unsafe.Pointer(ctx), nil, nil, nil)
+
+	if C.whisper_full_parallel((*C.struct_whisper_context)(ctx), (C.struct_whisper_full_params)(params), samplesPtr(samples), C.int(len(samples)), C.int(processors)) == 0 {
+		return nil
+	} else {
+		return ErrConversionFailed
+	}
+}
 
-	if C.whisper_full_parallel((*C.struct_whisper_context)(ctx), (C.struct_whisper_full_params)(params), (*C.float)(&samples[0]), C.int(len(samples)), C.int(processors)) == 0 {
+// Same as Whisper_full, the results are stored in the state instead of the default
+// state of the context. The callbacks are registered for the state, so goroutines
+// can process audio with the same context and their own states at the same time.
+func (ctx *Context) Whisper_full_with_state(
+	state *State,
+	params Params,
+	samples []float32,
+	encoderBeginCallback func() bool,
+	newSegmentCallback func(int),
+	progressCallback func(int),
+) error {
+	key := unsafe.Pointer(state)
+	registerCallbacks(key, encoderBeginCallback, newSegmentCallback, progressCallback)
+	defer registerCallbacks(key, nil, nil, nil)
+
+	params.new_segment_callback_user_data = key
+	params.encoder_begin_callback_user_data = key
+	params.progress_callback_user_data = key
+	if C.whisper_full_with_state((*C.struct_whisper_context)(ctx), (*C.struct_whisper_state)(state), (C.struct_whisper_full_params)(params), samplesPtr(samples), C.int(len(samples))) == 0 {
 		return nil
 	} else {
 		return ErrConversionFailed
@@ -396,56 +433,115 @@ func (ctx *Context) Whisper_full_get_token_p(segment int, token int) float32 {
 	return float32(C.whisper_full_get_token_p((*C.struct_whisper_context)(ctx), C.int(segment), C.int(token)))
 }
 
+// Return the id of the autodetected language of the state, returns -1 if not found
+func (state *State) Whisper_full_lang_id_from_state() int {
+	return int(C.whisper_full_lang_id_from_state((*C.struct_whisper_state)(state)))
+}
+
+// Number of generated text segments of the state.
+func (state *State) Whisper_full_n_segments_from_state() int {
+	return int(C.whisper_full_n_segments_from_state((*C.struct_whisper_state)(state)))
+}
+
+// Get the start time of the specified segment of the state.
+func (state *State) Whisper_full_get_segment_t0_from_state(segment int) int64 {
+	return int64(C.whisper_full_get_segment_t0_from_state((*C.struct_whisper_state)(state), C.int(segment)))
+}
+
+// Get the end time of the specified segment of the state.
+func (state *State) Whisper_full_get_segment_t1_from_state(segment int) int64 {
+	return int64(C.whisper_full_get_segment_t1_from_state((*C.struct_whisper_state)(state), C.int(segment)))
+}
+
+// Get the text of the specified segment of the state.
+func (state *State) Whisper_full_get_segment_text_from_state(segment int) string {
+	return C.GoString(C.whisper_full_get_segment_text_from_state((*C.struct_whisper_state)(state), C.int(segment)))
+}
+
+// Get number of tokens in the specified segment of the state.
+func (state *State) Whisper_full_n_tokens_from_state(segment int) int {
+	return int(C.whisper_full_n_tokens_from_state((*C.struct_whisper_state)(state), C.int(segment)))
+}
+
+// Get the token text of the specified token index in the specified segment of the state.
+func (ctx *Context) Whisper_full_get_token_text_from_state(state *State, segment int, token int) string {
+	return C.GoString(C.whisper_full_get_token_text_from_state((*C.struct_whisper_context)(ctx), (*C.struct_whisper_state)(state), C.int(segment), C.int(token)))
+}
+
+// Get the token of the specified token index in the specified segment of the state.
+func (state *State) Whisper_full_get_token_id_from_state(segment int, token int) Token {
+	return Token(C.whisper_full_get_token_id_from_state((*C.struct_whisper_state)(state), C.int(segment), C.int(token)))
+}
+
+// Get token data for the specified token in the specified segment of the state.
+func (state *State) Whisper_full_get_token_data_from_state(segment int, token int) TokenData {
+	return TokenData(C.whisper_full_get_token_data_from_state((*C.struct_whisper_state)(state), C.int(segment), C.int(token)))
+}
+
+// Get the probability of the specified token in the specified segment of the state.
+func (state *State) Whisper_full_get_token_p_from_state(segment int, token int) float32 {
+	return float32(C.whisper_full_get_token_p_from_state((*C.struct_whisper_state)(state), C.int(segment), C.int(token)))
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // CALLBACKS
 
+// The callbacks are keyed by the user data passed to whisper.cpp: the context, or
+// the state for Whisper_full_with_state. Several goroutines register theirs at the
+// same time, so the maps are guarded by a mutex.
 var (
+	cbMutex        sync.RWMutex
 	cbNewSegment   = make(map[unsafe.Pointer]func(int))
 	cbProgress     = make(map[unsafe.Pointer]func(int))
 	cbEncoderBegin = make(map[unsafe.Pointer]func() bool)
 )
 
-func registerNewSegmentCallback(ctx *Context, fn func(int)) {
-	if fn == nil {
-		delete(cbNewSegment, unsafe.Pointer(ctx))
+func registerCallbacks(key unsafe.Pointer, encoderBegin func() bool, newSegment func(int), progress func(int)) {
+	cbMutex.Lock()
+	defer cbMutex.Unlock()
+	if encoderBegin == nil {
+		delete(cbEncoderBegin, key)
 	} else {
-		cbNewSegment[unsafe.Pointer(ctx)] = fn
+		cbEncoderBegin[key] = encoderBegin
 	}
-}
-
-func registerProgressCallback(ctx *Context, fn func(int)) {
-	if fn == nil {
-		delete(cbProgress, unsafe.Pointer(ctx))
+	if newSegment == nil {
+		delete(cbNewSegment, key)
 	} else {
-		cbProgress[unsafe.Pointer(ctx)] = fn
+		cbNewSegment[key] = newSegment
 	}
-}
-
-func registerEncoderBeginCallback(ctx *Context, fn func() bool) {
-	if fn == nil {
-		delete(cbEncoderBegin, unsafe.Pointer(ctx))
+	if progress == nil {
+		delete(cbProgress, key)
 	} else {
-		cbEncoderBegin[unsafe.Pointer(ctx)] = fn
+		cbProgress[key] = progress
 	}
 }
 
 //export callNewSegment
 func callNewSegment(user_data unsafe.Pointer, new C.int) {
-	if fn, ok := cbNewSegment[user_data]; ok {
+	cbMutex.RLock()
+	fn, ok := cbNewSegment[user_data]
+	cbMutex.RUnlock()
+	if ok {
 		fn(int(new))
 	}
 }
 
 //export callProgress
 func callProgress(user_data unsafe.Pointer, progress C.int) {
-	if fn, ok := cbProgress[user_data]; ok {
+	cbMutex.RLock()
+	fn, ok := cbProgress[user_data]
+	cbMutex.RUnlock()
+	if ok {
 		fn(int(progress))
 	}
 }
 
 //export callEncoderBegin
 func callEncoderBegin(user_data unsafe.Pointer) C.bool {
-	if fn, ok := cbEncoderBegin[user_data]; ok {
+	cbMutex.RLock()
+	fn, ok := cbEncoderBegin[user_data]
+	cbMutex.RUnlock()
+	if ok {
 		if fn() {
 			return C.bool(true)
 		} else {
@@ -455,6 +551,15 @@ func callEncoderBegin(user_data unsafe.Pointer) C.bool {
 	return true
 }
 
+// Pointer to the first sample: the samples are passed to whisper.cpp without a copy,
+// they must not be modified until the call returns
+func samplesPtr(samples []float32) *C.float {
+	if len(samples) == 0 {
+		return nil
+	}
+	return (*C.float)(unsafe.Pointer(&samples[0]))
+}
+
 func (t TokenData) T0() int64 {
 	return int64(t.t0)
 }
@@ -1,5 +1,6 @@
 package io.github.ggerganov.whispercpp;
 
+import com.sun.jna.Memory;
 import com.sun.jna.Native;
 import com.sun.jna.Pointer;
 import io.github.ggerganov.whispercpp.bean.WhisperSegment;
@@ -10,8 +11,18 @@ import io.github.ggerganov.whispercpp.params.WhisperSamplingStrategy;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
 import java.util.ArrayList;
 import java.util.List;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.CompletableFuture;
+import java.util.concurrent.CompletionException;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+import java.util.concurrent.TimeUnit;
 
 /**
  * Before calling most methods, you must call `initContext(modelPath)` to initialise the `ctx` Pointer.
@@ -23,6 +34,10 @@ public class WhisperCpp implements AutoCloseable {
     private Pointer greedyParamsPointer = null;
     private Pointer beamParamsPointer = null;
 
+    // worker pool for the async API, each worker thread runs with its own whisper_state
+    private ExecutorService workers = null;
+    private BlockingQueue<Pointer> workerStates = null;
+
     public File modelDir() {
         String modelDirPath = System.getenv("XDG_CACHE_HOME");
         if (modelDirPath == null) {
@@ -109,6 +124,7 @@ public class WhisperCpp implements AutoCloseable {
 
     @Override
     public void close() {
+        stopWorkers();
         freeContext();
         freeParams();
         System.out.println("Whisper closed");
@@ -117,7 +133,80 @@ public class WhisperCpp implements AutoCloseable {
     private void freeContext() {
         if (ctx != null) {
             lib.whisper_free(ctx);
+            ctx = null;
+        }
+    }
+
+    /**
+     * Allocate a new whisper_state for the context, which must be freed with `freeState()`.
+     * A state can be used by one thread at a time, so the context can be shared by several threads,
+     * each with its own state.
+     */
+    public Pointer initState() {
+        if (ctx == null) {
+            throw new IllegalStateException("Model not initialised");
+        }
+
+        Pointer state = lib.whisper_init_state(ctx);
+        if (state == null) {
+            throw new IllegalStateException("Failed to allocate the whisper state");
+        }
+
+        return state;
+    }
+
+    public void freeState(Pointer state) {
+        if (state != null) {
+            lib.whisper_free_state(state);
+        }
+    }
+
+    /**
+     * Start the worker pool used by `fullTranscribeAsync()`: `nWorkers` threads, each with its own whisper_state.
+     * With n_threads in the params, the total number of threads is nWorkers * n_threads.
+     */
+    public synchronized void startWorkers(int nWorkers) {
+        if (nWorkers < 1) {
+            throw new IllegalArgumentException("nWorkers must be >= 1");
+        }
+
+        stopWorkers();
+
+        workerStates = new ArrayBlockingQueue<>(nWorkers);
+        for (int i = 0; i < nWorkers; i++) {
+            workerStates.add(initState());
         }
+
+        workers = Executors.newFixedThreadPool(nWorkers, r -> {
+            Thread t = new Thread(r, "whisper-worker");
+            t.setDaemon(true);
+            return t;
+        });
+    }
+
+    /**
+     * Wait for the pending async transcriptions and free the worker states.
+     */
+    public synchronized void stopWorkers() {
+        if (workers == null) {
+            return;
+        }
+
+        workers.shutdown();
+        try {
+            while (!workers.awaitTermination(1, TimeUnit.SECONDS)) {
+                // the native call cannot be interrupted, wait for it to finish before freeing its state
+            }
+        } catch (InterruptedException e) {
+            Thread.currentThread().interrupt();
+        }
+
+        for (Pointer state : workerStates) {
+            freeState(state);
+        }
+
+        workers = null;
+        workerStates = null;
     }
 
     private void freeParams() {
@@ -195,6 +284,130 @@ public class WhisperCpp implements AutoCloseable {
         return segments;
     }
 
+    /**
+     * Same as `fullTranscribe(whisperParams, float[])`, with the samples in a FloatBuffer.
+     * The samples between the position and the limit of the buffer are processed.
+     * A direct buffer is passed to native code without a copy.
+     */
+    public String fullTranscribe(WhisperFullParams.ByValue whisperParams, FloatBuffer audioData) throws IOException {
+        if (ctx == null) {
+            throw new IllegalStateException("Model not initialised");
+        }
+
+        if (lib.whisper_full(ctx, whisperParams, samplesPointer(audioData), audioData.remaining()) != 0) {
+            throw new IOException("Failed to process audio");
+        }
+
+        return segmentsText(null);
+    }
+
+    /**
+     * Same as `fullTranscribe(whisperParams, FloatBuffer)`, with the 32-bit float samples in a ByteBuffer
+     * in the native byte order, e.g. `ByteBuffer.allocateDirect(n * 4).order(ByteOrder.nativeOrder())`.
+     */
+    public String fullTranscribe(WhisperFullParams.ByValue whisperParams, ByteBuffer audioData) throws IOException {
+        return fullTranscribe(whisperParams, asFloatBuffer(audioData));
+    }
+
+    /**
+     * Run the entire model using the given state instead of the default state of the context.
+     * Thread safe as long as each thread uses its own state, see `initState()`.
+     */
+    public String fullTranscribe(Pointer state, WhisperFullParams.ByValue whisperParams, FloatBuffer audioData) throws IOException {
+        if (ctx == null) {
+            throw new IllegalStateException("Model not initialised");
+        }
+
+        if (lib.whisper_full_with_state(ctx, state, whisperParams, samplesPointer(audioData), audioData.remaining()) != 0) {
+            throw new IOException("Failed to process audio");
+        }
+
+        return segmentsText(state);
+    }
+
+    /**
+     * Run the transcription on the worker pool, see `startWorkers()`. A pool of one worker is started if needed.
+     * The buffer must not be modified before the future completes. A direct buffer is not copied.
+     * The params are shared with the native code: use a separate instance for each call if they change.
+     */
+    public CompletableFuture<String> fullTranscribeAsync(WhisperFullParams.ByValue whisperParams, FloatBuffer audioData) {
+        final ExecutorService executor;
+        final BlockingQueue<Pointer> states;
+
+        synchronized (this) {
+            if (workers == null) {
+                startWorkers(1);
+            }
+            executor = workers;
+            states = workerStates;
+        }
+
+        final FloatBuffer samples = audioData.duplicate();
+
+        return CompletableFuture.supplyAsync(() -> {
+            Pointer state = null;
+            try {
+                state = states.take();
+                return fullTranscribe(state, whisperParams, samples);
+            } catch (IOException e) {
+                throw new CompletionException(e);
+            } catch (InterruptedException e) {
+                Thread.currentThread().interrupt();
+                throw new CompletionException(e);
+            } finally {
+                if (state != null) {
+                    states.add(state);
+                }
+            }
+        }, executor);
+    }
+
+    public CompletableFuture<String> fullTranscribeAsync(WhisperFullParams.ByValue whisperParams, ByteBuffer audioData) {
+        return fullTranscribeAsync(whisperParams, asFloatBuffer(audioData));
+    }
+
+    public CompletableFuture<String> fullTranscribeAsync(WhisperFullParams.ByValue whisperParams, float[] audioData) {
+        return fullTranscribeAsync(whisperParams, FloatBuffer.wrap(audioData));
+    }
+
+    private static FloatBuffer asFloatBuffer(ByteBuffer audioData) {
+        if (audioData.order() != ByteOrder.nativeOrder()) {
+            throw new IllegalArgumentException("The audio ByteBuffer must be in the native byte order");
+        }
+
+        return audioData.asFloatBuffer();
+    }
+
+    /**
+     * Pointer to the remaining samples of the buffer: the native memory of a direct buffer,
+     * or a native copy of a heap buffer.
+     */
+    private static Pointer samplesPointer(FloatBuffer audioData) {
+        if (audioData.isDirect()) {
+            return Native.getDirectBufferPointer(audioData).share((long) audioData.position() * Float.BYTES);
+        }
+
+        float[] samples = new float[audioData.remaining()];
+        audioData.duplicate().get(samples);
+
+        Memory memory = new Memory(Math.max(1, (long) samples.length * Float.BYTES));
+        memory.write(0, samples, 0, samples.length);
+        return memory;
+    }
+
+    /** Concatenated text of the segments of the state, or of the default state when null. */
+    private String segmentsText(Pointer state) {
+        int nSegments = state == null ? lib.whisper_full_n_segments(ctx) : lib.whisper_full_n_segments_from_state(state);
+
+        StringBuilder str = new StringBuilder();
+
+        for (int i = 0; i < nSegments; i++) {
+            str.append(state == null ? lib.whisper_full_get_segment_text(ctx, i) : lib.whisper_full_get_segment_text_from_state(state, i));
+        }
+
+        return str.toString().trim();
+    }
+
 //    public int getTextSegmentCount(Pointer ctx) {
 //        return lib.whisper_full_n_segments(ctx);
 //    }
@@ -278,6 +278,15 @@ public interface WhisperCppJnaLibrary extends Library {
     public int whisper_full_with_state(Pointer ctx, Pointer state, WhisperFullParams.ByValue params, float[] samples, int n_samples);
     //int whisper_full_with_state(Pointer ctx, Pointer state, WhisperFullParams params, final float[] samples, int n_samples);
 
+    /**
+     * Same as whisper_full() and whisper_full_with_state(), with the samples in native memory, which is passed
+     * without a copy, e.g. `Native.getDirectBufferPointer()` of a direct buffer.
+     * A float[] is copied by JNA for each call.
+     */
+    int whisper_full(Pointer ctx, WhisperFullParams.ByValue params, Pointer samples, int n_samples);
+
+    int whisper_full_with_state(Pointer ctx, Pointer state, WhisperFullParams.ByValue params, Pointer samples, int n_samples);
+
     // Split the input audio in chunks and process each chunk separately using whisper_full_with_state()
     // Result is stored in the default state of the context
     // Not thread safe if executed in parallel on the same context.
@@ -285,6 +294,8 @@ public interface WhisperCppJnaLibrary extends Library {
     // However, the transcription accuracy can be worse at the beginning and end of each chunk.
     int whisper_full_parallel(Pointer ctx, WhisperFullParams.ByValue params, final float[] samples, int n_samples, int n_processors);
 
+    int whisper_full_parallel(Pointer ctx, WhisperFullParams.ByValue params, Pointer samples, int n_samples, int n_processors);
+
     /**
      * Number of generated text segments.
      * A segment can be a few words, a sentence, or even a paragraph.
@@ -40,6 +40,78 @@ public class WhisperContextParams extends Structure {
     /** DTW memory size (internal use) */
     public NativeLong dtw_mem_size;
 
+    /** [EXPERIMENTAL] Type of the KV caches, quantized types require flash attention (default = GGML_TYPE_F16) */
+    public int type_kv;
+
+    /** [EXPERIMENTAL] Memory-map the model file (default = false) */
+    public CBool use_mmap;
+
+    /** [EXPERIMENTAL] Do not load the encoder weights, an external encoder is required (default = false) */
+    public CBool skip_encoder;
+
+    /** [EXPERIMENTAL] Do not load the decoder weights, only the encoder can be run (default = false) */
+    public CBool skip_decoder;
+
+    /** [EXPERIMENTAL] Share the compute buffers between the states, the computations are serialized (default = false) */
+    public CBool shared_compute;
+
+    /** [EXPERIMENTAL] NUMA strategy, see ggml_numa_strategy (default = 0, disabled) */
+    public int numa;
+
+    /** [EXPERIMENTAL] Record the time and the bytes of each node of the graphs (default = false) */
+    public CBool profile;
+
+    /** [EXPERIMENTAL] Replicate the weights on this number of GPU devices from gpu_device (default = 1) */
+    public int n_gpu_devices;
+
+    /** [EXPERIMENTAL] Name of the device of the encoder, e.g. "CUDA0" (default = null, gpu_device) */
+    public String encoder_device;
+
+    /** [EXPERIMENTAL] Name of the device of the decoder, e.g. "CPU" (default = null, gpu_device) */
+    public String decoder_device;
+
+    /** [EXPERIMENTAL] Split the layers of the encoder over this number of GPU devices from gpu_device (default = 1) */
+    public int encoder_split;
+
+    /** [EXPERIMENTAL] Comma-separated host:port of ggml RPC servers, the encoder runs on the first (default = null) */
+    public String rpc_servers;
+
+    /** [EXPERIMENTAL] Collect the importance matrix of the weights for the quantization (default = false) */
+    public CBool imatrix;
+
+    /** [EXPERIMENTAL] Predict the next window with the Core ML encoder while the current one is decoded (default = false) */
+    public CBool coreml_prefetch;
+
+    /** [EXPERIMENTAL] Decode with the stateful Core ML decoder, macOS 15 / iOS 18 (default = false) */
+    public CBool coreml_decoder;
+
+    /** [EXPERIMENTAL] External ggml GPU backend, not owned (default = null) */
+    public Pointer backend;
+
+    /** [EXPERIMENTAL] Compute the log mel spectrogram on the GPU of the encoder (default = false) */
+    public CBool mel_gpu;
+
+    /** [EXPERIMENTAL] Block-causal encoder self-attention in blocks of this many frames, for streaming models (default = 0) */
+    public int encoder_block;
+
+    /** [EXPERIMENTAL] Tune the number of threads of the decoder graphs of each state (default = false) */
+    public CBool tune_threads;
+
+    /** [EXPERIMENTAL] Read the weights in a background thread, the encoder is usable before the decoder (default = false) */
+    public CBool load_async;
+
+    /** [EXPERIMENTAL] Comma-separated audio_ctx sizes for which the states reserve compute buffers (default = null) */
+    public String audio_ctx_buckets;
+
+    /** [EXPERIMENTAL] Compute the conv, encoder and cross-attention keys and values as a single graph (default = false) */
+    public CBool fused_encode;
+
+    /** [EXPERIMENTAL] Size in MB of the huge pages of the CPU buffers: 0 (off), 2 or 1024 (default = 0) */
+    public int cpu_hugepages;
+
+    /** [EXPERIMENTAL] whisper_full_parallel() pins each processor to a disjoint part of the CPUs (default = false) */
+    public CBool cpu_partition;
+
     /** Use GPU for inference */
     public void useGpu(boolean enable) {
         use_gpu = enable ? CBool.TRUE : CBool.FALSE;
@@ -70,7 +142,31 @@ public class WhisperContextParams extends Structure {
             "dtw_aheads_preset",
             "dtw_n_top",
             "dtw_aheads",
-            "dtw_mem_size"
+            "dtw_mem_size",
+            "type_kv",
+            "use_mmap",
+            "skip_encoder",
+            "skip_decoder",
+            "shared_compute",
+            "numa",
+            "profile",
+            "n_gpu_devices",
+            "encoder_device",
+            "decoder_device",
+            "encoder_split",
+            "rpc_servers",
+            "imatrix",
+            "coreml_prefetch",
+            "coreml_decoder",
+            "backend",
+            "mel_gpu",
+            "encoder_block",
+            "tune_threads",
+            "load_async",
+            "audio_ctx_buckets",
+            "fused_encode",
+            "cpu_hugepages",
+            "cpu_partition"
         );
     }
 
@@ -12,7 +12,11 @@ import javax.sound.sampled.AudioInputStream;
 import javax.sound.sampled.AudioSystem;
 import java.io.File;
 import java.io.FileNotFoundException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.FloatBuffer;
 import java.util.List;
+import java.util.concurrent.CompletableFuture;
 
 class WhisperCppTest {
     private static WhisperCpp whisper = new WhisperCpp();
@@ -141,4 +145,44 @@ class WhisperCppTest {
         }
     }
 
+    @Test
+    void testFullTranscribeAsyncDirectBuffer() throws Exception {
+        if (!modelInitialised) {
+            System.out.println("Model not initialised, skipping test");
+            return;
+        }
+
+        // Given
+        File file = new File(System.getProperty("user.dir"), "../../samples/jfk.wav");
+        AudioInputStream audioInputStream = AudioSystem.getAudioInputStream(file);
+
+        byte[] b = new byte[audioInputStream.available()];
+        FloatBuffer floats = ByteBuffer.allocateDirect(b.length / 2 * Float.BYTES)
+                .order(ByteOrder.nativeOrder()).asFloatBuffer();
+
+        WhisperFullParams.ByValue params = whisper.getFullDefaultParams(WhisperSamplingStrategy.WHISPER_SAMPLING_GREEDY);
+        params.print_progress = CBool.FALSE;
+
+        try {
+            audioInputStream.read(b);
+
+            for (int i = 0; i < b.length; i += 2) {
+                int intSample = (int) (b[i + 1]) << 8 | (int) (b[i]) & 0xFF;
+                floats.put(intSample / 32767.0f);
+            }
+            floats.flip();
+
+            // When
+            whisper.startWorkers(2);
+            CompletableFuture<String> first = whisper.fullTranscribeAsync(params, floats);
+            CompletableFuture<String> second = whisper.fullTranscribeAsync(params, floats);
+
+            // Then
+            assertEquals(first.get(), second.get());
+            assertEquals(first.get(), whisper.fullTranscribe(params, floats));
+        } finally {
+            whisper.stopWorkers();
+            audioInputStream.close();
+        }
+    }
 }
@@ -9,6 +9,7 @@ VALUE eError;
 
 VALUE cSegment;
 VALUE cModel;
+VALUE cState;
 
 ID id_to_s;
 ID id_call;
@@ -31,7 +32,8 @@ extern void init_ruby_whisper_params(VALUE *mWhisper);
 extern void init_ruby_whisper_error(VALUE *mWhisper);
 extern void init_ruby_whisper_segment(VALUE *mWhisper, VALUE *cSegment);
 extern void init_ruby_whisper_model(VALUE *mWhisper);
-extern void register_callbacks(ruby_whisper_params *rwp, VALUE *context);
+extern void init_ruby_whisper_state(VALUE *mWhisper);
+extern VALUE ruby_whisper_call_with_gvl(VALUE (*func)(VALUE), VALUE arg);
 
 /*
  * call-seq:
@@ -85,14 +87,27 @@ static VALUE ruby_whisper_s_finalize_log_callback(VALUE self, VALUE id) {
   return Qnil;
 }
 
+typedef struct {
+  enum ggml_log_level level;
+  const char * buffer;
+} ruby_whisper_log_args;
+
+static VALUE
+call_log_callback(VALUE arg) {
+  const ruby_whisper_log_args *args = (ruby_whisper_log_args *)arg;
+  VALUE log_callback = rb_iv_get(mWhisper, "log_callback");
+  VALUE udata = rb_iv_get(mWhisper, "user_data");
+  return rb_funcall(log_callback, id_call, 3, INT2NUM(args->level), rb_str_new2(args->buffer), udata);
+}
+
+// whisper.cpp logs during the transcriptions, which run without the GVL
 static void
 ruby_whisper_log_callback(enum ggml_log_level level, const char * buffer, void * user_data) {
   if (is_log_callback_finalized) {
     return;
   }
-  VALUE log_callback = rb_iv_get(mWhisper, "log_callback");
-  VALUE udata = rb_iv_get(mWhisper, "user_data");
-  rb_funcall(log_callback, id_call, 3, INT2NUM(level), rb_str_new2(buffer), udata);
+  ruby_whisper_log_args args = { level, buffer };
+  ruby_whisper_call_with_gvl(call_log_callback, (VALUE)&args);
 }
 
 /*
@@ -159,6 +174,7 @@ void Init_whisper() {
   init_ruby_whisper_error(&mWhisper);
   init_ruby_whisper_segment(&mWhisper, &cContext);
   init_ruby_whisper_model(&mWhisper);
+  init_ruby_whisper_state(&mWhisper);
 
   rb_require("whisper/model/uri");
 }
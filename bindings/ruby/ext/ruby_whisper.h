@@ -4,7 +4,6 @@
 #include "whisper.h"
 
 typedef struct {
-  VALUE *context;
   VALUE user_data;
   VALUE callback;
   VALUE callbacks;
@@ -25,6 +24,12 @@ typedef struct {
 
 typedef struct {
   VALUE context;
+  struct whisper_state *state;
+} ruby_whisper_state;
+
+typedef struct {
+  VALUE context;
+  VALUE state; // Qnil for the default state of the context
   int index;
 } ruby_whisper_segment;
 
@@ -18,8 +18,8 @@ extern VALUE cModel;
 
 extern VALUE ruby_whisper_transcribe(int argc, VALUE *argv, VALUE self);
 extern VALUE rb_whisper_model_initialize(VALUE context);
-extern VALUE rb_whisper_segment_initialize(VALUE context, int index);
-extern void register_callbacks(ruby_whisper_params *rwp, VALUE *context);
+extern VALUE rb_whisper_segment_initialize(VALUE context, VALUE state, int index);
+extern int ruby_whisper_full_without_gvl(VALUE context, VALUE state, VALUE params, const float *samples, int n_samples, int n_processors, int *exception);
 
 static void
 ruby_whisper_free(ruby_whisper *rw)
@@ -230,79 +230,112 @@ VALUE ruby_whisper_model_type(VALUE self)
 }
 
 /*
- * Run the entire model: PCM -> log mel spectrogram -> encoder -> decoder -> text
- * Not thread safe for same context
- * Uses the specified decoding strategy to obtain the text.
- *
- * call-seq:
- *   full(params, samples, n_samples) -> nil
- *   full(params, samples) -> nil
- *
- * The second argument +samples+ must be an array of samples, respond to :length, or be a MemoryView of an array of float. It must be 32 bit float PCM audio data.
+ * Converts the samples argument of full and full_parallel to floats.
+ * n_samples can be nil. The returned samples are either the memory view, which is
+ * released by ruby_whisper_release_samples, or a copy in *buffer.
  */
-VALUE ruby_whisper_full(int argc, VALUE *argv, VALUE self)
+static const float *
+ruby_whisper_get_samples(VALUE samples, VALUE n_samples_value, int *n_samples, rb_memory_view_t *view, float **buffer)
 {
-  if (argc < 2 || argc > 3) {
-    rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 2..3)", argc);
-  }
-
-  ruby_whisper *rw;
-  ruby_whisper_params *rwp;
-  Data_Get_Struct(self, ruby_whisper, rw);
-  VALUE params = argv[0];
-  Data_Get_Struct(params, ruby_whisper_params, rwp);
-  VALUE samples = argv[1];
-  int n_samples;
-  rb_memory_view_t view;
+  view->obj = Qnil;
+  *buffer = NULL;
   const bool memory_view_available_p = rb_memory_view_available_p(samples);
-  if (argc == 3) {
-    n_samples = NUM2INT(argv[2]);
+  if (!NIL_P(n_samples_value)) {
+    *n_samples = NUM2INT(n_samples_value);
     if (TYPE(samples) == T_ARRAY) {
-      if (RARRAY_LEN(samples) < n_samples) {
-        rb_raise(rb_eArgError, "samples length %ld is less than n_samples %d", RARRAY_LEN(samples), n_samples);
+      if (RARRAY_LEN(samples) < *n_samples) {
+        rb_raise(rb_eArgError, "samples length %ld is less than n_samples %d", RARRAY_LEN(samples), *n_samples);
       }
     }
     // Should check when samples.respond_to?(:length)?
-  } else {
-    if (TYPE(samples) == T_ARRAY) {
-      n_samples = RARRAY_LEN(samples);
-    } else if (memory_view_available_p) {
-      if (!rb_memory_view_get(samples, &view, RUBY_MEMORY_VIEW_SIMPLE)) {
-        view.obj = Qnil;
-        rb_raise(rb_eArgError, "unable to get a memory view");
-      }
-      n_samples = view.byte_size / view.item_size;
-    } else if (rb_respond_to(samples, id_length)) {
-      n_samples = NUM2INT(rb_funcall(samples, id_length, 0));
+  } else if (TYPE(samples) == T_ARRAY) {
+    *n_samples = RARRAY_LEN(samples);
+  } else if (!memory_view_available_p) {
+    if (rb_respond_to(samples, id_length)) {
+      *n_samples = NUM2INT(rb_funcall(samples, id_length, 0));
     } else {
       rb_raise(rb_eArgError, "samples must respond to :length or be a MemoryView of an array of flaot when n_samples is not given");
     }
   }
-  float * c_samples = (float *)malloc(n_samples * sizeof(float));
-  if (memory_view_available_p)  {
-    c_samples = (float *)view.data;
-  } else {
-    if (TYPE(samples) == T_ARRAY) {
-      for (int i = 0; i < n_samples; i++) {
-        c_samples[i] = RFLOAT_VALUE(rb_ary_entry(samples, i));
-      }
-    } else {
-      // TODO: use rb_block_call
-      VALUE iter = rb_funcall(samples, id_to_enum, 1, rb_str_new2("each"));
-      for (int i = 0; i < n_samples; i++) {
-        // TODO: check if iter is exhausted and raise ArgumentError appropriately
-        VALUE sample = rb_funcall(iter, id_next, 0);
-        c_samples[i] = RFLOAT_VALUE(sample);
-      }
+  if (memory_view_available_p) {
+    if (!rb_memory_view_get(samples, view, RUBY_MEMORY_VIEW_SIMPLE)) {
+      view->obj = Qnil;
+      rb_raise(rb_eArgError, "unable to get a memory view");
+    }
+    if (NIL_P(n_samples_value)) {
+      *n_samples = view->byte_size / view->item_size;
     }
+    return (const float *)view->data;
   }
-  register_callbacks(rwp, &self);
-  const int result = whisper_full(rw->context, rwp->params, c_samples, n_samples);
-  if (0 == result) {
-    return self;
+  float *c_samples = ALLOC_N(float, *n_samples);
+  *buffer = c_samples;
+  if (TYPE(samples) == T_ARRAY) {
+    for (int i = 0; i < *n_samples; i++) {
+      c_samples[i] = RFLOAT_VALUE(rb_ary_entry(samples, i));
+    }
   } else {
-    rb_exc_raise(rb_funcall(eError, id_new, 1, result));
+    // TODO: use rb_block_call
+    VALUE iter = rb_funcall(samples, id_to_enum, 1, rb_str_new2("each"));
+    for (int i = 0; i < *n_samples; i++) {
+      // TODO: check if iter is exhausted and raise ArgumentError appropriately
+      VALUE sample = rb_funcall(iter, id_next, 0);
+      c_samples[i] = RFLOAT_VALUE(sample);
+    }
+  }
+  return c_samples;
+}
+
+static void
+ruby_whisper_release_samples(rb_memory_view_t *view, float *buffer)
+{
+  if (!NIL_P(view->obj)) {
+    rb_memory_view_release(view);
+  }
+  xfree(buffer);
+}
+
+/*
+ * Runs the transcription of full and full_parallel, and of Whisper::State#full when state is not nil.
+ * The GVL is released while whisper.cpp runs.
+ */
+VALUE
+ruby_whisper_full_samples(VALUE context, VALUE state, VALUE params, VALUE samples, VALUE n_samples_value, int n_processors)
+{
+  int n_samples;
+  rb_memory_view_t view;
+  float *buffer;
+  const float *c_samples = ruby_whisper_get_samples(samples, n_samples_value, &n_samples, &view, &buffer);
+  int exception;
+  const int result = ruby_whisper_full_without_gvl(context, state, params, c_samples, n_samples, n_processors, &exception);
+  ruby_whisper_release_samples(&view, buffer);
+  if (exception) {
+    rb_jump_tag(exception);
+  }
+  if (0 != result) {
+    rb_exc_raise(rb_funcall(eError, id_new, 1, INT2NUM(result)));
+  }
+  return NIL_P(state) ? context : state;
+}
+
+/*
+ * Run the entire model: PCM -> log mel spectrogram -> encoder -> decoder -> text
+ * Not thread safe for same context, use a Whisper::State per thread instead
+ * Uses the specified decoding strategy to obtain the text.
+ * The GVL is released during the transcription, the callbacks of params are called with the GVL.
+ *
+ * call-seq:
+ *   full(params, samples, n_samples) -> nil
+ *   full(params, samples) -> nil
+ *
+ * The second argument +samples+ must be an array of samples, respond to :length, or be a MemoryView of an array of float. It must be 32 bit float PCM audio data.
+ */
+VALUE ruby_whisper_full(int argc, VALUE *argv, VALUE self)
+{
+  if (argc < 2 || argc > 3) {
+    rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 2..3)", argc);
   }
+
+  return ruby_whisper_full_samples(self, Qnil, argv[0], argv[1], argc == 3 ? argv[2] : Qnil, 1);
 }
 
 /*
@@ -311,6 +344,7 @@ VALUE ruby_whisper_full(int argc, VALUE *argv, VALUE self)
  * Not thread safe if executed in parallel on the same context.
  * It seems this approach can offer some speedup in some cases.
  * However, the transcription accuracy can be worse at the beginning and end of each chunk.
+ * With several processors, the new segment callbacks are called once the transcription is done.
  *
  * call-seq:
  *   full_parallel(params, samples) -> nil
@@ -325,75 +359,8 @@ ruby_whisper_full_parallel(int argc, VALUE *argv,VALUE self)
     rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 2..3)", argc);
   }
 
-  ruby_whisper *rw;
-  ruby_whisper_params *rwp;
-  Data_Get_Struct(self, ruby_whisper, rw);
-  VALUE params = argv[0];
-  Data_Get_Struct(params, ruby_whisper_params, rwp);
-  VALUE samples = argv[1];
-  int n_samples;
-  int n_processors;
-  rb_memory_view_t view;
-  const bool memory_view_available_p = rb_memory_view_available_p(samples);
-  switch (argc) {
-  case 2:
-    n_processors = 1;
-    break;
-  case 3:
-    n_processors = 1;
-    break;
-  case 4:
-    n_processors = NUM2INT(argv[3]);
-    break;
-  }
-  if (argc >= 3 && !NIL_P(argv[2])) {
-    n_samples = NUM2INT(argv[2]);
-    if (TYPE(samples) == T_ARRAY) {
-      if (RARRAY_LEN(samples) < n_samples) {
-        rb_raise(rb_eArgError, "samples length %ld is less than n_samples %d", RARRAY_LEN(samples), n_samples);
-      }
-    }
-    // Should check when samples.respond_to?(:length)?
-  } else if (memory_view_available_p) {
-    if (!rb_memory_view_get(samples, &view, RUBY_MEMORY_VIEW_SIMPLE)) {
-      view.obj = Qnil;
-      rb_raise(rb_eArgError, "unable to get a memory view");
-    }
-    n_samples = view.byte_size / view.item_size;
-  } else {
-    if (TYPE(samples) == T_ARRAY) {
-      n_samples = RARRAY_LEN(samples);
-    } else if (rb_respond_to(samples, id_length)) {
-      n_samples = NUM2INT(rb_funcall(samples, id_length, 0));
-    } else {
-      rb_raise(rb_eArgError, "samples must respond to :length or be a MemoryView of an array of flaot when n_samples is not given");
-    }
-  }
-  float * c_samples = (float *)malloc(n_samples * sizeof(float));
-  if (memory_view_available_p) {
-    c_samples = (float *)view.data;
-  } else {
-    if (TYPE(samples) == T_ARRAY) {
-      for (int i = 0; i < n_samples; i++) {
-        c_samples[i] = RFLOAT_VALUE(rb_ary_entry(samples, i));
-      }
-    } else {
-      // FIXME: use rb_block_call
-      VALUE iter = rb_funcall(samples, id_to_enum, 1, rb_str_new2("each"));
-      for (int i = 0; i < n_samples; i++) {
-        // TODO: check if iter is exhausted and raise ArgumentError
-        VALUE sample = rb_funcall(iter, id_next, 0);
-        c_samples[i] = RFLOAT_VALUE(sample);
-      }
-    }
-  }
-  register_callbacks(rwp, &self);
-  const int result = whisper_full_parallel(rw->context, rwp->params, c_samples, n_samples, n_processors);
-  if (0 == result) {
-    return self;
-  } else {
-    rb_exc_raise(rb_funcall(eError, id_new, 1, result));
-  }
+  const int n_processors = argc == 4 ? NUM2INT(argv[3]) : 1;
+  return ruby_whisper_full_samples(self, Qnil, argv[0], argv[1], argc >= 3 ? argv[2] : Qnil, n_processors);
 }
 
 /*
@@ -524,7 +491,7 @@ ruby_whisper_full_get_segment_no_speech_prob(VALUE self, VALUE i_segment)
 static VALUE
 ruby_whisper_full_get_segment(VALUE self, VALUE i_segment)
 {
-  return rb_whisper_segment_initialize(self, NUM2INT(i_segment));
+  return rb_whisper_segment_initialize(self, Qnil, NUM2INT(i_segment));
 }
 
 /*
@@ -558,7 +525,7 @@ ruby_whisper_each_segment(VALUE self)
 
   const int n_segments = whisper_full_n_segments(rw->context);
   for (int i = 0; i < n_segments; ++i) {
-    rb_yield(rb_whisper_segment_initialize(self, i));
+    rb_yield(rb_whisper_segment_initialize(self, Qnil, i));
   }
 
   return self;
@@ -1,4 +1,5 @@
 #include <ruby.h>
+#include <ruby/thread.h>
 #include "ruby_whisper.h"
 
 #define BOOL_PARAMS_SETTER(self, prop, value) \
@@ -32,7 +33,7 @@ extern VALUE cParams;
 
 extern ID id_call;
 
-extern VALUE rb_whisper_segment_initialize(VALUE context, int index);
+extern VALUE rb_whisper_segment_initialize(VALUE context, VALUE state, int index);
 
 static ID param_names[RUBY_WHISPER_PARAMS_PARAM_NAMES_COUNT];
 static ID id_language;
@@ -80,71 +81,158 @@ static ruby_whisper_callback_container*
 rb_whisper_callback_container_allocate() {
   ruby_whisper_callback_container *container;
   container = ALLOC(ruby_whisper_callback_container);
-  container->context = NULL;
   container->user_data = Qnil;
   container->callback = Qnil;
   container->callbacks = rb_ary_new();
   return container;
 }
 
-static void new_segment_callback(struct whisper_context *ctx, struct whisper_state *state, int n_new, void *user_data) {
-  const ruby_whisper_callback_container *container = (ruby_whisper_callback_container *)user_data;
+static bool
+has_callbacks(const ruby_whisper_callback_container *container)
+{
+  return !NIL_P(container->callback) || 0 != RARRAY_LEN(container->callbacks);
+}
+
+// A call of whisper_full() that runs without the GVL.
+// whisper.cpp passes it as the user data of the callbacks.
+typedef struct {
+  VALUE context;
+  VALUE state; // Qnil for the default state of the context
+  ruby_whisper_params *rwp;
+  struct whisper_context *ctx;
+  struct whisper_state *wstate;
+  struct whisper_full_params params;
+  const float *samples;
+  int n_samples;
+  int n_processors;
+  int result;
+  // tag of the exception raised by a Ruby callback, the transcription is aborted
+  int exception;
+  // set when the Ruby thread is interrupted (Thread#raise, Thread#kill, signals), the transcription is aborted
+  volatile bool interrupted;
+} ruby_whisper_full_call;
+
+// the call that released the GVL on this thread, NULL while the thread holds the GVL
+static RB_THREAD_LOCAL_SPECIFIER ruby_whisper_full_call *current_call = NULL;
+
+typedef struct {
+  ruby_whisper_full_call *call;
+  VALUE (*func)(VALUE);
+  VALUE arg;
+  VALUE result;
+} ruby_whisper_with_gvl_args;
+
+static void *
+ruby_whisper_protect_with_gvl(void *data)
+{
+  ruby_whisper_with_gvl_args *args = (ruby_whisper_with_gvl_args *)data;
+  current_call = NULL;
+  args->result = rb_protect(args->func, args->arg, &args->call->exception);
+  current_call = args->call;
+  return NULL;
+}
+
+/*
+ * Calls func(arg) from a callback of whisper.cpp, re-acquiring the GVL if the thread released it.
+ * Returns Qnil without calling func on the threads of whisper.cpp, which are not Ruby threads,
+ * and after a previous callback of the same call raised an exception.
+ */
+VALUE
+ruby_whisper_call_with_gvl(VALUE (*func)(VALUE), VALUE arg)
+{
+  if (!ruby_native_thread_p()) {
+    return Qnil;
+  }
+  ruby_whisper_full_call *call = current_call;
+  if (call == NULL) {
+    return func(arg);
+  }
+  if (call->exception) {
+    return Qnil;
+  }
+  ruby_whisper_with_gvl_args args = { call, func, arg, Qnil };
+  rb_thread_call_with_gvl(ruby_whisper_protect_with_gvl, &args);
+  return args.result;
+}
+
+typedef struct {
+  const ruby_whisper_full_call *call;
+  int i_segment;
+  int n_new;
+} ruby_whisper_new_segment_args;
+
+static VALUE
+call_new_segment_callbacks(VALUE arg) {
+  const ruby_whisper_new_segment_args *args = (ruby_whisper_new_segment_args *)arg;
+  const ruby_whisper_full_call *call = args->call;
+  const ruby_whisper_callback_container *container = call->rwp->new_segment_callback_container;
 
-  // Currently, doesn't support state because
-  // those require to resolve GC-related problems.
   if (!NIL_P(container->callback)) {
-    rb_funcall(container->callback, id_call, 4, *container->context, Qnil, INT2NUM(n_new), container->user_data);
+    rb_funcall(container->callback, id_call, 4, call->context, call->state, INT2NUM(args->n_new), container->user_data);
   }
   const long callbacks_len = RARRAY_LEN(container->callbacks);
   if (0 == callbacks_len) {
-    return;
+    return Qnil;
   }
-  const int n_segments = whisper_full_n_segments_from_state(state);
-  for (int i = n_new; i > 0; i--) {
-    int i_segment = n_segments - i;
-    VALUE segment = rb_whisper_segment_initialize(*container->context, i_segment);
+  for (int i = 0; i < args->n_new; i++) {
+    VALUE segment = rb_whisper_segment_initialize(call->context, call->state, args->i_segment + i);
     for (int j = 0; j < callbacks_len; j++) {
       VALUE cb = rb_ary_entry(container->callbacks, j);
       rb_funcall(cb, id_call, 1, segment);
     }
   }
+  return Qnil;
 }
 
-static void progress_callback(struct whisper_context *ctx, struct whisper_state *state, int progress_cur, void *user_data) {
-  const ruby_whisper_callback_container *container = (ruby_whisper_callback_container *)user_data;
-  const VALUE progress = INT2NUM(progress_cur);
-  // Currently, doesn't support state because
-  // those require to resolve GC-related problems.
+static void new_segment_callback(struct whisper_context *ctx, struct whisper_state *state, int n_new, void *user_data) {
+  const ruby_whisper_full_call *call = (ruby_whisper_full_call *)user_data;
+  ruby_whisper_new_segment_args args = { call, whisper_full_n_segments_from_state(state) - n_new, n_new };
+  ruby_whisper_call_with_gvl(call_new_segment_callbacks, (VALUE)&args);
+}
+
+typedef struct {
+  const ruby_whisper_full_call *call;
+  int progress;
+} ruby_whisper_progress_args;
+
+static VALUE
+call_progress_callbacks(VALUE arg) {
+  const ruby_whisper_progress_args *args = (ruby_whisper_progress_args *)arg;
+  const ruby_whisper_full_call *call = args->call;
+  const ruby_whisper_callback_container *container = call->rwp->progress_callback_container;
+  const VALUE progress = INT2NUM(args->progress);
+
   if (!NIL_P(container->callback)) {
-    rb_funcall(container->callback, id_call, 4, *container->context, Qnil, progress, container->user_data);
+    rb_funcall(container->callback, id_call, 4, call->context, call->state, progress, container->user_data);
   }
   const long callbacks_len = RARRAY_LEN(container->callbacks);
-  if (0 == callbacks_len) {
-    return;
-  }
   for (int j = 0; j < callbacks_len; j++) {
     VALUE cb = rb_ary_entry(container->callbacks, j);
     rb_funcall(cb, id_call, 1, progress);
   }
+  return Qnil;
 }
 
-static bool encoder_begin_callback(struct whisper_context *ctx, struct whisper_state *state, void *user_data) {
-  const ruby_whisper_callback_container *container = (ruby_whisper_callback_container *)user_data;
+static void progress_callback(struct whisper_context *ctx, struct whisper_state *state, int progress_cur, void *user_data) {
+  const ruby_whisper_full_call *call = (ruby_whisper_full_call *)user_data;
+  ruby_whisper_progress_args args = { call, progress_cur };
+  ruby_whisper_call_with_gvl(call_progress_callbacks, (VALUE)&args);
+}
+
+static VALUE
+call_encoder_begin_callbacks(VALUE arg) {
+  const ruby_whisper_full_call *call = (ruby_whisper_full_call *)arg;
+  const ruby_whisper_callback_container *container = call->rwp->encoder_begin_callback_container;
   bool is_aborted = false;
   VALUE result;
 
-  // Currently, doesn't support state because
-  // those require to resolve GC-related problems.
   if (!NIL_P(container->callback)) {
-    result = rb_funcall(container->callback, id_call, 3, *container->context, Qnil, container->user_data);
+    result = rb_funcall(container->callback, id_call, 3, call->context, call->state, container->user_data);
     if (result == Qfalse) {
       is_aborted = true;
     }
   }
   const long callbacks_len = RARRAY_LEN(container->callbacks);
-  if (0 == callbacks_len) {
-    return !is_aborted;
-  }
   for (int j = 0; j < callbacks_len; j++) {
     VALUE cb = rb_ary_entry(container->callbacks, j);
     result = rb_funcall(cb, id_call, 0);
@@ -152,55 +240,141 @@ static bool encoder_begin_callback(struct whisper_context *ctx, struct whisper_s
       is_aborted = true;
     }
   }
-  return !is_aborted;
+  return is_aborted ? Qfalse : Qtrue;
 }
 
-static bool abort_callback(void * user_data) {
-  const ruby_whisper_callback_container *container = (ruby_whisper_callback_container *)user_data;
+static bool encoder_begin_callback(struct whisper_context *ctx, struct whisper_state *state, void *user_data) {
+  ruby_whisper_full_call *call = (ruby_whisper_full_call *)user_data;
+  if (call->exception || call->interrupted) {
+    return false;
+  }
+  const VALUE result = ruby_whisper_call_with_gvl(call_encoder_begin_callbacks, (VALUE)call);
+  return !call->exception && result != Qfalse;
+}
+
+static VALUE
+call_abort_callbacks(VALUE arg) {
+  const ruby_whisper_full_call *call = (ruby_whisper_full_call *)arg;
+  const ruby_whisper_callback_container *container = call->rwp->abort_callback_container;
   if (!NIL_P(container->callback)) {
     VALUE result = rb_funcall(container->callback, id_call, 1, container->user_data);
     if (!NIL_P(result) && Qfalse != result) {
-      return true;
+      return Qtrue;
     }
   }
   const long callbacks_len = RARRAY_LEN(container->callbacks);
-  if (0 == callbacks_len) {
-    return false;
-  }
   for (int j = 0; j < callbacks_len; j++) {
     VALUE cb = rb_ary_entry(container->callbacks, j);
     VALUE result = rb_funcall(cb, id_call, 1, container->user_data);
     if (!NIL_P(result) && Qfalse != result) {
-      return true;
+      return Qtrue;
     }
   }
-  return false;
+  return Qfalse;
+}
+
+// always set, to stop the transcription when the Ruby thread is interrupted
+static bool abort_callback(void * user_data) {
+  ruby_whisper_full_call *call = (ruby_whisper_full_call *)user_data;
+  if (call->exception || call->interrupted) {
+    return true;
+  }
+  if (!has_callbacks(call->rwp->abort_callback_container)) {
+    return false;
+  }
+  const VALUE result = ruby_whisper_call_with_gvl(call_abort_callbacks, (VALUE)call);
+  return call->exception || result == Qtrue;
+}
+
+static void *
+ruby_whisper_full_nogvl(void *data)
+{
+  ruby_whisper_full_call *call = (ruby_whisper_full_call *)data;
+  ruby_whisper_full_call *prev_call = current_call;
+  current_call = call;
+  if (call->wstate) {
+    call->result = whisper_full_with_state(call->ctx, call->wstate, call->params, call->samples, call->n_samples);
+  } else {
+    call->result = whisper_full_parallel(call->ctx, call->params, call->samples, call->n_samples, call->n_processors);
+  }
+  current_call = prev_call;
+  return NULL;
+}
+
+static void
+ruby_whisper_full_ubf(void *data)
+{
+  ruby_whisper_full_call *call = (ruby_whisper_full_call *)data;
+  call->interrupted = true;
 }
 
-void register_callbacks(ruby_whisper_params * rwp, VALUE * context) {
-  if (!NIL_P(rwp->new_segment_callback_container->callback) || 0 != RARRAY_LEN(rwp->new_segment_callback_container->callbacks)) {
-    rwp->new_segment_callback_container->context = context;
-    rwp->params.new_segment_callback = new_segment_callback;
-    rwp->params.new_segment_callback_user_data = rwp->new_segment_callback_container;
+/*
+ * Runs whisper_full_parallel(), or whisper_full_with_state() when state is a Whisper::State,
+ * without the GVL so that the other Ruby threads run during the transcription.
+ * The Ruby callbacks of params are called with the GVL. An exception raised by one of them aborts
+ * the transcription and its tag is stored in *exception, to be passed to rb_jump_tag() by the caller.
+ */
+int
+ruby_whisper_full_without_gvl(VALUE context, VALUE state, VALUE params, const float *samples, int n_samples, int n_processors, int *exception)
+{
+  ruby_whisper *rw;
+  ruby_whisper_params *rwp;
+  Data_Get_Struct(context, ruby_whisper, rw);
+  Data_Get_Struct(params, ruby_whisper_params, rwp);
+
+  ruby_whisper_full_call call;
+  call.context = context;
+  call.state = state;
+  call.rwp = rwp;
+  call.ctx = rw->context;
+  call.wstate = NULL;
+  if (!NIL_P(state)) {
+    ruby_whisper_state *rwst;
+    Data_Get_Struct(state, ruby_whisper_state, rwst);
+    call.wstate = rwst->state;
   }
+  call.params = rwp->params;
+  call.samples = samples;
+  call.n_samples = n_samples;
+  call.n_processors = n_processors;
+  call.result = 0;
+  call.exception = 0;
+  call.interrupted = false;
+
+  // with several processors, the segments are delivered from the threads of whisper.cpp,
+  // which cannot call Ruby - they are passed to the callbacks once the transcription is done
+  const bool defer_new_segments = call.wstate == NULL && n_processors > 1;
 
-  if (!NIL_P(rwp->progress_callback_container->callback) || 0 != RARRAY_LEN(rwp->progress_callback_container->callbacks)) {
-    rwp->progress_callback_container->context = context;
-    rwp->params.progress_callback = progress_callback;
-    rwp->params.progress_callback_user_data = rwp->progress_callback_container;
+  if (has_callbacks(rwp->new_segment_callback_container) && !defer_new_segments) {
+    call.params.new_segment_callback = new_segment_callback;
+    call.params.new_segment_callback_user_data = &call;
   }
 
-  if (!NIL_P(rwp->encoder_begin_callback_container->callback) || 0 != RARRAY_LEN(rwp->encoder_begin_callback_container->callbacks)) {
-    rwp->encoder_begin_callback_container->context = context;
-    rwp->params.encoder_begin_callback = encoder_begin_callback;
-    rwp->params.encoder_begin_callback_user_data = rwp->encoder_begin_callback_container;
+  if (has_callbacks(rwp->progress_callback_container)) {
+    call.params.progress_callback = progress_callback;
+    call.params.progress_callback_user_data = &call;
   }
 
-  if (!NIL_P(rwp->abort_callback_container->callback) || 0 != RARRAY_LEN(rwp->abort_callback_container->callbacks)) {
-    rwp->abort_callback_container->context = context;
-    rwp->params.abort_callback = abort_callback;
-    rwp->params.abort_callback_user_data = rwp->abort_callback_container;
+  if (has_callbacks(rwp->encoder_begin_callback_container)) {
+    call.params.encoder_begin_callback = encoder_begin_callback;
+    call.params.encoder_begin_callback_user_data = &call;
   }
+
+  call.params.abort_callback = abort_callback;
+  call.params.abort_callback_user_data = &call;
+
+  rb_thread_call_without_gvl(ruby_whisper_full_nogvl, &call, ruby_whisper_full_ubf, &call);
+
+  if (defer_new_segments && 0 == call.result && has_callbacks(rwp->new_segment_callback_container)) {
+    const int n_segments = whisper_full_n_segments(call.ctx);
+    for (int i = 0; i < n_segments && !call.exception; i++) {
+      ruby_whisper_new_segment_args args = { &call, i, 1 };
+      rb_protect(call_new_segment_callbacks, (VALUE)&args, &call.exception);
+    }
+  }
+
+  *exception = call.exception;
+  return call.result;
 }
 
 void
@@ -7,6 +7,7 @@ static void
 rb_whisper_segment_mark(ruby_whisper_segment *rws)
 {
   rb_gc_mark(rws->context);
+  rb_gc_mark(rws->state);
 }
 
 VALUE
@@ -18,16 +19,29 @@ ruby_whisper_segment_allocate(VALUE klass)
 }
 
 VALUE
-rb_whisper_segment_initialize(VALUE context, int index)
+rb_whisper_segment_initialize(VALUE context, VALUE state, int index)
 {
   ruby_whisper_segment *rws;
   const VALUE segment = ruby_whisper_segment_allocate(cSegment);
   Data_Get_Struct(segment, ruby_whisper_segment, rws);
   rws->context = context;
+  rws->state = state;
   rws->index = index;
   return segment;
 };
 
+// the state of a segment of Whisper::State, NULL for the default state of the context
+static struct whisper_state *
+ruby_whisper_segment_state(const ruby_whisper_segment *rws)
+{
+  if (NIL_P(rws->state)) {
+    return NULL;
+  }
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(rws->state, ruby_whisper_state, rwst);
+  return rwst->state;
+}
+
 /*
  * Start time in milliseconds.
  *
@@ -41,7 +55,8 @@ ruby_whisper_segment_get_start_time(VALUE self)
   Data_Get_Struct(self, ruby_whisper_segment, rws);
   ruby_whisper *rw;
   Data_Get_Struct(rws->context, ruby_whisper, rw);
-  const int64_t t0 = whisper_full_get_segment_t0(rw->context, rws->index);
+  struct whisper_state *state = ruby_whisper_segment_state(rws);
+  const int64_t t0 = state ? whisper_full_get_segment_t0_from_state(state, rws->index) : whisper_full_get_segment_t0(rw->context, rws->index);
   // able to multiply 10 without overflow because to_timestamp() in whisper.cpp does it
   return INT2NUM(t0 * 10);
 }
@@ -59,7 +74,8 @@ ruby_whisper_segment_get_end_time(VALUE self)
   Data_Get_Struct(self, ruby_whisper_segment, rws);
   ruby_whisper *rw;
   Data_Get_Struct(rws->context, ruby_whisper, rw);
-  const int64_t t1 = whisper_full_get_segment_t1(rw->context, rws->index);
+  struct whisper_state *state = ruby_whisper_segment_state(rws);
+  const int64_t t1 = state ? whisper_full_get_segment_t1_from_state(state, rws->index) : whisper_full_get_segment_t1(rw->context, rws->index);
   // able to multiply 10 without overflow because to_timestamp() in whisper.cpp does it
   return INT2NUM(t1 * 10);
 }
@@ -77,7 +93,8 @@ ruby_whisper_segment_get_speaker_turn_next(VALUE self)
   Data_Get_Struct(self, ruby_whisper_segment, rws);
   ruby_whisper *rw;
   Data_Get_Struct(rws->context, ruby_whisper, rw);
-  return whisper_full_get_segment_speaker_turn_next(rw->context, rws->index) ? Qtrue : Qfalse;
+  struct whisper_state *state = ruby_whisper_segment_state(rws);
+  return (state ? whisper_full_get_segment_speaker_turn_next_from_state(state, rws->index) : whisper_full_get_segment_speaker_turn_next(rw->context, rws->index)) ? Qtrue : Qfalse;
 }
 
 /*
@@ -91,7 +108,8 @@ ruby_whisper_segment_get_text(VALUE self)
   Data_Get_Struct(self, ruby_whisper_segment, rws);
   ruby_whisper *rw;
   Data_Get_Struct(rws->context, ruby_whisper, rw);
-  const char * text = whisper_full_get_segment_text(rw->context, rws->index);
+  struct whisper_state *state = ruby_whisper_segment_state(rws);
+  const char * text = state ? whisper_full_get_segment_text_from_state(state, rws->index) : whisper_full_get_segment_text(rw->context, rws->index);
   return rb_str_new2(text);
 }
 
@@ -106,7 +124,8 @@ ruby_whisper_segment_get_no_speech_prob(VALUE self)
   Data_Get_Struct(self, ruby_whisper_segment, rws);
   ruby_whisper *rw;
   Data_Get_Struct(rws->context, ruby_whisper, rw);
-  return DBL2NUM(whisper_full_get_segment_no_speech_prob(rw->context, rws->index));
+  struct whisper_state *state = ruby_whisper_segment_state(rws);
+  return DBL2NUM(state ? whisper_full_get_segment_no_speech_prob_from_state(state, rws->index) : whisper_full_get_segment_no_speech_prob(rw->context, rws->index));
 }
 
 void
@@ -0,0 +1,195 @@
+#include <ruby.h>
+#include "ruby_whisper.h"
+
+extern ID id___method__;
+extern ID id_to_enum;
+
+extern VALUE cContext;
+extern VALUE cState;
+
+extern VALUE rb_whisper_segment_initialize(VALUE context, VALUE state, int index);
+extern VALUE ruby_whisper_full_samples(VALUE context, VALUE state, VALUE params, VALUE samples, VALUE n_samples_value, int n_processors);
+
+static void
+rb_whisper_state_mark(ruby_whisper_state *rwst)
+{
+  rb_gc_mark(rwst->context);
+}
+
+static void
+rb_whisper_state_free(ruby_whisper_state *rwst)
+{
+  if (rwst->state) {
+    whisper_free_state(rwst->state);
+    rwst->state = NULL;
+  }
+  free(rwst);
+}
+
+static VALUE
+ruby_whisper_state_allocate(VALUE klass)
+{
+  ruby_whisper_state *rwst;
+  rwst = ALLOC(ruby_whisper_state);
+  rwst->context = Qnil;
+  rwst->state = NULL;
+  return Data_Wrap_Struct(klass, rb_whisper_state_mark, rb_whisper_state_free, rwst);
+}
+
+/*
+ * A state of its own for the transcriptions of a context.
+ * The model of the context is shared, so each Ruby thread can transcribe with its own state at the same time:
+ *
+ *   whisper = Whisper::Context.new("base.en")
+ *   threads = paths.map {|path|
+ *     Thread.new {
+ *       state = Whisper::State.new(whisper)
+ *       state.full(params, read_samples(path))
+ *       state.each_segment.collect(&:text).join
+ *     }
+ *   }
+ *
+ * call-seq:
+ *   new(context) -> Whisper::State
+ */
+static VALUE
+ruby_whisper_state_initialize(VALUE self, VALUE context)
+{
+  if (!rb_obj_is_kind_of(context, cContext)) {
+    rb_raise(rb_eTypeError, "context must be a Whisper::Context");
+  }
+
+  ruby_whisper_state *rwst;
+  ruby_whisper *rw;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+  Data_Get_Struct(context, ruby_whisper, rw);
+  if (rw->context == NULL) {
+    rb_raise(rb_eRuntimeError, "context is not initialized");
+  }
+
+  rwst->state = whisper_init_state(rw->context);
+  if (rwst->state == NULL) {
+    rb_raise(rb_eRuntimeError, "failed to initialize the state");
+  }
+  rwst->context = context;
+
+  return self;
+}
+
+/*
+ * Same as Whisper::Context#full, into this state. The GVL is released during the transcription.
+ *
+ * call-seq:
+ *   full(params, samples, n_samples) -> Whisper::State
+ *   full(params, samples) -> Whisper::State
+ */
+static VALUE
+ruby_whisper_state_full(int argc, VALUE *argv, VALUE self)
+{
+  if (argc < 2 || argc > 3) {
+    rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 2..3)", argc);
+  }
+
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+
+  return ruby_whisper_full_samples(rwst->context, self, argv[0], argv[1], argc == 3 ? argv[2] : Qnil, 1);
+}
+
+/*
+ * call-seq:
+ *   context -> Whisper::Context
+ */
+static VALUE
+ruby_whisper_state_get_context(VALUE self)
+{
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+  return rwst->context;
+}
+
+/*
+ * Number of segments.
+ *
+ * call-seq:
+ *   full_n_segments -> Integer
+ */
+static VALUE
+ruby_whisper_state_full_n_segments(VALUE self)
+{
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+  return INT2NUM(whisper_full_n_segments_from_state(rwst->state));
+}
+
+/*
+ * Language ID, which can be converted to string by Whisper.lang_str and Whisper.lang_str_full.
+ *
+ * call-seq:
+ *   full_lang_id -> Integer
+ */
+static VALUE
+ruby_whisper_state_full_lang_id(VALUE self)
+{
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+  return INT2NUM(whisper_full_lang_id_from_state(rwst->state));
+}
+
+/*
+ * call-seq:
+ *   full_get_segment(segment_index) -> Whisper::Segment
+ */
+static VALUE
+ruby_whisper_state_full_get_segment(VALUE self, VALUE i_segment)
+{
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+  const int c_i_segment = NUM2INT(i_segment);
+  if (c_i_segment < 0 || c_i_segment >= whisper_full_n_segments_from_state(rwst->state)) {
+    rb_raise(rb_eIndexError, "segment index %d out of range", c_i_segment);
+  }
+  return rb_whisper_segment_initialize(rwst->context, self, c_i_segment);
+}
+
+/*
+ * Yields each Whisper::Segment of the last transcription of this state.
+ * Returns an Enumerator if no block given.
+ *
+ * call-seq:
+ *   each_segment {|segment| ... }
+ *   each_segment -> Enumerator
+ */
+static VALUE
+ruby_whisper_state_each_segment(VALUE self)
+{
+  if (!rb_block_given_p()) {
+    const VALUE method_name = rb_funcall(self, id___method__, 0);
+    return rb_funcall(self, id_to_enum, 1, method_name);
+  }
+
+  ruby_whisper_state *rwst;
+  Data_Get_Struct(self, ruby_whisper_state, rwst);
+
+  const int n_segments = whisper_full_n_segments_from_state(rwst->state);
+  for (int i = 0; i < n_segments; ++i) {
+    rb_yield(rb_whisper_segment_initialize(rwst->context, self, i));
+  }
+
+  return self;
+}
+
+void
+init_ruby_whisper_state(VALUE *mWhisper)
+{
+  cState = rb_define_class_under(*mWhisper, "State", rb_cObject);
+
+  rb_define_alloc_func(cState, ruby_whisper_state_allocate);
+  rb_define_method(cState, "initialize", ruby_whisper_state_initialize, 1);
+  rb_define_method(cState, "full", ruby_whisper_state_full, -1);
+  rb_define_method(cState, "context", ruby_whisper_state_get_context, 0);
+  rb_define_method(cState, "full_n_segments", ruby_whisper_state_full_n_segments, 0);
+  rb_define_method(cState, "full_lang_id", ruby_whisper_state_full_lang_id, 0);
+  rb_define_method(cState, "full_get_segment", ruby_whisper_state_full_get_segment, 1);
+  rb_define_method(cState, "each_segment", ruby_whisper_state_each_segment, 0);
+}
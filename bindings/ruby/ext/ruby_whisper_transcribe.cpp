@@ -11,8 +11,8 @@ extern "C" {
 extern ID id_to_s;
 extern ID id_call;
 
-extern void
-register_callbacks(ruby_whisper_params * rwp, VALUE * self);
+extern int
+ruby_whisper_full_without_gvl(VALUE context, VALUE state, VALUE params, const float * samples, int n_samples, int n_processors, int * exception);
 
 /*
  * transcribe a single file
@@ -41,29 +41,27 @@ ruby_whisper_transcribe(int argc, VALUE *argv, VALUE self) {
     rb_raise(rb_eRuntimeError, "Expected file path to wave file");
   }
 
-  std::string fname_inp = StringValueCStr(wave_file_path);
+  int result;
+  int exception;
+  {
+    std::string fname_inp = StringValueCStr(wave_file_path);
 
-  std::vector<float> pcmf32; // mono-channel F32 PCM
-  std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
+    std::vector<float> pcmf32; // mono-channel F32 PCM
+    std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
 
-  if (!read_audio_data(fname_inp, pcmf32, pcmf32s, rwp->diarize)) {
-    fprintf(stderr, "error: failed to open '%s' as WAV file\n", fname_inp.c_str());
-    return self;
-  }
-  // Commented out because it is work in progress
-  // {
-  //   static bool is_aborted = false; // NOTE: this should be atomic to avoid data race
-
-  //   rwp->params.encoder_begin_callback = [](struct whisper_context * /*ctx*/, struct whisper_state * /*state*/, void * user_data) {
-  //     bool is_aborted = *(bool*)user_data;
-  //     return !is_aborted;
-  //   };
-  //   rwp->params.encoder_begin_callback_user_data = &is_aborted;
-  // }
+    if (!read_audio_data(fname_inp, pcmf32, pcmf32s, rwp->diarize)) {
+      fprintf(stderr, "error: failed to open '%s' as WAV file\n", fname_inp.c_str());
+      return self;
+    }
 
-  register_callbacks(rwp, &self);
-
-  if (whisper_full_parallel(rw->context, rwp->params, pcmf32.data(), pcmf32.size(), 1) != 0) {
+    // the GVL is released during the transcription, the audio is freed before an exception
+    // of a callback is raised again
+    result = ruby_whisper_full_without_gvl(self, Qnil, params, pcmf32.data(), pcmf32.size(), 1, &exception);
+  }
+  if (exception) {
+    rb_jump_tag(exception);
+  }
+  if (result != 0) {
     fprintf(stderr, "failed to process audio\n");
     return self;
   }
@@ -223,4 +223,46 @@ class TestWhisper < TestBase
       assert_match(/for your country/i, text)
     end
   end
+
+  sub_test_case "state" do
+    def setup
+      super
+      @whisper = Whisper::Context.new("base.en")
+      @samples = File.read(AUDIO, nil, 78).unpack("s<*").collect {|i| i.to_f / 2**15}
+    end
+
+    def test_full
+      state = Whisper::State.new(@whisper)
+      assert_same state, state.full(@params, @samples)
+
+      assert_same @whisper, state.context
+      assert_equal 1, state.full_n_segments
+      assert_equal 0, state.full_lang_id
+      assert_match(/ask not what your country can do for you, ask what you can do for your country/, state.each_segment.first.text)
+      assert_equal 0, state.full_get_segment(0).start_time
+    end
+
+    def test_full_in_threads
+      threads = 2.times.collect {
+        Thread.new do
+          Whisper::State.new(@whisper).full(@params, @samples).each_segment.collect(&:text).join
+        end
+      }
+      threads.each do |thread|
+        assert_match(/ask not what your country can do for you, ask what you can do for your country/, thread.value)
+      end
+    end
+
+    def test_new_segment_callback
+      state = Whisper::State.new(@whisper)
+      yielded = []
+      @params.new_segment_callback = ->(context, st, n_new, user_data) {
+        assert_same state, st
+        yielded << st.full_get_segment(st.full_n_segments - 1).text
+      }
+      state.full(@params, @samples)
+
+      assert_equal state.each_segment.collect(&:text), yielded
+    end
+  end
 end
@@ -1,5 +1,5 @@
 const path = require("path");
-const { whisper } = require(path.join(
+const { whisper, unload } = require(path.join(
   __dirname,
   "../../../build/Release/addon.node"
 ));
@@ -33,5 +33,17 @@ describe("Run whisper.node", () => {
 
         expect(result.length).toBeGreaterThan(0);
     }, 10000);
+
+    test("it should run concurrent calls with the same model", async () => {
+        const segments = [];
+        const params = { ...whisperParamsMock, on_new_segment: (segment) => segments.push(segment) };
+
+        const [first, second] = await Promise.all([whisperAsync(params), whisperAsync(params)]);
+
+        expect(first).toEqual(second);
+        expect(segments.length).toBeGreaterThan(0);
+
+        unload(whisperParamsMock.model);
+    }, 20000);
 });
 
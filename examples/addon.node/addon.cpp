@@ -9,6 +9,9 @@
 #include <vector>
 #include <cmath>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 
 struct whisper_params {
     int32_t n_threads    = std::min(4, (int32_t) std::thread::hardware_concurrency());
@@ -58,11 +61,11 @@ struct whisper_print_user_data {
     const std::vector<std::vector<float>> * pcmf32s;
 };
 
-void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data) {
+void whisper_print_segment_callback(struct whisper_context * /*ctx*/, struct whisper_state * state, int n_new, void * user_data) {
     const auto & params  = *((whisper_print_user_data *) user_data)->params;
     const auto & pcmf32s = *((whisper_print_user_data *) user_data)->pcmf32s;
 
-    const int n_segments = whisper_full_n_segments(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
 
     std::string speaker = "";
 
@@ -78,8 +81,8 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
 
     for (int i = s0; i < n_segments; i++) {
         if (!params.no_timestamps || params.diarize) {
-            t0 = whisper_full_get_segment_t0(ctx, i);
-            t1 = whisper_full_get_segment_t1(ctx, i);
+            t0 = whisper_full_get_segment_t0_from_state(state, i);
+            t1 = whisper_full_get_segment_t1_from_state(state, i);
         }
 
         if (!params.no_timestamps) {
@@ -113,7 +116,7 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
 
         // colorful print bug
         //
-        const char * text = whisper_full_get_segment_text(ctx, i);
+        const char * text = whisper_full_get_segment_text_from_state(state, i);
         printf("%s%s", speaker.c_str(), text);
 
 
@@ -128,9 +131,43 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
 
 void cb_log_disable(enum ggml_log_level, const char *, void *) {}
 
+// the models stay loaded across the calls and are shared by the concurrent transcriptions,
+// each of them running on a libuv worker thread with its own whisper_state
+static std::mutex g_models_mutex;
+static std::map<std::string, std::shared_ptr<whisper_context>> g_models;
+
+static std::string whisper_model_key(const whisper_params & params) {
+    return params.model + (params.use_gpu ? "|gpu" : "|cpu") + (params.flash_attn ? "|fa" : "");
+}
+
+static std::shared_ptr<whisper_context> whisper_model_get(const whisper_params & params) {
+    std::lock_guard<std::mutex> lock(g_models_mutex);
+
+    const std::string key = whisper_model_key(params);
+
+    auto it = g_models.find(key);
+    if (it != g_models.end()) {
+        return it->second;
+    }
+
+    struct whisper_context_params cparams = whisper_context_default_params();
+    cparams.use_gpu    = params.use_gpu;
+    cparams.flash_attn = params.flash_attn;
+
+    struct whisper_context * ctx = whisper_init_from_file_with_params_no_state(params.model.c_str(), cparams);
+    if (ctx == nullptr) {
+        return nullptr;
+    }
+
+    std::shared_ptr<whisper_context> model(ctx, whisper_free);
+    g_models[key] = model;
+
+    return model;
+}
+
 class ProgressWorker : public Napi::AsyncWorker {
  public:
-    ProgressWorker(Napi::Function& callback, whisper_params params, Napi::Function progress_callback, Napi::Env env)
+    ProgressWorker(Napi::Function& callback, whisper_params params, Napi::Function progress_callback, Napi::Function segment_callback, Napi::Env env)
         : Napi::AsyncWorker(callback), params(params), env(env) {
         // Create thread-safe function
         if (!progress_callback.IsEmpty()) {
@@ -142,6 +179,15 @@ class ProgressWorker : public Napi::AsyncWorker {
                 1
             );
         }
+        if (!segment_callback.IsEmpty()) {
+            tsfn_segment = Napi::ThreadSafeFunction::New(
+                env,
+                segment_callback,
+                "New Segment Callback",
+                0,
+                1
+            );
+        }
     }
 
     ~ProgressWorker() {
@@ -149,11 +195,17 @@ class ProgressWorker : public Napi::AsyncWorker {
             // Make sure to release the thread-safe function on destruction
             tsfn.Release();
         }
+        if (tsfn_segment) {
+            tsfn_segment.Release();
+        }
     }
 
     void Execute() override {
         // Use custom run function with progress callback support
-        run_with_progress(params, result);
+        const int ret = run_with_progress(params, result);
+        if (ret != 0) {
+            SetError("whisper failed with error code " + std::to_string(ret));
+        }
     }
 
     void OnOK() override {
@@ -181,11 +233,43 @@ class ProgressWorker : public Napi::AsyncWorker {
         }
     }
 
+    // Stream the new segments to JavaScript as [t0, t1, text] while the transcription is running
+    void OnNewSegments(struct whisper_state * state, int n_new) {
+        if (!tsfn_segment) {
+            return;
+        }
+
+        const int n_segments = whisper_full_n_segments_from_state(state);
+
+        std::vector<std::vector<std::string>> segments;
+        for (int i = n_segments - n_new; i < n_segments; ++i) {
+            segments.push_back({
+                to_timestamp(whisper_full_get_segment_t0_from_state(state, i), params.comma_in_time),
+                to_timestamp(whisper_full_get_segment_t1_from_state(state, i), params.comma_in_time),
+                whisper_full_get_segment_text_from_state(state, i),
+            });
+        }
+
+        auto callback = [segments](Napi::Env env, Napi::Function jsCallback) {
+            for (const auto & segment : segments) {
+                Napi::Array tmp = Napi::Array::New(env, segment.size());
+                for (uint32_t j = 0; j < segment.size(); ++j) {
+                    tmp[j] = Napi::String::New(env, segment[j]);
+                }
+                jsCallback.Call({tmp});
+            }
+        };
+
+        tsfn_segment.BlockingCall(callback);
+    }
+
  private:
     whisper_params params;
     std::vector<std::vector<std::string>> result;
     Napi::Env env;
     Napi::ThreadSafeFunction tsfn;
+    Napi::ThreadSafeFunction tsfn_segment;
+    whisper_print_user_data print_user_data;
 
     // Custom run function with progress callback support
     int run_with_progress(whisper_params &params, std::vector<std::vector<std::string>> &result) {
@@ -200,20 +284,26 @@ class ProgressWorker : public Napi::AsyncWorker {
 
         if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1) {
             fprintf(stderr, "error: unknown language '%s'\n", params.language.c_str());
-            exit(0);
+            return 2;
         }
 
-        // whisper init
-        struct whisper_context_params cparams = whisper_context_default_params();
-        cparams.use_gpu = params.use_gpu;
-        cparams.flash_attn = params.flash_attn;
-        struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+        // whisper init - the model is loaded once and reused by the next calls
+        std::shared_ptr<whisper_context> model = whisper_model_get(params);
 
-        if (ctx == nullptr) {
+        if (model == nullptr) {
             fprintf(stderr, "error: failed to initialize whisper context\n");
             return 3;
         }
 
+        struct whisper_context * ctx = model.get();
+
+        std::unique_ptr<whisper_state, decltype(&whisper_free_state)> state(whisper_init_state(ctx), whisper_free_state);
+
+        if (state == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper state\n");
+            return 3;
+        }
+
         // If params.pcmf32 provides, set params.fname_inp as "buffer"
         if (!params.pcmf32.empty()) {
             fprintf(stderr, "info: using audio buffer as input\n");
@@ -297,12 +387,16 @@ class ProgressWorker : public Napi::AsyncWorker {
 
                 wparams.no_timestamps    = params.no_timestamps;
 
-                whisper_print_user_data user_data = { &params, &pcmf32s };
+                print_user_data = { &params, &pcmf32s };
 
                 // This callback is called for each new segment
                 if (!wparams.print_realtime) {
-                    wparams.new_segment_callback           = whisper_print_segment_callback;
-                    wparams.new_segment_callback_user_data = &user_data;
+                    wparams.new_segment_callback = [](struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data) {
+                        ProgressWorker* worker = static_cast<ProgressWorker*>(user_data);
+                        whisper_print_segment_callback(ctx, state, n_new, &worker->print_user_data);
+                        worker->OnNewSegments(state, n_new);
+                    };
+                    wparams.new_segment_callback_user_data = this;
                 }
 
                 // Set progress callback
@@ -323,28 +417,26 @@ class ProgressWorker : public Napi::AsyncWorker {
                     wparams.encoder_begin_callback_user_data = &is_aborted;
                 }
 
-                if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
+                // whisper_full_parallel() uses the default state of the context, which is shared by all the calls
+                if (whisper_full_with_state(ctx, state.get(), wparams, pcmf32.data(), pcmf32.size()) != 0) {
                     fprintf(stderr, "failed to process audio\n");
                     return 10;
                 }
             }
     }
 
-        const int n_segments = whisper_full_n_segments(ctx);
+        const int n_segments = whisper_full_n_segments_from_state(state.get());
         result.resize(n_segments);
         for (int i = 0; i < n_segments; ++i) {
-            const char * text = whisper_full_get_segment_text(ctx, i);
-            const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+            const char * text = whisper_full_get_segment_text_from_state(state.get(), i);
+            const int64_t t0 = whisper_full_get_segment_t0_from_state(state.get(), i);
+            const int64_t t1 = whisper_full_get_segment_t1_from_state(state.get(), i);
 
             result[i].emplace_back(to_timestamp(t0, params.comma_in_time));
             result[i].emplace_back(to_timestamp(t1, params.comma_in_time));
             result[i].emplace_back(text);
         }
 
-        whisper_print_timings(ctx);
-        whisper_free(ctx);
-
         return 0;
     }
 };
@@ -391,15 +483,18 @@ Napi::Value whisper(const Napi::CallbackInfo& info) {
     progress_callback = whisper_params.Get("progress_callback").As<Napi::Function>();
   }
 
+  // Add support for streaming the segments
+  Napi::Function segment_callback;
+  if (whisper_params.Has("on_new_segment") && whisper_params.Get("on_new_segment").IsFunction()) {
+    segment_callback = whisper_params.Get("on_new_segment").As<Napi::Function>();
+  }
+
+  // the samples are copied, as the JS buffer cannot be accessed from the worker thread
   Napi::Value pcmf32Value = whisper_params.Get("pcmf32");
   std::vector<float> pcmf32_vec;
   if (pcmf32Value.IsTypedArray()) {
     Napi::Float32Array pcmf32 = pcmf32Value.As<Napi::Float32Array>();
-    size_t length = pcmf32.ElementLength();
-    pcmf32_vec.reserve(length);
-    for (size_t i = 0; i < length; i++) {
-      pcmf32_vec.push_back(pcmf32[i]);
-    }
+    pcmf32_vec.assign(pcmf32.Data(), pcmf32.Data() + pcmf32.ElementLength());
   }
 
   params.language = language;
@@ -410,7 +505,7 @@ Napi::Value whisper(const Napi::CallbackInfo& info) {
   params.no_prints = no_prints;
   params.no_timestamps = no_timestamps;
   params.audio_ctx = audio_ctx;
-  params.pcmf32 = pcmf32_vec;
+  params.pcmf32 = std::move(pcmf32_vec);
   params.comma_in_time = comma_in_time;
   params.max_len = max_len;
   params.max_context = max_context;
@@ -419,17 +514,44 @@ Napi::Value whisper(const Napi::CallbackInfo& info) {
 
   Napi::Function callback = info[1].As<Napi::Function>();
   // Create a new Worker class with progress callback support
-  ProgressWorker* worker = new ProgressWorker(callback, params, progress_callback, env);
+  ProgressWorker* worker = new ProgressWorker(callback, params, progress_callback, segment_callback, env);
   worker->Queue();
   return env.Undefined();
 }
 
 
+// Release the cached models: all of them, or the ones loaded from the given path.
+// The transcriptions in progress keep their model alive until they finish.
+Napi::Value unload(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  std::lock_guard<std::mutex> lock(g_models_mutex);
+
+  if (info.Length() > 0 && info[0].IsString()) {
+    const std::string model = info[0].As<Napi::String>();
+    for (auto it = g_models.begin(); it != g_models.end();) {
+      if (it->first.compare(0, model.size() + 1, model + "|") == 0) {
+        it = g_models.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  } else {
+    g_models.clear();
+  }
+
+  return env.Undefined();
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
   exports.Set(
       Napi::String::New(env, "whisper"),
       Napi::Function::New(env, whisper)
   );
+  exports.Set(
+      Napi::String::New(env, "unload"),
+      Napi::Function::New(env, unload)
+  );
   return exports;
 }
 
@@ -21,6 +21,9 @@ const whisperParams = {
   max_len: 0,
   progress_callback: (progress) => {
       console.log(`progress: ${progress}%`);
+    },
+  on_new_segment: (segment) => {
+      console.log(`segment: ${segment}`);
     }
 };
 
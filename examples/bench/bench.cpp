@@ -1,24 +1,95 @@
+#define _USE_MATH_DEFINES // for M_PI
+#include "common-whisper.h"
 #include "whisper.h"
+#include "ggml.h"
+#include "ggml-alloc.h"
+#include "ggml-backend.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdarg>
 #include <cstdio>
 #include <cstring>
+#include <functional>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <glob.h>
+#endif
+
+#if defined(__APPLE__)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 // command-line parameters
 struct whisper_params {
     int32_t n_threads = std::min(4, (int32_t) std::thread::hardware_concurrency());
-    int32_t what = 0; // what to benchmark: 0 - whisper encoder, 1 - memcpy, 2 - ggml_mul_mat
+    int32_t what = 0; // what to benchmark: 0 - whisper encoder, 1 - memcpy, 2 - ggml_mul_mat, 3 - whisper_full, 4 - ggml ops,
+                      //                    5 - mel spectrogram, 6 - VAD
+    int32_t n_runs = 3;
+
+    // whisper_full benchmark: every combination of these is measured
+    std::vector<int32_t>     threads;
+    std::vector<int32_t>     beam_sizes = { 1 }; // 1 - greedy sampling, > 1 - beam search
+    std::vector<std::string> devices    = { "gpu" };
+
+    // ggml ops benchmark: the model sizes and the types of the weights of the matrix multiplications
+    std::vector<std::string> model_sizes = { "tiny", "base", "small", "medium", "large" };
+    std::vector<std::string> wtypes      = { "f16", "q8_0", "q5_0", "q4_0" };
+
+    // mel and VAD benchmarks: the durations of the audio, in seconds
+    std::vector<float> durations = { 1.0f, 10.0f, 30.0f, 120.0f };
+
+    std::string vad_model = "models/ggml-silero-v5.1.2.bin";
 
     std::string model = "models/ggml-base.en.bin";
+    std::string fname_inp;
+    std::string fname_json; // "-" for stdout
+    std::string language = "en";
 
     bool use_gpu    = true;
     bool flash_attn = false;
+    bool power      = false; // measure the energy of the whisper_full runs
+
+    int32_t cpu_hugepages = 0;
 };
 
+template <typename T>
+static std::vector<T> parse_list(const std::string & str) {
+    std::vector<T> res;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        std::stringstream si(item);
+        T value;
+        si >> value;
+        res.push_back(value);
+    }
+    return res;
+}
+
 void whisper_print_usage(int argc, char ** argv, const whisper_params & params);
 
 static bool whisper_params_parse(int argc, char ** argv, whisper_params & params) {
+    bool devices_set = false;
+
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
 
@@ -26,11 +97,23 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
             whisper_print_usage(argc, argv, params);
             exit(0);
         }
-        else if (arg == "-t"  || arg == "--threads")    { params.n_threads  = std::stoi(argv[++i]); }
+        else if (arg == "-t"  || arg == "--threads")    { params.threads    = parse_list<int32_t>(argv[++i]); }
         else if (arg == "-m"  || arg == "--model")      { params.model      = argv[++i]; }
         else if (arg == "-w"  || arg == "--what")       { params.what       = atoi(argv[++i]); }
+        else if (arg == "-f"  || arg == "--file")       { params.fname_inp  = argv[++i]; }
+        else if (arg == "-l"  || arg == "--language")   { params.language   = argv[++i]; }
+        else if (arg == "-bs" || arg == "--beam-size")  { params.beam_sizes = parse_list<int32_t>(argv[++i]); }
+        else if (arg == "-d"  || arg == "--devices")    { params.devices    = parse_list<std::string>(argv[++i]); devices_set = true; }
+        else if (arg == "-ms" || arg == "--model-sizes") { params.model_sizes = parse_list<std::string>(argv[++i]); }
+        else if (arg == "-wt" || arg == "--wtypes")     { params.wtypes     = parse_list<std::string>(argv[++i]); }
+        else if (arg == "-du" || arg == "--durations")  { params.durations  = parse_list<float>(argv[++i]); }
+        else if (arg == "-vm" || arg == "--vad-model")  { params.vad_model  = argv[++i]; }
+        else if (arg == "-r"  || arg == "--runs")       { params.n_runs     = std::stoi(argv[++i]); }
+        else if (arg == "-oj" || arg == "--output-json") { params.fname_json = argv[++i]; }
         else if (arg == "-ng" || arg == "--no-gpu")     { params.use_gpu    = false; }
         else if (arg == "-fa" || arg == "--flash-attn") { params.flash_attn = true; }
+        else if (arg == "-pw" || arg == "--power")      { params.power      = true; }
+        else if (arg == "-hp" || arg == "--huge-pages") { params.cpu_hugepages = std::stoi(argv[++i]); }
         else {
             fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
             whisper_print_usage(argc, argv, params);
@@ -38,6 +121,27 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         }
     }
 
+    if (params.threads.empty()) {
+        params.threads.push_back(params.n_threads);
+    }
+    params.n_threads = params.threads[0];
+
+    // the ops are measured on all the backends unless the devices are given
+    if (params.what == 4 && !devices_set) {
+        params.devices = { "cpu", "gpu" };
+    }
+
+    if (!params.use_gpu) {
+        params.devices = { "cpu" };
+    }
+
+    for (const auto & device : params.devices) {
+        if (device != "cpu" && device != "gpu") {
+            fprintf(stderr, "error: unknown device: %s\n", device.c_str());
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -53,8 +157,32 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "                           %-7s  0 - whisper\n",                                 "");
     fprintf(stderr, "                           %-7s  1 - memcpy\n",                                  "");
     fprintf(stderr, "                           %-7s  2 - ggml_mul_mat\n",                            "");
+    fprintf(stderr, "                           %-7s  3 - whisper_full on the audio of -f\n",         "");
+    fprintf(stderr, "                           %-7s  4 - ggml ops at the shapes of the whisper models\n", "");
+    fprintf(stderr, "                           %-7s  5 - mel spectrogram\n",                         "");
+    fprintf(stderr, "                           %-7s  6 - VAD (speech probabilities of the model of -vm)\n", "");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  whisper_full (-w 3) - the lists are comma-separated, every combination is measured:\n");
+    fprintf(stderr, "  -t N,...,  --threads N,...   number of threads\n");
+    fprintf(stderr, "  -f FNAME,  --file FNAME      [%-7s] input audio file\n",                     params.fname_inp.c_str());
+    fprintf(stderr, "  -l LANG,   --language LANG   [%-7s] spoken language\n",                      params.language.c_str());
+    fprintf(stderr, "  -bs N,...  --beam-size N,... [%-7d] beam sizes (1 - greedy sampling)\n",     params.beam_sizes[0]);
+    fprintf(stderr, "  -d D,...   --devices D,...   [%-7s] backends: cpu, gpu\n",                   params.devices[0].c_str());
+    fprintf(stderr, "  -r N,      --runs N          [%-7d] number of runs of each combination\n",   params.n_runs);
+    fprintf(stderr, "  -oj FNAME, --output-json FNAME [%-5s] write the results as JSON ('-' for stdout)\n", params.fname_json.c_str());
+    fprintf(stderr, "  -pw,       --power           [%-7s] energy per second of audio (RAPL, NVML, hwmon, battery, powermetrics)\n", params.power ? "true" : "false");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  ggml ops (-w 4) - also uses -t, -d (default: cpu,gpu) and -oj:\n");
+    fprintf(stderr, "  -ms S,...  --model-sizes S,... [%-5s] model sizes: tiny, base, small, medium, large\n", params.model_sizes[0].c_str());
+    fprintf(stderr, "  -wt T,...  --wtypes T,...      [%-5s] types of the weights of the matrix multiplications\n", params.wtypes[0].c_str());
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  mel spectrogram (-w 5) and VAD (-w 6) - also use -t, -f (default: synthetic audio), -r, -ng and -oj:\n");
+    fprintf(stderr, "  -du S,...  --durations S,...   [%-5.0f] durations of the audio in seconds\n",            params.durations[0]);
+    fprintf(stderr, "  -vm FNAME, --vad-model FNAME   [%-5s] VAD model path\n",                                  params.vad_model.c_str());
+    fprintf(stderr, "\n");
     fprintf(stderr, "  -ng,      --no-gpu      [%-7s] disable GPU\n",                                 params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,      --flash-attn  [%-7s] enable flash attention\n",                      params.flash_attn ? "true" : "false");
+    fprintf(stderr, "  -hp N,    --huge-pages N [%-6d] CPU buffers on huge pages of N MB (2 or 1024, 0 - off)\n", params.cpu_hugepages);
     fprintf(stderr, "\n");
 }
 
@@ -66,6 +194,8 @@ static int whisper_bench_full(const whisper_params & params) {
     cparams.use_gpu    = params.use_gpu;
     cparams.flash_attn = params.flash_attn;
 
+    cparams.cpu_hugepages = params.cpu_hugepages;
+
     struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
 
     {
@@ -155,6 +285,1312 @@ static int whisper_bench_full(const whisper_params & params) {
     return 0;
 }
 
+// peak resident memory of the process, in bytes
+static size_t bench_peak_rss() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss*1024;
+#endif
+#endif
+}
+
+static std::string bench_json_escape(const std::string & str) {
+    std::string res;
+    for (const char c : str) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+        }
+        if ((unsigned char) c < 0x20) {
+            continue;
+        }
+        res += c;
+    }
+    return res;
+}
+
+static double bench_percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t i = std::min(values.size() - 1, (size_t) (p*(values.size() - 1) + 0.5));
+    return values[i];
+}
+
+static std::string bench_fmt(const char * fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return buf;
+}
+
+struct bench_full_energy {
+    std::string source;
+
+    double j_per_audio_s; // J per second of audio
+    double avg_w;         // average power during the runs
+};
+
+struct bench_full_result {
+    std::string device;
+    int n_threads;
+    int beam_size;
+
+    double rtf;
+    double tokens_per_s;
+    double window_p50_ms;
+    double window_p95_ms;
+    size_t peak_rss;
+
+    std::vector<bench_full_energy> energy;
+};
+
+// the latency of a 30 s window is the time between the start of its encoder and the start of the next one
+struct bench_windows {
+    std::chrono::steady_clock::time_point t_last;
+    std::vector<double> ms;
+    bool started = false;
+};
+
+static bool bench_encoder_begin(struct whisper_context * /*ctx*/, struct whisper_state * /*state*/, void * user_data) {
+    bench_windows * windows = (bench_windows *) user_data;
+
+    const auto t_now = std::chrono::steady_clock::now();
+    if (windows->started) {
+        windows->ms.push_back(std::chrono::duration<double, std::milli>(t_now - windows->t_last).count());
+    }
+    windows->t_last  = t_now;
+    windows->started = true;
+
+    return true;
+}
+
+// energy of the runs of -w 3 (-pw), from the power interfaces of the platform that can be read:
+//
+//   rapl         - the energy counters of the CPU packages in /sys/class/powercap/intel-rapl:N (Linux, x86, often
+//                  readable only by root)
+//   nvml         - the energy counters of the NVIDIA GPUs, or their power (libnvidia-ml is loaded at run time)
+//   hwmon        - the power sensors of /sys/class/hwmon: power*_input, or the voltage and current of the INA3221
+//                  rails of the Jetson boards (the rails of tegrastats), and the ina3221x rails of the older L4T kernels
+//   battery      - the power drawn from the batteries of /sys/class/power_supply while discharging (phones, laptops)
+//   powermetrics - the combined power of the CPU, GPU and ANE of Apple silicon (macOS, as root)
+//
+// The counters are read and the power is integrated every 50 ms by a thread, from the start to the end of the runs.
+// The energy is the one of the whole device seen by each source, not only of this process.
+struct bench_power_source {
+    std::string name;
+
+    bool   counter = false; // read() returns an energy counter in J, else a power in W
+    double range   = 0.0;   // the counter wraps around after range J (0 - never)
+
+    std::function<bool(double &)> read;
+
+    // measurement
+    double last   = 0.0;
+    double energy = 0.0; // J
+};
+
+static bool bench_read_number(const std::string & fname, double & value) {
+    FILE * f = fopen(fname.c_str(), "r");
+    if (f == nullptr) {
+        return false;
+    }
+    const bool ok = fscanf(f, "%lf", &value) == 1;
+    fclose(f);
+    return ok;
+}
+
+static std::string bench_read_line(const std::string & fname) {
+    char buf[256] = { 0 };
+    FILE * f = fopen(fname.c_str(), "r");
+    if (f == nullptr) {
+        return "";
+    }
+    if (fgets(buf, sizeof(buf), f) == nullptr) {
+        buf[0] = 0;
+    }
+    fclose(f);
+    std::string res = buf;
+    while (!res.empty() && (res.back() == '\n' || res.back() == ' ')) {
+        res.pop_back();
+    }
+    return res;
+}
+
+#if defined(__linux__)
+static std::vector<std::string> bench_glob(const std::string & pattern) {
+    std::vector<std::string> res;
+    glob_t g;
+    if (glob(pattern.c_str(), 0, nullptr, &g) == 0) {
+        for (size_t i = 0; i < g.gl_pathc; ++i) {
+            res.push_back(g.gl_pathv[i]);
+        }
+    }
+    globfree(&g);
+    return res;
+}
+
+// the subset of the NVML API that is used, resolved with dlopen() so that the bench does not depend on the driver
+struct bench_nvml {
+    typedef int (*init_t)(void);
+    typedef int (*count_t)(unsigned int *);
+    typedef int (*handle_t)(unsigned int, void **);
+    typedef int (*energy_t)(void *, unsigned long long *);
+    typedef int (*power_t)(void *, unsigned int *);
+
+    void *   lib    = nullptr;
+    energy_t energy = nullptr;
+    power_t  power  = nullptr;
+
+    std::vector<void *> devices;
+
+    bench_nvml() {
+        lib = dlopen("libnvidia-ml.so.1", RTLD_NOW);
+        if (lib == nullptr) {
+            return;
+        }
+
+        init_t   init   = (init_t)   dlsym(lib, "nvmlInit_v2");
+        count_t  count  = (count_t)  dlsym(lib, "nvmlDeviceGetCount_v2");
+        handle_t handle = (handle_t) dlsym(lib, "nvmlDeviceGetHandleByIndex_v2");
+
+        energy = (energy_t) dlsym(lib, "nvmlDeviceGetTotalEnergyConsumption");
+        power  = (power_t)  dlsym(lib, "nvmlDeviceGetPowerUsage");
+
+        unsigned int n = 0;
+        if (!init || !count || !handle || init() != 0 || count(&n) != 0) {
+            return;
+        }
+
+        for (unsigned int i = 0; i < n; ++i) {
+            void * dev = nullptr;
+            if (handle(i, &dev) == 0) {
+                devices.push_back(dev);
+            }
+        }
+    }
+};
+#endif
+
+static std::vector<bench_power_source> bench_power_sources() {
+    std::vector<bench_power_source> res;
+
+#if defined(__linux__)
+    // the packages, not their sub-zones (core, uncore, dram), which are included in them
+    for (const auto & dir : bench_glob("/sys/class/powercap/intel-rapl:[0-9]")) {
+        double value = 0.0;
+        if (!bench_read_number(dir + "/energy_uj", value)) {
+            continue;
+        }
+
+        bench_power_source src;
+        src.name    = "rapl:" + bench_read_line(dir + "/name");
+        src.counter = true;
+        if (bench_read_number(dir + "/max_energy_range_uj", src.range)) {
+            src.range *= 1e-6;
+        }
+        const std::string fname = dir + "/energy_uj";
+        src.read = [fname](double & v) {
+            if (!bench_read_number(fname, v)) {
+                return false;
+            }
+            v *= 1e-6;
+            return true;
+        };
+        res.push_back(src);
+    }
+
+    static bench_nvml nvml;
+    for (size_t i = 0; i < nvml.devices.size(); ++i) {
+        void * dev = nvml.devices[i];
+
+        bench_power_source src;
+        src.name = "nvml:" + std::to_string(i);
+
+        unsigned long long mj = 0;
+        if (nvml.energy && nvml.energy(dev, &mj) == 0) {
+            src.counter = true;
+            src.read = [dev](double & v) {
+                unsigned long long mj = 0;
+                if (nvml.energy(dev, &mj) != 0) {
+                    return false;
+                }
+                v = 1e-3*mj;
+                return true;
+            };
+        } else if (nvml.power) {
+            src.read = [dev](double & v) {
+                unsigned int mw = 0;
+                if (nvml.power(dev, &mw) != 0) {
+                    return false;
+                }
+                v = 1e-3*mw;
+                return true;
+            };
+        } else {
+            continue;
+        }
+        res.push_back(src);
+    }
+
+    for (const auto & dir : bench_glob("/sys/class/hwmon/hwmon*")) {
+        const std::string name = bench_read_line(dir + "/name");
+
+        for (const auto & fname : bench_glob(dir + "/power*_input")) {
+            const std::string sensor = fname.substr(dir.size() + 1, fname.size() - dir.size() - 1 - strlen("_input"));
+            const std::string label  = bench_read_line(dir + "/" + sensor + "_label");
+
+            bench_power_source src;
+            src.name = "hwmon:" + name + ":" + (label.empty() ? sensor : label);
+            src.read = [fname](double & v) {
+                if (!bench_read_number(fname, v)) {
+                    return false;
+                }
+                v *= 1e-6;
+                return true;
+            };
+            res.push_back(src);
+        }
+
+        // the INA3221 rails report their voltage (mV) and their current (mA)
+        if (name != "ina3221") {
+            continue;
+        }
+        for (const auto & fname : bench_glob(dir + "/curr*_input")) {
+            const std::string ch   = fname.substr(dir.size() + 1 + strlen("curr"), fname.size() - dir.size() - 1 - strlen("curr") - strlen("_input"));
+            const std::string volt = dir + "/in" + ch + "_input";
+            const std::string label = bench_read_line(dir + "/in" + ch + "_label");
+
+            bench_power_source src;
+            src.name = "hwmon:" + name + ":" + (label.empty() ? "rail" + ch : label);
+            src.read = [fname, volt](double & v) {
+                double mv = 0.0;
+                double ma = 0.0;
+                if (!bench_read_number(volt, mv) || !bench_read_number(fname, ma)) {
+                    return false;
+                }
+                v = 1e-6*mv*ma;
+                return true;
+            };
+            res.push_back(src);
+        }
+    }
+
+    for (const auto & fname : bench_glob("/sys/bus/i2c/drivers/ina3221x/*/iio:device*/in_power*_input")) {
+        const std::string dir = fname.substr(0, fname.rfind('/'));
+        const std::string ch  = fname.substr(fname.rfind("in_power") + strlen("in_power"), 1);
+
+        bench_power_source src;
+        src.name = "hwmon:ina3221x:" + bench_read_line(dir + "/rail_name_" + ch);
+        src.read = [fname](double & v) {
+            if (!bench_read_number(fname, v)) {
+                return false;
+            }
+            v *= 1e-3;
+            return true;
+        };
+        res.push_back(src);
+    }
+
+    for (const auto & dir : bench_glob("/sys/class/power_supply/*")) {
+        if (bench_read_line(dir + "/type") != "Battery") {
+            continue;
+        }
+
+        bench_power_source src;
+        src.name = "battery:" + dir.substr(dir.rfind('/') + 1);
+        src.read = [dir](double & v) {
+            if (bench_read_line(dir + "/status") != "Discharging") {
+                v = 0.0;
+                return true;
+            }
+            double uw = 0.0;
+            if (bench_read_number(dir + "/power_now", uw)) {
+                v = 1e-6*std::fabs(uw);
+                return true;
+            }
+            double uv = 0.0;
+            double ua = 0.0;
+            if (!bench_read_number(dir + "/voltage_now", uv) || !bench_read_number(dir + "/current_now", ua)) {
+                return false;
+            }
+            v = 1e-12*uv*std::fabs(ua);
+            return true;
+        };
+        res.push_back(src);
+    }
+#endif
+
+    // the sources that cannot be read are dropped
+    std::vector<bench_power_source> valid;
+    for (auto & src : res) {
+        double v = 0.0;
+        if (src.read(v)) {
+            valid.push_back(src);
+        }
+    }
+
+    return valid;
+}
+
+struct bench_energy {
+    std::vector<bench_power_source> sources;
+
+    double t_ms = 0.0; // duration of the measurement
+
+    std::thread             worker;
+    std::mutex              mutex;
+    std::condition_variable cv;
+    bool                    stopping = false;
+
+#if defined(__APPLE__)
+    // powermetrics runs in a child process for the duration of the measurement, and prints the combined power of
+    // each interval of 100 ms, which is read by a thread
+    pid_t       pm_pid = -1;
+    std::thread pm_reader;
+    double      pm_energy = 0.0; // J
+    int         pm_n      = 0;
+#endif
+
+    void start() {
+        for (auto & src : sources) {
+            src.energy = 0.0;
+            src.read(src.last);
+        }
+
+        stopping = false;
+
+        const auto t_start = std::chrono::steady_clock::now();
+
+        worker = std::thread([this, t_start]() {
+            auto t_last = t_start;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                const bool stop = cv.wait_for(lock, std::chrono::milliseconds(50), [this]() { return stopping; });
+
+                const auto   t_now = std::chrono::steady_clock::now();
+                const double dt    = std::chrono::duration<double>(t_now - t_last).count();
+
+                for (auto & src : sources) {
+                    double v = 0.0;
+                    if (!src.read(v)) {
+                        continue;
+                    }
+                    if (src.counter) {
+                        double d = v - src.last;
+                        if (d < 0.0 && src.range > 0.0) {
+                            d += src.range;
+                        }
+                        src.energy += std::max(0.0, d);
+                    } else {
+                        src.energy += 0.5*(v + src.last)*dt;
+                    }
+                    src.last = v;
+                }
+
+                t_last = t_now;
+
+                if (stop) {
+                    break;
+                }
+            }
+
+            t_ms = std::chrono::duration<double, std::milli>(t_last - t_start).count();
+        });
+
+#if defined(__APPLE__)
+        bench_powermetrics_start();
+#endif
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+
+#if defined(__APPLE__)
+        bench_powermetrics_stop();
+#endif
+    }
+
+#if defined(__APPLE__)
+    void bench_powermetrics_start() {
+        pm_pid    = -1;
+        pm_energy = 0.0;
+        pm_n      = 0;
+
+        if (geteuid() != 0) {
+            return;
+        }
+
+        int fd[2];
+        if (pipe(fd) != 0) {
+            return;
+        }
+
+        pm_pid = fork();
+        if (pm_pid == 0) {
+            dup2(fd[1], STDOUT_FILENO);
+            close(fd[0]);
+            close(fd[1]);
+            execlp("powermetrics", "powermetrics", "--samplers", "cpu_power,gpu_power,ane_power", "-i", "100", (char *) nullptr);
+            _exit(127);
+        }
+
+        close(fd[1]);
+        if (pm_pid < 0) {
+            close(fd[0]);
+            return;
+        }
+
+        pm_reader = std::thread([this, fd]() {
+            FILE * f = fdopen(fd[0], "r");
+            if (f == nullptr) {
+                close(fd[0]);
+                return;
+            }
+
+            char line[512];
+            while (fgets(line, sizeof(line), f)) {
+                const char * p = strstr(line, "Combined Power");
+                p = p ? strchr(p, ':') : nullptr;
+                if (p) {
+                    pm_energy += 1e-3*atof(p + 1)*0.1;
+                    pm_n++;
+                }
+            }
+            fclose(f);
+        });
+    }
+
+    void bench_powermetrics_stop() {
+        if (pm_pid <= 0) {
+            return;
+        }
+
+        kill(pm_pid, SIGINT);
+        waitpid(pm_pid, nullptr, 0);
+        pm_reader.join();
+        pm_pid = -1;
+
+        if (pm_n == 0) {
+            return;
+        }
+
+        for (auto & src : sources) {
+            if (src.name == "powermetrics") {
+                src.energy = pm_energy;
+                return;
+            }
+        }
+
+        bench_power_source src;
+        src.name   = "powermetrics";
+        src.read   = [](double &) { return false; };
+        src.energy = pm_energy;
+        sources.push_back(src);
+    }
+#endif
+};
+
+static int whisper_bench_pipeline(const whisper_params & params) {
+    if (params.fname_inp.empty()) {
+        fprintf(stderr, "error: -w 3 requires an input audio file (-f)\n");
+        return 1;
+    }
+
+    std::vector<float> pcmf32;
+    std::vector<std::vector<float>> pcmf32s;
+
+    if (!::read_audio_data(params.fname_inp, pcmf32, pcmf32s, false)) {
+        fprintf(stderr, "error: failed to read audio file '%s'\n", params.fname_inp.c_str());
+        return 2;
+    }
+
+    const double audio_s = (double) pcmf32.size()/WHISPER_SAMPLE_RATE;
+
+    bench_energy energy;
+    if (params.power) {
+        energy.sources = bench_power_sources();
+
+        fprintf(stderr, "%s: power sources:", __func__);
+        for (const auto & src : energy.sources) {
+            fprintf(stderr, " %s", src.name.c_str());
+        }
+#if defined(__APPLE__)
+        fprintf(stderr, "%s", geteuid() == 0 ? " powermetrics" : "");
+#endif
+        fprintf(stderr, "%s\n", energy.sources.empty() ? " none" : "");
+    }
+
+    std::vector<bench_full_result> results;
+
+    for (const auto & device : params.devices) {
+        struct whisper_context_params cparams = whisper_context_default_params();
+
+        cparams.use_gpu    = device == "gpu";
+        cparams.flash_attn = params.flash_attn;
+
+        cparams.cpu_hugepages = params.cpu_hugepages;
+
+        struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+        if (ctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize whisper context\n");
+            return 2;
+        }
+
+        for (const int n_threads : params.threads) {
+            for (const int beam_size : params.beam_sizes) {
+                whisper_full_params wparams = whisper_full_default_params(beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+
+                wparams.n_threads             = n_threads;
+                wparams.language              = params.language.c_str();
+                wparams.beam_search.beam_size = beam_size;
+                wparams.print_progress        = false;
+                wparams.print_realtime        = false;
+                wparams.print_timestamps      = false;
+
+                bench_windows windows;
+
+                wparams.encoder_begin_callback           = bench_encoder_begin;
+                wparams.encoder_begin_callback_user_data = &windows;
+
+                // warm-up
+                if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+                    fprintf(stderr, "error: failed to process audio\n");
+                    whisper_free(ctx);
+                    return 4;
+                }
+
+                double t_total_ms = 0.0;
+                int n_tokens = 0;
+
+                windows.ms.clear();
+
+                if (params.power) {
+                    energy.start();
+                }
+
+                for (int r = 0; r < params.n_runs; ++r) {
+                    windows.started = false;
+
+                    const auto t_start = std::chrono::steady_clock::now();
+
+                    if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+                        fprintf(stderr, "error: failed to process audio\n");
+                        whisper_free(ctx);
+                        return 4;
+                    }
+
+                    const auto t_end = std::chrono::steady_clock::now();
+
+                    // the last window ends with whisper_full()
+                    bench_encoder_begin(ctx, nullptr, &windows);
+
+                    t_total_ms += std::chrono::duration<double, std::milli>(t_end - t_start).count();
+
+                    for (int i = 0; i < whisper_full_n_segments(ctx); ++i) {
+                        n_tokens += whisper_full_n_tokens(ctx, i);
+                    }
+                }
+
+                if (params.power) {
+                    energy.stop();
+                }
+
+                bench_full_result res;
+
+                res.device        = device;
+                res.n_threads     = n_threads;
+                res.beam_size     = beam_size;
+                res.rtf           = t_total_ms/(1e3*audio_s*std::max(1, params.n_runs));
+                res.tokens_per_s  = t_total_ms > 0.0 ? 1e3*n_tokens/t_total_ms : 0.0;
+                res.window_p50_ms = bench_percentile(windows.ms, 0.50);
+                res.window_p95_ms = bench_percentile(windows.ms, 0.95);
+                res.peak_rss      = bench_peak_rss();
+
+                if (params.power) {
+                    for (const auto & src : energy.sources) {
+                        bench_full_energy e;
+                        e.source        = src.name;
+                        e.j_per_audio_s = src.energy/(audio_s*std::max(1, params.n_runs));
+                        e.avg_w         = energy.t_ms > 0.0 ? 1e3*src.energy/energy.t_ms : 0.0;
+                        res.energy.push_back(e);
+                    }
+                }
+
+                fprintf(stderr, "%s: device = %s, threads = %2d, beam = %d | RTF = %6.3f | %8.2f tokens/s | window p50 = %8.2f ms, p95 = %8.2f ms | peak RSS = %7.1f MB\n",
+                        __func__, device.c_str(), n_threads, beam_size, res.rtf, res.tokens_per_s,
+                        res.window_p50_ms, res.window_p95_ms, res.peak_rss/1024.0/1024.0);
+
+                for (const auto & e : res.energy) {
+                    fprintf(stderr, "%s:   %-32s | %8.3f J per second of audio | %7.2f W\n", __func__, e.source.c_str(), e.j_per_audio_s, e.avg_w);
+                }
+
+                results.push_back(res);
+            }
+        }
+
+        whisper_free(ctx);
+    }
+
+    if (!params.fname_json.empty()) {
+        FILE * fout = params.fname_json == "-" ? stdout : fopen(params.fname_json.c_str(), "w");
+        if (fout == nullptr) {
+            fprintf(stderr, "error: failed to open '%s' for writing\n", params.fname_json.c_str());
+            return 5;
+        }
+
+        fprintf(fout, "{\n");
+        fprintf(fout, "  \"model\": \"%s\",\n", bench_json_escape(params.model).c_str());
+        fprintf(fout, "  \"audio\": \"%s\",\n", bench_json_escape(params.fname_inp).c_str());
+        fprintf(fout, "  \"audio_s\": %.3f,\n", audio_s);
+        fprintf(fout, "  \"runs\": %d,\n", params.n_runs);
+        fprintf(fout, "  \"system_info\": \"%s\",\n", whisper_print_system_info());
+        fprintf(fout, "  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto & res = results[i];
+            std::string energy_json;
+            for (size_t j = 0; j < res.energy.size(); ++j) {
+                energy_json += bench_fmt("%s{\"source\": \"%s\", \"j_per_audio_s\": %.5f, \"avg_w\": %.3f}", j > 0 ? ", " : "",
+                        bench_json_escape(res.energy[j].source).c_str(), res.energy[j].j_per_audio_s, res.energy[j].avg_w);
+            }
+            fprintf(fout, "    {\"device\": \"%s\", \"threads\": %d, \"beam_size\": %d, \"rtf\": %.5f, \"tokens_per_s\": %.3f, "
+                          "\"window_p50_ms\": %.3f, \"window_p95_ms\": %.3f, \"peak_rss_bytes\": %zu, \"energy\": [%s]}%s\n",
+                    res.device.c_str(), res.n_threads, res.beam_size, res.rtf, res.tokens_per_s,
+                    res.window_p50_ms, res.window_p95_ms, res.peak_rss, energy_json.c_str(), i + 1 < results.size() ? "," : "");
+        }
+        fprintf(fout, "  ]\n");
+        fprintf(fout, "}\n");
+
+        if (fout != stdout) {
+            fclose(fout);
+        }
+    }
+
+    return 0;
+}
+
+// ggml ops at the shapes of the whisper models (-w 4)
+//
+// Each op of the encoder and decoder graphs is computed alone on each backend, with random data, for each model size.
+// The matrix multiplications of the weights are measured for each type of -wt, the other ops with the types that
+// whisper uses for them. The conv kernels and the KV caches are F16, and the decoder attends 256 cells of its cache.
+
+struct bench_op_model {
+    const char * name;
+    int n_state;
+    int n_head;
+};
+
+static const bench_op_model bench_op_models[] = {
+    { "tiny",    384,  6 },
+    { "base",    512,  8 },
+    { "small",   768, 12 },
+    { "medium", 1024, 16 },
+    { "large",  1280, 20 },
+};
+
+struct bench_op_case {
+    std::string op;
+    std::string shape;
+    std::string type;
+    double flops; // 0 - memory bound, only the bandwidth is reported
+
+    std::function<ggml_tensor * (ggml_context *)> build;
+};
+
+struct bench_op_result {
+    std::string backend;
+    std::string model;
+    std::string op;
+    std::string shape;
+    std::string type;
+
+    bool   supported;
+    int    n_runs;
+    double us;    // per run
+    double flops;
+    double bytes; // inputs and output
+};
+
+static std::vector<bench_op_case> bench_op_cases(const bench_op_model & model, const std::vector<ggml_type> & wtypes) {
+    const int64_t n_state = model.n_state;
+    const int64_t n_head  = model.n_head;
+    const int64_t d_head  = n_state/n_head;
+
+    const int64_t n_mels   = 80;
+    const int64_t n_frames = 3000;
+    const int64_t n_ctx    = 1500;
+    const int64_t n_ctx_fa = GGML_PAD(n_ctx, 256); // the encoder pads its KV for flash attention
+    const int64_t n_kv     = 256;                  // decoder self-attention
+    const int64_t n_vocab  = 51865;
+
+    std::vector<bench_op_case> res;
+
+    // encoder stem
+    res.push_back({ "conv_1d_ph", bench_fmt("3x%dx%d * %dx%d, s=1", (int) n_mels, (int) n_state, (int) n_frames, (int) n_mels), "f16",
+        2.0*3*n_mels*n_state*n_frames,
+        [=](ggml_context * ctx) {
+            ggml_tensor * w = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, 3, n_mels, n_state);
+            ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_frames, n_mels);
+            return ggml_conv_1d_ph(ctx, w, x, 1, 1);
+        } });
+    res.push_back({ "conv_1d_ph", bench_fmt("3x%dx%d * %dx%d, s=2", (int) n_state, (int) n_state, (int) n_frames, (int) n_state), "f16",
+        2.0*3*n_state*n_state*n_ctx,
+        [=](ggml_context * ctx) {
+            ggml_tensor * w = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, 3, n_state, n_state);
+            ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_frames, n_state);
+            return ggml_conv_1d_ph(ctx, w, x, 2, 1);
+        } });
+
+    // encoder layer
+    res.push_back({ "norm", bench_fmt("%dx%d", (int) n_state, (int) n_ctx), "f32", 0.0,
+        [=](ggml_context * ctx) {
+            return ggml_norm(ctx, ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_state, n_ctx), 1e-5f);
+        } });
+    res.push_back({ "norm_affine", bench_fmt("%dx%d", (int) n_state, (int) n_ctx), "f32", 0.0,
+        [=](ggml_context * ctx) {
+            ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_state, n_ctx);
+            ggml_tensor * w = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n_state);
+            ggml_tensor * b = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n_state);
+            return ggml_norm_affine(ctx, x, w, b, 1e-5f);
+        } });
+    res.push_back({ "soft_max_ext", bench_fmt("%dx%dx%d", (int) n_ctx, (int) n_ctx, (int) n_head), "f32", 0.0,
+        [=](ggml_context * ctx) {
+            ggml_tensor * kq = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, n_ctx, n_ctx, n_head);
+            return ggml_soft_max_ext(ctx, kq, nullptr, 1.0f/sqrtf(float(d_head)), 0.0f);
+        } });
+    res.push_back({ "flash_attn_ext", bench_fmt("%dx%dx%d, kv %d", (int) d_head, (int) n_ctx, (int) n_head, (int) n_ctx_fa), "f16",
+        4.0*d_head*n_ctx*n_ctx_fa*n_head,
+        [=](ggml_context * ctx) {
+            ggml_tensor * q = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, d_head, n_ctx,    n_head);
+            ggml_tensor * k = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, d_head, n_ctx_fa, n_head);
+            ggml_tensor * v = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, d_head, n_ctx_fa, n_head);
+            ggml_tensor * m = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, n_ctx_fa, GGML_PAD(n_ctx, GGML_KQ_MASK_PAD));
+            return ggml_flash_attn_ext(ctx, q, k, v, m, 1.0f/sqrtf(float(d_head)), 0.0f, 0.0f);
+        } });
+    res.push_back({ "gelu", bench_fmt("%dx%d", (int) (4*n_state), (int) n_ctx), "f32", 0.0,
+        [=](ggml_context * ctx) {
+            return ggml_gelu(ctx, ggml_new_tensor_2d(ctx, GGML_TYPE_F32, 4*n_state, n_ctx));
+        } });
+    res.push_back({ "cpy", bench_fmt("%dx%d -> cross KV", (int) n_state, (int) n_ctx), "f32 -> f16", 0.0,
+        [=](ggml_context * ctx) {
+            ggml_tensor * cur = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n_state*n_ctx);
+            ggml_tensor * kv  = ggml_new_tensor_1d(ctx, GGML_TYPE_F16, 2*n_state*n_ctx);
+            return ggml_cpy(ctx, cur, ggml_view_1d(ctx, kv, n_state*n_ctx, ggml_row_size(kv->type, n_state*n_ctx)));
+        } });
+
+    // decoder, one token
+    res.push_back({ "soft_max_ext", bench_fmt("%dx1x%d, mask", (int) n_kv, (int) n_head), "f32", 0.0,
+        [=](ggml_context * ctx) {
+            ggml_tensor * kq = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, n_kv, 1, n_head);
+            ggml_tensor * m  = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, n_kv, GGML_KQ_MASK_PAD);
+            return ggml_soft_max_ext(ctx, kq, m, 1.0f/sqrtf(float(d_head)), 0.0f);
+        } });
+    res.push_back({ "flash_attn_ext", bench_fmt("%dx1x%d, kv %d", (int) d_head, (int) n_head, (int) n_kv), "f16",
+        4.0*d_head*n_kv*n_head,
+        [=](ggml_context * ctx) {
+            ggml_tensor * q = ggml_new_tensor_3d(ctx, GGML_TYPE_F32, d_head, 1,    n_head);
+            ggml_tensor * k = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, d_head, n_kv, n_head);
+            ggml_tensor * v = ggml_new_tensor_3d(ctx, GGML_TYPE_F16, d_head, n_kv, n_head);
+            ggml_tensor * m = ggml_new_tensor_2d(ctx, GGML_TYPE_F16, n_kv, GGML_KQ_MASK_PAD);
+            return ggml_flash_attn_ext(ctx, q, k, v, m, 1.0f/sqrtf(float(d_head)), 0.0f, 0.0f);
+        } });
+    res.push_back({ "cpy", bench_fmt("%dx1 -> KV", (int) n_state), "f32 -> f16", 0.0,
+        [=](ggml_context * ctx) {
+            ggml_tensor * cur = ggml_new_tensor_1d(ctx, GGML_TYPE_F32, n_state);
+            ggml_tensor * kv  = ggml_new_tensor_1d(ctx, GGML_TYPE_F16, n_state*448);
+            return ggml_cpy(ctx, cur, ggml_view_1d(ctx, kv, n_state, ggml_row_size(kv->type, n_state*n_kv)));
+        } });
+
+    // the matrix multiplications of the weights: [ne00 x ne01] * [ne00 x n_tokens]
+    struct mul_mat_shape {
+        const char * name;
+        int64_t ne00;
+        int64_t ne01;
+        int64_t n_tokens;
+    };
+
+    const mul_mat_shape shapes[] = {
+        { "attn",    n_state,   n_state, n_ctx },
+        { "mlp up",  n_state, 4*n_state, n_ctx },
+        { "mlp down", 4*n_state, n_state, n_ctx },
+        { "attn",    n_state,   n_state, 1 },
+        { "mlp up",  n_state, 4*n_state, 1 },
+        { "logits",  n_state,   n_vocab, 1 },
+    };
+
+    for (const auto & shape : shapes) {
+        for (const ggml_type wtype : wtypes) {
+            const int64_t ne00     = shape.ne00;
+            const int64_t ne01     = shape.ne01;
+            const int64_t n_tokens = shape.n_tokens;
+
+            res.push_back({ "mul_mat", bench_fmt("%s %dx%d * %dx%d", shape.name, (int) ne00, (int) ne01, (int) ne00, (int) n_tokens),
+                ggml_type_name(wtype), 2.0*ne00*ne01*n_tokens,
+                [=](ggml_context * ctx) {
+                    ggml_tensor * w = ggml_new_tensor_2d(ctx, wtype,         ne00, ne01);
+                    ggml_tensor * x = ggml_new_tensor_2d(ctx, GGML_TYPE_F32, ne00, n_tokens);
+                    return ggml_mul_mat(ctx, w, x);
+                } });
+        }
+    }
+
+    return res;
+}
+
+// uniform random values in [-1, 1), converted to the type of the tensor
+static void bench_op_fill(ggml_tensor * t, uint32_t & seed) {
+    const int64_t n = ggml_nelements(t);
+
+    std::vector<float> data(n);
+    for (int64_t i = 0; i < n; ++i) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        data[i] = (seed >> 8)*(2.0f/16777216.0f) - 1.0f;
+    }
+
+    std::vector<uint8_t> buf(ggml_nbytes(t));
+
+    switch (t->type) {
+        case GGML_TYPE_F32:
+            memcpy(buf.data(), data.data(), buf.size());
+            break;
+        case GGML_TYPE_F16:
+            ggml_fp32_to_fp16_row(data.data(), (ggml_fp16_t *) buf.data(), n);
+            break;
+        default:
+            ggml_quantize_chunk(t->type, data.data(), buf.data(), 0, n/t->ne[0], t->ne[0], nullptr);
+            break;
+    }
+
+    ggml_backend_tensor_set(t, buf.data(), 0, buf.size());
+}
+
+static bench_op_result bench_op_run(ggml_backend_t backend, const bench_op_case & c) {
+    bench_op_result res;
+
+    res.op        = c.op;
+    res.shape     = c.shape;
+    res.type      = c.type;
+    res.supported = false;
+    res.n_runs    = 0;
+    res.us        = 0.0;
+    res.flops     = c.flops;
+    res.bytes     = 0.0;
+
+    struct ggml_init_params iparams = {
+        /*.mem_size   =*/ 32*ggml_tensor_overhead() + ggml_graph_overhead(),
+        /*.mem_buffer =*/ nullptr,
+        /*.no_alloc   =*/ true,
+    };
+
+    ggml_context * ctx = ggml_init(iparams);
+
+    ggml_tensor * out = c.build(ctx);
+
+    ggml_cgraph * gf = ggml_new_graph(ctx);
+    ggml_build_forward_expand(gf, out);
+
+    for (int i = 0; i < ggml_graph_n_nodes(gf); ++i) {
+        if (!ggml_backend_supports_op(backend, ggml_graph_node(gf, i))) {
+            ggml_free(ctx);
+            return res;
+        }
+    }
+
+    ggml_backend_buffer_t buf = ggml_backend_alloc_ctx_tensors(ctx, backend);
+    if (buf == nullptr) {
+        ggml_free(ctx);
+        return res;
+    }
+
+    uint32_t seed = 12345;
+    for (ggml_tensor * t = ggml_get_first_tensor(ctx); t != nullptr; t = ggml_get_next_tensor(ctx, t)) {
+        if (t->op == GGML_OP_NONE && t->view_src == nullptr) {
+            bench_op_fill(t, seed);
+            res.bytes += ggml_nbytes(t);
+        }
+    }
+    res.bytes += ggml_nbytes(out);
+
+    // warm-up
+    ggml_backend_graph_compute(backend, gf);
+
+    // at least 3 runs and 0.25 s
+    double t_sum_us = 0.0;
+    while (res.n_runs < 3 || (t_sum_us < 250e3 && res.n_runs < 1000)) {
+        const int64_t t0 = ggml_time_us();
+
+        ggml_backend_graph_compute(backend, gf);
+
+        t_sum_us += ggml_time_us() - t0;
+        res.n_runs++;
+    }
+
+    res.supported = true;
+    res.us        = t_sum_us/res.n_runs;
+
+    ggml_backend_buffer_free(buf);
+    ggml_free(ctx);
+
+    return res;
+}
+
+static int whisper_bench_ops(const whisper_params & params) {
+    ggml_time_init();
+#ifdef GGML_BACKEND_DL
+    ggml_backend_load_all();
+#endif
+
+    std::vector<ggml_type> wtypes;
+    for (const auto & name : params.wtypes) {
+        ggml_type wtype = GGML_TYPE_COUNT;
+        for (int t = 0; t < GGML_TYPE_COUNT; ++t) {
+            if (ggml_get_type_traits((ggml_type) t)->blck_size != 0 && name == ggml_type_name((ggml_type) t)) {
+                wtype = (ggml_type) t;
+            }
+        }
+        if (wtype == GGML_TYPE_COUNT) {
+            fprintf(stderr, "error: unknown type: %s\n", name.c_str());
+            return 1;
+        }
+        wtypes.push_back(wtype);
+    }
+
+    std::vector<const bench_op_model *> models;
+    for (const auto & name : params.model_sizes) {
+        const bench_op_model * model = nullptr;
+        for (const auto & m : bench_op_models) {
+            if (name == m.name) {
+                model = &m;
+            }
+        }
+        if (model == nullptr) {
+            fprintf(stderr, "error: unknown model size: %s\n", name.c_str());
+            return 1;
+        }
+        models.push_back(model);
+    }
+
+    std::vector<bench_op_result> results;
+
+    printf("| %-8s | %-6s | %-14s | %-34s | %-10s | %10s | %5s | %9s | %8s |\n",
+            "backend", "model", "op", "shape", "type", "us/run", "runs", "GFLOPS", "GB/s");
+    printf("| %s | %s | %s | %s | %s | %s | %s | %s | %s |\n",
+            std::string(8, '-').c_str(), std::string(6, '-').c_str(), std::string(14, '-').c_str(),
+            std::string(34, '-').c_str(), std::string(10, '-').c_str(), std::string(10, '-').c_str(),
+            std::string(5, '-').c_str(), std::string(9, '-').c_str(), std::string(8, '-').c_str());
+
+    for (size_t i = 0; i < ggml_backend_dev_count(); ++i) {
+        ggml_backend_dev_t dev = ggml_backend_dev_get(i);
+
+        const auto dev_type = ggml_backend_dev_type(dev);
+        if (dev_type == GGML_BACKEND_DEVICE_TYPE_ACCEL) {
+            continue;
+        }
+
+        const std::string device = dev_type == GGML_BACKEND_DEVICE_TYPE_CPU ? "cpu" : "gpu";
+        if (std::find(params.devices.begin(), params.devices.end(), device) == params.devices.end()) {
+            continue;
+        }
+
+        ggml_backend_t backend = ggml_backend_dev_init(dev, nullptr);
+        if (backend == nullptr) {
+            fprintf(stderr, "error: failed to initialize the backend %s\n", ggml_backend_dev_name(dev));
+            return 2;
+        }
+
+        ggml_backend_reg_t reg = ggml_backend_dev_backend_reg(dev);
+
+        auto * fn_set_n_threads = (ggml_backend_set_n_threads_t) ggml_backend_reg_get_proc_address(reg, "ggml_backend_set_n_threads");
+        if (fn_set_n_threads) {
+            fn_set_n_threads(backend, params.n_threads);
+        }
+
+        for (const auto * model : models) {
+            for (const auto & c : bench_op_cases(*model, wtypes)) {
+                bench_op_result res = bench_op_run(backend, c);
+
+                res.backend = ggml_backend_dev_name(dev);
+                res.model   = model->name;
+
+                if (res.supported) {
+                    printf("| %-8s | %-6s | %-14s | %-34s | %-10s | %10.2f | %5d | %9s | %8.2f |\n",
+                            res.backend.c_str(), res.model.c_str(), res.op.c_str(), res.shape.c_str(), res.type.c_str(),
+                            res.us, res.n_runs, res.flops > 0.0 ? bench_fmt("%.1f", 1e-3*res.flops/res.us).c_str() : "",
+                            1e-3*res.bytes/res.us);
+                } else {
+                    printf("| %-8s | %-6s | %-14s | %-34s | %-10s | %10s | %5s | %9s | %8s |\n",
+                            res.backend.c_str(), res.model.c_str(), res.op.c_str(), res.shape.c_str(), res.type.c_str(),
+                            "n/a", "", "", "");
+                }
+                fflush(stdout);
+
+                results.push_back(res);
+            }
+        }
+
+        ggml_backend_free(backend);
+    }
+
+    if (!params.fname_json.empty()) {
+        FILE * fout = params.fname_json == "-" ? stdout : fopen(params.fname_json.c_str(), "w");
+        if (fout == nullptr) {
+            fprintf(stderr, "error: failed to open '%s' for writing\n", params.fname_json.c_str());
+            return 5;
+        }
+
+        fprintf(fout, "{\n");
+        fprintf(fout, "  \"threads\": %d,\n", params.n_threads);
+        fprintf(fout, "  \"system_info\": \"%s\",\n", whisper_print_system_info());
+        fprintf(fout, "  \"results\": [\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto & res = results[i];
+            fprintf(fout, "    {\"backend\": \"%s\", \"model\": \"%s\", \"op\": \"%s\", \"shape\": \"%s\", \"type\": \"%s\", "
+                          "\"supported\": %s, \"runs\": %d, \"us\": %.3f, \"flops\": %.0f, \"bytes\": %.0f}%s\n",
+                    bench_json_escape(res.backend).c_str(), res.model.c_str(), res.op.c_str(), res.shape.c_str(), res.type.c_str(),
+                    res.supported ? "true" : "false", res.n_runs, res.us, res.flops, res.bytes, i + 1 < results.size() ? "," : "");
+        }
+        fprintf(fout, "  ]\n");
+        fprintf(fout, "}\n");
+
+        if (fout != stdout) {
+            fclose(fout);
+        }
+    }
+
+    return 0;
+}
+
+// mel spectrogram (-w 5) and VAD (-w 6)
+//
+// The audio of each duration is the audio of -f, repeated as needed, or a synthetic signal without -f. Each duration
+// and thread count is computed once to warm up, then -r times.
+
+struct bench_pre_result {
+    float  duration_s;
+    int    n_threads;
+    double ms; // per call
+};
+
+static std::vector<float> bench_pre_audio(const std::vector<float> & pcmf32, float duration_s) {
+    std::vector<float> res((size_t) (duration_s*WHISPER_SAMPLE_RATE));
+
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < res.size(); ++i) {
+        if (!pcmf32.empty()) {
+            res[i] = pcmf32[i % pcmf32.size()];
+            continue;
+        }
+
+        // a 220 Hz tone with harmonics, on and off at 2 Hz, over noise
+        const float t = (float) i/WHISPER_SAMPLE_RATE;
+
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        const float noise = 0.01f*((seed >> 8)*(2.0f/16777216.0f) - 1.0f);
+        const float gate  = sinf(2.0f*float(M_PI)*2.0f*t) > 0.0f ? 1.0f : 0.0f;
+
+        res[i] = noise + gate*(0.3f*sinf(2.0f*float(M_PI)*220.0f*t) + 0.1f*sinf(2.0f*float(M_PI)*440.0f*t));
+    }
+
+    return res;
+}
+
+// mean duration of a call, in ms - negative if a call fails
+static double bench_pre_time_ms(int n_runs, const std::function<bool()> & fn) {
+    if (!fn()) {
+        return -1.0;
+    }
+
+    n_runs = std::max(1, n_runs);
+
+    const auto t_start = std::chrono::steady_clock::now();
+    for (int r = 0; r < n_runs; ++r) {
+        if (!fn()) {
+            return -1.0;
+        }
+    }
+    const auto t_end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::milli>(t_end - t_start).count()/n_runs;
+}
+
+static void bench_pre_print(const char * name, const bench_pre_result & res) {
+    const double audio_ms = 1e3*res.duration_s;
+
+    fprintf(stderr, "%s: duration = %7.1f s, threads = %2d | %9.2f ms | %8.1fx real time | %12.0f samples/s\n",
+            name, res.duration_s, res.n_threads, res.ms, audio_ms/res.ms, 1e3*res.duration_s*WHISPER_SAMPLE_RATE/res.ms);
+}
+
+static int bench_pre_write_json(const whisper_params & params, const char * name, const std::string & model,
+        const std::vector<bench_pre_result> & results) {
+    if (params.fname_json.empty()) {
+        return 0;
+    }
+
+    FILE * fout = params.fname_json == "-" ? stdout : fopen(params.fname_json.c_str(), "w");
+    if (fout == nullptr) {
+        fprintf(stderr, "error: failed to open '%s' for writing\n", params.fname_json.c_str());
+        return 5;
+    }
+
+    fprintf(fout, "{\n");
+    fprintf(fout, "  \"bench\": \"%s\",\n", name);
+    fprintf(fout, "  \"model\": \"%s\",\n", bench_json_escape(model).c_str());
+    fprintf(fout, "  \"audio\": \"%s\",\n", bench_json_escape(params.fname_inp.empty() ? "synthetic" : params.fname_inp).c_str());
+    fprintf(fout, "  \"runs\": %d,\n", params.n_runs);
+    fprintf(fout, "  \"system_info\": \"%s\",\n", whisper_print_system_info());
+    fprintf(fout, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto & res = results[i];
+        fprintf(fout, "    {\"duration_s\": %.3f, \"threads\": %d, \"ms\": %.3f, \"samples_per_s\": %.0f}%s\n",
+                res.duration_s, res.n_threads, res.ms, 1e3*res.duration_s*WHISPER_SAMPLE_RATE/res.ms,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fout, "  ]\n");
+    fprintf(fout, "}\n");
+
+    if (fout != stdout) {
+        fclose(fout);
+    }
+
+    return 0;
+}
+
+static bool bench_pre_read_audio(const whisper_params & params, std::vector<float> & pcmf32) {
+    if (params.fname_inp.empty()) {
+        return true;
+    }
+
+    std::vector<std::vector<float>> pcmf32s;
+
+    if (!::read_audio_data(params.fname_inp, pcmf32, pcmf32s, false)) {
+        fprintf(stderr, "error: failed to read audio file '%s'\n", params.fname_inp.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+static int whisper_bench_mel(const whisper_params & params) {
+    std::vector<float> pcmf32;
+    if (!bench_pre_read_audio(params, pcmf32)) {
+        return 2;
+    }
+
+    struct whisper_context_params cparams = whisper_context_default_params();
+
+    cparams.use_gpu = params.use_gpu;
+
+    struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+    if (ctx == nullptr) {
+        fprintf(stderr, "error: failed to initialize whisper context\n");
+        return 2;
+    }
+
+    std::vector<bench_pre_result> results;
+
+    for (const float duration_s : params.durations) {
+        const std::vector<float> audio = bench_pre_audio(pcmf32, duration_s);
+
+        for (const int n_threads : params.threads) {
+            bench_pre_result res;
+
+            res.duration_s = duration_s;
+            res.n_threads  = n_threads;
+            res.ms         = bench_pre_time_ms(params.n_runs, [&]() {
+                return whisper_pcm_to_mel(ctx, audio.data(), audio.size(), n_threads) == 0;
+            });
+
+            if (res.ms < 0.0) {
+                fprintf(stderr, "error: failed to compute the mel spectrogram\n");
+                whisper_free(ctx);
+                return 4;
+            }
+
+            bench_pre_print(__func__, res);
+
+            results.push_back(res);
+        }
+    }
+
+    whisper_free(ctx);
+
+    return bench_pre_write_json(params, "mel", params.model, results);
+}
+
+static int whisper_bench_vad(const whisper_params & params) {
+    std::vector<float> pcmf32;
+    if (!bench_pre_read_audio(params, pcmf32)) {
+        return 2;
+    }
+
+    std::vector<bench_pre_result> results;
+
+    for (const int n_threads : params.threads) {
+        struct whisper_vad_context_params vparams = whisper_vad_default_context_params();
+
+        vparams.n_threads = n_threads;
+        vparams.use_gpu   = params.use_gpu;
+
+        struct whisper_vad_context * vctx = whisper_vad_init_from_file_with_params(params.vad_model.c_str(), vparams);
+        if (vctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize the VAD context from '%s'\n", params.vad_model.c_str());
+            return 2;
+        }
+
+        for (const float duration_s : params.durations) {
+            const std::vector<float> audio = bench_pre_audio(pcmf32, duration_s);
+
+            bench_pre_result res;
+
+            res.duration_s = duration_s;
+            res.n_threads  = n_threads;
+            res.ms         = bench_pre_time_ms(params.n_runs, [&]() {
+                return whisper_vad_detect_speech(vctx, audio.data(), audio.size());
+            });
+
+            if (res.ms < 0.0) {
+                fprintf(stderr, "error: failed to detect speech\n");
+                whisper_vad_free(vctx);
+                return 4;
+            }
+
+            bench_pre_print(__func__, res);
+
+            results.push_back(res);
+        }
+
+        whisper_vad_free(vctx);
+    }
+
+    return bench_pre_write_json(params, "vad", params.vad_model, results);
+}
+
 int main(int argc, char ** argv) {
     whisper_params params;
 
@@ -168,6 +1604,10 @@ int main(int argc, char ** argv) {
         case 0: ret = whisper_bench_full(params);                break;
         case 1: ret = whisper_bench_memcpy(params.n_threads);       break;
         case 2: ret = whisper_bench_ggml_mul_mat(params.n_threads); break;
+        case 3: ret = whisper_bench_pipeline(params);               break;
+        case 4: ret = whisper_bench_ops(params);                    break;
+        case 5: ret = whisper_bench_mel(params);                    break;
+        case 6: ret = whisper_bench_vad(params);                    break;
         default: fprintf(stderr, "error: unknown benchmark: %d\n", params.what); break;
     }
 
@@ -1,12 +1,19 @@
 #include "common.h"
 #include "common-whisper.h"
+#include "common-download.h"
 
 #include "whisper.h"
 #include "grammar-parser.h"
 
+#include <algorithm>
+#include <cctype>
 #include <cmath>
 #include <fstream>
 #include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
@@ -34,6 +41,12 @@ static void replace_all(std::string & s, const std::string & search, const std::
 struct whisper_params {
     int32_t n_threads     = std::min(4, (int32_t) std::thread::hardware_concurrency());
     int32_t n_processors  = 1;
+    int32_t chunk_batch   = 0;
+    int32_t chunk_overlap = 2000;
+    int32_t stream_block  = 0;
+    int32_t batch_workers = 0;
+    int32_t encoder_split = 1;
+    int32_t encoder_block = 0;
     int32_t offset_t_ms   = 0;
     int32_t offset_n      = 0;
     int32_t duration_ms   = 0;
@@ -43,9 +56,12 @@ struct whisper_params {
     int32_t best_of       = whisper_full_default_params(WHISPER_SAMPLING_GREEDY).greedy.best_of;
     int32_t beam_size     = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH).beam_search.beam_size;
     int32_t audio_ctx     = 0;
+    int32_t lang_detect_audio_ctx = 0;
+    int32_t n_draft       = whisper_full_default_params(WHISPER_SAMPLING_GREEDY).n_draft;
 
     float word_thold      =  0.01f;
     float entropy_thold   =  2.40f;
+    float max_tokens_per_sec = whisper_full_default_params(WHISPER_SAMPLING_GREEDY).max_tokens_per_sec;
     float logprob_thold   = -1.00f;
     float no_speech_thold =  0.6f;
     float grammar_penalty = 100.0f;
@@ -57,8 +73,10 @@ struct whisper_params {
     bool detect_language = false;
     bool diarize         = false;
     bool tinydiarize     = false;
+    bool split_channels  = false;
     bool split_on_word   = false;
     bool no_fallback     = false;
+    bool repetition_stop = false;
     bool output_txt      = false;
     bool output_vtt      = false;
     bool output_srt      = false;
@@ -75,12 +93,26 @@ struct whisper_params {
     bool log_score       = false;
     bool use_gpu         = true;
     bool flash_attn      = false;
+    bool tune_threads    = false;
+    bool load_async      = false;
+    bool fused_encode    = false;
+    int32_t cpu_hugepages = 0;
+    bool cpu_partition   = false;
+    bool warmup          = false;
     bool suppress_nst    = false;
+    bool sample_device   = false;
+    bool pipeline_encode = false;
+    bool mel_window      = false;
+    float silence_thold  = 0.0f;
+    float speech_gate    = 0.0f;
 
     std::string language  = "en";
     std::string prompt;
     std::string font_path = "/System/Library/Fonts/Supplemental/Courier New Bold.ttf";
     std::string model     = "models/ggml-base.en.bin";
+    std::string model_draft;
+    std::string model_cascade;
+    std::string model_sha256;
     std::string grammar;
     std::string grammar_rule;
 
@@ -90,9 +122,37 @@ struct whisper_params {
     // A regular expression that matches tokens to suppress
     std::string suppress_regex;
 
+    // [EXPERIMENTAL] file with the words to transcribe - the logits are computed only for their tokens
+    std::string allowed_words;
+    std::vector<whisper_token> allowed_tokens;
+
     std::string openvino_encode_device = "CPU";
 
+    bool coreml_prefetch = false;
+    bool coreml_decoder  = false;
+    bool mel_gpu         = false;
+
+    std::string rpc_servers = "";
+    std::string audio_ctx_buckets = "";
+
     std::string dtw = "";
+    std::string numa = "";
+
+    // [EXPERIMENTAL] per-node profile of the graphs, written as Chrome trace JSON
+    std::string fname_profile = "";
+
+    // [EXPERIMENTAL] importance matrix of the weights, for examples/quantize
+    std::string fname_imatrix = "";
+
+    // [EXPERIMENTAL] CPU threadpool
+    std::string cpu_mask   = "";
+    bool        cpu_strict = false;
+    bool        perf_cores = false;
+    int32_t     prio       = 0;
+    int32_t     poll       = 50;
+    int32_t     poll_us    = 0;
+
+    std::string kv_type = "f16";
 
     std::vector<std::string> fname_inp = {};
     std::vector<std::string> fname_out = {};
@@ -146,6 +206,10 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         #define ARGV_NEXT (((i + 1) < argc) ? argv[++i] : requires_value_error(arg))
         else if (arg == "-t"    || arg == "--threads")         { params.n_threads       = std::stoi(ARGV_NEXT); }
         else if (arg == "-p"    || arg == "--processors")      { params.n_processors    = std::stoi(ARGV_NEXT); }
+        else if (arg == "-cb"   || arg == "--chunk-batch")     { params.chunk_batch     = std::stoi(ARGV_NEXT); }
+        else if (arg == "-co"   || arg == "--chunk-overlap")   { params.chunk_overlap   = std::stoi(ARGV_NEXT); }
+        else if (arg == "-sb"   || arg == "--stream-block")    { params.stream_block    = std::stoi(ARGV_NEXT); }
+        else if (arg == "-bw"   || arg == "--batch-workers")   { params.batch_workers   = std::stoi(ARGV_NEXT); }
         else if (arg == "-ot"   || arg == "--offset-t")        { params.offset_t_ms     = std::stoi(ARGV_NEXT); }
         else if (arg == "-on"   || arg == "--offset-n")        { params.offset_n        = std::stoi(ARGV_NEXT); }
         else if (arg == "-d"    || arg == "--duration")        { params.duration_ms     = std::stoi(ARGV_NEXT); }
@@ -154,8 +218,10 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-bo"   || arg == "--best-of")         { params.best_of         = std::stoi(ARGV_NEXT); }
         else if (arg == "-bs"   || arg == "--beam-size")       { params.beam_size       = std::stoi(ARGV_NEXT); }
         else if (arg == "-ac"   || arg == "--audio-ctx")       { params.audio_ctx       = std::stoi(ARGV_NEXT); }
+        else if (arg == "-lac"  || arg == "--lang-audio-ctx")  { params.lang_detect_audio_ctx = std::stoi(ARGV_NEXT); }
         else if (arg == "-wt"   || arg == "--word-thold")      { params.word_thold      = std::stof(ARGV_NEXT); }
         else if (arg == "-et"   || arg == "--entropy-thold")   { params.entropy_thold   = std::stof(ARGV_NEXT); }
+        else if (arg == "-mtps" || arg == "--max-tokens-per-sec") { params.max_tokens_per_sec = std::stof(ARGV_NEXT); }
         else if (arg == "-lpt"  || arg == "--logprob-thold")   { params.logprob_thold   = std::stof(ARGV_NEXT); }
         else if (arg == "-nth"  || arg == "--no-speech-thold") { params.no_speech_thold = std::stof(ARGV_NEXT); }
         else if (arg == "-tp"   || arg == "--temperature")     { params.temperature     = std::stof(ARGV_NEXT); }
@@ -164,8 +230,10 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-tr"   || arg == "--translate")       { params.translate       = true; }
         else if (arg == "-di"   || arg == "--diarize")         { params.diarize         = true; }
         else if (arg == "-tdrz" || arg == "--tinydiarize")     { params.tinydiarize     = true; }
+        else if (arg == "-sc"   || arg == "--split-channels")  { params.split_channels  = true; }
         else if (arg == "-sow"  || arg == "--split-on-word")   { params.split_on_word   = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")     { params.no_fallback     = true; }
+        else if (arg == "-rs"   || arg == "--repetition-stop") { params.repetition_stop = true; }
         else if (arg == "-otxt" || arg == "--output-txt")      { params.output_txt      = true; }
         else if (arg == "-ovtt" || arg == "--output-vtt")      { params.output_vtt      = true; }
         else if (arg == "-osrt" || arg == "--output-srt")      { params.output_srt      = true; }
@@ -185,14 +253,47 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-dl"   || arg == "--detect-language") { params.detect_language = true; }
         else if (                  arg == "--prompt")          { params.prompt          = ARGV_NEXT; }
         else if (arg == "-m"    || arg == "--model")           { params.model           = ARGV_NEXT; }
+        else if (arg == "-md"   || arg == "--model-draft")     { params.model_draft     = ARGV_NEXT; }
+        else if (arg == "-mc"   || arg == "--model-cascade")   { params.model_cascade   = ARGV_NEXT; }
+        else if (                  arg == "--model-sha256")    { params.model_sha256    = ARGV_NEXT; }
+        else if (arg == "-nd"   || arg == "--n-draft")         { params.n_draft         = std::stoi(ARGV_NEXT); }
         else if (arg == "-f"    || arg == "--file")            { params.fname_inp.emplace_back(ARGV_NEXT); }
         else if (arg == "-oved" || arg == "--ov-e-device")     { params.openvino_encode_device = ARGV_NEXT; }
+        else if (                  arg == "--coreml-prefetch") { params.coreml_prefetch = true; }
+        else if (                  arg == "--coreml-decoder")  { params.coreml_decoder  = true; }
+        else if (                  arg == "--mel-gpu")         { params.mel_gpu         = true; }
         else if (arg == "-dtw"  || arg == "--dtw")             { params.dtw             = ARGV_NEXT; }
+        else if (                  arg == "--numa")            { params.numa            = ARGV_NEXT; }
+        else if (                  arg == "--profile")         { params.fname_profile   = ARGV_NEXT; }
+        else if (                  arg == "--imatrix")         { params.fname_imatrix   = ARGV_NEXT; }
+        else if (arg == "-C"    || arg == "--cpu-mask")        { params.cpu_mask        = ARGV_NEXT; }
+        else if (                  arg == "--cpu-strict")      { params.cpu_strict      = true; }
+        else if (                  arg == "--perf-cores")      { params.perf_cores      = true; }
+        else if (                  arg == "--prio")            { params.prio            = std::stoi(ARGV_NEXT); }
+        else if (                  arg == "--poll")            { params.poll            = std::stoi(ARGV_NEXT); }
+        else if (                  arg == "--poll-us")         { params.poll_us         = std::stoi(ARGV_NEXT); }
         else if (arg == "-ls"   || arg == "--log-score")       { params.log_score       = true; }
         else if (arg == "-ng"   || arg == "--no-gpu")          { params.use_gpu         = false; }
         else if (arg == "-fa"   || arg == "--flash-attn")      { params.flash_attn      = true; }
+        else if (arg == "-es"   || arg == "--encoder-split")   { params.encoder_split   = std::stoi(ARGV_NEXT); }
+        else if (arg == "-eb"   || arg == "--encoder-block")   { params.encoder_block   = std::stoi(ARGV_NEXT); }
+        else if (arg == "-tt"   || arg == "--tune-threads")    { params.tune_threads    = true; }
+        else if (arg == "-la"   || arg == "--load-async")      { params.load_async      = true; }
+        else if (arg == "-fe"   || arg == "--fused-encode")    { params.fused_encode    = true; }
+        else if (arg == "-hp"   || arg == "--huge-pages")      { params.cpu_hugepages   = std::stoi(ARGV_NEXT); }
+        else if (arg == "-cpt"  || arg == "--cpu-partition")   { params.cpu_partition   = true; }
+        else if (arg == "-wu"   || arg == "--warmup")          { params.warmup          = true; }
+        else if (arg == "-rpc"  || arg == "--rpc")             { params.rpc_servers     = ARGV_NEXT; }
+        else if (arg == "-acb"  || arg == "--ctx-buckets")     { params.audio_ctx_buckets = ARGV_NEXT; }
+        else if (arg == "-kvt"  || arg == "--kv-type")         { params.kv_type         = ARGV_NEXT; }
         else if (arg == "-sns"  || arg == "--suppress-nst")    { params.suppress_nst    = true; }
+        else if (arg == "-sod"  || arg == "--sample-on-device"){ params.sample_device   = true; }
+        else if (arg == "-pe"   || arg == "--pipeline-encode") { params.pipeline_encode = true; }
+        else if (arg == "-mw"   || arg == "--mel-window")      { params.mel_window      = true; }
+        else if (arg == "-sth"  || arg == "--silence-thold")   { params.silence_thold   = std::stof(ARGV_NEXT); }
+        else if (arg == "-sg"   || arg == "--speech-gate")     { params.speech_gate     = std::stof(ARGV_NEXT); }
         else if (                  arg == "--suppress-regex")  { params.suppress_regex  = ARGV_NEXT; }
+        else if (                  arg == "--allowed-words")   { params.allowed_words   = ARGV_NEXT; }
         else if (                  arg == "--grammar")         { params.grammar         = ARGV_NEXT; }
         else if (                  arg == "--grammar-rule")    { params.grammar_rule    = ARGV_NEXT; }
         else if (                  arg == "--grammar-penalty") { params.grammar_penalty = std::stof(ARGV_NEXT); }
@@ -224,6 +325,10 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -h,        --help              [default] show this help message and exit\n");
     fprintf(stderr, "  -t N,      --threads N         [%-7d] number of threads to use during computation\n",    params.n_threads);
     fprintf(stderr, "  -p N,      --processors N      [%-7d] number of processors to use during computation\n", params.n_processors);
+    fprintf(stderr, "  -cb N,     --chunk-batch N     [%-7d] transcribe fixed 30 s chunks, N at a time (0 - off)\n", params.chunk_batch);
+    fprintf(stderr, "  -co N,     --chunk-overlap N   [%-7d] overlap of the chunks in milliseconds\n",           params.chunk_overlap);
+    fprintf(stderr, "  -sb N,     --stream-block N    [%-7d] decode the audio in blocks of N seconds while transcribing (0 - off)\n", params.stream_block);
+    fprintf(stderr, "  -bw N,     --batch-workers N   [%-7d] transcribe N files at a time, decoding the audio of the next files ahead (0 - off)\n", params.batch_workers);
     fprintf(stderr, "  -ot N,     --offset-t N        [%-7d] time offset in milliseconds\n",                    params.offset_t_ms);
     fprintf(stderr, "  -on N,     --offset-n N        [%-7d] segment index offset\n",                           params.offset_n);
     fprintf(stderr, "  -d  N,     --duration N        [%-7d] duration of audio to process in milliseconds\n",   params.duration_ms);
@@ -232,9 +337,11 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -sow,      --split-on-word     [%-7s] split on word rather than on token\n",             params.split_on_word ? "true" : "false");
     fprintf(stderr, "  -bo N,     --best-of N         [%-7d] number of best candidates to keep\n",              params.best_of);
     fprintf(stderr, "  -bs N,     --beam-size N       [%-7d] beam size for beam search\n",                      params.beam_size);
-    fprintf(stderr, "  -ac N,     --audio-ctx N       [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
+    fprintf(stderr, "  -ac N,     --audio-ctx N       [%-7d] audio context size (0 - all, -1 - fit to the audio)\n", params.audio_ctx);
+    fprintf(stderr, "  -lac N,    --lang-audio-ctx N  [%-7d] audio context size of the language detection (0 - same as -ac)\n", params.lang_detect_audio_ctx);
     fprintf(stderr, "  -wt N,     --word-thold N      [%-7.2f] word timestamp probability threshold\n",         params.word_thold);
     fprintf(stderr, "  -et N,     --entropy-thold N   [%-7.2f] entropy threshold for decoder fail\n",           params.entropy_thold);
+    fprintf(stderr, "  -mtps N,   --max-tokens-per-sec N [%-7.2f] token budget of a window per second of audio (0 - off)\n", params.max_tokens_per_sec);
     fprintf(stderr, "  -lpt N,    --logprob-thold N   [%-7.2f] log probability threshold for decoder fail\n",   params.logprob_thold);
     fprintf(stderr, "  -nth N,    --no-speech-thold N [%-7.2f] no speech threshold\n",                          params.no_speech_thold);
     fprintf(stderr, "  -tp,       --temperature N     [%-7.2f] The sampling temperature, between 0 and 1\n",    params.temperature);
@@ -243,7 +350,9 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -tr,       --translate         [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     fprintf(stderr, "  -di,       --diarize           [%-7s] stereo audio diarization\n",                       params.diarize ? "true" : "false");
     fprintf(stderr, "  -tdrz,     --tinydiarize       [%-7s] enable tinydiarize (requires a tdrz model)\n",     params.tinydiarize ? "true" : "false");
+    fprintf(stderr, "  -sc,       --split-channels    [%-7s] transcribe the channels of stereo audio in one batch, one speaker each\n", params.split_channels ? "true" : "false");
     fprintf(stderr, "  -nf,       --no-fallback       [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
+    fprintf(stderr, "  -rs,       --repetition-stop   [%-7s] fail the decoders as soon as they repeat an n-gram\n", params.repetition_stop ? "true" : "false");
     fprintf(stderr, "  -otxt,     --output-txt        [%-7s] output result in a text file\n",                   params.output_txt ? "true" : "false");
     fprintf(stderr, "  -ovtt,     --output-vtt        [%-7s] output result in a vtt file\n",                    params.output_vtt ? "true" : "false");
     fprintf(stderr, "  -osrt,     --output-srt        [%-7s] output result in a srt file\n",                    params.output_srt ? "true" : "false");
@@ -262,15 +371,48 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
     fprintf(stderr, "  -l LANG,   --language LANG     [%-7s] spoken language ('auto' for auto-detect)\n",       params.language.c_str());
     fprintf(stderr, "  -dl,       --detect-language   [%-7s] exit after automatically detecting language\n",    params.detect_language ? "true" : "false");
     fprintf(stderr, "             --prompt PROMPT     [%-7s] initial prompt (max n_text_ctx/2 tokens)\n",       params.prompt.c_str());
-    fprintf(stderr, "  -m FNAME,  --model FNAME       [%-7s] model path\n",                                     params.model.c_str());
+    fprintf(stderr, "  -m FNAME,  --model FNAME       [%-7s] model path, or http(s) URL of the model to download in the cache ($WHISPER_CACHE_DIR)\n", params.model.c_str());
+    fprintf(stderr, "             --model-sha256 HASH [%-7s] expected SHA-256 of the model of the URL\n",      params.model_sha256.c_str());
+    fprintf(stderr, "  -md FNAME, --model-draft FNAME [%-7s] draft model path for speculative decoding\n",       params.model_draft.c_str());
+    fprintf(stderr, "  -nd N,     --n-draft N         [%-7d] number of tokens to draft with the draft model\n", params.n_draft);
+    fprintf(stderr, "  -mc FNAME, --model-cascade FNAME [%-7s] model for the windows that fail the thresholds at the first temperature\n", params.model_cascade.c_str());
     fprintf(stderr, "  -f FNAME,  --file FNAME        [%-7s] input audio file path\n",                            "");
     fprintf(stderr, "  -oved D,   --ov-e-device DNAME [%-7s] the OpenVINO device used for encode inference\n",  params.openvino_encode_device.c_str());
+    fprintf(stderr, "             --coreml-prefetch   [%-7s] predict the next window with Core ML while decoding\n", params.coreml_prefetch ? "true" : "false");
+    fprintf(stderr, "             --coreml-decoder    [%-7s] greedy decoding with the stateful Core ML decoder\n", params.coreml_decoder ? "true" : "false");
+    fprintf(stderr, "             --mel-gpu           [%-7s] compute the log mel spectrogram on the GPU\n", params.mel_gpu ? "true" : "false");
     fprintf(stderr, "  -dtw MODEL --dtw MODEL         [%-7s] compute token-level timestamps\n",                 params.dtw.c_str());
+    fprintf(stderr, "             --numa TYPE         [%-7s] NUMA strategy (distribute, isolate, numactl)\n",      params.numa.c_str());
+    fprintf(stderr, "             --profile FNAME     [%-7s] profile the graphs, write the nodes as Chrome trace JSON\n", params.fname_profile.c_str());
+    fprintf(stderr, "             --imatrix FNAME     [%-7s] collect the importance matrix of the weights, write it to FNAME\n", params.fname_imatrix.c_str());
+    fprintf(stderr, "  -C M,      --cpu-mask M        [%-7s] CPU affinity mask in hex, e.g. 0xff (requires a threadpool)\n", params.cpu_mask.c_str());
+    fprintf(stderr, "             --cpu-strict        [%-7s] pin each thread to a single CPU of the mask\n",       params.cpu_strict ? "true" : "false");
+    fprintf(stderr, "             --perf-cores        [%-7s] run on the performance cores of a hybrid CPU\n",     params.perf_cores ? "true" : "false");
+    fprintf(stderr, "             --prio N            [%-7d] thread priority (0 - normal, 1 - medium, 2 - high, 3 - realtime)\n", params.prio);
+    fprintf(stderr, "             --poll N            [%-7d] threadpool polling level (0 - no polling, 100 - aggressive)\n", params.poll);
+    fprintf(stderr, "             --poll-us N         [%-7d] threadpool threads spin N us for work, then sleep (0 - use --poll)\n", params.poll_us);
     fprintf(stderr, "  -ls,       --log-score         [%-7s] log best decoder scores of tokens\n",              params.log_score?"true":"false");
     fprintf(stderr, "  -ng,       --no-gpu            [%-7s] disable GPU\n",                                    params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,       --flash-attn        [%-7s] flash attention\n",                                params.flash_attn ? "true" : "false");
+    fprintf(stderr, "  -es N,     --encoder-split N   [%-7d] split the encoder layers over N GPUs, pipelined with -cb\n", params.encoder_split);
+    fprintf(stderr, "  -eb N,     --encoder-block N   [%-7d] block-causal encoder attention in blocks of N frames, for streaming models\n", params.encoder_block);
+    fprintf(stderr, "  -tt,       --tune-threads      [%-7s] tune the number of threads of the decoder graphs (at most -t)\n", params.tune_threads ? "true" : "false");
+    fprintf(stderr, "  -la,       --load-async        [%-7s] load the weights in the background, encode before the decoder is loaded\n", params.load_async ? "true" : "false");
+    fprintf(stderr, "  -fe,       --fused-encode      [%-7s] compute the conv, encoder and cross-attention KV as a single graph\n", params.fused_encode ? "true" : "false");
+    fprintf(stderr, "  -hp N,     --huge-pages N      [%-7d] CPU buffers on huge pages of N MB (2 or 1024, 0 - off)\n", params.cpu_hugepages);
+    fprintf(stderr, "  -cpt,      --cpu-partition     [%-7s] pin the threads of each processor (-p) / worker (-bw) to a disjoint part of the CPUs\n", params.cpu_partition ? "true" : "false");
+    fprintf(stderr, "  -wu,       --warmup            [%-7s] compute the graphs once on silence before the first file\n", params.warmup ? "true" : "false");
+    fprintf(stderr, "  -rpc LIST, --rpc LIST          [%-7s] comma-separated host:port of RPC servers, the encoder runs on the first\n", params.rpc_servers.c_str());
+    fprintf(stderr, "  -acb LIST, --ctx-buckets LIST  [%-7s] comma-separated audio context sizes with their own compute buffers\n", params.audio_ctx_buckets.c_str());
+    fprintf(stderr, "  -kvt TYPE, --kv-type TYPE      [%-7s] KV cache type (f16, q8_0, q4_0, ...), quantized types require -fa\n", params.kv_type.c_str());
     fprintf(stderr, "  -sns,      --suppress-nst      [%-7s] suppress non-speech tokens\n",                     params.suppress_nst ? "true" : "false");
+    fprintf(stderr, "  -sod,      --sample-on-device  [%-7s] sampling in the decoder graph\n",                  params.sample_device ? "true" : "false");
+    fprintf(stderr, "  -pe,       --pipeline-encode   [%-7s] encode the next window while decoding the current one\n", params.pipeline_encode ? "true" : "false");
+    fprintf(stderr, "  -mw,       --mel-window        [%-7s] compute and normalize the log mel spectrogram per window\n", params.mel_window ? "true" : "false");
+    fprintf(stderr, "  -sth N,    --silence-thold N   [%-7.4f] skip 30 s windows with a signal RMS below this (< 0 - off)\n", params.silence_thold);
+    fprintf(stderr, "  -sg N,     --speech-gate N     [%-7.2f] skip 30 s windows with a VAD speech probability below this (needs -vm, 0 - off)\n", params.speech_gate);
     fprintf(stderr, "  --suppress-regex REGEX         [%-7s] regular expression matching tokens to suppress\n", params.suppress_regex.c_str());
+    fprintf(stderr, "  --allowed-words FNAME          [%-7s] compute the logits only for the tokens of the words in FNAME\n", params.allowed_words.c_str());
     fprintf(stderr, "  --grammar GRAMMAR              [%-7s] GBNF grammar to guide decoding\n",                 params.grammar.c_str());
     fprintf(stderr, "  --grammar-rule RULE            [%-7s] top-level GBNF grammar rule name\n",               params.grammar_rule.c_str());
     fprintf(stderr, "  --grammar-penalty N            [%-7.1f] scales down logits of nongrammar tokens\n",      params.grammar_penalty);
@@ -292,34 +434,13 @@ static void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params
 struct whisper_print_user_data {
     const whisper_params * params;
 
-    const std::vector<std::vector<float>> * pcmf32s;
+    const stereo_energy * energy;
     int progress_prev;
 };
 
-static std::string estimate_diarization_speaker(std::vector<std::vector<float>> pcmf32s, int64_t t0, int64_t t1, bool id_only = false) {
-    std::string speaker = "";
-    const int64_t n_samples = pcmf32s[0].size();
-
-    const int64_t is0 = timestamp_to_sample(t0, n_samples, WHISPER_SAMPLE_RATE);
-    const int64_t is1 = timestamp_to_sample(t1, n_samples, WHISPER_SAMPLE_RATE);
-
-    double energy0 = 0.0f;
-    double energy1 = 0.0f;
-
-    for (int64_t j = is0; j < is1; j++) {
-        energy0 += fabs(pcmf32s[0][j]);
-        energy1 += fabs(pcmf32s[1][j]);
-    }
-
-    if (energy0 > 1.1*energy1) {
-        speaker = "0";
-    } else if (energy1 > 1.1*energy0) {
-        speaker = "1";
-    } else {
-        speaker = "?";
-    }
-
-    //printf("is0 = %lld, is1 = %lld, energy0 = %f, energy1 = %f, speaker = %s\n", is0, is1, energy0, energy1, speaker.c_str());
+// the speaker of a segment with --diarize of stereo audio: "(speaker N)", or "N" with id_only
+static std::string estimate_diarization_speaker(const stereo_energy & energy, int64_t t0, int64_t t1, bool id_only = false) {
+    std::string speaker = stereo_energy_speaker(energy, t0, t1);
 
     if (!id_only) {
         speaker.insert(0, "(speaker ");
@@ -340,7 +461,7 @@ static void whisper_print_progress_callback(struct whisper_context * /*ctx*/, st
 
 static void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * /*state*/, int n_new, void * user_data) {
     const auto & params  = *((whisper_print_user_data *) user_data)->params;
-    const auto & pcmf32s = *((whisper_print_user_data *) user_data)->pcmf32s;
+    const auto & energy  = *((whisper_print_user_data *) user_data)->energy;
 
     const int n_segments = whisper_full_n_segments(ctx);
 
@@ -366,8 +487,8 @@ static void whisper_print_segment_callback(struct whisper_context * ctx, struct
             printf("[%s --> %s]  ", to_timestamp(t0).c_str(), to_timestamp(t1).c_str());
         }
 
-        if (params.diarize && pcmf32s.size() == 2) {
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+        if (params.diarize && energy.n_samples > 0) {
+            speaker = estimate_diarization_speaker(energy, t0, t1);
         }
 
         if (params.print_colors) {
@@ -407,62 +528,164 @@ static void whisper_print_segment_callback(struct whisper_context * ctx, struct
     }
 }
 
-static void output_txt(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
-    const int n_segments = whisper_full_n_segments(ctx);
+// the result of an input file, read from the context once - the output formats are written from it while the next
+// file is transcribed
+struct transcript_token {
+    whisper_token_data data;
+    std::string        text;
+};
+
+struct transcript_segment {
+    std::string text;
+
+    int64_t t0;
+    int64_t t1;
+
+    bool speaker_turn_next;
+
+    // with --diarize of stereo audio: "(speaker N)" and "N"
+    std::string speaker;
+    std::string speaker_id;
+
+    // with -owts, -ojf and -ls
+    std::vector<transcript_token> tokens;
+};
+
+struct transcript {
+    bool diarize = false;
+
+    std::string fname_inp;
+    float       t_sec = 0.0f;
+
+    whisper_token token_eot;
+
+    // the model and the system information of -oj
+    std::string system_info;
+    std::string model_type;
+    std::string language;
+
+    bool multilingual;
+    int  n_vocab;
+    int  n_audio_ctx, n_audio_state, n_audio_head, n_audio_layer;
+    int  n_text_ctx,  n_text_state,  n_text_head,  n_text_layer;
+    int  n_mels;
+    int  ftype;
+
+    std::vector<transcript_segment> segments;
+};
+
+// state: the state of whisper_full_with_state(), or nullptr for the default state of the context
+static void transcript_read(struct whisper_context * ctx, struct whisper_state * state, const whisper_params & params, const stereo_energy & energy, bool with_tokens, transcript & tr) {
+    tr.diarize   = params.diarize && energy.n_samples > 0;
+    tr.token_eot = whisper_token_eot(ctx);
+
+    tr.system_info   = whisper_print_system_info();
+    tr.model_type    = whisper_model_type_readable(ctx);
+    tr.language      = whisper_lang_str(state ? whisper_full_lang_id_from_state(state) : whisper_full_lang_id(ctx));
+    tr.multilingual  = whisper_is_multilingual(ctx);
+    tr.n_vocab       = whisper_model_n_vocab(ctx);
+    tr.n_audio_ctx   = whisper_model_n_audio_ctx(ctx);
+    tr.n_audio_state = whisper_model_n_audio_state(ctx);
+    tr.n_audio_head  = whisper_model_n_audio_head(ctx);
+    tr.n_audio_layer = whisper_model_n_audio_layer(ctx);
+    tr.n_text_ctx    = whisper_model_n_text_ctx(ctx);
+    tr.n_text_state  = whisper_model_n_text_state(ctx);
+    tr.n_text_head   = whisper_model_n_text_head(ctx);
+    tr.n_text_layer  = whisper_model_n_text_layer(ctx);
+    tr.n_mels        = whisper_model_n_mels(ctx);
+    tr.ftype         = whisper_model_ftype(ctx);
+
+    const int n_segments = state ? whisper_full_n_segments_from_state(state) : whisper_full_n_segments(ctx);
+
+    tr.segments.resize(n_segments);
+
     for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
-        std::string speaker = "";
+        auto & seg = tr.segments[i];
 
-        if (params.diarize && pcmf32s.size() == 2)
-        {
-            const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+        seg.text = state ? whisper_full_get_segment_text_from_state(state, i) : whisper_full_get_segment_text(ctx, i);
+        seg.t0   = state ? whisper_full_get_segment_t0_from_state  (state, i) : whisper_full_get_segment_t0  (ctx, i);
+        seg.t1   = state ? whisper_full_get_segment_t1_from_state  (state, i) : whisper_full_get_segment_t1  (ctx, i);
+
+        seg.speaker_turn_next = state ? whisper_full_get_segment_speaker_turn_next_from_state(state, i) : whisper_full_get_segment_speaker_turn_next(ctx, i);
+
+        if (tr.diarize) {
+            seg.speaker_id = estimate_diarization_speaker(energy, seg.t0, seg.t1, true);
+            seg.speaker    = "(speaker " + seg.speaker_id + ")";
         }
 
-        fout << speaker << text << "\n";
+        if (with_tokens) {
+            const int n = state ? whisper_full_n_tokens_from_state(state, i) : whisper_full_n_tokens(ctx, i);
+
+            seg.tokens.resize(n);
+            for (int j = 0; j < n; ++j) {
+                seg.tokens[j].data = state ? whisper_full_get_token_data_from_state(state, i, j) : whisper_full_get_token_data(ctx, i, j);
+                seg.tokens[j].text = whisper_token_to_str(ctx, seg.tokens[j].data.id);
+            }
+        }
     }
 }
 
-static void output_vtt(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
-    fout << "WEBVTT\n\n";
+// -sc: the segments of the channels of a stereo file, ordered by time - the channel is the speaker of a segment
+static void transcript_read_channels(struct whisper_context * ctx, struct whisper_state * const * states, int n_channels, const whisper_params & params, bool with_tokens, transcript & tr) {
+    stereo_energy energy; // empty - the speakers are the channels
 
-    const int n_segments = whisper_full_n_segments(ctx);
-    for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-        std::string speaker = "";
+    transcript_read(ctx, states[0], params, energy, with_tokens, tr);
 
-        if (params.diarize && pcmf32s.size() == 2)
-        {
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1, true);
-            speaker.insert(0, "<v Speaker");
-            speaker.append(">");
+    tr.diarize = true;
+    tr.segments.clear();
+
+    for (int c = 0; c < n_channels; ++c) {
+        transcript tr_c;
+        transcript_read(ctx, states[c], params, energy, with_tokens, tr_c);
+
+        for (auto & seg : tr_c.segments) {
+            seg.speaker_id = std::to_string(c);
+            seg.speaker    = "(speaker " + seg.speaker_id + ")";
+
+            tr.segments.push_back(std::move(seg));
         }
+    }
+
+    std::stable_sort(tr.segments.begin(), tr.segments.end(), [](const transcript_segment & a, const transcript_segment & b) {
+        return a.t0 < b.t0;
+    });
+}
 
-        fout << to_timestamp(t0) << " --> " << to_timestamp(t1) << "\n";
-        fout << speaker << text << "\n\n";
+static bool output_txt(const transcript & tr, std::ostream & fout, const whisper_params & /*params*/) {
+    for (const auto & seg : tr.segments) {
+        fout << seg.speaker << seg.text << "\n";
     }
+
+    return true;
 }
 
-static void output_srt(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
-    const int n_segments = whisper_full_n_segments(ctx);
-    for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+static bool output_vtt(const transcript & tr, std::ostream & fout, const whisper_params & /*params*/) {
+    fout << "WEBVTT\n\n";
+
+    for (const auto & seg : tr.segments) {
         std::string speaker = "";
 
-        if (params.diarize && pcmf32s.size() == 2)
-        {
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+        if (tr.diarize) {
+            speaker = "<v Speaker" + seg.speaker_id + ">";
         }
 
+        fout << to_timestamp(seg.t0) << " --> " << to_timestamp(seg.t1) << "\n";
+        fout << speaker << seg.text << "\n\n";
+    }
+
+    return true;
+}
+
+static bool output_srt(const transcript & tr, std::ostream & fout, const whisper_params & params) {
+    for (int i = 0; i < (int) tr.segments.size(); ++i) {
+        const auto & seg = tr.segments[i];
+
         fout << i + 1 + params.offset_n << "\n";
-        fout << to_timestamp(t0, true) << " --> " << to_timestamp(t1, true) << "\n";
-        fout << speaker << text << "\n\n";
+        fout << to_timestamp(seg.t0, true) << " --> " << to_timestamp(seg.t1, true) << "\n";
+        fout << seg.speaker << seg.text << "\n\n";
     }
+
+    return true;
 }
 
 static char * escape_double_quotes_and_backslashes(const char * str) {
@@ -528,51 +751,45 @@ static char * escape_double_quotes_in_csv(const char * str) {
     return escaped;
 }
 
-static void output_csv(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
-    const int n_segments = whisper_full_n_segments(ctx);
+static bool output_csv(const transcript & tr, std::ostream & fout, const whisper_params & /*params*/) {
     fout << "start,end,";
-    if (params.diarize && pcmf32s.size() == 2)
+    if (tr.diarize)
     {
         fout << "speaker,";
     }
     fout << "text\n";
 
-    for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-        char * text_escaped = escape_double_quotes_in_csv(text);
+    for (const auto & seg : tr.segments) {
+        char * text_escaped = escape_double_quotes_in_csv(seg.text.c_str());
 
         //need to multiply times returned from whisper_full_get_segment_t{0,1}() by 10 to get milliseconds.
-        fout << 10 * t0 << "," << 10 * t1 << ",";
-        if (params.diarize && pcmf32s.size() == 2)
+        fout << 10 * seg.t0 << "," << 10 * seg.t1 << ",";
+        if (tr.diarize)
         {
-            fout << estimate_diarization_speaker(pcmf32s, t0, t1, true) << ",";
+            fout << seg.speaker_id << ",";
         }
         fout << "\"" << text_escaped << "\"\n";
+
+        free(text_escaped);
     }
+
+    return true;
 }
 
-static void output_score(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & /*params*/, std::vector<std::vector<float>> /*pcmf32s*/) {
-    const int n_segments = whisper_full_n_segments(ctx);
-    // fprintf(stderr,"segments: %d\n",n_segments);
-    for (int i = 0; i < n_segments; ++i) {
-        const int n_tokens = whisper_full_n_tokens(ctx, i);
-        // fprintf(stderr,"tokens: %d\n",n_tokens);
-        for (int j = 0; j < n_tokens; j++) {
-            auto token = whisper_full_get_token_text(ctx, i, j);
-            auto probability = whisper_full_get_token_p(ctx, i, j);
-            fout << token << '\t' << probability << std::endl;
-            // fprintf(stderr,"token: %s %f\n",token,probability);
-	    }
+static bool output_score(const transcript & tr, std::ostream & fout, const whisper_params & /*params*/) {
+    for (const auto & seg : tr.segments) {
+        for (const auto & token : seg.tokens) {
+            fout << token.text << '\t' << token.data.p << '\n';
+        }
     }
+
+    return true;
 }
 
-static void output_json(
-             struct whisper_context * ctx,
-                      std::ofstream & fout,
-               const whisper_params & params,
-    std::vector<std::vector<float>>   pcmf32s) {
+static bool output_json(
+                 const transcript & tr,
+                     std::ostream & fout,
+               const whisper_params & params) {
     const bool full = params.output_jsn_full;
     int indent = 0;
 
@@ -654,25 +871,25 @@ static void output_json(
     };
 
     start_obj(nullptr);
-        value_s("systeminfo", whisper_print_system_info(), false);
+        value_s("systeminfo", tr.system_info.c_str(), false);
         start_obj("model");
-            value_s("type", whisper_model_type_readable(ctx), false);
-            value_b("multilingual", whisper_is_multilingual(ctx), false);
-            value_i("vocab", whisper_model_n_vocab(ctx), false);
+            value_s("type", tr.model_type.c_str(), false);
+            value_b("multilingual", tr.multilingual, false);
+            value_i("vocab", tr.n_vocab, false);
             start_obj("audio");
-                value_i("ctx", whisper_model_n_audio_ctx(ctx), false);
-                value_i("state", whisper_model_n_audio_state(ctx), false);
-                value_i("head", whisper_model_n_audio_head(ctx), false);
-                value_i("layer", whisper_model_n_audio_layer(ctx), true);
+                value_i("ctx", tr.n_audio_ctx, false);
+                value_i("state", tr.n_audio_state, false);
+                value_i("head", tr.n_audio_head, false);
+                value_i("layer", tr.n_audio_layer, true);
             end_obj(false);
             start_obj("text");
-                value_i("ctx", whisper_model_n_text_ctx(ctx), false);
-                value_i("state", whisper_model_n_text_state(ctx), false);
-                value_i("head", whisper_model_n_text_head(ctx), false);
-                value_i("layer", whisper_model_n_text_layer(ctx), true);
+                value_i("ctx", tr.n_text_ctx, false);
+                value_i("state", tr.n_text_state, false);
+                value_i("head", tr.n_text_head, false);
+                value_i("layer", tr.n_text_layer, true);
             end_obj(false);
-            value_i("mels", whisper_model_n_mels(ctx), false);
-            value_i("ftype", whisper_model_ftype(ctx), true);
+            value_i("mels", tr.n_mels, false);
+            value_i("ftype", tr.ftype, true);
         end_obj(false);
         start_obj("params");
             value_s("model", params.model.c_str(), false);
@@ -680,28 +897,28 @@ static void output_json(
             value_b("translate", params.translate, true);
         end_obj(false);
         start_obj("result");
-            value_s("language", whisper_lang_str(whisper_full_lang_id(ctx)), true);
+            value_s("language", tr.language.c_str(), true);
         end_obj(false);
         start_arr("transcription");
 
-            const int n_segments = whisper_full_n_segments(ctx);
+            const int n_segments = tr.segments.size();
             for (int i = 0; i < n_segments; ++i) {
-                const char * text = whisper_full_get_segment_text(ctx, i);
+                const auto & seg = tr.segments[i];
 
-                const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+                const int64_t t0 = seg.t0;
+                const int64_t t1 = seg.t1;
 
                 start_obj(nullptr);
                     times_o(t0, t1, false);
-                    value_s("text", text, !params.diarize && !params.tinydiarize && !full);
+                    value_s("text", seg.text.c_str(), !tr.diarize && !params.tinydiarize && !full);
 
                     if (full) {
                         start_arr("tokens");
-                        const int n = whisper_full_n_tokens(ctx, i);
+                        const int n = seg.tokens.size();
                         for (int j = 0; j < n; ++j) {
-                            auto token = whisper_full_get_token_data(ctx, i, j);
+                            const auto & token = seg.tokens[j].data;
                             start_obj(nullptr);
-                                value_s("text", whisper_token_to_str(ctx, token.id), false);
+                                value_s("text", seg.tokens[j].text.c_str(), false);
                                 if(token.t0 > -1 && token.t1 > -1) {
                                     // If we have per-token timestamps, write them out
                                     times_o(token.t0, token.t1, false);
@@ -711,28 +928,31 @@ static void output_json(
                                 value_f("t_dtw", token.t_dtw, true);
                             end_obj(j == (n - 1));
                         }
-                        end_arr(!params.diarize && !params.tinydiarize);
+                        end_arr(!tr.diarize && !params.tinydiarize);
                     }
 
-                    if (params.diarize && pcmf32s.size() == 2) {
-                        value_s("speaker", estimate_diarization_speaker(pcmf32s, t0, t1, true).c_str(), true);
+                    if (tr.diarize) {
+                        value_s("speaker", seg.speaker_id.c_str(), true);
                     }
 
                     if (params.tinydiarize) {
-                        value_b("speaker_turn_next", whisper_full_get_segment_speaker_turn_next(ctx, i), true);
+                        value_b("speaker_turn_next", seg.speaker_turn_next, true);
                     }
                 end_obj(i == (n_segments - 1));
             }
 
         end_arr(true);
     end_obj(true);
+
+    return true;
 }
 
 // karaoke video generation
 // outputs a bash script that uses ffmpeg to generate a video with the subtitles
 // TODO: font parameter adjustments
-static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s, const char * fname_inp, float t_sec, const char * fname_out) {
-    static const char * font = params.font_path.c_str();
+static bool output_wts(const transcript & tr, std::ostream & fout, const whisper_params & params) {
+    const char * font      = params.font_path.c_str();
+    const char * fname_inp = tr.fname_inp.c_str();
 
     std::ifstream fin(font);
     if (!fin.is_open()) {
@@ -743,18 +963,17 @@ static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const
     fout << "#!/bin/bash" << "\n";
     fout << "\n";
 
-    fout << "ffmpeg -i " << fname_inp << " -f lavfi -i color=size=1200x120:duration=" << t_sec << ":rate=25:color=black -vf \"";
+    fout << "ffmpeg -i " << fname_inp << " -f lavfi -i color=size=1200x120:duration=" << tr.t_sec << ":rate=25:color=black -vf \"";
 
-    for (int i = 0; i < whisper_full_n_segments(ctx); i++) {
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+    for (int i = 0; i < (int) tr.segments.size(); i++) {
+        const auto & seg = tr.segments[i];
 
-        const int n = whisper_full_n_tokens(ctx, i);
+        const int64_t t0 = seg.t0;
+        const int64_t t1 = seg.t1;
 
-        std::vector<whisper_token_data> tokens(n);
-        for (int j = 0; j < n; ++j) {
-            tokens[j] = whisper_full_get_token_data(ctx, i, j);
-        }
+        const int n = seg.tokens.size();
+
+        const auto & tokens = seg.tokens;
 
         if (i > 0) {
             fout << ",";
@@ -764,16 +983,12 @@ static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const
         fout << "drawtext=fontfile='" << font << "':fontsize=24:fontcolor=gray:x=(w-text_w)/2:y=h/2:text='':enable='between(t," << t0/100.0 << "," << t0/100.0 << ")'";
 
         bool is_first = true;
-        std::string speaker = "";
-
-        if (params.diarize && pcmf32s.size() == 2) {
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
-        }
+        const std::string & speaker = seg.speaker;
 
         for (int j = 0; j < n; ++j) {
-            const auto & token = tokens[j];
+            const auto & token = tokens[j].data;
 
-            if (tokens[j].id >= whisper_token_eot(ctx)) {
+            if (token.id >= tr.token_eot) {
                 continue;
             }
 
@@ -781,7 +996,7 @@ static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const
             std::string txt_fg = ""; // highlight token
             std::string txt_ul = ""; // underline
 
-            if (params.diarize && pcmf32s.size() == 2) {
+            if (tr.diarize) {
                 txt_bg = speaker;
                 txt_fg = speaker;
                 txt_ul = "\\ \\ \\ \\ \\ \\ \\ \\ \\ \\ \\ ";
@@ -793,13 +1008,11 @@ static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const
 
             {
                 for (int k = 0; k < n; ++k) {
-                    const auto & token2 = tokens[k];
-
-                    if (tokens[k].id >= whisper_token_eot(ctx)) {
+                    if (tokens[k].data.id >= tr.token_eot) {
                         continue;
                     }
 
-                    const std::string txt = whisper_token_to_str(ctx, token2.id);
+                    const std::string & txt = tokens[k].text;
 
                     txt_bg += txt;
 
@@ -845,20 +1058,14 @@ static bool output_wts(struct whisper_context * ctx, std::ofstream & fout, const
     fout << "echo \"  ffplay " << fname_inp << ".mp4\"\n";
     fout << "\n";
 
-    fout.close();
-
-    fprintf(stderr, "# %s: run 'source %s' to generate karaoke video\n", __func__, fname_out);
-
     return true;
 }
 
-static void output_lrc(struct whisper_context * ctx, std::ofstream & fout, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
+static bool output_lrc(const transcript & tr, std::ostream & fout, const whisper_params & /*params*/) {
     fout << "[by:whisper.cpp]\n";
 
-    const int n_segments = whisper_full_n_segments(ctx);
-    for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
-        const int64_t t = whisper_full_get_segment_t0(ctx, i);
+    for (const auto & seg : tr.segments) {
+        const int64_t t = seg.t0;
 
         int64_t msec = t * 10;
         int64_t min = msec / (1000 * 60);
@@ -869,19 +1076,514 @@ static void output_lrc(struct whisper_context * ctx, std::ofstream & fout, const
         char buf[16];
         snprintf(buf, sizeof(buf), "%02d:%02d.%02d", (int) min, (int) sec, (int) ( msec / 10));
         std::string timestamp_lrc = std::string(buf);
-        std::string speaker = "";
 
-        if (params.diarize && pcmf32s.size() == 2)
-        {
-            const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+        fout <<  '[' << timestamp_lrc << ']' << seg.speaker << seg.text << "\n";
+    }
+
+    return true;
+}
+
+// the segments of an input file at once, for the console output of the batch mode (-bw)
+static bool output_console(const transcript & tr, std::ostream & fout, const whisper_params & params) {
+    fout << "\n" << tr.fname_inp << ":\n";
+
+    for (const auto & seg : tr.segments) {
+        if (!params.no_timestamps) {
+            fout << "[" << to_timestamp(seg.t0) << " --> " << to_timestamp(seg.t1) << "]  ";
+        }
+
+        fout << seg.speaker << seg.text;
+
+        if (params.tinydiarize && seg.speaker_turn_next) {
+            fout << params.tdrz_speaker_turn;
+        }
+
+        if (!params.no_timestamps || tr.diarize) {
+            fout << "\n";
+        }
+    }
+
+    if (params.no_timestamps && !tr.diarize) {
+        fout << "\n";
+    }
+
+    return true;
+}
+
+typedef bool (*output_writer_t)(const transcript & tr, std::ostream & fout, const whisper_params & params);
+
+// the output files of an input file
+struct output_job {
+    struct file {
+        output_writer_t writer;
+        std::string     fname;
+    };
+
+    whisper_params    params;
+    transcript        tr;
+    std::vector<file> files;
+};
+
+// format each output in memory and write it to its file at once
+static void output_write(const output_job & job) {
+    for (const auto & file : job.files) {
+        std::ostringstream out;
+
+        const bool ok = file.writer(job.tr, out, job.params);
+
+        std::ofstream fout(file.fname);
+        if (!fout.is_open()) {
+            fprintf(stderr, "%s: failed to open '%s' for writing\n", __func__, file.fname.c_str());
+            continue;
+        }
+
+        const std::string data = out.str();
+        fout.write(data.data(), data.size());
+
+        if (ok && file.writer == output_wts) {
+            fprintf(stderr, "# %s: run 'source %s' to generate karaoke video\n", "output_wts", file.fname.c_str());
+        }
+    }
+}
+
+// writes the outputs of the previous input file on a thread while the next one is transcribed
+struct output_writer {
+    std::thread thread;
+
+    void wait() {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    void write(output_job && job, bool async) {
+        wait();
+
+        if (async) {
+            thread = std::thread([job = std::move(job)]() { output_write(job); });
+        } else {
+            output_write(job);
+        }
+    }
+
+    ~output_writer() {
+        wait();
+    }
+};
+
+
+// the output files of an input file: -of FNAME, or the input file name, with the extension of each format
+struct fout_factory {
+    std::string fname_out;
+    const size_t basename_length;
+    const bool is_stdout;
+    bool used_stdout;
+    decltype(whisper_print_segment_callback) * const print_segment_callback;
+
+    fout_factory (const std::string & fname_out_, const std::string & fname_inp, whisper_params & params) :
+            fname_out{!fname_out_.empty() ? fname_out_ : fname_inp},
+            basename_length{fname_out.size()},
+            is_stdout{fname_out == "-"},
+            used_stdout{},
+            print_segment_callback{is_stdout ? nullptr : whisper_print_segment_callback} {
+        if (!print_segment_callback) {
+            params.print_progress = false;
+        }
+    }
+
+    // the name of the output file of the format - the file is written by output_write()
+    bool name(const char * ext, const char * function, std::string & fname) {
+        if (is_stdout) {
+            if (used_stdout) {
+                fprintf(stderr, "warning: Not appending multiple file formats to stdout\n");
+                return false;
+            }
+
+            used_stdout = true;
+#ifdef _WIN32
+            fname = "CON";
+#else
+            fname = "/dev/stdout";
+#endif
+            // Not using fprintf stderr here because it might equal stdout
+            // Also assuming /dev is mounted
+            return true;
         }
 
-        fout <<  '[' << timestamp_lrc << ']' << speaker << text << "\n";
+        fname_out.resize(basename_length);
+        fname_out += ext;
+        fname = fname_out;
+        fprintf(stderr, "%s: saving output to '%s'\n", function, fname_out.c_str());
+        return true;
     }
+};
+
+// the output files of the formats of params
+static void output_job_files(struct fout_factory & fout_factory, const whisper_params & params, output_job & job) {
+    // macros to stringify function name
+#define output_func(func, ext, param) if (param && fout_factory.name(ext, #func, fname)) {\
+    job.files.push_back({ func, fname }); \
 }
+#define output_ext(ext) output_func(output_##ext, "." #ext, params.output_##ext)
+
+    std::string fname;
+
+    output_ext(txt);
+    output_ext(vtt);
+    output_ext(srt);
+    output_ext(wts);
+    output_ext(csv);
+    output_func(output_json, ".json", params.output_jsn);
+    output_ext(lrc);
+    output_func(output_score, ".score.txt", params.log_score);
+
+#undef output_ext
+#undef output_func
+
+    if (fout_factory.is_stdout && !fout_factory.used_stdout) {
+        fprintf(stderr, "warning: '--output-file -' used without any other '--output-*'");
+    }
+}
+
+// the whisper_full() parameters of the command-line parameters - grammar_rules are the rules of params.grammar_parsed
+// the threadpool, the VAD context, the draft context and the callbacks are set by the caller
+static whisper_full_params whisper_params_to_full(const whisper_params & params, std::vector<const whisper_grammar_element *> & grammar_rules) {
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+    const bool use_grammar = (!params.grammar_parsed.rules.empty() && !params.grammar_rule.empty());
+    wparams.strategy = (params.beam_size > 1 || use_grammar) ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
+
+    wparams.print_realtime   = false;
+    wparams.print_progress   = params.print_progress;
+    wparams.print_timestamps = !params.no_timestamps;
+    wparams.print_special    = params.print_special;
+    wparams.translate        = params.translate;
+    wparams.language         = params.language.c_str();
+    wparams.detect_language  = params.detect_language;
+    wparams.n_threads        = params.n_threads;
+    wparams.n_max_text_ctx   = params.max_context >= 0 ? params.max_context : wparams.n_max_text_ctx;
+    wparams.offset_ms        = params.offset_t_ms;
+    wparams.duration_ms      = params.duration_ms;
+
+    wparams.token_timestamps = params.output_wts || params.output_jsn_full || params.max_len > 0;
+    wparams.thold_pt         = params.word_thold;
+    wparams.max_len          = params.output_wts && params.max_len == 0 ? 60 : params.max_len;
+    wparams.split_on_word    = params.split_on_word;
+    wparams.audio_ctx        = params.audio_ctx;
+    wparams.lang_detect_audio_ctx = params.lang_detect_audio_ctx;
+
+    wparams.debug_mode       = params.debug_mode;
+
+    wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+
+    wparams.suppress_regex   = params.suppress_regex.empty() ? nullptr : params.suppress_regex.c_str();
+
+    wparams.allowed_tokens   = params.allowed_tokens.empty() ? nullptr : params.allowed_tokens.data();
+    wparams.allowed_n_tokens = params.allowed_tokens.size();
+
+    wparams.initial_prompt   = params.prompt.c_str();
+
+    wparams.greedy.best_of        = params.best_of;
+    wparams.beam_search.beam_size = params.beam_size;
+
+    wparams.temperature_inc  = params.no_fallback ? 0.0f : params.temperature_inc;
+    wparams.repetition_stop  = params.repetition_stop;
+    wparams.temperature      = params.temperature;
+
+    wparams.entropy_thold    = params.entropy_thold;
+    wparams.max_tokens_per_sec = params.max_tokens_per_sec;
+    wparams.logprob_thold    = params.logprob_thold;
+    wparams.no_speech_thold  = params.no_speech_thold;
+
+    wparams.no_timestamps    = params.no_timestamps;
+
+    wparams.suppress_nst     = params.suppress_nst;
+
+    wparams.sample_on_device = params.sample_device;
+    wparams.pipeline_encode  = params.pipeline_encode;
+    wparams.mel_window       = params.mel_window;
+    wparams.silence_thold    = params.silence_thold;
+    wparams.speech_gate_thold = params.speech_gate;
+
+    wparams.vad            = params.vad;
+    wparams.vad_model_path = params.vad_model.c_str();
+
+    wparams.n_draft        = params.n_draft;
+
+    wparams.vad_params.threshold               = params.vad_threshold;
+    wparams.vad_params.min_speech_duration_ms  = params.vad_min_speech_duration_ms;
+    wparams.vad_params.min_silence_duration_ms = params.vad_min_silence_duration_ms;
+    wparams.vad_params.max_speech_duration_s   = params.vad_max_speech_duration_s;
+    wparams.vad_params.speech_pad_ms           = params.vad_speech_pad_ms;
+    wparams.vad_params.samples_overlap         = params.vad_samples_overlap;
+
+    const auto & grammar_parsed = params.grammar_parsed;
+    if (use_grammar) {
+        if (grammar_parsed.symbol_ids.find(params.grammar_rule) == grammar_parsed.symbol_ids.end()) {
+            fprintf(stderr, "%s: warning: grammar rule '%s' not found - skipping grammar sampling\n", __func__, params.grammar_rule.c_str());
+        } else {
+            wparams.grammar_rules = grammar_rules.data();
+            wparams.n_grammar_rules = grammar_rules.size();
+            wparams.i_start_rule = grammar_parsed.symbol_ids.at(params.grammar_rule);
+            wparams.grammar_penalty = params.grammar_penalty;
+        }
+    }
+
+    return wparams;
+}
+
+// -bw N: the files are transcribed by N workers at a time, each with its own state of the context and its own
+// threads, while a reader thread decodes the audio of the next files - the model is loaded once and the states
+// are reused for all the files
+struct batch_audio {
+    int  f  = -1;
+    bool ok = false;
+
+    std::vector<float> pcmf32;
+    stereo_energy      energy;
+};
+
+struct batch_stats {
+    int n_done = 0;
+    int n_fail = 0;
+
+    double t_audio_s = 0.0; // the duration of the transcribed audio
+    double t_read_s  = 0.0; // decoding the audio files
+    double t_wait_s  = 0.0; // the workers waiting for the audio, summed over the workers
+
+    whisper_state_counters counters = {}; // summed over the workers
+};
+
+static int batch_run(struct whisper_context * ctx, const whisper_params & params_cli) {
+    whisper_params params = params_cli;
+
+    if (!whisper_is_multilingual(ctx)) {
+        if (params.language != "en" || params.translate) {
+            params.language = "en";
+            params.translate = false;
+            fprintf(stderr, "%s: WARNING: model is not multilingual, ignoring language and translation options\n", __func__);
+        }
+    }
+    if (params.detect_language) {
+        params.language = "auto";
+    }
+
+    // the other modes of main() run on the default state, or share the threadpool, the VAD, the draft and the cascade contexts
+    if (params.n_processors > 1 || params.chunk_batch > 0 || params.stream_block > 0 || !params.model_draft.empty() ||
+        !params.model_cascade.empty() || !params.cpu_mask.empty() || params.cpu_strict || params.perf_cores || params.prio != 0 ||
+        !params.fname_profile.empty() || !params.fname_imatrix.empty()) {
+        fprintf(stderr, "%s: WARNING: -p, -cb, -sb, -md, -mc, --profile, --imatrix and the threadpool options are ignored with -bw\n", __func__);
+    }
+
+    const int n_files   = params.fname_inp.size();
+    const int n_workers = std::min(params.batch_workers, n_files);
+
+    auto grammar_rules = params.grammar_parsed.c_rules();
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+    std::deque<batch_audio> queue;
+    bool                    read_done = false;
+
+    std::mutex  mutex_print;
+    batch_stats stats;
+
+    if (!params.no_prints) {
+        fprintf(stderr, "\n");
+        fprintf(stderr, "system_info: n_threads = %d / %d | %s\n",
+                n_workers*params.n_threads, std::thread::hardware_concurrency(), whisper_print_system_info());
+        fprintf(stderr, "\n");
+        fprintf(stderr, "%s: processing %d files with %d workers of %d threads, lang = %s, task = %s ...\n",
+                __func__, n_files, n_workers, params.n_threads, params.language.c_str(), params.translate ? "translate" : "transcribe");
+        fprintf(stderr, "\n");
+    }
+
+    const int64_t t_start_us = ggml_time_us();
+
+    // decode the audio of the files in order, at most n_workers files ahead of the workers
+    std::thread reader([&]() {
+        for (int f = 0; f < n_files; ++f) {
+            const int64_t t0_us = ggml_time_us();
+
+            batch_audio audio;
+            audio.f  = f;
+            {
+                std::vector<std::vector<float>> pcmf32s;
+
+                audio.ok = ::read_audio_data(params.fname_inp[f], audio.pcmf32, pcmf32s, params.diarize);
 
+                stereo_energy_init(audio.energy, pcmf32s);
+            }
+
+            const int64_t t1_us = ggml_time_us();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            stats.t_read_s += (t1_us - t0_us)*1e-6;
+            cv.wait(lock, [&]() { return (int) queue.size() < n_workers; });
+            queue.push_back(std::move(audio));
+            cv.notify_all();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        read_done = true;
+        cv.notify_all();
+    });
+
+    auto worker = [&](int iw) {
+        struct whisper_state * state = whisper_init_state(ctx);
+        if (state == nullptr) {
+            fprintf(stderr, "%s: worker %d: failed to initialize the state\n", "batch_run", iw);
+            return;
+        }
+
+        if (params.cpu_partition) {
+            whisper_state_set_cpu_part(state, iw, n_workers);
+        }
+
+        // the VAD context is not shared between the threads
+        struct whisper_vad_context * vctx = nullptr;
+        if (params.vad || params.speech_gate > 0.0f) {
+            vctx = whisper_vad_init_from_file_with_params(params.vad_model.c_str(), whisper_vad_default_context_params());
+            if (vctx == nullptr) {
+                fprintf(stderr, "%s: worker %d: failed to initialize VAD context\n", "batch_run", iw);
+                whisper_free_state(state);
+                return;
+            }
+        }
+
+        while (true) {
+            batch_audio audio;
+            {
+                const int64_t t0_us = ggml_time_us();
+
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return !queue.empty() || read_done; });
+
+                stats.t_wait_s += (ggml_time_us() - t0_us)*1e-6;
+
+                if (queue.empty()) {
+                    break;
+                }
+
+                audio = std::move(queue.front());
+                queue.pop_front();
+                cv.notify_all();
+            }
+
+            const std::string & fname_inp = params.fname_inp[audio.f];
+
+            if (!audio.ok) {
+                std::lock_guard<std::mutex> lock(mutex_print);
+                fprintf(stderr, "error: failed to read audio file '%s'\n", fname_inp.c_str());
+                stats.n_fail++;
+                continue;
+            }
+
+            whisper_full_params wparams = whisper_params_to_full(params, grammar_rules);
+
+            // the segments are printed once the file is transcribed, see output_console()
+            wparams.print_progress = false;
+            wparams.vad_ctx        = vctx;
+
+            const int64_t t0_us = ggml_time_us();
+
+            const int ret = whisper_full_with_state(ctx, state, wparams, audio.pcmf32.data(), audio.pcmf32.size());
+
+            const double t_s     = (ggml_time_us() - t0_us)*1e-6;
+            const double t_audio = double(audio.pcmf32.size())/WHISPER_SAMPLE_RATE;
+
+            if (ret != 0) {
+                std::lock_guard<std::mutex> lock(mutex_print);
+                fprintf(stderr, "%s: failed to process audio file '%s'\n", "batch_run", fname_inp.c_str());
+                stats.n_fail++;
+                continue;
+            }
+
+            output_job job;
+
+            whisper_params params_file = params;
+            struct fout_factory fout_factory{audio.f < (int) params.fname_out.size() ? params.fname_out[audio.f] : "", fname_inp, params_file};
+
+            std::lock_guard<std::mutex> lock(mutex_print);
+
+            output_job_files(fout_factory, params, job);
+
+            job.params = params;
+
+            job.tr.fname_inp = fname_inp;
+            job.tr.t_sec     = float(audio.pcmf32.size() + 1000)/WHISPER_SAMPLE_RATE;
+
+            transcript_read(ctx, state, params, audio.energy, params.output_wts || params.output_jsn_full || params.log_score, job.tr);
+
+            if (!fout_factory.is_stdout) {
+                std::ostringstream out;
+                output_console(job.tr, out, params);
+                printf("%s", out.str().c_str());
+                fflush(stdout);
+            }
+
+            output_write(job);
+
+            if (!params.no_prints) {
+                fprintf(stderr, "%s: worker %d: '%s' (%.1f sec) in %.2f sec, %.1fx real time\n",
+                        "batch_run", iw, fname_inp.c_str(), t_audio, t_s, t_audio/std::max(t_s, 1e-6));
+            }
+
+            stats.n_done++;
+            stats.t_audio_s += t_audio;
+        }
+
+        whisper_state_counters c;
+        whisper_get_state_counters(state, &c);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_print);
+
+            stats.counters.t_mel_us    += c.t_mel_us;
+            stats.counters.t_encode_us += c.t_encode_us;
+            stats.counters.t_decode_us += c.t_decode_us + c.t_batchd_us + c.t_prompt_us;
+            stats.counters.t_vad_us    += c.t_vad_us;
+        }
+
+        whisper_vad_free(vctx);
+        whisper_free_state(state);
+    };
+
+    std::vector<std::thread> workers;
+    for (int iw = 0; iw < n_workers; ++iw) {
+        workers.emplace_back(worker, iw);
+    }
+    for (auto & w : workers) {
+        w.join();
+    }
+
+    // the workers that failed to start leave the remaining files in the queue
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!read_done) {
+            stats.n_fail += queue.size();
+            queue.clear();
+            cv.notify_all();
+            cv.wait(lock, [&]() { return !queue.empty() || read_done; });
+        }
+        stats.n_fail += queue.size();
+        queue.clear();
+    }
+    reader.join();
+
+    const double t_total_s = (ggml_time_us() - t_start_us)*1e-6;
+
+    fprintf(stderr, "\n");
+    fprintf(stderr, "%s: %d files (%d failed), %.1f sec of audio in %.1f sec with %d workers: %.1fx real time, %.1f files/min\n",
+            __func__, stats.n_done + stats.n_fail, stats.n_fail, stats.t_audio_s, t_total_s, n_workers,
+            stats.t_audio_s/std::max(t_total_s, 1e-6), 60.0*stats.n_done/std::max(t_total_s, 1e-6));
+    fprintf(stderr, "%s: audio decoding %.2f sec, the workers waited %.2f sec for the audio\n",
+            __func__, stats.t_read_s, stats.t_wait_s);
+    fprintf(stderr, "%s: summed over the workers: mel %.2f sec, vad %.2f sec, encode %.2f sec, decode %.2f sec\n",
+            __func__, stats.counters.t_mel_us*1e-6, stats.counters.t_vad_us*1e-6, stats.counters.t_encode_us*1e-6, stats.counters.t_decode_us*1e-6);
+
+    return stats.n_fail > 0 ? 10 : 0;
+}
 
 static void cb_log_disable(enum ggml_log_level , const char * , void * ) { }
 
@@ -960,6 +1662,12 @@ int main(int argc, char ** argv) {
         exit(0);
     }
 
+    if (params.split_channels && (params.diarize || params.tinydiarize)) {
+        fprintf(stderr, "error: cannot use --split-channels with --diarize or --tinydiarize\n");
+        whisper_print_usage(argc, argv, params);
+        exit(0);
+    }
+
     if (params.no_prints) {
         whisper_log_set(cb_log_disable, NULL);
     }
@@ -968,8 +1676,58 @@ int main(int argc, char ** argv) {
 
     struct whisper_context_params cparams = whisper_context_default_params();
 
-    cparams.use_gpu    = params.use_gpu;
-    cparams.flash_attn = params.flash_attn;
+    cparams.use_gpu       = params.use_gpu;
+    cparams.flash_attn    = params.flash_attn;
+    cparams.encoder_split = params.encoder_split;
+    cparams.encoder_block = params.encoder_block;
+    cparams.tune_threads  = params.tune_threads;
+    cparams.load_async    = params.load_async;
+    cparams.fused_encode  = params.fused_encode;
+    cparams.cpu_hugepages = params.cpu_hugepages;
+    cparams.cpu_partition = params.cpu_partition;
+
+    if (!params.rpc_servers.empty()) {
+        cparams.rpc_servers = params.rpc_servers.c_str();
+    }
+
+    if (!params.audio_ctx_buckets.empty()) {
+        cparams.audio_ctx_buckets = params.audio_ctx_buckets.c_str();
+    }
+
+    {
+        int type_kv = GGML_TYPE_COUNT;
+        for (int t = 0; t < GGML_TYPE_COUNT; ++t) {
+            const char * name = ggml_type_name((ggml_type) t);
+            if (name && params.kv_type == name) {
+                type_kv = t;
+                break;
+            }
+        }
+
+        if (type_kv == GGML_TYPE_COUNT) {
+            fprintf(stderr, "error: unknown KV cache type '%s'\n", params.kv_type.c_str());
+            return 3;
+        }
+
+        cparams.type_kv = (ggml_type) type_kv;
+    }
+
+    if (!params.numa.empty()) {
+        if      (params.numa == "distribute") cparams.numa = GGML_NUMA_STRATEGY_DISTRIBUTE;
+        else if (params.numa == "isolate")    cparams.numa = GGML_NUMA_STRATEGY_ISOLATE;
+        else if (params.numa == "numactl")    cparams.numa = GGML_NUMA_STRATEGY_NUMACTL;
+        else {
+            fprintf(stderr, "error: unknown NUMA strategy '%s'\n", params.numa.c_str());
+            return 3;
+        }
+    }
+
+    cparams.profile = !params.fname_profile.empty();
+    cparams.imatrix = !params.fname_imatrix.empty();
+
+    cparams.coreml_prefetch = params.coreml_prefetch;
+    cparams.coreml_decoder  = params.coreml_decoder;
+    cparams.mel_gpu         = params.mel_gpu;
 
     if (!params.dtw.empty()) {
         cparams.dtw_token_timestamps = true;
@@ -994,6 +1752,17 @@ int main(int argc, char ** argv) {
         }
     }
 
+    if (is_url(params.model)) {
+        fetch_params fparams;
+        fparams.sha256 = params.model_sha256;
+
+        params.model = fetch_model(params.model, fparams);
+        if (params.model.empty()) {
+            fprintf(stderr, "error: failed to download the model\n");
+            return 3;
+        }
+    }
+
     struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
 
     if (ctx == nullptr) {
@@ -1027,65 +1796,224 @@ int main(int argc, char ** argv) {
         }
     }
 
-    for (int f = 0; f < (int) params.fname_inp.size(); ++f) {
-        const auto & fname_inp = params.fname_inp[f];
-        struct fout_factory {
-            std::string fname_out;
-            const size_t basename_length;
-            const bool is_stdout;
-            bool used_stdout;
-            decltype(whisper_print_segment_callback) * const print_segment_callback;
-            std::ofstream fout;
-
-            fout_factory (const std::string & fname_out_, const std::string & fname_inp, whisper_params & params) :
-                    fname_out{!fname_out_.empty() ? fname_out_ : fname_inp},
-                    basename_length{fname_out.size()},
-                    is_stdout{fname_out == "-"},
-                    used_stdout{},
-                    print_segment_callback{is_stdout ? nullptr : whisper_print_segment_callback} {
-                if (!print_segment_callback) {
-                    params.print_progress = false;
+    if (!params.allowed_words.empty()) {
+        std::ifstream ifs(params.allowed_words);
+        if (!ifs) {
+            fprintf(stderr, "error: failed to open '%s'\n", params.allowed_words.c_str());
+            whisper_free(ctx);
+            return 4;
+        }
+
+        // each word with and without a leading space, also with a capital first letter
+        std::vector<whisper_token> tokens(whisper_n_text_ctx(ctx));
+
+        std::string word;
+        while (ifs >> word) {
+            std::string upper = word;
+            upper[0] = toupper(upper[0]);
+
+            for (const std::string & w : { word, " " + word, upper, " " + upper }) {
+                const int n = whisper_tokenize(ctx, w.c_str(), tokens.data(), tokens.size());
+                if (n > 0) {
+                    params.allowed_tokens.insert(params.allowed_tokens.end(), tokens.begin(), tokens.begin() + n);
                 }
             }
+        }
 
-            bool open(const char * ext, const char * function) {
-                if (is_stdout) {
-                    if (used_stdout) {
-                        fprintf(stderr, "warning: Not appending multiple file formats to stdout\n");
-                        return false;
-                    }
+        if (params.allowed_tokens.empty()) {
+            fprintf(stderr, "error: no words in '%s'\n", params.allowed_words.c_str());
+            whisper_free(ctx);
+            return 4;
+        }
+    }
 
-                    used_stdout = true;
-#ifdef _WIN32
-                    fout = std::ofstream{"CON"};
-#else
-                    fout = std::ofstream{"/dev/stdout"};
-#endif
-                    // Not using fprintf stderr here because it might equal stdout
-                    // Also assuming /dev is mounted
-                    return true;
+    // [EXPERIMENTAL] batch mode: the files are transcribed by the states of the workers
+    if (params.batch_workers > 0) {
+        const int ret = batch_run(ctx, params);
+
+        whisper_free(ctx);
+
+        return ret;
+    }
+
+    // load the VAD model once and reuse it for all input files
+    struct whisper_vad_context * vctx = nullptr;
+    if (params.vad || params.speech_gate > 0.0f) {
+        vctx = whisper_vad_init_from_file_with_params(params.vad_model.c_str(), whisper_vad_default_context_params());
+        if (vctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize VAD context\n");
+            whisper_free(ctx);
+            return 3;
+        }
+    }
+
+    // [EXPERIMENTAL] CPU threadpool with the requested affinity and priority
+    struct ggml_threadpool * threadpool = nullptr;
+    if (!params.cpu_mask.empty() || params.cpu_strict || params.perf_cores || params.prio != 0 || params.poll_us > 0) {
+        struct ggml_threadpool_params tpp = ggml_threadpool_params_default(params.n_threads);
+
+        tpp.prio       = (ggml_sched_priority) params.prio;
+        tpp.poll       = params.poll;
+        tpp.poll_us    = params.poll_us;
+        tpp.strict_cpu = params.cpu_strict;
+
+        if (!params.cpu_mask.empty()) {
+            // the last hex digit has the CPUs 0 - 3
+            std::string mask = params.cpu_mask;
+            if (mask.rfind("0x", 0) == 0 || mask.rfind("0X", 0) == 0) {
+                mask = mask.substr(2);
+            }
+
+            for (int i = 0; i < (int) mask.size() && 4*i < GGML_MAX_N_THREADS; ++i) {
+                const char c = mask[mask.size() - 1 - i];
+                const int  v = isdigit(c) ? c - '0' : (isxdigit(c) ? tolower(c) - 'a' + 10 : -1);
+                if (v < 0) {
+                    fprintf(stderr, "error: invalid CPU mask '%s'\n", params.cpu_mask.c_str());
+                    whisper_vad_free(vctx);
+                    whisper_free(ctx);
+                    return 3;
+                }
+
+                for (int j = 0; j < 4 && 4*i + j < GGML_MAX_N_THREADS; ++j) {
+                    tpp.cpumask[4*i + j] = (v >> j) & 1;
+                }
+            }
+        } else if (params.perf_cores) {
+            const int n_perf = whisper_cpu_perf_cores(tpp.cpumask);
+            if (n_perf == 0) {
+                fprintf(stderr, "%s: no hybrid CPU detected - using all cores\n", __func__);
+            } else if (tpp.n_threads > n_perf) {
+                tpp.n_threads = n_perf;
+            }
+        }
+
+        threadpool = whisper_threadpool_new(&tpp);
+        if (threadpool == nullptr) {
+            fprintf(stderr, "%s: failed to create the threadpool - using the default threads\n", __func__);
+        }
+    }
+
+    // [EXPERIMENTAL] compile the GPU pipelines and page in the weights before the first file
+    if (params.warmup && whisper_warmup(ctx, params.n_threads) != 0) {
+        fprintf(stderr, "%s: failed to warm up\n", __func__);
+    }
+
+    // [EXPERIMENTAL] draft model for speculative decoding
+    struct whisper_context * ctx_draft = nullptr;
+    if (!params.model_draft.empty()) {
+        struct whisper_context_params cparams_draft = cparams;
+        cparams_draft.dtw_token_timestamps = false;
+
+        ctx_draft = whisper_init_from_file_with_params(params.model_draft.c_str(), cparams_draft);
+        if (ctx_draft == nullptr) {
+            fprintf(stderr, "error: failed to initialize draft whisper context\n");
+            whisper_threadpool_free(threadpool);
+            whisper_vad_free(vctx);
+            whisper_free(ctx);
+            return 3;
+        }
+    }
+
+    // [EXPERIMENTAL] cascade model for the windows that the model fails to transcribe with confidence
+    struct whisper_context * ctx_cascade = nullptr;
+    if (!params.model_cascade.empty()) {
+        ctx_cascade = whisper_init_from_file_with_params(params.model_cascade.c_str(), cparams);
+        if (ctx_cascade == nullptr) {
+            fprintf(stderr, "error: failed to initialize cascade whisper context\n");
+            whisper_free(ctx_draft);
+            whisper_threadpool_free(threadpool);
+            whisper_vad_free(vctx);
+            whisper_free(ctx);
+            return 3;
+        }
+    }
+
+    // [EXPERIMENTAL] -sc: a state for each channel of stereo audio, the channels are transcribed together by
+    // whisper_full_batch() - the VAD context is not shared between the channels
+    std::vector<struct whisper_state *> states_ch;
+    struct whisper_vad_context * vctx_ch = nullptr;
+
+    if (params.split_channels) {
+        if (params.n_processors > 1 || params.chunk_batch > 0 || params.stream_block > 0 || ctx_draft || ctx_cascade || threadpool) {
+            fprintf(stderr, "%s: WARNING: -p, -cb, -sb, -md, -mc and the threadpool options are ignored with -sc\n", __func__);
+        }
+
+        for (int c = 0; c < 2; ++c) {
+            struct whisper_state * state = whisper_init_state(ctx);
+            if (state == nullptr) {
+                fprintf(stderr, "error: failed to initialize the state of channel %d\n", c);
+                for (auto * st : states_ch) {
+                    whisper_free_state(st);
                 }
+                whisper_free(ctx_cascade);
+                whisper_free(ctx_draft);
+                whisper_threadpool_free(threadpool);
+                whisper_vad_free(vctx);
+                whisper_free(ctx);
+                return 3;
+            }
+
+            states_ch.push_back(state);
+        }
 
-                fname_out.resize(basename_length);
-                fname_out += ext;
-                fout = std::ofstream{fname_out};
-                if (!fout.is_open()) {
-                    fprintf(stderr, "%s: failed to open '%s' for writing\n", __func__, fname_out.c_str());
-                    return false;
+        if (params.vad || params.speech_gate > 0.0f) {
+            vctx_ch = whisper_vad_init_from_file_with_params(params.vad_model.c_str(), whisper_vad_default_context_params());
+            if (vctx_ch == nullptr) {
+                fprintf(stderr, "error: failed to initialize VAD context\n");
+                for (auto * st : states_ch) {
+                    whisper_free_state(st);
                 }
-                fprintf(stderr, "%s: saving output to '%s'\n", function, fname_out.c_str());
-                return true;
+                whisper_free(ctx_cascade);
+                whisper_free(ctx_draft);
+                whisper_threadpool_free(threadpool);
+                whisper_vad_free(vctx);
+                whisper_free(ctx);
+                return 3;
             }
-        } fout_factory{f < (int) params.fname_out.size() ? params.fname_out[f] : "", fname_inp, params};
+        }
+    }
+
+    output_writer writer;
+
+    for (int f = 0; f < (int) params.fname_inp.size(); ++f) {
+        const auto & fname_inp = params.fname_inp[f];
+        struct fout_factory fout_factory{f < (int) params.fname_out.size() ? params.fname_out[f] : "", fname_inp, params};
 
         std::vector<float> pcmf32;               // mono-channel F32 PCM
         std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
-
-        if (!::read_audio_data(fname_inp, pcmf32, pcmf32s, params.diarize)) {
+        stereo_energy energy;                    // the channel energy of pcmf32s for --diarize
+
+        // with --stream-block, the audio is decoded block by block during the transcription
+        // the diarization needs the stereo PCM of the whole file
+        struct stream_input {
+            audio_reader * reader    = nullptr;
+            int64_t        n_samples = 0;
+        } stream;
+
+        if (params.stream_block > 0 && !params.diarize && !params.split_channels) {
+            // the reader skips the offset and stops after the duration, whisper_full_stream() only shifts the timestamps
+            stream.reader = audio_reader_open(fname_inp, params.offset_t_ms, params.duration_ms);
+            if (stream.reader == nullptr) {
+                fprintf(stderr, "error: failed to read audio file '%s'\n", fname_inp.c_str());
+                continue;
+            }
+        } else if (!::read_audio_data(fname_inp, pcmf32, pcmf32s, params.diarize || params.split_channels)) {
             fprintf(stderr, "error: failed to read audio file '%s'\n", fname_inp.c_str());
             continue;
         }
 
+        if (params.split_channels) {
+            // the channels are transcribed instead of the interleaved PCM
+            pcmf32 = std::vector<float>();
+        } else {
+            // the speakers are estimated from the energy of the channels, the stereo PCM is released
+            stereo_energy_init(energy, pcmf32s);
+            std::vector<std::vector<float>>().swap(pcmf32s);
+        }
+
+        // the samples of a channel
+        const int n_samples = params.split_channels ? pcmf32s[0].size() : pcmf32.size();
+
         if (!whisper_is_multilingual(ctx)) {
             if (params.language != "en" || params.translate) {
                 params.language = "en";
@@ -1106,13 +2034,17 @@ int main(int argc, char ** argv) {
             // print some info about the processing
             fprintf(stderr, "\n");
             fprintf(stderr, "%s: processing '%s' (%d samples, %.1f sec), %d threads, %d processors, %d beams + best of %d, lang = %s, task = %s, %stimestamps = %d ...\n",
-                    __func__, fname_inp.c_str(), int(pcmf32.size()), float(pcmf32.size())/WHISPER_SAMPLE_RATE,
+                    __func__, fname_inp.c_str(), n_samples, float(n_samples)/WHISPER_SAMPLE_RATE,
                     params.n_threads, params.n_processors, params.beam_size, params.best_of,
                     params.language.c_str(),
                     params.translate ? "translate" : "transcribe",
                     params.tinydiarize ? "tdrz = 1, " : "",
                     params.no_timestamps ? 0 : 1);
 
+            if (stream.reader) {
+                fprintf(stderr, "%s: decoding the audio in blocks of %d sec during the transcription\n", __func__, params.stream_block);
+            }
+
             if (params.print_colors) {
                 fprintf(stderr, "%s: color scheme: red (low confidence), yellow (medium), green (high confidence)\n", __func__);
             }
@@ -1121,76 +2053,17 @@ int main(int argc, char ** argv) {
 
         // run the inference
         {
-            whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-
-            const bool use_grammar = (!params.grammar_parsed.rules.empty() && !params.grammar_rule.empty());
-            wparams.strategy = (params.beam_size > 1 || use_grammar) ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
-
-            wparams.print_realtime   = false;
-            wparams.print_progress   = params.print_progress;
-            wparams.print_timestamps = !params.no_timestamps;
-            wparams.print_special    = params.print_special;
-            wparams.translate        = params.translate;
-            wparams.language         = params.language.c_str();
-            wparams.detect_language  = params.detect_language;
-            wparams.n_threads        = params.n_threads;
-            wparams.n_max_text_ctx   = params.max_context >= 0 ? params.max_context : wparams.n_max_text_ctx;
-            wparams.offset_ms        = params.offset_t_ms;
-            wparams.duration_ms      = params.duration_ms;
-
-            wparams.token_timestamps = params.output_wts || params.output_jsn_full || params.max_len > 0;
-            wparams.thold_pt         = params.word_thold;
-            wparams.max_len          = params.output_wts && params.max_len == 0 ? 60 : params.max_len;
-            wparams.split_on_word    = params.split_on_word;
-            wparams.audio_ctx        = params.audio_ctx;
-
-            wparams.debug_mode       = params.debug_mode;
-
-            wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
-
-            wparams.suppress_regex   = params.suppress_regex.empty() ? nullptr : params.suppress_regex.c_str();
-
-            wparams.initial_prompt   = params.prompt.c_str();
-
-            wparams.greedy.best_of        = params.best_of;
-            wparams.beam_search.beam_size = params.beam_size;
-
-            wparams.temperature_inc  = params.no_fallback ? 0.0f : params.temperature_inc;
-            wparams.temperature      = params.temperature;
-
-            wparams.entropy_thold    = params.entropy_thold;
-            wparams.logprob_thold    = params.logprob_thold;
-            wparams.no_speech_thold  = params.no_speech_thold;
+            auto grammar_rules = params.grammar_parsed.c_rules();
 
-            wparams.no_timestamps    = params.no_timestamps;
+            whisper_full_params wparams = whisper_params_to_full(params, grammar_rules);
 
-            wparams.suppress_nst     = params.suppress_nst;
+            wparams.threadpool  = threadpool;
+            wparams.vad_ctx     = vctx;
+            wparams.draft_ctx   = ctx_draft;
+            wparams.cascade_ctx = ctx_cascade;
 
-            wparams.vad            = params.vad;
-            wparams.vad_model_path = params.vad_model.c_str();
+            whisper_print_user_data user_data = { &params, &energy, 0 };
 
-            wparams.vad_params.threshold               = params.vad_threshold;
-            wparams.vad_params.min_speech_duration_ms  = params.vad_min_speech_duration_ms;
-            wparams.vad_params.min_silence_duration_ms = params.vad_min_silence_duration_ms;
-            wparams.vad_params.max_speech_duration_s   = params.vad_max_speech_duration_s;
-            wparams.vad_params.speech_pad_ms           = params.vad_speech_pad_ms;
-            wparams.vad_params.samples_overlap         = params.vad_samples_overlap;
-
-            whisper_print_user_data user_data = { &params, &pcmf32s, 0 };
-
-            const auto & grammar_parsed = params.grammar_parsed;
-            auto grammar_rules = grammar_parsed.c_rules();
-
-            if (use_grammar) {
-                if (grammar_parsed.symbol_ids.find(params.grammar_rule) == grammar_parsed.symbol_ids.end()) {
-                    fprintf(stderr, "%s: warning: grammar rule '%s' not found - skipping grammar sampling\n", __func__, params.grammar_rule.c_str());
-                } else {
-                    wparams.grammar_rules = grammar_rules.data();
-                    wparams.n_grammar_rules = grammar_rules.size();
-                    wparams.i_start_rule = grammar_parsed.symbol_ids.at(params.grammar_rule);
-                    wparams.grammar_penalty = params.grammar_penalty;
-                }
-            }
 
             // this callback is called on each new segment
             if (!wparams.print_realtime) {
@@ -1228,7 +2101,54 @@ int main(int argc, char ** argv) {
                 wparams.abort_callback_user_data = &is_aborted;
             }
 
-            if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
+            if (params.split_channels) {
+                const int n_channels = states_ch.size();
+
+                std::vector<whisper_full_params> wparams_ch(n_channels, wparams);
+                std::vector<const float *>       samples_ch(n_channels);
+                std::vector<int>                 n_samples_ch(n_channels);
+
+                // the segments are printed once the channels are transcribed, see output_console()
+                for (int c = 0; c < n_channels; ++c) {
+                    wparams_ch[c].new_segment_callback = nullptr;
+                    wparams_ch[c].progress_callback    = nullptr;
+                    wparams_ch[c].threadpool           = nullptr;
+                    wparams_ch[c].draft_ctx            = nullptr;
+                    wparams_ch[c].cascade_ctx          = nullptr;
+                    wparams_ch[c].vad_ctx              = c == 0 ? vctx : vctx_ch;
+
+                    samples_ch[c]   = pcmf32s[c].data();
+                    n_samples_ch[c] = pcmf32s[c].size();
+                }
+
+                if (whisper_full_batch(ctx, states_ch.data(), wparams_ch.data(), samples_ch.data(), n_samples_ch.data(), n_channels, nullptr) != 0) {
+                    fprintf(stderr, "%s: failed to process audio\n", argv[0]);
+                    return 10;
+                }
+            } else if (stream.reader) {
+                auto read_callback = [](float * pcm, int n_max, void * user_data) {
+                    auto & stream = *(stream_input *) user_data;
+
+                    const int n = audio_reader_read(stream.reader, pcm, n_max);
+                    stream.n_samples += std::max(n, 0);
+
+                    return n;
+                };
+
+                const int ret = whisper_full_stream(ctx, wparams, read_callback, &stream, params.stream_block*1000);
+
+                audio_reader_close(stream.reader);
+
+                if (ret != 0) {
+                    fprintf(stderr, "%s: failed to process audio\n", argv[0]);
+                    return 10;
+                }
+            } else if (params.chunk_batch > 0) {
+                if (whisper_full_chunked(ctx, wparams, pcmf32.data(), pcmf32.size(), params.chunk_batch, params.chunk_overlap) != 0) {
+                    fprintf(stderr, "%s: failed to process audio\n", argv[0]);
+                    return 10;
+                }
+            } else if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 return 10;
             }
@@ -1236,34 +2156,70 @@ int main(int argc, char ** argv) {
 
         // output stuff
         {
-            // macros to stringify function name
-#define output_func(func, ext, param, ...) if (param && fout_factory.open(ext, #func)) {\
-    func(ctx, fout_factory.fout, params, __VA_ARGS__); \
-}
-#define output_ext(ext, ...) output_func(output_##ext, "." #ext, params.output_##ext, __VA_ARGS__)
+            output_job job;
 
-            output_ext(txt, pcmf32s);
-            output_ext(vtt, pcmf32s);
-            output_ext(srt, pcmf32s);
-            output_ext(wts, pcmf32s, fname_inp.c_str(), float(pcmf32.size() + 1000)/WHISPER_SAMPLE_RATE, fout_factory.fname_out.c_str());
-            output_ext(csv, pcmf32s);
-            output_func(output_json, ".json", params.output_jsn, pcmf32s);
-            output_ext(lrc, pcmf32s);
-            output_func(output_score, ".score.txt", params.log_score, pcmf32s);
+            output_job_files(fout_factory, params, job);
 
-#undef output_ext
-#undef output_func
+            // -sc: the segments of the channels are printed once the file is transcribed
+            const bool print_channels = params.split_channels && !fout_factory.is_stdout;
+
+            // the segments are read once for all the formats, the files are written while the next file is transcribed
+            if (!job.files.empty() || print_channels) {
+                job.params = params;
+
+                job.tr.fname_inp = fname_inp;
+                job.tr.t_sec     = float(n_samples + stream.n_samples + 1000)/WHISPER_SAMPLE_RATE;
+
+                const bool with_tokens = params.output_wts || params.output_jsn_full || params.log_score;
 
-            if (fout_factory.is_stdout && !fout_factory.used_stdout) {
-                fprintf(stderr, "warning: '--output-file -' used without any other '--output-*'");
+                if (params.split_channels) {
+                    transcript_read_channels(ctx, states_ch.data(), states_ch.size(), params, with_tokens, job.tr);
+                } else {
+                    transcript_read(ctx, nullptr, params, energy, with_tokens, job.tr);
+                }
+
+                if (print_channels) {
+                    std::ostringstream out;
+                    output_console(job.tr, out, params);
+                    printf("%s", out.str().c_str());
+                    fflush(stdout);
+                }
+
+                if (!job.files.empty()) {
+                    writer.write(std::move(job), !fout_factory.is_stdout);
+                }
             }
         }
     }
 
+    writer.wait();
+
     if (!params.no_prints) {
         whisper_print_timings(ctx);
     }
+    if (cparams.profile) {
+        whisper_print_profile(ctx);
+        whisper_profile_write_trace(ctx, params.fname_profile.c_str());
+    }
+    if (cparams.imatrix) {
+        whisper_imatrix_write(ctx, params.fname_imatrix.c_str());
+    }
+    if (threadpool && !params.no_prints) {
+        int64_t t_spin_us = 0, n_spin = 0, n_sleep = 0;
+        if (whisper_threadpool_poll_stats(threadpool, &t_spin_us, &n_spin, &n_sleep) == 0) {
+            fprintf(stderr, "%s: threadpool: spin = %8.2f ms, woken while spinning = %lld, slept = %lld\n", __func__,
+                    t_spin_us/1000.0, (long long) n_spin, (long long) n_sleep);
+        }
+    }
+    for (auto * state : states_ch) {
+        whisper_free_state(state);
+    }
+    whisper_vad_free(vctx_ch);
+    whisper_vad_free(vctx);
+    whisper_free(ctx_cascade);
+    whisper_free(ctx_draft);
     whisper_free(ctx);
+    whisper_threadpool_free(threadpool);
 
     return 0;
 }
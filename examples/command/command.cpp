@@ -268,27 +268,30 @@ static int process_command_list(struct whisper_context * ctx, audio_async &audio
 
     for (const auto & cmd : allowed_commands) {
         whisper_token tokens[1024];
-        allowed_tokens.emplace_back();
 
-        for (int l = 0; l < (int) cmd.size(); ++l) {
-            // NOTE: very important to add the whitespace !
-            //       the reason is that the first decoded token starts with a whitespace too!
-            std::string ss = std::string(" ") + cmd.substr(0, l + 1);
+        // NOTE: very important to add the whitespace !
+        //       the reason is that the first decoded token starts with a whitespace too!
+        std::string ss = std::string(" ") + cmd;
 
-            const int n = whisper_tokenize(ctx, ss.c_str(), tokens, 1024);
-            if (n < 0) {
-                fprintf(stderr, "%s: error: failed to tokenize command '%s'\n", __func__, cmd.c_str());
-                return 3;
-            }
-
-            if (n == 1) {
-                allowed_tokens.back().push_back(tokens[0]);
-            }
+        const int n = whisper_tokenize(ctx, ss.c_str(), tokens, 1024);
+        if (n <= 0) {
+            fprintf(stderr, "%s: error: failed to tokenize command '%s'\n", __func__, cmd.c_str());
+            return 3;
         }
 
+        allowed_tokens.emplace_back(tokens, tokens + n);
+
         max_len = std::max(max_len, (int) cmd.size());
     }
 
+    std::vector<const whisper_token *> allowed_ptrs;
+    std::vector<int>                   allowed_lens;
+
+    for (const auto & tokens : allowed_tokens) {
+        allowed_ptrs.push_back(tokens.data());
+        allowed_lens.push_back(tokens.size());
+    }
+
     fprintf(stderr, "%s: allowed commands [ tokens ]:\n", __func__);
     fprintf(stderr, "\n");
     for (int i = 0; i < (int) allowed_commands.size(); ++i) {
@@ -362,54 +365,54 @@ static int process_command_list(struct whisper_context * ctx, audio_async &audio
             wparams.no_context       = true;
             wparams.single_segment   = true;
             wparams.max_tokens       = 1;
+            wparams.temperature_inc  = 0.0f;
             wparams.language         = params.language.c_str();
             wparams.n_threads        = params.n_threads;
 
             wparams.audio_ctx        = params.audio_ctx;
 
-            wparams.prompt_tokens    = k_tokens.data();
-            wparams.prompt_n_tokens  = k_tokens.size();
-
-            // run the transformer and a single decoding pass
+            // run the encoder (and detect the language) - the decoded token is not used
             if (whisper_full(ctx, wparams, pcmf32_cur.data(), pcmf32_cur.size()) != 0) {
                 fprintf(stderr, "%s: ERROR: whisper_full() failed\n", __func__);
                 break;
             }
 
-            // estimate command probability
-            // NOTE: not optimal
+            // the decoder prompt: the list of commands, then the start of the transcription
+            std::vector<whisper_token> prompt = { whisper_token_prev(ctx) };
             {
-                const auto * logits = whisper_get_logits(ctx);
+                const int n_take = std::min((int) k_tokens.size(), whisper_n_text_ctx(ctx)/2);
 
-                std::vector<float> probs(whisper_n_vocab(ctx), 0.0f);
-
-                // compute probs from logits via softmax
-                {
-                    float max = -1e9;
-                    for (int i = 0; i < (int) probs.size(); ++i) {
-                        max = std::max(max, logits[i]);
-                    }
+                prompt.insert(prompt.end(), k_tokens.end() - n_take, k_tokens.end());
+                prompt.push_back(whisper_token_sot(ctx));
 
-                    float sum = 0.0f;
-                    for (int i = 0; i < (int) probs.size(); ++i) {
-                        probs[i] = expf(logits[i] - max);
-                        sum += probs[i];
-                    }
+                if (whisper_is_multilingual(ctx)) {
+                    const int lang_id = params.language == "auto" ? whisper_full_lang_id(ctx) : whisper_lang_id(params.language.c_str());
 
-                    for (int i = 0; i < (int) probs.size(); ++i) {
-                        probs[i] /= sum;
-                    }
+                    prompt.push_back(whisper_token_lang(ctx, lang_id));
+                    prompt.push_back(params.translate ? whisper_token_translate(ctx) : whisper_token_transcribe(ctx));
                 }
 
+                prompt.push_back(whisper_token_not(ctx));
+            }
+
+            // score all commands in a single decoder pass, sharing the KV cache of the prompt
+            std::vector<float> logprobs(allowed_commands.size());
+
+            if (whisper_score(ctx, prompt.data(), prompt.size(), allowed_ptrs.data(), allowed_lens.data(), allowed_commands.size(), logprobs.data(), params.n_threads) != 0) {
+                fprintf(stderr, "%s: ERROR: whisper_score() failed\n", __func__);
+                break;
+            }
+
+            // estimate command probability
+            {
                 std::vector<std::pair<float, int>> probs_id;
 
+                // softmax over the commands
+                const float max = *std::max_element(logprobs.begin(), logprobs.end());
+
                 double psum = 0.0;
                 for (int i = 0; i < (int) allowed_commands.size(); ++i) {
-                    probs_id.emplace_back(probs[allowed_tokens[i][0]], i);
-                    for (int j = 1; j < (int) allowed_tokens[i].size(); ++j) {
-                        probs_id.back().first += probs[allowed_tokens[i][j]];
-                    }
-                    probs_id.back().first /= allowed_tokens[i].size();
+                    probs_id.emplace_back(expf(logprobs[i] - max), i);
                     psum += probs_id.back().first;
                 }
 
@@ -430,9 +433,9 @@ static int process_command_list(struct whisper_context * ctx, audio_async &audio
                 {
                     fprintf(stdout, "\n");
                     for (const auto & cmd : probs_id) {
-                        fprintf(stdout, "%s: %s%-*s%s = %f | ", __func__, "\033[1m", max_len, allowed_commands[cmd.second].c_str(), "\033[0m", cmd.first);
+                        fprintf(stdout, "%s: %s%-*s%s = %f | logprob = %8.3f | ", __func__, "\033[1m", max_len, allowed_commands[cmd.second].c_str(), "\033[0m", cmd.first, logprobs[cmd.second]);
                         for (int token : allowed_tokens[cmd.second]) {
-                            fprintf(stdout, "'%4s' %f ", whisper_token_to_str(ctx, token), probs[token]);
+                            fprintf(stdout, "'%s' ", whisper_token_to_str(ctx, token));
                         }
                         fprintf(stdout, "\n");
                     }
@@ -0,0 +1,582 @@
+#include "common-download.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#define whisper_mkdir(path) _mkdir(path)
+#else
+#include <unistd.h>
+#define whisper_mkdir(path) mkdir(path, 0755)
+#endif
+
+#ifdef WHISPER_CURL
+#include <curl/curl.h>
+#endif
+
+//
+// SHA-256
+//
+
+namespace {
+
+struct sha256_ctx {
+    uint32_t state[8];
+    uint64_t n_bytes;
+    uint8_t  block[64];
+    size_t   n_block;
+};
+
+const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+inline uint32_t sha256_rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void sha256_init(sha256_ctx & ctx) {
+    static const uint32_t h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(ctx.state, h0, sizeof(h0));
+    ctx.n_bytes = 0;
+    ctx.n_block = 0;
+}
+
+void sha256_transform(sha256_ctx & ctx, const uint8_t * data) {
+    uint32_t w[64];
+
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t) data[4*i] << 24 | (uint32_t) data[4*i + 1] << 16 | (uint32_t) data[4*i + 2] << 8 | (uint32_t) data[4*i + 3];
+    }
+
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = sha256_rotr(w[i - 15],  7) ^ sha256_rotr(w[i - 15], 18) ^ (w[i - 15] >>  3);
+        const uint32_t s1 = sha256_rotr(w[i -  2], 17) ^ sha256_rotr(w[i -  2], 19) ^ (w[i -  2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx.state[0], b = ctx.state[1], c = ctx.state[2], d = ctx.state[3];
+    uint32_t e = ctx.state[4], f = ctx.state[5], g = ctx.state[6], h = ctx.state[7];
+
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t s1 = sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25);
+        const uint32_t ch = (e & f) ^ (~e & g);
+        const uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        const uint32_t s0 = sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22);
+        const uint32_t mj = (a & b) ^ (a & c) ^ (b & c);
+        const uint32_t t2 = s0 + mj;
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx.state[0] += a; ctx.state[1] += b; ctx.state[2] += c; ctx.state[3] += d;
+    ctx.state[4] += e; ctx.state[5] += f; ctx.state[6] += g; ctx.state[7] += h;
+}
+
+void sha256_update(sha256_ctx & ctx, const uint8_t * data, size_t n) {
+    ctx.n_bytes += n;
+
+    while (n > 0) {
+        if (ctx.n_block == 0 && n >= 64) {
+            sha256_transform(ctx, data);
+            data += 64;
+            n    -= 64;
+            continue;
+        }
+
+        const size_t m = std::min(n, 64 - ctx.n_block);
+
+        memcpy(ctx.block + ctx.n_block, data, m);
+        ctx.n_block += m;
+        data        += m;
+        n           -= m;
+
+        if (ctx.n_block == 64) {
+            sha256_transform(ctx, ctx.block);
+            ctx.n_block = 0;
+        }
+    }
+}
+
+std::string sha256_final(sha256_ctx & ctx) {
+    const uint64_t n_bits = ctx.n_bytes*8;
+
+    const uint8_t pad = 0x80;
+    const uint8_t zero = 0x00;
+
+    sha256_update(ctx, &pad, 1);
+    while (ctx.n_block != 56) {
+        sha256_update(ctx, &zero, 1);
+    }
+
+    uint8_t len[8];
+    for (int i = 0; i < 8; ++i) {
+        len[i] = (uint8_t) (n_bits >> (56 - 8*i));
+    }
+    sha256_update(ctx, len, 8);
+
+    char hex[65];
+    for (int i = 0; i < 8; ++i) {
+        snprintf(hex + 8*i, 9, "%08x", ctx.state[i]);
+    }
+
+    return std::string(hex, 64);
+}
+
+std::string sha256_string(const std::string & s) {
+    sha256_ctx ctx;
+    sha256_init(ctx);
+    sha256_update(ctx, (const uint8_t *) s.data(), s.size());
+
+    return sha256_final(ctx);
+}
+
+//
+// files
+//
+
+bool file_exists(const std::string & path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+bool make_dir(const std::string & path) {
+    return whisper_mkdir(path.c_str()) == 0 || errno == EEXIST;
+}
+
+std::string read_line(const std::string & path) {
+    std::string line;
+
+    FILE * f = fopen(path.c_str(), "rb");
+    if (f) {
+        char buf[256];
+        if (fgets(buf, sizeof(buf), f)) {
+            line = buf;
+            line.erase(line.find_last_not_of(" \r\n\t") + 1);
+        }
+        fclose(f);
+    }
+
+    return line;
+}
+
+std::string default_cache_dir() {
+    const char * dir = getenv("WHISPER_CACHE_DIR");
+    if (dir && dir[0]) {
+        return dir;
+    }
+
+    const char * xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && xdg[0]) {
+        return std::string(xdg) + "/whisper.cpp";
+    }
+
+#if defined(_WIN32)
+    const char * home = getenv("LOCALAPPDATA");
+#else
+    const char * home = getenv("HOME");
+#endif
+    if (home && home[0]) {
+#if defined(_WIN32)
+        return std::string(home) + "/whisper.cpp";
+#else
+        return std::string(home) + "/.cache/whisper.cpp";
+#endif
+    }
+
+    return "";
+}
+
+//
+// download
+//
+
+#ifdef WHISPER_CURL
+
+int64_t file_size(const std::string & path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    return (int64_t) st.st_size;
+}
+
+// write through a temporary file, so that the other processes see either the old or the new content
+bool write_line(const std::string & path, const std::string & line) {
+    const std::string tmp = path + ".tmp" + std::to_string((long long) std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    FILE * f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    const bool ok = fprintf(f, "%s\n", line.c_str()) > 0;
+
+    if (fclose(f) != 0 || !ok) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+#if defined(_WIN32)
+    remove(path.c_str());
+#endif
+
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// the parts of a download are at least this large, so that small models are not split in tiny requests
+const int64_t fetch_part_min = 16*1024*1024;
+
+const int fetch_retries = 5;
+
+struct fetch_part {
+    std::string path;
+    int64_t     begin; // [begin, end) in the file, end = -1 for the whole file of unknown size
+    int64_t     end;
+};
+
+size_t fetch_write(char * ptr, size_t size, size_t nmemb, void * userdata) {
+    return fwrite(ptr, size, nmemb, (FILE *) userdata);
+}
+
+// size of the file, and whether the server accepts range requests
+bool fetch_head(const std::string & url, int64_t & size, bool & ranges) {
+    size   = -1;
+    ranges = false;
+
+    CURL * curl = curl_easy_init();
+    if (!curl) {
+        return false;
+    }
+
+    std::string accept_ranges;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, +[](char * buffer, size_t size, size_t nitems, void * userdata) -> size_t {
+        const size_t n = size*nitems;
+
+        std::string header(buffer, n);
+        std::transform(header.begin(), header.end(), header.begin(), ::tolower);
+
+        if (header.rfind("accept-ranges:", 0) == 0) {
+            *(std::string *) userdata = header.substr(14);
+        }
+
+        return n;
+    });
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &accept_ranges);
+
+    const CURLcode res = curl_easy_perform(curl);
+
+    if (res == CURLE_OK) {
+        curl_off_t length = -1;
+        if (curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK && length > 0) {
+            size = (int64_t) length;
+        }
+        ranges = accept_ranges.find("bytes") != std::string::npos;
+    } else {
+        fprintf(stderr, "%s: HEAD '%s' failed: %s\n", __func__, url.c_str(), curl_easy_strerror(res));
+    }
+
+    curl_easy_cleanup(curl);
+
+    return res == CURLE_OK;
+}
+
+// download the part, appending to what is already in its file
+bool fetch_range(const std::string & url, const fetch_part & part) {
+    for (int attempt = 0; attempt < fetch_retries; ++attempt) {
+        int64_t have = std::max<int64_t>(0, file_size(part.path));
+
+        if (part.end >= 0 && have > part.end - part.begin) {
+            // not the part of this download
+            remove(part.path.c_str());
+            have = 0;
+        }
+
+        if (part.end >= 0 && have == part.end - part.begin) {
+            return true;
+        }
+
+        // without ranges, the whole file is downloaded again
+        FILE * f = fopen(part.path.c_str(), part.end >= 0 ? "ab" : "wb");
+        if (!f) {
+            fprintf(stderr, "%s: failed to open '%s'\n", __func__, part.path.c_str());
+            return false;
+        }
+
+        CURL * curl = curl_easy_init();
+        if (!curl) {
+            fclose(f);
+            return false;
+        }
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, fetch_write);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, f);
+
+        // give up on stalled connections, the next attempt resumes from the end of the file
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+
+        std::string range;
+        if (part.end >= 0) {
+            range = std::to_string((long long) (part.begin + have)) + "-" + std::to_string((long long) (part.end - 1));
+            curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+        }
+
+        const CURLcode res = curl_easy_perform(curl);
+
+        curl_easy_cleanup(curl);
+        fclose(f);
+
+        if (res == CURLE_OK && (part.end < 0 || file_size(part.path) == part.end - part.begin)) {
+            return true;
+        }
+
+        fprintf(stderr, "%s: attempt %d of '%s' [%lld, %lld) failed: %s\n", __func__, attempt + 1, url.c_str(),
+                (long long) part.begin, (long long) part.end, res == CURLE_OK ? "short read" : curl_easy_strerror(res));
+    }
+
+    return false;
+}
+
+#endif // WHISPER_CURL
+
+} // namespace
+
+bool is_url(const std::string & path) {
+    return path.rfind("http://", 0) == 0 || path.rfind("https://", 0) == 0;
+}
+
+std::string sha256_file(const std::string & fname) {
+    FILE * f = fopen(fname.c_str(), "rb");
+    if (!f) {
+        return "";
+    }
+
+    sha256_ctx ctx;
+    sha256_init(ctx);
+
+    std::vector<uint8_t> buf(1 << 20);
+
+    size_t n = 0;
+    while ((n = fread(buf.data(), 1, buf.size(), f)) > 0) {
+        sha256_update(ctx, buf.data(), n);
+    }
+
+    const bool ok = !ferror(f);
+
+    fclose(f);
+
+    return ok ? sha256_final(ctx) : "";
+}
+
+std::string fetch_model(const std::string & url, const fetch_params & params) {
+    const std::string dir = params.cache_dir.empty() ? default_cache_dir() : params.cache_dir;
+    if (dir.empty()) {
+        fprintf(stderr, "%s: no cache directory, set WHISPER_CACHE_DIR\n", __func__);
+        return "";
+    }
+
+    const std::string dir_blobs = dir + "/blobs";
+    const std::string dir_refs  = dir + "/refs";
+    const std::string dir_tmp   = dir + "/tmp";
+
+    if (!make_dir(dir) || !make_dir(dir_blobs) || !make_dir(dir_refs) || !make_dir(dir_tmp)) {
+        fprintf(stderr, "%s: failed to create the cache directory '%s'\n", __func__, dir.c_str());
+        return "";
+    }
+
+    const std::string key      = sha256_string(url);
+    const std::string path_ref = dir_refs + "/" + key;
+
+    std::string sha256 = params.sha256;
+    std::transform(sha256.begin(), sha256.end(), sha256.begin(), ::tolower);
+
+    // the URL of an expected hash does not matter, the same model may be cached from another mirror
+    const std::string sha256_cached = sha256.empty() ? read_line(path_ref) : sha256;
+
+    if (!sha256_cached.empty()) {
+        const std::string path_blob = dir_blobs + "/sha256-" + sha256_cached;
+
+        if (file_exists(path_blob)) {
+            if (!params.verify || sha256_file(path_blob) == sha256_cached) {
+                fprintf(stderr, "%s: using the cached model '%s'\n", __func__, path_blob.c_str());
+                return path_blob;
+            }
+
+            fprintf(stderr, "%s: the cached model '%s' is corrupted, downloading it again\n", __func__, path_blob.c_str());
+            remove(path_blob.c_str());
+        }
+    }
+
+#ifdef WHISPER_CURL
+    static std::atomic<bool> curl_init(false);
+    if (!curl_init.exchange(true)) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+    }
+
+    int64_t size   = -1;
+    bool    ranges = false;
+
+    if (!fetch_head(url, size, ranges)) {
+        return "";
+    }
+
+    std::vector<fetch_part> parts;
+
+    // the parts are named by the size of the file, so that the parts of another version of the file are not resumed
+    const std::string prefix = dir_tmp + "/" + key + "-" + std::to_string((long long) size);
+
+    if (size > 0 && ranges) {
+        const int64_t n_parts = std::max<int64_t>(1, std::min<int64_t>(std::max(1, params.n_parallel), (size + fetch_part_min - 1)/fetch_part_min));
+        const int64_t n_per   = (size + n_parts - 1)/n_parts;
+
+        for (int64_t i = 0; i < n_parts; ++i) {
+            const int64_t begin = i*n_per;
+            const int64_t end   = std::min(size, begin + n_per);
+
+            if (begin < end) {
+                parts.push_back({ prefix + ".part" + std::to_string((long long) i), begin, end });
+            }
+        }
+    } else {
+        parts.push_back({ prefix + ".part0", 0, -1 });
+    }
+
+    fprintf(stderr, "%s: downloading '%s' (%.1f MB) in %d part(s)\n", __func__, url.c_str(), size > 0 ? size/1e6 : 0.0, (int) parts.size());
+
+    std::vector<std::thread> workers;
+    std::atomic<int> n_failed(0);
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        workers.emplace_back([&, i]() {
+            if (!fetch_range(url, parts[i])) {
+                n_failed++;
+            }
+        });
+    }
+
+    for (auto & w : workers) {
+        w.join();
+    }
+
+    if (n_failed > 0) {
+        fprintf(stderr, "%s: failed to download '%s', the completed parts are kept for the next attempt\n", __func__, url.c_str());
+        return "";
+    }
+
+    // join the parts, computing the hash on the way
+    const std::string path_tmp = prefix + ".bin";
+
+    FILE * fout = fopen(path_tmp.c_str(), "wb");
+    if (!fout) {
+        fprintf(stderr, "%s: failed to open '%s'\n", __func__, path_tmp.c_str());
+        return "";
+    }
+
+    sha256_ctx ctx;
+    sha256_init(ctx);
+
+    std::vector<uint8_t> buf(1 << 20);
+
+    bool ok = true;
+
+    for (const auto & part : parts) {
+        FILE * fin = fopen(part.path.c_str(), "rb");
+        if (!fin) {
+            ok = false;
+            break;
+        }
+
+        size_t n = 0;
+        while ((n = fread(buf.data(), 1, buf.size(), fin)) > 0) {
+            sha256_update(ctx, buf.data(), n);
+            if (fwrite(buf.data(), 1, n, fout) != n) {
+                ok = false;
+                break;
+            }
+        }
+
+        fclose(fin);
+
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (fclose(fout) != 0 || !ok) {
+        fprintf(stderr, "%s: failed to write '%s'\n", __func__, path_tmp.c_str());
+        remove(path_tmp.c_str());
+        return "";
+    }
+
+    for (const auto & part : parts) {
+        remove(part.path.c_str());
+    }
+
+    const std::string sha256_got = sha256_final(ctx);
+
+    if (!sha256.empty() && sha256_got != sha256) {
+        fprintf(stderr, "%s: SHA-256 mismatch for '%s': expected %s, got %s\n", __func__, url.c_str(), sha256.c_str(), sha256_got.c_str());
+        remove(path_tmp.c_str());
+        return "";
+    }
+
+    const std::string path_blob = dir_blobs + "/sha256-" + sha256_got;
+
+    // another process may have stored the same model meanwhile - the content is the same
+#if defined(_WIN32)
+    if (file_exists(path_blob)) {
+        remove(path_tmp.c_str());
+    } else
+#endif
+    if (rename(path_tmp.c_str(), path_blob.c_str()) != 0) {
+        fprintf(stderr, "%s: failed to move the model to '%s'\n", __func__, path_blob.c_str());
+        remove(path_tmp.c_str());
+        return "";
+    }
+
+    if (!write_line(path_ref, sha256_got)) {
+        fprintf(stderr, "%s: failed to write '%s'\n", __func__, path_ref.c_str());
+    }
+
+    fprintf(stderr, "%s: stored '%s' as '%s'\n", __func__, url.c_str(), path_blob.c_str());
+
+    return path_blob;
+#else
+    fprintf(stderr, "%s: '%s' is not in the cache and whisper is built without WHISPER_CURL\n", __func__, url.c_str());
+    return "";
+#endif
+}
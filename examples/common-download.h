@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+// Model download with a content-addressed cache
+//
+// The cache directory is shared by all the processes that fetch models (e.g. a volume of the nodes):
+//
+//   <cache_dir>/blobs/sha256-<hex>  - the models, named by the SHA-256 of their content
+//   <cache_dir>/refs/<hex>          - the SHA-256 of the model of an URL (the file is named by the SHA-256 of the URL)
+//   <cache_dir>/tmp/                - the parts of the downloads in progress
+//
+// A model is downloaded with up to n_parallel HTTP range requests at once, in parts that are kept in tmp/ when the
+// download is interrupted and resumed by the next fetch of the same URL. The SHA-256 of the whole file is computed
+// once the parts are complete (and checked against sha256 if it is given) before the model is moved into blobs/.
+
+struct fetch_params {
+    std::string cache_dir;      // empty - $WHISPER_CACHE_DIR, else $XDG_CACHE_HOME/whisper.cpp, else ~/.cache/whisper.cpp
+    std::string sha256;         // expected SHA-256 of the model (hex), optional
+    int         n_parallel = 8; // number of range requests at once
+    bool        verify = false; // also compute the SHA-256 of a model that is already in the cache
+};
+
+// true for the http:// and https:// model paths
+bool is_url(const std::string & path);
+
+// Return the path of the cached model of url, after downloading it if it is not in the cache yet
+// Without WHISPER_CURL, only the models that are already in the cache can be returned
+// Returns an empty string on error
+std::string fetch_model(const std::string & url, const fetch_params & params);
+
+// SHA-256 of the content of a file (hex), empty if the file cannot be read
+std::string sha256_file(const std::string & fname);
@@ -1,5 +1,7 @@
 #include "common-ggml.h"
 
+#include <cmath>
+#include <cstring>
 #include <regex>
 #include <map>
 
@@ -38,12 +40,59 @@ enum ggml_ftype ggml_parse_ftype(const char * str) {
     return ftype;
 }
 
+enum ggml_type ggml_parse_type(const char * str) {
+    if (strcmp(str, "f32") == 0) {
+        return GGML_TYPE_F32;
+    }
+    if (strcmp(str, "f16") == 0) {
+        return GGML_TYPE_F16;
+    }
+
+    const auto it = GGML_FTYPE_MAP.find(str);
+    if (it == GGML_FTYPE_MAP.end()) {
+        return GGML_TYPE_COUNT;
+    }
+
+    return ggml_ftype_to_ggml_type(it->second);
+}
+
+// the legacy type of similar size of a K-quant
+static ggml_type ggml_fallback_type(ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_Q2_K:
+        case GGML_TYPE_Q3_K: return GGML_TYPE_Q4_0;
+        case GGML_TYPE_Q4_K: return GGML_TYPE_Q5_0;
+        case GGML_TYPE_Q5_K: return GGML_TYPE_Q5_1;
+        case GGML_TYPE_Q6_K: return GGML_TYPE_Q8_0;
+        default:             return type;
+    }
+}
+
+// relative RMS error of the quantized values q of x
+static float ggml_quantize_error(ggml_type type, const float * x, const void * q, int64_t n) {
+    std::vector<float> y(n);
+    ggml_get_type_traits(type)->to_float(q, y.data(), n);
+
+    double sum_err = 0.0;
+    double sum_x   = 0.0;
+    for (int64_t i = 0; i < n; ++i) {
+        sum_err += double(x[i] - y[i])*(x[i] - y[i]);
+        sum_x   += double(x[i])*x[i];
+    }
+
+    return sum_x > 0.0 ? (float) sqrt(sum_err/sum_x) : 0.0f;
+}
+
 bool ggml_common_quantize_0(
         std::ifstream & finp,
         std::ofstream & fout,
         const ggml_ftype ftype,
         const std::vector<std::string> & to_quant,
-        const std::vector<std::string> & to_skip) {
+        const std::vector<std::string> & to_skip,
+        const std::vector<ggml_tensor_type_rule> & rules,
+        const ggml_imatrix & imatrix,
+        const std::vector<std::string> & to_flatten,
+        float max_err_flatten) {
 
     ggml_type qtype = GGML_TYPE_F32;
 
@@ -86,6 +135,11 @@ bool ggml_common_quantize_0(
     size_t total_size_org = 0;
     size_t total_size_new = 0;
 
+    int n_quantized = 0;
+    int n_fallback  = 0;
+    int n_imatrix   = 0;
+    int n_flattened = 0;
+
     std::vector<float> work;
 
     std::vector<uint8_t>     data_u8;
@@ -135,8 +189,50 @@ bool ggml_common_quantize_0(
             }
         }
 
+        // check if this 3D tensor is quantized as the 2D tensor [ne0*ne1, ne2]
+        bool flatten = false;
+        if (quantize && n_dims == 3) {
+            for (const auto & s : to_flatten) {
+                if (std::regex_match(name, std::regex(s))) {
+                    flatten = true;
+                    break;
+                }
+            }
+        }
+
         // quantize only 2D tensors
-        quantize &= (n_dims == 2);
+        quantize &= (n_dims == 2 || flatten);
+
+        // the rows that are quantized
+        const int32_t n_per_row = flatten ? ne[0]*ne[1] : ne[0];
+
+        ggml_type type = qtype;
+
+        if (quantize) {
+            for (const auto & rule : rules) {
+                if (std::regex_match(name, std::regex(rule.pattern))) {
+                    type = rule.type;
+                    break;
+                }
+            }
+
+            if (type != qtype && n_per_row % ggml_blck_size(type) != 0) {
+                fprintf(stderr, "%s: the rows of %s are not a multiple of %d for %s, using %s\n",
+                        __func__, name.c_str(), (int) ggml_blck_size(type), ggml_type_name(type), ggml_type_name(qtype));
+                type = qtype;
+            }
+
+            if (n_per_row % ggml_blck_size(type) != 0) {
+                type = ggml_fallback_type(type);
+                n_fallback++;
+            }
+
+            // the tensors that keep their type are copied, as well as the flattened tensors whose rows are still not
+            // a multiple of the block (e.g. the 3*80 values of the kernel of the first convolution)
+            quantize = type != (ggml_type) ttype && n_per_row % ggml_blck_size(type) == 0;
+        }
+
+        flatten &= quantize && ggml_is_quantized(type);
 
         if (quantize) {
             if (ttype != GGML_TYPE_F32 && ttype != GGML_TYPE_F16) {
@@ -156,7 +252,7 @@ bool ggml_common_quantize_0(
                 finp.read(reinterpret_cast<char *>(data_f32.data()), nelements * sizeof(float));
             }
 
-            ttype = qtype;
+            ttype = type;
         } else {
             const int bpe = (ttype == 0) ? sizeof(float) : sizeof(uint16_t);
 
@@ -164,18 +260,11 @@ bool ggml_common_quantize_0(
             finp.read(reinterpret_cast<char *>(data_u8.data()), nelements * bpe);
         }
 
-        fout.write(reinterpret_cast<char *>(&n_dims), sizeof(n_dims));
-        fout.write(reinterpret_cast<char *>(&length), sizeof(length));
-        fout.write(reinterpret_cast<char *>(&ttype),  sizeof(ttype));
-        for (int i = 0; i < n_dims; ++i) {
-            fout.write(reinterpret_cast<char *>(&ne[i]), sizeof(ne[i]));
-        }
-        fout.write(&name[0], length);
+        size_t cur_size = 0;
 
         if (quantize) {
             work.resize(nelements); // for quantization
 
-            size_t cur_size = 0;
             switch ((ggml_type) ttype) {
                 case GGML_TYPE_Q4_0:
                 case GGML_TYPE_Q4_1:
@@ -188,10 +277,44 @@ bool ggml_common_quantize_0(
                 case GGML_TYPE_Q5_K:
                 case GGML_TYPE_Q6_K:
                     {
-                        cur_size = ggml_quantize_chunk((ggml_type) ttype, data_f32.data(), work.data(), 0, nelements/ne[0], ne[0], nullptr);
+                        const float * imatrix_data = nullptr;
+
+                        const auto it = imatrix.find(name);
+                        if (it != imatrix.end() && (int) it->second.size() == ne[0]) {
+                            imatrix_data = it->second.data();
+                            n_imatrix++;
+                        }
+
+                        cur_size = ggml_quantize_chunk((ggml_type) ttype, data_f32.data(), work.data(), 0, nelements/n_per_row, n_per_row, imatrix_data);
+                        n_quantized++;
+
+                        // accuracy check of the flattened tensors: fall back to Q8_0 when the relative RMS error of
+                        // the dequantized values is too large
+                        if (flatten) {
+                            float err = ggml_quantize_error((ggml_type) ttype, data_f32.data(), work.data(), nelements);
+
+                            if (err > max_err_flatten && ttype != GGML_TYPE_Q8_0 && n_per_row % ggml_blck_size(GGML_TYPE_Q8_0) == 0) {
+                                printf("error = %.4f > %.4f, using %s ", err, max_err_flatten, ggml_type_name(GGML_TYPE_Q8_0));
+
+                                ttype    = GGML_TYPE_Q8_0;
+                                cur_size = ggml_quantize_chunk(GGML_TYPE_Q8_0, data_f32.data(), work.data(), 0, nelements/n_per_row, n_per_row, nullptr);
+                                err      = ggml_quantize_error(GGML_TYPE_Q8_0, data_f32.data(), work.data(), nelements);
+                            }
+
+                            printf("error = %.4f ", err);
+                            n_flattened++;
+                        }
                     } break;
                 case GGML_TYPE_F32:
+                    {
+                        memcpy(work.data(), data_f32.data(), nelements*sizeof(float));
+                        cur_size = nelements*sizeof(float);
+                    } break;
                 case GGML_TYPE_F16:
+                    {
+                        ggml_fp32_to_fp16_row(data_f32.data(), (ggml_fp16_t *) work.data(), nelements);
+                        cur_size = nelements*sizeof(ggml_fp16_t);
+                    } break;
                 case GGML_TYPE_I8:
                 case GGML_TYPE_I16:
                 case GGML_TYPE_I32:
@@ -217,7 +340,23 @@ bool ggml_common_quantize_0(
                         return false;
                     }
             }
+        }
 
+        // the header is written after the quantization, which can change the type
+        {
+            const int32_t n_dims_out = flatten ? 2 : n_dims;
+            const int32_t ne_out[2]  = { n_per_row, ne[2] };
+
+            fout.write(reinterpret_cast<const char *>(&n_dims_out), sizeof(n_dims_out));
+            fout.write(reinterpret_cast<const char *>(&length),     sizeof(length));
+            fout.write(reinterpret_cast<const char *>(&ttype),      sizeof(ttype));
+            for (int i = 0; i < n_dims_out; ++i) {
+                fout.write(reinterpret_cast<const char *>(flatten ? &ne_out[i] : &ne[i]), sizeof(ne[i]));
+            }
+            fout.write(&name[0], length);
+        }
+
+        if (quantize) {
             fout.write(reinterpret_cast<char *>(work.data()), cur_size);
             total_size_new += cur_size;
 
@@ -234,5 +373,15 @@ bool ggml_common_quantize_0(
     printf("%s: model size  = %8.2f MB\n", __func__, total_size_org/1024.0/1024.0);
     printf("%s: quant size  = %8.2f MB | ftype = %d (%s)\n", __func__, total_size_new/1024.0/1024.0, ftype, ggml_type_name(qtype));
 
+    if (n_fallback > 0) {
+        printf("%s: fallback    = %d tensors with rows that are not a multiple of 256 use a legacy type\n", __func__, n_fallback);
+    }
+    if (n_flattened > 0) {
+        printf("%s: flattened   = %d 3D tensors quantized as 2D\n", __func__, n_flattened);
+    }
+    if (!imatrix.empty()) {
+        printf("%s: imatrix     = %d of %d quantized tensors\n", __func__, n_imatrix, n_quantized);
+    }
+
     return true;
 }
@@ -3,16 +3,37 @@
 #include "ggml.h"
 
 #include <fstream>
+#include <map>
 #include <vector>
 #include <string>
 
 enum ggml_ftype ggml_parse_ftype(const char * str);
 
+// "f32", "f16" or the name of a quantization type - GGML_TYPE_COUNT if unknown
+enum ggml_type ggml_parse_type(const char * str);
+
 void ggml_print_ftypes(FILE * fp = stderr);
 
+// the type of the 2D tensors whose name matches the regex of a rule, instead of the type of ftype
+// the first matching rule is used
+struct ggml_tensor_type_rule {
+    std::string    pattern;
+    enum ggml_type type;
+};
+
+// the importance matrix of the weights, by name: the mean squared activation of each column
+typedef std::map<std::string, std::vector<float>> ggml_imatrix;
+
+// the rows of the K-quants are a multiple of 256 - the tensors with other rows get the legacy type of similar size
+// the 3D tensors that match to_flatten are quantized as [ne0*ne1, ne2] (e.g. the kernels of the convolutions) and get
+// Q8_0 when the relative RMS error of their quantized values exceeds max_err_flatten
 bool ggml_common_quantize_0(
         std::ifstream & finp,
         std::ofstream & fout,
         const ggml_ftype ftype,
         const std::vector<std::string> & to_quant,
-        const std::vector<std::string> & to_skip);
+        const std::vector<std::string> & to_skip,
+        const std::vector<ggml_tensor_type_rule> & rules = {},
+        const ggml_imatrix & imatrix = {},
+        const std::vector<std::string> & to_flatten = {},
+        float max_err_flatten = 1.0f);
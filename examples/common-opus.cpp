@@ -0,0 +1,160 @@
+#include "common-opus.h"
+
+#include "whisper.h"
+
+#include <opus.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+// the longest Opus packet is 120 ms
+#define OPUS_MAX_FRAME (WHISPER_SAMPLE_RATE*120/1000)
+
+struct opus_ingest {
+    OpusDecoder * dec = nullptr;
+
+    int n_jitter = 0; // the packets received after a missing one before it is concealed
+
+    // the packets that were not decoded yet, by their sequence number without the wrap around
+    std::map<int64_t, std::vector<uint8_t>> packets;
+
+    bool    started  = false;
+    int64_t seq_next = 0; // the next packet to decode
+    int64_t seq_last = 0; // the last packet received
+
+    int frame_size = WHISPER_SAMPLE_RATE/50; // the samples of the last packet - the duration of a lost one
+
+    std::vector<float> pcm; // the audio of opus_ingest_append()
+
+    opus_ingest_stats stats;
+};
+
+opus_ingest * opus_ingest_init(int jitter_ms) {
+    int err = OPUS_OK;
+
+    // a stereo stream is downmixed by the decoder
+    OpusDecoder * dec = opus_decoder_create(WHISPER_SAMPLE_RATE, 1, &err);
+    if (dec == nullptr || err != OPUS_OK) {
+        fprintf(stderr, "%s: failed to create the Opus decoder (%s)\n", __func__, opus_strerror(err));
+        return nullptr;
+    }
+
+    opus_ingest * ing = new opus_ingest;
+
+    ing->dec      = dec;
+    ing->n_jitter = std::max(1, jitter_ms/20);
+
+    return ing;
+}
+
+void opus_ingest_free(opus_ingest * ing) {
+    if (ing) {
+        opus_decoder_destroy(ing->dec);
+        delete ing;
+    }
+}
+
+bool opus_ingest_push(opus_ingest * ing, uint16_t seq, const uint8_t * data, size_t size) {
+    int64_t ext = seq;
+
+    if (!ing->started) {
+        ing->started  = true;
+        ing->seq_next = ext;
+        ing->seq_last = ext;
+    } else {
+        // the closest sequence number to the last one
+        ext = ing->seq_last + (int16_t) (seq - (uint16_t) ing->seq_last);
+    }
+
+    if (ext < ing->seq_next || ing->packets.count(ext) > 0) {
+        ing->stats.n_late++;
+        return false;
+    }
+
+    // a gap of more than 10 s of 20 ms packets is a restart of the stream - it is not concealed
+    if (ext - ing->seq_next > 500) {
+        ing->packets.clear();
+        ing->seq_next = ext;
+        opus_decoder_ctl(ing->dec, OPUS_RESET_STATE);
+    }
+
+    ing->packets[ext].assign(data, data + size);
+    ing->seq_last = std::max(ing->seq_last, ext);
+
+    return true;
+}
+
+int opus_ingest_decode(opus_ingest * ing, std::vector<float> & pcm, bool flush) {
+    const size_t n0 = pcm.size();
+
+    while (!ing->packets.empty()) {
+        auto it = ing->packets.begin();
+
+        const bool lost = it->first != ing->seq_next;
+
+        // wait for the missing packet until the jitter buffer is full
+        if (lost && !flush && ing->seq_last - ing->seq_next < ing->n_jitter) {
+            break;
+        }
+
+        const size_t n_cur = pcm.size();
+        pcm.resize(n_cur + OPUS_MAX_FRAME);
+
+        int n = 0;
+        if (!lost) {
+            n = opus_decode_float(ing->dec, it->second.data(), (opus_int32) it->second.size(), pcm.data() + n_cur, OPUS_MAX_FRAME, 0);
+            if (n > 0) {
+                ing->frame_size = n;
+            }
+
+            ing->packets.erase(it);
+            ing->stats.n_packets++;
+        } else if (it->first == ing->seq_next + 1) {
+            // the FEC data of the next packet - the decoder falls back to the concealment if it has none
+            n = opus_decode_float(ing->dec, it->second.data(), (opus_int32) it->second.size(), pcm.data() + n_cur, ing->frame_size, 1);
+            ing->stats.n_lost++;
+        } else {
+            n = opus_decode_float(ing->dec, nullptr, 0, pcm.data() + n_cur, ing->frame_size, 0);
+            ing->stats.n_lost++;
+        }
+
+        if (n < 0) {
+            fprintf(stderr, "%s: failed to decode packet %lld (%s)\n", __func__, (long long) ing->seq_next, opus_strerror(n));
+            pcm.resize(n_cur);
+
+            // a corrupt packet is dropped, the decoder is reset
+            if (!lost) {
+                opus_decoder_ctl(ing->dec, OPUS_RESET_STATE);
+                ing->seq_next++;
+                continue;
+            }
+
+            return -1;
+        }
+
+        pcm.resize(n_cur + n);
+        ing->seq_next++;
+    }
+
+    return (int) (pcm.size() - n0);
+}
+
+int opus_ingest_append(opus_ingest * ing, whisper_context * ctx, whisper_state * state, int n_threads, bool flush) {
+    ing->pcm.clear();
+
+    const int n = opus_ingest_decode(ing, ing->pcm, flush);
+    if (n <= 0) {
+        return n;
+    }
+
+    if (whisper_pcm_append_with_state(ctx, state, ing->pcm.data(), n, n_threads) != 0) {
+        return -1;
+    }
+
+    return n;
+}
+
+opus_ingest_stats opus_ingest_get_stats(const opus_ingest * ing) {
+    return ing->stats;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct whisper_context;
+struct whisper_state;
+
+// Live input of Opus packets (e.g. the payloads of the RTP packets of a WebRTC call), built with WHISPER_OPUS
+// The packets are put back in the order of their 16-bit sequence number by a jitter buffer of jitter_ms, and decoded by
+// libopus directly at 16 kHz mono - the rate of whisper, so the audio is not resampled.
+// A packet that is still missing when the buffer is full is concealed for the timestamps to stay aligned: from the
+// in-band FEC data of the next packet when it arrived, else with the packet loss concealment of the decoder.
+struct opus_ingest;
+
+struct opus_ingest_stats {
+    int64_t n_packets = 0; // decoded packets
+    int64_t n_lost    = 0; // concealed packets
+    int64_t n_late    = 0; // packets that arrived after they were concealed, or twice (dropped)
+};
+
+opus_ingest * opus_ingest_init(int jitter_ms = 60);
+
+void opus_ingest_free(opus_ingest * ing);
+
+// Add a packet to the jitter buffer
+// Returns false if the packet is dropped (late or duplicate)
+bool opus_ingest_push(opus_ingest * ing, uint16_t seq, const uint8_t * data, size_t size);
+
+// Decode the packets that leave the jitter buffer and append their audio to pcm
+// With flush, all the packets are decoded (at the end of the stream)
+// Returns the number of samples appended, < 0 on error
+int opus_ingest_decode(opus_ingest * ing, std::vector<float> & pcm, bool flush = false);
+
+// Same as opus_ingest_decode(), but the audio is appended to the log mel spectrogram of the state with
+// whisper_pcm_append_with_state() - only the frames of the new samples are computed
+int opus_ingest_append(opus_ingest * ing, whisper_context * ctx, whisper_state * state, int n_threads, bool flush = false);
+
+opus_ingest_stats opus_ingest_get_stats(const opus_ingest * ing);
@@ -1,6 +1,8 @@
 #include "common-sdl.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
 audio_async::audio_async(int len_ms) {
     m_len_ms = len_ms;
@@ -141,9 +143,7 @@ bool audio_async::pause() {
 
 bool audio_async::clear() {
     if (m_input_mode == MODE_STDIN) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_audio_pos = 0;
-        m_audio_len = 0;
+        m_pos_clear = m_pos.load();
         return true;
     }
 
@@ -157,14 +157,36 @@ bool audio_async::clear() {
         return false;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    m_pos_clear = m_pos.load();
+
+    return true;
+}
+
+// called only by the producer
+void audio_async::write(const float * samples, size_t n_samples) {
+    const size_t n_audio = m_audio.size();
 
-        m_audio_pos = 0;
-        m_audio_len = 0;
+    if (n_samples > n_audio) {
+        samples  += n_samples - n_audio;
+        n_samples = n_audio;
     }
 
-    return true;
+    const uint64_t pos = m_pos.load(std::memory_order_relaxed);
+    const size_t   i0  = pos % n_audio;
+
+    // announce the samples that are overwritten before writing them, for valid()
+    m_pos_end.store(pos + n_samples);
+
+    if (i0 + n_samples > n_audio) {
+        const size_t n0 = n_audio - i0;
+
+        memcpy(&m_audio[i0], samples, n0 * sizeof(float));
+        memcpy(&m_audio[0], samples + n0, (n_samples - n0) * sizeof(float));
+    } else {
+        memcpy(&m_audio[i0], samples, n_samples * sizeof(float));
+    }
+
+    m_pos.store(pos + n_samples, std::memory_order_release);
 }
 
 // callback to be called by SDL
@@ -173,78 +195,76 @@ void audio_async::callback(uint8_t * stream, int len) {
         return;
     }
 
-    size_t n_samples = len / sizeof(float);
+    write((const float *) stream, len / sizeof(float));
+}
 
-    if (n_samples > m_audio.size()) {
-        n_samples = m_audio.size();
+void audio_async::get(int ms, std::vector<float> & result) {
+    if (m_input_mode != MODE_STDIN && !m_dev_id_in) {
+        fprintf(stderr, "%s: no audio device to get audio from!\n", __func__);
+        return;
+    }
 
-        stream += (len - (n_samples * sizeof(float)));
+    if (!m_running) {
+        fprintf(stderr, "%s: not running!\n", __func__);
+        return;
     }
 
-    //fprintf(stderr, "%s: %zu samples, pos %zu, len %zu\n", __func__, n_samples, m_audio_pos, m_audio_len);
+    result.clear();
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    // the oldest samples are overwritten if the producer wraps around during the copy - then copy them again
+    // with stdin, the producer is this thread and the samples are always valid
+    while (true) {
+        const span s = get_span(ms);
 
-        if (m_audio_pos + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - m_audio_pos;
+        result.resize(s.size());
+        memcpy(result.data(), s.p0, s.n0 * sizeof(float));
+        memcpy(result.data() + s.n0, s.p1, s.n1 * sizeof(float));
 
-            memcpy(&m_audio[m_audio_pos], stream, n0 * sizeof(float));
-            memcpy(&m_audio[0], stream + n0 * sizeof(float), (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(&m_audio[m_audio_pos], stream, n_samples * sizeof(float));
+        if (valid(s)) {
+            break;
         }
-        m_audio_pos = (m_audio_pos + n_samples) % m_audio.size();
-        m_audio_len = std::min(m_audio_len + n_samples, m_audio.size());
     }
 }
 
-void audio_async::get(int ms, std::vector<float> & result) {
+audio_async::span audio_async::get_span(int ms) {
+    span s;
+
     if (m_input_mode == MODE_STDIN && m_running) {
         // For stdin mode, try to read more data before returning
         read_from_stdin();
     }
 
-    if (m_input_mode != MODE_STDIN && !m_dev_id_in) {
-        fprintf(stderr, "%s: no audio device to get audio from!\n", __func__);
-        return;
+    if (!m_running || m_audio.empty()) {
+        return s;
     }
 
-    if (!m_running) {
-        fprintf(stderr, "%s: not running!\n", __func__);
-        return;
+    if (ms <= 0) {
+        ms = m_len_ms;
     }
 
-    result.clear();
+    const size_t n_audio = m_audio.size();
 
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t pos = m_pos.load(std::memory_order_acquire);
+    const uint64_t beg = std::max(m_pos_clear.load(), pos > n_audio ? pos - n_audio : 0);
 
-        if (ms <= 0) {
-            ms = m_len_ms;
-        }
+    const size_t n_samples = std::min<uint64_t>((m_sample_rate * (uint64_t) ms) / 1000, pos - beg);
 
-        size_t n_samples = (m_sample_rate * ms) / 1000;
-        if (n_samples > m_audio_len) {
-            n_samples = m_audio_len;
-        }
+    s.pos = pos - n_samples;
 
-        result.resize(n_samples);
+    const size_t i0 = s.pos % n_audio;
 
-        int s0 = m_audio_pos - n_samples;
-        if (s0 < 0) {
-            s0 += m_audio.size();
-        }
+    s.p0 = &m_audio[i0];
+    s.n0 = std::min(n_samples, n_audio - i0);
+    s.p1 = &m_audio[0];
+    s.n1 = n_samples - s.n0;
+
+    return s;
+}
 
-        if (s0 + n_samples > m_audio.size()) {
-            const size_t n0 = m_audio.size() - s0;
+bool audio_async::valid(const span & s) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
 
-            memcpy(result.data(), &m_audio[s0], n0 * sizeof(float));
-            memcpy(&result[n0], &m_audio[0], (n_samples - n0) * sizeof(float));
-        } else {
-            memcpy(result.data(), &m_audio[s0], n_samples * sizeof(float));
-        }
-    }
+    return s.size() == 0 || m_pos_end.load() <= s.pos + m_audio.size();
 }
 
 bool sdl_poll_events() {
@@ -287,21 +307,7 @@ bool audio_async::read_from_stdin() {
     }
     
     // Store the data in the circular buffer
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        
-        if (m_audio_pos + n_read > m_audio.size()) {
-            const size_t n0 = m_audio.size() - m_audio_pos;
-            
-            memcpy(&m_audio[m_audio_pos], buf.data(), n0 * sizeof(float));
-            memcpy(&m_audio[0], buf.data() + n0, (n_read - n0) * sizeof(float));
-        } else {
-            memcpy(&m_audio[m_audio_pos], buf.data(), n_read * sizeof(float));
-        }
-        
-        m_audio_pos = (m_audio_pos + n_read) % m_audio.size();
-        m_audio_len = std::min(m_audio_len + n_read, m_audio.size());
-    }
+    write(buf.data(), n_read);
     
     return true;
 }
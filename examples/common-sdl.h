@@ -6,14 +6,27 @@
 #include <atomic>
 #include <cstdint>
 #include <vector>
-#include <mutex>
 
 //
 // SDL Audio capture
 //
 
+// the audio is kept in a single-producer / single-consumer ring buffer: the SDL callback (or read_from_stdin())
+// writes to it and a single thread reads from it with get() or get_span(), without locking each other
 class audio_async {
 public:
+    // the last samples of the ring buffer, in up to two contiguous parts
+    struct span {
+        const float * p0 = nullptr;
+        size_t        n0 = 0;
+        const float * p1 = nullptr;
+        size_t        n1 = 0;
+
+        uint64_t pos = 0; // index of the first sample since the start of the capture
+
+        size_t size() const { return n0 + n1; }
+    };
+
     audio_async(int len_ms);
     ~audio_async();
 
@@ -40,6 +53,11 @@ public:
     // get audio data from the circular buffer
     void get(int ms, std::vector<float> & audio);
 
+    // get the last ms of audio without copying it
+    // the samples can be overwritten by new audio once they are older than len_ms - check with valid() after using them
+    span get_span(int ms);
+    bool valid(const span & s) const;
+
 private:
     SDL_AudioDeviceID m_dev_id_in = 0;
 
@@ -47,14 +65,17 @@ private:
     int m_sample_rate = 0;
 
     std::atomic_bool m_running;
-    std::mutex       m_mutex;
-    
+
     InputMode m_input_mode = MODE_MICROPHONE;
     bool m_stdin_eof = false;
 
-    std::vector<float> m_audio;
-    size_t             m_audio_pos = 0;
-    size_t             m_audio_len = 0;
+    void write(const float * samples, size_t n_samples);
+
+    // the positions are numbers of samples since the start of the capture
+    std::vector<float>    m_audio;
+    std::atomic<uint64_t> m_pos_end  { 0 }; // end of the samples being written
+    std::atomic<uint64_t> m_pos      { 0 }; // end of the written samples
+    std::atomic<uint64_t> m_pos_clear{ 0 }; // set by clear(), the samples before it are not returned
 };
 
 // Return false if need to quit
@@ -31,22 +31,142 @@
 #include <io.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <fstream>
 
 #ifdef WHISPER_FFMPEG
 // as implemented in ffmpeg_trancode.cpp only embedded in common lib if whisper built with ffmpeg support
-extern bool ffmpeg_decode_audio(const std::string & ifname, std::vector<uint8_t> & wav_data);
+struct ffmpeg_decoder;
+
+extern ffmpeg_decoder * ffmpeg_decoder_open(const std::string & ifname, int n_threads, int64_t offset_ms, int64_t duration_ms);
+extern ffmpeg_decoder * ffmpeg_decoder_open_memory(const uint8_t * data, size_t size, int n_threads, int64_t offset_ms, int64_t duration_ms);
+extern int  ffmpeg_decoder_read(ffmpeg_decoder * dec, float * pcm, int n_max);
+extern void ffmpeg_decoder_close(ffmpeg_decoder * dec);
+
+// decode the whole audio to 16 kHz mono float and close the decoder - for stereo, the mono PCM is in both channels
+static bool read_audio_ffmpeg(ffmpeg_decoder * dec, std::vector<float> & pcmf32, std::vector<std::vector<float>> & pcmf32s, bool stereo) {
+    if (dec == nullptr) {
+        return false;
+    }
+
+    const int n_block = 30*WHISPER_SAMPLE_RATE;
+
+    size_t n_pcm = 0;
+    int    n     = 0;
+
+    do {
+        pcmf32.resize(n_pcm + n_block);
+        n = ffmpeg_decoder_read(dec, pcmf32.data() + n_pcm, n_block);
+        n_pcm += std::max(n, 0);
+    } while (n > 0);
+
+    pcmf32.resize(n_pcm);
+
+    ffmpeg_decoder_close(dec);
+
+    if (n < 0) {
+        return false;
+    }
+
+    if (stereo) {
+        pcmf32s.assign(2, pcmf32);
+
+        pcmf32.resize(2*n_pcm);
+        for (size_t i = 0; i < n_pcm; i++) {
+            pcmf32[2*i]     = pcmf32s[0][i];
+            pcmf32[2*i + 1] = pcmf32s[1][i];
+        }
+    }
+
+    return true;
+}
 #endif
 
+// resample the channels of the audio at the native rate of the decoder to WHISPER_SAMPLE_RATE
+static bool resample_audio(int sample_rate, std::vector<float> & pcmf32, std::vector<std::vector<float>> & pcmf32s, bool stereo) {
+    auto resample = [sample_rate](std::vector<float> & pcm) {
+        std::vector<float> out(-whisper_resample(pcm.data(), pcm.size(), sample_rate, nullptr, 0));
+        if (whisper_resample(pcm.data(), pcm.size(), sample_rate, out.data(), out.size()) < 0) {
+            return false;
+        }
+        pcm = std::move(out);
+        return true;
+    };
+
+    if (!stereo) {
+        return resample(pcmf32);
+    }
+
+    if (!resample(pcmf32s[0]) || !resample(pcmf32s[1])) {
+        return false;
+    }
+
+    const size_t n = std::min(pcmf32s[0].size(), pcmf32s[1].size());
+
+    pcmf32.resize(2*n);
+    for (size_t i = 0; i < n; i++) {
+        pcmf32[2*i]     = pcmf32s[0][i];
+        pcmf32[2*i + 1] = pcmf32s[1][i];
+    }
+
+    return true;
+}
+
+// read the frames of an initialized decoder and uninit it
+static bool read_audio_decoder(ma_decoder & decoder, std::vector<float> & pcmf32, std::vector<std::vector<float>> & pcmf32s, bool stereo) {
+    ma_result result;
+
+    ma_uint64 frame_count;
+    ma_uint64 frames_read;
+
+    if ((result = ma_decoder_get_length_in_pcm_frames(&decoder, &frame_count)) != MA_SUCCESS) {
+		fprintf(stderr, "error: failed to retrieve the length of the audio data (%s)\n", ma_result_description(result));
+
+		return false;
+    }
+
+    pcmf32.resize(stereo ? frame_count*2 : frame_count);
+
+    if ((result = ma_decoder_read_pcm_frames(&decoder, pcmf32.data(), frame_count, &frames_read)) != MA_SUCCESS) {
+		fprintf(stderr, "error: failed to read the frames of the audio data (%s)\n", ma_result_description(result));
+
+		return false;
+    }
+
+    if (stereo) {
+		pcmf32s.resize(2);
+		pcmf32s[0].resize(frame_count);
+		pcmf32s[1].resize(frame_count);
+		for (uint64_t i = 0; i < frame_count; i++) {
+			pcmf32s[0][i] = pcmf32[2*i];
+			pcmf32s[1][i] = pcmf32[2*i + 1];
+		}
+    }
+
+    const int sample_rate = decoder.outputSampleRate;
+
+    ma_decoder_uninit(&decoder);
+
+    // the decoders are opened at the native rate of the audio - resample with the polyphase filter of the library
+    if (sample_rate != WHISPER_SAMPLE_RATE && !resample_audio(sample_rate, pcmf32, pcmf32s, stereo)) {
+        fprintf(stderr, "error: failed to resample the audio data from %d Hz\n", sample_rate);
+
+        return false;
+    }
+
+    return true;
+}
+
 bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std::vector<std::vector<float>>& pcmf32s, bool stereo) {
-    std::vector<uint8_t> audio_data; // used for pipe input from stdin or ffmpeg decoding output
+    std::vector<uint8_t> audio_data; // used for pipe input from stdin
 
     ma_result result;
     ma_decoder_config decoder_config;
     ma_decoder decoder;
 
-    decoder_config = ma_decoder_config_init(ma_format_f32, stereo ? 2 : 1, WHISPER_SAMPLE_RATE);
+    decoder_config = ma_decoder_config_init(ma_format_f32, stereo ? 2 : 1, 0);
 
     if (fname == "-") {
 		#ifdef _WIN32
@@ -74,17 +194,14 @@ bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std:
     }
     else if (((result = ma_decoder_init_file(fname.c_str(), &decoder_config, &decoder)) != MA_SUCCESS)) {
 #if defined(WHISPER_FFMPEG)
-		if (ffmpeg_decode_audio(fname, audio_data) != 0) {
+		// the formats that miniaudio does not know (opus, aac, ...) are decoded by ffmpeg directly to float
+		if (!read_audio_ffmpeg(ffmpeg_decoder_open(fname, 0, 0, 0), pcmf32, pcmf32s, stereo)) {
 			fprintf(stderr, "error: failed to ffmpeg decode '%s'\n", fname.c_str());
 
 			return false;
 		}
 
-		if ((result = ma_decoder_init_memory(audio_data.data(), audio_data.size(), &decoder_config, &decoder)) != MA_SUCCESS) {
-			fprintf(stderr, "error: failed to read audio data as wav (%s)\n", ma_result_description(result));
-
-			return false;
-		}
+		return true;
 #else
 		if ((result = ma_decoder_init_memory(fname.c_str(), fname.size(), &decoder_config, &decoder)) != MA_SUCCESS) {
 			fprintf(stderr, "error: failed to read audio data as wav (%s)\n", ma_result_description(result));
@@ -94,36 +211,237 @@ bool read_audio_data(const std::string & fname, std::vector<float>& pcmf32, std:
 #endif
     }
 
-    ma_uint64 frame_count;
-    ma_uint64 frames_read;
+    return read_audio_decoder(decoder, pcmf32, pcmf32s, stereo);
+}
 
-    if ((result = ma_decoder_get_length_in_pcm_frames(&decoder, &frame_count)) != MA_SUCCESS) {
-		fprintf(stderr, "error: failed to retrieve the length of the audio data (%s)\n", ma_result_description(result));
+bool read_audio_data_from_memory(const void * data, size_t size, std::vector<float> & pcmf32, std::vector<std::vector<float>> & pcmf32s, bool stereo) {
+    ma_result result;
+    ma_decoder_config decoder_config;
+    ma_decoder decoder;
 
-		return false;
+    decoder_config = ma_decoder_config_init(ma_format_f32, stereo ? 2 : 1, 0);
+
+    if ((result = ma_decoder_init_memory(data, size, &decoder_config, &decoder)) == MA_SUCCESS) {
+        return read_audio_decoder(decoder, pcmf32, pcmf32s, stereo);
     }
 
-    pcmf32.resize(stereo ? frame_count*2 : frame_count);
+#if defined(WHISPER_FFMPEG)
+    // formats that miniaudio does not know (opus, aac, ...) are decoded by ffmpeg directly to float
+    if (!read_audio_ffmpeg(ffmpeg_decoder_open_memory((const uint8_t *) data, size, 0, 0, 0), pcmf32, pcmf32s, stereo)) {
+        fprintf(stderr, "error: failed to ffmpeg decode the audio data\n");
+        return false;
+    }
 
-    if ((result = ma_decoder_read_pcm_frames(&decoder, pcmf32.data(), frame_count, &frames_read)) != MA_SUCCESS) {
-		fprintf(stderr, "error: failed to read the frames of the audio data (%s)\n", ma_result_description(result));
+    return true;
+#endif
 
-		return false;
+    fprintf(stderr, "error: failed to read audio data (%s)\n", ma_result_description(result));
+
+    return false;
+}
+
+struct audio_reader {
+    ma_decoder decoder;
+
+    // stdin - the bytes read while the decoder probes the format are kept for its seeks back to the start
+    FILE *               file    = nullptr;
+    std::vector<uint8_t> head;
+    size_t               pos     = 0;
+    bool                 probing = true;
+
+    // the WAV data passed as the file name
+    std::vector<uint8_t> wav_data;
+
+#if defined(WHISPER_FFMPEG)
+    // the formats that miniaudio does not know - decoded by ffmpeg instead of the decoder
+    ffmpeg_decoder * ffmpeg = nullptr;
+#endif
+
+    // the samples left until the end of duration_ms (< 0 - until the end of the audio)
+    int64_t n_left = -1;
+};
+
+static ma_result audio_reader_on_read(ma_decoder * decoder, void * buf, size_t n, size_t * n_read) {
+    audio_reader & reader = *(audio_reader *) decoder->pUserData;
+
+    size_t n_cur = 0;
+
+    // pos is the offset from the start of the stream - the file is at max(pos, head.size())
+    if (reader.pos < reader.head.size()) {
+        n_cur = std::min(n, reader.head.size() - reader.pos);
+        memcpy(buf, reader.head.data() + reader.pos, n_cur);
     }
 
-    if (stereo) {
-		pcmf32s.resize(2);
-		pcmf32s[0].resize(frame_count);
-		pcmf32s[1].resize(frame_count);
-		for (uint64_t i = 0; i < frame_count; i++) {
-			pcmf32s[0][i] = pcmf32[2*i];
-			pcmf32s[1][i] = pcmf32[2*i + 1];
-		}
+    if (n_cur < n) {
+        const size_t n_file = fread((uint8_t *) buf + n_cur, 1, n - n_cur, reader.file);
+        if (reader.probing) {
+            reader.head.insert(reader.head.end(), (uint8_t *) buf + n_cur, (uint8_t *) buf + n_cur + n_file);
+        }
+        n_cur += n_file;
     }
 
-    ma_decoder_uninit(&decoder);
+    reader.pos += n_cur;
 
-    return true;
+    // the probed bytes are no longer needed
+    if (!reader.probing && !reader.head.empty() && reader.pos >= reader.head.size()) {
+        reader.head = {};
+    }
+
+    *n_read = n_cur;
+
+    return n_cur == 0 && n > 0 ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result audio_reader_on_seek(ma_decoder * decoder, ma_int64 offset, ma_seek_origin origin) {
+    audio_reader & reader = *(audio_reader *) decoder->pUserData;
+
+    if (origin == ma_seek_origin_end) {
+        return MA_BAD_SEEK;
+    }
+
+    const ma_int64 target = origin == ma_seek_origin_start ? offset : (ma_int64) reader.pos + offset;
+
+    // backwards only within the probed bytes
+    if (target < 0 || (target < (ma_int64) reader.pos && reader.pos > reader.head.size())) {
+        return MA_BAD_SEEK;
+    }
+
+    if (target <= (ma_int64) std::max(reader.pos, reader.head.size())) {
+        reader.pos = target;
+        return MA_SUCCESS;
+    }
+
+    // forwards by reading
+    reader.pos = std::max(reader.pos, reader.head.size());
+
+    uint8_t buf[4096];
+    while ((ma_int64) reader.pos < target) {
+        size_t n_read = 0;
+        audio_reader_on_read(decoder, buf, std::min<ma_int64>(sizeof(buf), target - reader.pos), &n_read);
+        if (n_read == 0) {
+            return MA_BAD_SEEK;
+        }
+    }
+
+    return MA_SUCCESS;
+}
+
+audio_reader * audio_reader_open(const std::string & fname, int64_t offset_ms, int64_t duration_ms, int n_threads) {
+    ma_result result;
+
+    ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 1, WHISPER_SAMPLE_RATE);
+
+    audio_reader * reader = new audio_reader;
+
+    if (fname == "-") {
+		#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+		#endif
+
+        reader->file = stdin;
+
+        if ((result = ma_decoder_init(audio_reader_on_read, audio_reader_on_seek, reader, &decoder_config, &reader->decoder)) != MA_SUCCESS) {
+            fprintf(stderr, "error: failed to open audio data from stdin (%s)\n", ma_result_description(result));
+            delete reader;
+            return nullptr;
+        }
+
+        reader->probing = false;
+    } else if ((result = ma_decoder_init_file(fname.c_str(), &decoder_config, &reader->decoder)) != MA_SUCCESS) {
+#if defined(WHISPER_FFMPEG)
+        // ffmpeg seeks to offset_ms and stops at the end of duration_ms itself
+        reader->ffmpeg = ffmpeg_decoder_open(fname, n_threads, offset_ms, duration_ms);
+        if (reader->ffmpeg == nullptr) {
+            fprintf(stderr, "error: failed to ffmpeg decode '%s'\n", fname.c_str());
+            delete reader;
+            return nullptr;
+        }
+
+        return reader;
+#else
+        reader->wav_data.assign(fname.begin(), fname.end());
+
+        if ((result = ma_decoder_init_memory(reader->wav_data.data(), reader->wav_data.size(), &decoder_config, &reader->decoder)) != MA_SUCCESS) {
+            fprintf(stderr, "error: failed to read audio data as wav (%s)\n", ma_result_description(result));
+            delete reader;
+            return nullptr;
+        }
+#endif
+    }
+
+    (void) n_threads;
+
+    if (offset_ms > 0) {
+        const ma_uint64 offset = offset_ms*WHISPER_SAMPLE_RATE/1000;
+
+        // the streams that cannot seek (e.g. stdin) are decoded up to the offset
+        if (ma_decoder_seek_to_pcm_frame(&reader->decoder, offset) != MA_SUCCESS) {
+            std::vector<float> buf(WHISPER_SAMPLE_RATE);
+
+            ma_uint64 n_skip = offset;
+            while (n_skip > 0) {
+                ma_uint64 frames_read = 0;
+                ma_decoder_read_pcm_frames(&reader->decoder, buf.data(), std::min<ma_uint64>(n_skip, buf.size()), &frames_read);
+                if (frames_read == 0) {
+                    break;
+                }
+                n_skip -= frames_read;
+            }
+        }
+    }
+
+    reader->n_left = duration_ms > 0 ? duration_ms*WHISPER_SAMPLE_RATE/1000 : -1;
+
+    return reader;
+}
+
+int audio_reader_read(audio_reader * reader, float * pcm, int n_max) {
+#if defined(WHISPER_FFMPEG)
+    if (reader->ffmpeg) {
+        const int n = ffmpeg_decoder_read(reader->ffmpeg, pcm, n_max);
+        if (n < 0) {
+            fprintf(stderr, "error: failed to ffmpeg decode the audio data\n");
+        }
+
+        return n;
+    }
+#endif
+
+    if (reader->n_left >= 0) {
+        n_max = (int) std::min<int64_t>(n_max, reader->n_left);
+    }
+
+    if (n_max == 0) {
+        return 0;
+    }
+
+    ma_uint64 frames_read = 0;
+
+    const ma_result result = ma_decoder_read_pcm_frames(&reader->decoder, pcm, n_max, &frames_read);
+    if (result != MA_SUCCESS && result != MA_AT_END) {
+        fprintf(stderr, "error: failed to read the frames of the audio data (%s)\n", ma_result_description(result));
+        return -1;
+    }
+
+    if (reader->n_left >= 0) {
+        reader->n_left -= frames_read;
+    }
+
+    return (int) frames_read;
+}
+
+void audio_reader_close(audio_reader * reader) {
+    if (reader) {
+#if defined(WHISPER_FFMPEG)
+        if (reader->ffmpeg) {
+            ffmpeg_decoder_close(reader->ffmpeg);
+            delete reader;
+            return;
+        }
+#endif
+        ma_decoder_uninit(&reader->decoder);
+        delete reader;
+    }
 }
 
 //  500 -> 00:05.000
@@ -147,6 +465,87 @@ int timestamp_to_sample(int64_t t, int n_samples, int whisper_sample_rate) {
     return std::max(0, std::min((int) n_samples - 1, (int) ((t*whisper_sample_rate)/100)));
 }
 
+void stereo_energy_init(stereo_energy & energy, const std::vector<std::vector<float>> & pcmf32s) {
+    const int hop = WHISPER_SAMPLE_RATE/100;
+
+    energy = stereo_energy();
+
+    if (pcmf32s.size() != 2 || pcmf32s[0].empty() || pcmf32s[0].size() != pcmf32s[1].size()) {
+        return;
+    }
+
+    const int n = pcmf32s[0].size();
+
+    energy.n_samples = n;
+
+    for (int c = 0; c < 2; ++c) {
+        const float * x = pcmf32s[c].data();
+
+        auto & cum = energy.cum[c];
+        cum.resize((n + hop - 1)/hop + 1);
+        cum[0] = 0.0;
+
+        for (int i = 0; i*hop < n; ++i) {
+            const int j0 = i*hop;
+            const int j1 = std::min(n, j0 + hop);
+
+            // independent partial sums, so that the loop is vectorized
+            float s[8] = { 0.0f };
+
+            int j = j0;
+            for (; j + 8 <= j1; j += 8) {
+                for (int k = 0; k < 8; ++k) {
+                    s[k] += fabsf(x[j + k]);
+                }
+            }
+            for (; j < j1; ++j) {
+                s[0] += fabsf(x[j]);
+            }
+
+            cum[i + 1] = cum[i] + (((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7])));
+        }
+
+        energy.last[c] = fabsf(x[n - 1]);
+    }
+}
+
+// the energy of channel c in the samples [0, i) - i is a multiple of the frame or one of the last 2 samples
+static double stereo_energy_at(const stereo_energy & energy, int c, int64_t i) {
+    const int hop = WHISPER_SAMPLE_RATE/100;
+
+    const auto & cum = energy.cum[c];
+
+    if (i >= energy.n_samples) {
+        return cum.back();
+    }
+    if (i == energy.n_samples - 1 && i % hop != 0) {
+        return cum.back() - energy.last[c];
+    }
+
+    return cum[i/hop];
+}
+
+std::string stereo_energy_speaker(const stereo_energy & energy, int64_t t0, int64_t t1) {
+    if (energy.n_samples == 0) {
+        return "";
+    }
+
+    const int64_t is0 = timestamp_to_sample(t0, energy.n_samples, WHISPER_SAMPLE_RATE);
+    const int64_t is1 = timestamp_to_sample(t1, energy.n_samples, WHISPER_SAMPLE_RATE);
+
+    const double energy0 = is1 > is0 ? stereo_energy_at(energy, 0, is1) - stereo_energy_at(energy, 0, is0) : 0.0;
+    const double energy1 = is1 > is0 ? stereo_energy_at(energy, 1, is1) - stereo_energy_at(energy, 1, is0) : 0.0;
+
+    if (energy0 > 1.1*energy1) {
+        return "0";
+    }
+    if (energy1 > 1.1*energy0) {
+        return "1";
+    }
+
+    return "?";
+}
+
 bool speak_with_file(const std::string & command, const std::string & text, const std::string & path, int voice_id) {
     std::ofstream speak_file(path.c_str());
     if (speak_file.fail()) {
@@ -14,11 +14,51 @@ bool read_audio_data(
         std::vector<std::vector<float>> & pcmf32s,
         bool stereo);
 
+// Decode an audio file that is already in memory (WAV, MP3, FLAC, OGG/Vorbis)
+// If whisper is built with ffmpeg support, the other formats are decoded by ffmpeg
+bool read_audio_data_from_memory(
+        const void * data,
+        size_t size,
+        std::vector<float> & pcmf32,
+        std::vector<std::vector<float>> & pcmf32s,
+        bool stereo);
+
+// Pull-based decoding of an audio file ("-" for stdin), for recordings that do not fit in memory
+// The mono PCM is decoded block by block with audio_reader_read() instead of the whole file upfront
+// If whisper is built with ffmpeg support, the other formats are decoded by ffmpeg to 16 kHz float block by block,
+// with n_threads decoder threads (0 - one per core)
+// The audio starts at offset_ms and stops after duration_ms (0 - until the end) - the decoder seeks to the offset
+// when the input can seek, so the audio before it is not decoded
+struct audio_reader;
+
+audio_reader * audio_reader_open(const std::string & fname, int64_t offset_ms = 0, int64_t duration_ms = 0, int n_threads = 0);
+
+// Read up to n_max samples, returns the number of samples (0 at the end of the audio, < 0 on error)
+int audio_reader_read(audio_reader * reader, float * pcm, int n_max);
+
+void audio_reader_close(audio_reader * reader);
+
 // convert timestamp to string, 6000 -> 01:00.000
 std::string to_timestamp(int64_t t, bool comma = false);
 
 // given a timestamp get the sample
 int timestamp_to_sample(int64_t t, int n_samples, int whisper_sample_rate);
 
+// Stereo diarization: the energy (the sum of |x|) of each channel as prefix sums over frames of 10 ms, the unit of
+// the whisper timestamps - computed once after the audio is decoded, the stereo PCM is not needed afterwards
+struct stereo_energy {
+    int n_samples = 0;
+
+    std::vector<double> cum[2]; // cum[c][i] - the energy of channel c in the frames [0, i)
+    float               last[2] = { 0.0f, 0.0f }; // |x| of the last sample of each channel
+};
+
+// pcmf32s: the 2 channels of read_audio_data() with stereo = true, anything else leaves the energy empty
+void stereo_energy_init(stereo_energy & energy, const std::vector<std::vector<float>> & pcmf32s);
+
+// the louder channel between the timestamps t0 and t1: "0" or "1" with at least 10% more energy, else "?"
+// empty if the energy is empty (not stereo)
+std::string stereo_energy_speaker(const stereo_energy & energy, int64_t t0, int64_t t1);
+
 // write text to file, and call system("command voice_id file")
 bool speak_with_file(const std::string & command, const std::string & text, const std::string & path, int voice_id);
@@ -10,6 +10,7 @@
 // Just for conveninent C++ API
 #include <vector>
 #include <string>
+#include <algorithm>
 
 // C
 #include <stdio.h>
@@ -322,35 +323,22 @@ static int decode_audio(struct audio_buffer *audio_buf, s16 **data, int *size)
 }
 
 // in mem decoding/conversion/resampling:
-// ifname: input file path
+// idata, isize: input audio file content
 // owav_data: in mem wav file. Can be forwarded as it to whisper/drwav
 // return 0 on success
-int ffmpeg_decode_audio(const std::string &ifname, std::vector<uint8_t>& owav_data) {
-    LOG("ffmpeg_decode_audio: %s\n", ifname.c_str());
-    int ifd = open(ifname.c_str(), O_RDONLY);
-    if (ifd == -1) {
-        fprintf(stderr, "Couldn't open input file %s\n", ifname.c_str());
-        return -1;
-    }
-    u8 *ibuf = NULL;
-    size_t ibuf_size;
-    int err = map_file(ifd, &ibuf, &ibuf_size);
-    if (err) {
-        LOG("Couldn't map input file %s\n", ifname.c_str());
-        return err;
-    }
-    LOG("Mapped input file: %s size: %d\n", ibuf, (int) ibuf_size);
+int ffmpeg_decode_audio_data(const uint8_t * idata, size_t isize, std::vector<uint8_t>& owav_data) {
     struct audio_buffer inaudio_buf;
-    inaudio_buf.ptr = ibuf;
-    inaudio_buf.size = ibuf_size;
+    inaudio_buf.ptr = (u8 *) idata; // only read by read_packet()
+    inaudio_buf.size = isize;
 
     s16 *odata=NULL;
     int osize=0;
 
-    err = decode_audio(&inaudio_buf, &odata, &osize);
+    int err = decode_audio(&inaudio_buf, &odata, &osize);
     LOG("decode_audio returned %d \n", err);
     if (err != 0) {
         LOG("decode_audio failed\n");
+        free(odata);
         return err;
     }
     LOG("decode_audio output size: %d\n", osize);
@@ -364,5 +352,391 @@ int ffmpeg_decode_audio(const std::string &ifname, std::vector<uint8_t>& owav_da
     // the data:
     memcpy(owav_data.data() + sizeof(wave_hdr), odata, osize* sizeof(s16));
 
+    free(odata);
+
     return 0;
 }
+
+// in mem decoding/conversion/resampling:
+// ifname: input file path
+// owav_data: in mem wav file. Can be forwarded as it to whisper/drwav
+// return 0 on success
+int ffmpeg_decode_audio(const std::string &ifname, std::vector<uint8_t>& owav_data) {
+    LOG("ffmpeg_decode_audio: %s\n", ifname.c_str());
+    int ifd = open(ifname.c_str(), O_RDONLY);
+    if (ifd == -1) {
+        fprintf(stderr, "Couldn't open input file %s\n", ifname.c_str());
+        return -1;
+    }
+    u8 *ibuf = NULL;
+    size_t ibuf_size;
+    int err = map_file(ifd, &ibuf, &ibuf_size);
+    close(ifd);
+    if (err) {
+        LOG("Couldn't map input file %s\n", ifname.c_str());
+        return err;
+    }
+    LOG("Mapped input file: %s size: %d\n", ibuf, (int) ibuf_size);
+
+    err = ffmpeg_decode_audio_data(ibuf, ibuf_size, owav_data);
+
+    munmap(ibuf, ibuf_size);
+
+    return err;
+}
+
+// Block decoding to 16 kHz mono float, without the WAV round trip:
+// the decoder threads of libavcodec decode the frames ahead (for the codecs with frame or slice threading) and
+// the start of the audio is skipped by seeking the demuxer to the key frame before offset_ms, then trimming the
+// decoded samples to the exact position with the timestamp of the first frame
+
+// input from memory - the demuxer can seek in it, unlike read_packet()
+struct memory_input {
+	const u8 *data;
+	size_t size;
+	size_t pos;
+};
+
+static int memory_input_read(void *opaque, u8 *buf, int buf_size)
+{
+	memory_input *in = (memory_input *)opaque;
+
+	const size_t n = std::min((size_t)buf_size, in->size - in->pos);
+	if (n == 0)
+		return AVERROR_EOF;
+
+	memcpy(buf, in->data + in->pos, n);
+	in->pos += n;
+
+	return (int)n;
+}
+
+static int64_t memory_input_seek(void *opaque, int64_t offset, int whence)
+{
+	memory_input *in = (memory_input *)opaque;
+
+	int64_t pos;
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE: return (int64_t)in->size;
+	case SEEK_SET:    pos = offset; break;
+	case SEEK_CUR:    pos = (int64_t)in->pos + offset; break;
+	case SEEK_END:    pos = (int64_t)in->size + offset; break;
+	default:          return -1;
+	}
+
+	if (pos < 0 || pos > (int64_t)in->size)
+		return -1;
+
+	in->pos = (size_t)pos;
+
+	return pos;
+}
+
+struct ffmpeg_decoder {
+	AVFormatContext *fmt_ctx = NULL;
+	AVIOContext *avio_ctx = NULL;
+	AVCodecContext *codec = NULL;
+	struct SwrContext *swr = NULL;
+	AVPacket *packet = NULL;
+	AVFrame *frame = NULL;
+
+	memory_input mem = { NULL, 0, 0 };
+
+	int stream_index = -1;
+
+	s64 offset = 0;     // the first output sample, from the start of the audio
+	s64 n_skip = 0;     // the output samples left to drop before offset
+	s64 n_left = -1;    // the output samples left until the end of duration_ms (< 0: until the end of the audio)
+	bool started = false;
+
+	std::vector<float> buf; // the converted samples not returned yet
+	size_t buf_pos = 0;
+
+	bool eof_input = false; // the demuxer is at the end, the decoder is flushed
+	bool eof = false;       // the decoder and the resampler are flushed
+};
+
+void ffmpeg_decoder_close(ffmpeg_decoder *dec)
+{
+	if (!dec)
+		return;
+
+	av_packet_free(&dec->packet);
+	av_frame_free(&dec->frame);
+	swr_free(&dec->swr);
+	avcodec_free_context(&dec->codec);
+	avformat_close_input(&dec->fmt_ctx);
+
+	if (dec->avio_ctx) {
+		av_freep(&dec->avio_ctx->buffer);
+		avio_context_free(&dec->avio_ctx);
+	}
+
+	delete dec;
+}
+
+static ffmpeg_decoder *ffmpeg_decoder_init(ffmpeg_decoder *dec, const char *url, int n_threads, s64 offset_ms, s64 duration_ms)
+{
+	const size_t errbuffsize = 1024;
+	char errbuff[errbuffsize];
+	int err;
+
+	if (!url) {
+		dec->fmt_ctx = avformat_alloc_context();
+		u8 *avio_ctx_buffer = (u8 *)av_malloc(AVIO_CTX_BUF_SZ);
+		dec->avio_ctx = avio_alloc_context(avio_ctx_buffer, AVIO_CTX_BUF_SZ, 0, &dec->mem, &memory_input_read, NULL, &memory_input_seek);
+		dec->fmt_ctx->pb = dec->avio_ctx;
+	}
+
+	// on failure, avformat_open_input() frees the context
+	err = avformat_open_input(&dec->fmt_ctx, url, NULL, NULL);
+	if (err < 0) {
+		LOG("Could not open the audio: %d: %s\n", err, av_make_error_string(errbuff, errbuffsize, err));
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	err = avformat_find_stream_info(dec->fmt_ctx, NULL);
+	if (err < 0) {
+		LOG("Could not retrieve the stream info: %d\n", err);
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	dec->stream_index = av_find_best_stream(dec->fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+	if (dec->stream_index < 0) {
+		LOG("Could not find an audio stream\n");
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	AVStream *stream = dec->fmt_ctx->streams[dec->stream_index];
+
+	const AVCodec *decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+	if (!decoder) {
+		LOG("No decoder for the codec %d\n", (int)stream->codecpar->codec_id);
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	dec->codec = avcodec_alloc_context3(decoder);
+	avcodec_parameters_to_context(dec->codec, stream->codecpar);
+
+	// 0 - one thread per core
+	dec->codec->thread_count = n_threads > 0 ? n_threads : 0;
+	dec->codec->thread_type  = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	err = avcodec_open2(dec->codec, decoder, NULL);
+	if (err < 0) {
+		LOG("Failed to open the decoder for stream #%d\n", dec->stream_index);
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	/* prepare resampler */
+	dec->swr = swr_alloc();
+
+#if LIBAVCODEC_VERSION_MAJOR > 60
+	AVChannelLayout in_ch_layout = dec->codec->ch_layout;
+	AVChannelLayout out_ch_layout = AV_CHANNEL_LAYOUT_MONO;
+
+	av_opt_set_chlayout(dec->swr, "in_chlayout", &in_ch_layout, 0);
+	av_opt_set_int(dec->swr, "in_sample_rate", dec->codec->sample_rate, 0);
+	av_opt_set_sample_fmt(dec->swr, "in_sample_fmt", dec->codec->sample_fmt, 0);
+
+	av_opt_set_chlayout(dec->swr, "out_chlayout", &out_ch_layout, 0);
+	av_opt_set_int(dec->swr, "out_sample_rate", WAVE_SAMPLE_RATE, 0);
+	av_opt_set_sample_fmt(dec->swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+#else
+	av_opt_set_int(dec->swr, "in_channel_count", dec->codec->channels, 0);
+	av_opt_set_int(dec->swr, "out_channel_count", 1, 0);
+	av_opt_set_int(dec->swr, "in_channel_layout", dec->codec->channel_layout, 0);
+	av_opt_set_int(dec->swr, "out_channel_layout", AV_CH_LAYOUT_MONO, 0);
+	av_opt_set_int(dec->swr, "in_sample_rate", dec->codec->sample_rate, 0);
+	av_opt_set_int(dec->swr, "out_sample_rate", WAVE_SAMPLE_RATE, 0);
+	av_opt_set_sample_fmt(dec->swr, "in_sample_fmt", dec->codec->sample_fmt, 0);
+	av_opt_set_sample_fmt(dec->swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+#endif
+
+	swr_init(dec->swr);
+	if (!swr_is_initialized(dec->swr)) {
+		LOG("Resampler has not been properly initialized\n");
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	dec->packet = av_packet_alloc();
+	dec->frame  = av_frame_alloc();
+	if (!dec->packet || !dec->frame) {
+		LOG("Error allocating the packet or the frame\n");
+		ffmpeg_decoder_close(dec);
+		return NULL;
+	}
+
+	dec->offset = std::max<s64>(offset_ms, 0)*WAVE_SAMPLE_RATE/1000;
+	dec->n_left = duration_ms > 0 ? duration_ms*WAVE_SAMPLE_RATE/1000 : -1;
+
+	if (offset_ms > 0) {
+		const s64 start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+		const s64 ts = start + av_rescale_q(offset_ms, AVRational{1, 1000}, stream->time_base);
+
+		// the key frame at or before ts - the samples before offset are dropped after decoding
+		// without seeking (e.g. a pipe), the audio before offset is decoded and dropped
+		err = avformat_seek_file(dec->fmt_ctx, dec->stream_index, INT64_MIN, ts, ts, 0);
+		if (err < 0) {
+			LOG("Could not seek to %lld ms, decoding from the start\n", (long long)offset_ms);
+		}
+		avcodec_flush_buffers(dec->codec);
+	}
+
+	return dec;
+}
+
+// n_threads: the decoder threads (0 - one per core)
+// offset_ms, duration_ms: the part of the audio to decode (0 - from the start, until the end)
+// return NULL on error
+ffmpeg_decoder *ffmpeg_decoder_open(const std::string &ifname, int n_threads, int64_t offset_ms, int64_t duration_ms)
+{
+	LOG("ffmpeg_decoder_open: %s\n", ifname.c_str());
+
+	return ffmpeg_decoder_init(new ffmpeg_decoder, ifname.c_str(), n_threads, offset_ms, duration_ms);
+}
+
+// the data must stay valid until ffmpeg_decoder_close()
+ffmpeg_decoder *ffmpeg_decoder_open_memory(const uint8_t *data, size_t size, int n_threads, int64_t offset_ms, int64_t duration_ms)
+{
+	LOG("ffmpeg_decoder_open_memory: input size: %zu\n", size);
+
+	ffmpeg_decoder *dec = new ffmpeg_decoder;
+	dec->mem.data = data;
+	dec->mem.size = size;
+	dec->mem.pos  = 0;
+
+	return ffmpeg_decoder_init(dec, NULL, n_threads, offset_ms, duration_ms);
+}
+
+// convert the frame (NULL: flush the resampler) and append the samples between offset and the end of duration_ms
+static void ffmpeg_decoder_convert(ffmpeg_decoder *dec, const AVFrame *frame)
+{
+	const int n_in = frame ? frame->nb_samples : 0;
+
+	const int n_out_max = swr_get_out_samples(dec->swr, n_in);
+	if (n_out_max <= 0)
+		return;
+
+	const size_t n_buf = dec->buf.size();
+	dec->buf.resize(n_buf + n_out_max);
+
+	u8 *out = (u8 *)(dec->buf.data() + n_buf);
+	const int n_out = swr_convert(dec->swr, &out, n_out_max, frame ? (const u8 **)frame->extended_data : NULL, n_in);
+
+	s64 n = std::max(n_out, 0);
+
+	const s64 n_skip = std::min(dec->n_skip, n);
+	dec->n_skip -= n_skip;
+	n -= n_skip;
+
+	if (dec->n_left >= 0) {
+		n = std::min(n, dec->n_left);
+		dec->n_left -= n;
+	}
+
+	if (n_skip > 0) {
+		memmove(dec->buf.data() + n_buf, dec->buf.data() + n_buf + n_skip, n*sizeof(float));
+	}
+	dec->buf.resize(n_buf + n);
+}
+
+// decode the next frames until there are samples in buf or the end of the audio
+static bool ffmpeg_decoder_fill(ffmpeg_decoder *dec)
+{
+	const size_t errbuffsize = 1024;
+	char errbuff[errbuffsize];
+
+	dec->buf.clear();
+	dec->buf_pos = 0;
+
+	while (dec->buf.empty() && !dec->eof && dec->n_left != 0) {
+		int err = avcodec_receive_frame(dec->codec, dec->frame);
+		if (err == 0) {
+			if (!dec->started) {
+				// the position of the first frame after the seek, in output samples
+				const AVStream *stream = dec->fmt_ctx->streams[dec->stream_index];
+				const s64 pts = dec->frame->best_effort_timestamp;
+
+				s64 pos = 0;
+				if (pts != AV_NOPTS_VALUE) {
+					const s64 start = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+					pos = av_rescale_q(pts - start, stream->time_base, AVRational{1, WAVE_SAMPLE_RATE});
+				}
+
+				dec->n_skip  = std::max<s64>(dec->offset - pos, 0);
+				dec->started = true;
+			}
+
+			ffmpeg_decoder_convert(dec, dec->frame);
+			av_frame_unref(dec->frame);
+			continue;
+		}
+
+		if (err == AVERROR_EOF) {
+			ffmpeg_decoder_convert(dec, NULL);
+			dec->eof = true;
+			break;
+		}
+
+		if (err != AVERROR(EAGAIN)) {
+			LOG("Error decoding the audio: %d: %s\n", err, av_make_error_string(errbuff, errbuffsize, err));
+			return false;
+		}
+
+		// the decoder needs the next packet
+		err = av_read_frame(dec->fmt_ctx, dec->packet);
+		if (err < 0) {
+			if (dec->eof_input) {
+				ffmpeg_decoder_convert(dec, NULL);
+				dec->eof = true;
+				break;
+			}
+			avcodec_send_packet(dec->codec, NULL);
+			dec->eof_input = true;
+			continue;
+		}
+
+		if (dec->packet->stream_index == dec->stream_index) {
+			err = avcodec_send_packet(dec->codec, dec->packet);
+			if (err < 0) {
+				// the corrupt packets are skipped
+				LOG("Error sending a packet to the decoder: %d: %s\n", err, av_make_error_string(errbuff, errbuffsize, err));
+			}
+		}
+		av_packet_unref(dec->packet);
+	}
+
+	return true;
+}
+
+// read up to n_max samples of 16 kHz mono float
+// return the number of samples, 0 at the end of the audio, < 0 on error
+int ffmpeg_decoder_read(ffmpeg_decoder *dec, float *pcm, int n_max)
+{
+	int n = 0;
+
+	while (n < n_max) {
+		if (dec->buf_pos < dec->buf.size()) {
+			const size_t n_cur = std::min((size_t)(n_max - n), dec->buf.size() - dec->buf_pos);
+			memcpy(pcm + n, dec->buf.data() + dec->buf_pos, n_cur*sizeof(float));
+			dec->buf_pos += n_cur;
+			n += n_cur;
+			continue;
+		}
+
+		if (dec->eof || dec->n_left == 0)
+			break;
+
+		if (!ffmpeg_decoder_fill(dec))
+			return -1;
+	}
+
+	return n;
+}
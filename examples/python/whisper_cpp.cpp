@@ -0,0 +1,475 @@
+// Python module of whisper.cpp
+//
+// The audio is passed with the buffer protocol (numpy arrays, array.array, memoryview, ...):
+//
+//   - float32 samples are read in place, without a copy
+//   - int16 samples are converted to float32 (scaled by 1/32768)
+//
+// The GIL is released while the audio is transcribed, so that the Python threads can transcribe with the same model
+// at once. Each thread needs its own whisper_state: either explicit State objects (Context.new_state()) or the state
+// of the calling thread that Context.transcribe() creates on its first call.
+//
+//   import whisper_cpp
+//
+//   ctx = whisper_cpp.Context("models/ggml-base.en.bin")
+//   for t0, t1, text in ctx.transcribe(pcm, n_threads = 2):
+//       print(t0, t1, text)
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "whisper.h"
+
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct py_context {
+    PyObject_HEAD
+
+    whisper_context * ctx;
+
+    // the states of Context.transcribe(), by thread
+    std::map<unsigned long, whisper_state *> * states;
+    std::mutex * mutex;
+};
+
+struct py_state {
+    PyObject_HEAD
+
+    py_context    * owner; // reference
+    whisper_state * state;
+
+    // a state cannot be used by two threads at once
+    std::atomic<bool> * busy;
+};
+
+static PyTypeObject py_context_type = { PyVarObject_HEAD_INIT(nullptr, 0) };
+static PyTypeObject py_state_type   = { PyVarObject_HEAD_INIT(nullptr, 0) };
+
+//
+// transcription
+//
+
+struct py_segment {
+    double t0;
+    double t1;
+    std::string text;
+};
+
+struct py_full_params {
+    const char * language  = "en";
+    const char * prompt    = nullptr;
+    int          n_threads = 0;
+    int          beam_size = 0;
+    int          translate = 0;
+    int          no_timestamps = 0;
+};
+
+static const char * py_full_kwlist[] = { "audio", "language", "n_threads", "beam_size", "translate", "no_timestamps", "initial_prompt", nullptr };
+
+static bool py_full_parse(PyObject * args, PyObject * kwargs, PyObject ** audio, py_full_params & fp) {
+    return PyArg_ParseTupleAndKeywords(args, kwargs, "O|ziippz", (char **) py_full_kwlist,
+            audio, &fp.language, &fp.n_threads, &fp.beam_size, &fp.translate, &fp.no_timestamps, &fp.prompt);
+}
+
+// transcribe the audio with the state, without the GIL - returns nullptr with an exception set on error
+static PyObject * py_full(whisper_context * ctx, whisper_state * state, PyObject * audio, const py_full_params & fp) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(audio, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+        return nullptr;
+    }
+
+    // the formats of the native (or little-endian) byte order
+    const char * fmt = view.format ? view.format : "B";
+    if (fmt[0] == '<' || fmt[0] == '=' || fmt[0] == '@') {
+        fmt++;
+    }
+
+    const bool is_f32 = strcmp(fmt, "f") == 0 && view.itemsize == 4;
+    const bool is_i16 = strcmp(fmt, "h") == 0 && view.itemsize == 2;
+
+    if (!is_f32 && !is_i16) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_TypeError, "the audio must be float32 or int16 samples, not '%s'", view.format ? view.format : "B");
+        return nullptr;
+    }
+
+    const Py_ssize_t n_samples = view.len/view.itemsize;
+
+    whisper_full_params wparams = whisper_full_default_params(fp.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+
+    wparams.print_progress   = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.print_special    = false;
+    wparams.language         = fp.language ? fp.language : "auto";
+    wparams.detect_language  = false;
+    wparams.translate        = fp.translate;
+    wparams.no_timestamps    = fp.no_timestamps;
+    wparams.initial_prompt   = fp.prompt;
+
+    if (fp.n_threads > 0) {
+        wparams.n_threads = fp.n_threads;
+    }
+
+    if (fp.beam_size > 1) {
+        wparams.beam_search.beam_size = fp.beam_size;
+    }
+
+    std::vector<py_segment> segments;
+    std::vector<float> pcm;
+
+    int ret = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    const float * samples = (const float *) view.buf;
+
+    if (is_i16) {
+        const int16_t * src = (const int16_t *) view.buf;
+
+        pcm.resize(n_samples);
+        for (Py_ssize_t i = 0; i < n_samples; ++i) {
+            pcm[i] = src[i]/32768.0f;
+        }
+
+        samples = pcm.data();
+    }
+
+    ret = whisper_full_with_state(ctx, state, wparams, samples, (int) n_samples);
+
+    if (ret == 0) {
+        const int n_segments = whisper_full_n_segments_from_state(state);
+
+        segments.resize(n_segments);
+        for (int i = 0; i < n_segments; ++i) {
+            segments[i].t0   = whisper_full_get_segment_t0_from_state(state, i)/100.0;
+            segments[i].t1   = whisper_full_get_segment_t1_from_state(state, i)/100.0;
+            segments[i].text = whisper_full_get_segment_text_from_state(state, i);
+        }
+    }
+
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+
+    if (ret != 0) {
+        PyErr_Format(PyExc_RuntimeError, "failed to transcribe the audio (%d)", ret);
+        return nullptr;
+    }
+
+    PyObject * result = PyList_New(segments.size());
+    if (!result) {
+        return nullptr;
+    }
+
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const auto & seg = segments[i];
+
+        PyObject * item = Py_BuildValue("(ddN)", seg.t0, seg.t1, PyUnicode_DecodeUTF8(seg.text.data(), seg.text.size(), "replace"));
+        if (!item) {
+            Py_DECREF(result);
+            return nullptr;
+        }
+
+        PyList_SET_ITEM(result, i, item);
+    }
+
+    return result;
+}
+
+//
+// State
+//
+
+static void py_state_dealloc(py_state * self) {
+    if (self->state) {
+        whisper_free_state(self->state);
+    }
+
+    delete self->busy;
+
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject * py_state_transcribe(py_state * self, PyObject * args, PyObject * kwargs) {
+    PyObject * audio = nullptr;
+    py_full_params fp;
+
+    if (!py_full_parse(args, kwargs, &audio, fp)) {
+        return nullptr;
+    }
+
+    if (self->busy->exchange(true)) {
+        PyErr_SetString(PyExc_RuntimeError, "the state is used by another thread");
+        return nullptr;
+    }
+
+    PyObject * result = py_full(self->owner->ctx, self->state, audio, fp);
+
+    self->busy->store(false);
+
+    return result;
+}
+
+static PyObject * py_state_lang(py_state * self, PyObject *) {
+    const int id = whisper_full_lang_id_from_state(self->state);
+
+    if (id < 0) {
+        Py_RETURN_NONE;
+    }
+
+    return PyUnicode_FromString(whisper_lang_str(id));
+}
+
+static PyMethodDef py_state_methods[] = {
+    { "transcribe", (PyCFunction) (void (*)(void)) py_state_transcribe, METH_VARARGS | METH_KEYWORDS,
+      "transcribe(audio, language='en', n_threads=0, beam_size=0, translate=False, no_timestamps=False, initial_prompt=None)\n"
+      "Transcribe float32 or int16 samples at 16 kHz, returns a list of (t0, t1, text) with the times in seconds" },
+    { "language", (PyCFunction) py_state_lang, METH_NOARGS,
+      "language()\nThe language of the last transcription" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+//
+// Context
+//
+
+static int py_context_init(py_context * self, PyObject * args, PyObject * kwargs) {
+    static const char * kwlist[] = { "model", "use_gpu", "flash_attn", "gpu_device", nullptr };
+
+    const char * model = nullptr;
+
+    whisper_context_params cparams = whisper_context_default_params();
+
+    int use_gpu    = cparams.use_gpu;
+    int flash_attn = cparams.flash_attn;
+    int gpu_device = cparams.gpu_device;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|ppi", (char **) kwlist, &model, &use_gpu, &flash_attn, &gpu_device)) {
+        return -1;
+    }
+
+    if (self->ctx) {
+        PyErr_SetString(PyExc_RuntimeError, "the context is already initialized");
+        return -1;
+    }
+
+    cparams.use_gpu    = use_gpu;
+    cparams.flash_attn = flash_attn;
+    cparams.gpu_device = gpu_device;
+
+    whisper_context * ctx = nullptr;
+
+    Py_BEGIN_ALLOW_THREADS
+    ctx = whisper_init_from_file_with_params_no_state(model, cparams);
+    Py_END_ALLOW_THREADS
+
+    if (!ctx) {
+        PyErr_Format(PyExc_RuntimeError, "failed to load the model '%s'", model);
+        return -1;
+    }
+
+    self->ctx    = ctx;
+    self->states = new std::map<unsigned long, whisper_state *>();
+    self->mutex  = new std::mutex();
+
+    return 0;
+}
+
+static void py_context_dealloc(py_context * self) {
+    if (self->states) {
+        for (auto & it : *self->states) {
+            whisper_free_state(it.second);
+        }
+    }
+
+    delete self->states;
+    delete self->mutex;
+
+    if (self->ctx) {
+        whisper_free(self->ctx);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static bool py_context_check(py_context * self) {
+    if (!self->ctx) {
+        PyErr_SetString(PyExc_RuntimeError, "the context is not initialized");
+        return false;
+    }
+
+    return true;
+}
+
+static PyObject * py_context_new_state(py_context * self, PyObject *) {
+    if (!py_context_check(self)) {
+        return nullptr;
+    }
+
+    whisper_state * state = nullptr;
+
+    Py_BEGIN_ALLOW_THREADS
+    state = whisper_init_state(self->ctx);
+    Py_END_ALLOW_THREADS
+
+    if (!state) {
+        PyErr_SetString(PyExc_RuntimeError, "failed to initialize the state");
+        return nullptr;
+    }
+
+    py_state * result = PyObject_New(py_state, &py_state_type);
+    if (!result) {
+        whisper_free_state(state);
+        return nullptr;
+    }
+
+    Py_INCREF(self);
+
+    result->owner = self;
+    result->state = state;
+    result->busy  = new std::atomic<bool>(false);
+
+    return (PyObject *) result;
+}
+
+static PyObject * py_context_transcribe(py_context * self, PyObject * args, PyObject * kwargs) {
+    PyObject * audio = nullptr;
+    py_full_params fp;
+
+    if (!py_full_parse(args, kwargs, &audio, fp) || !py_context_check(self)) {
+        return nullptr;
+    }
+
+    // the thread ids can be reused - by a new thread once the previous one has exited
+    const unsigned long tid = PyThread_get_thread_ident();
+
+    whisper_state * state = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(*self->mutex);
+
+        auto it = self->states->find(tid);
+        if (it != self->states->end()) {
+            state = it->second;
+        }
+    }
+
+    if (!state) {
+        Py_BEGIN_ALLOW_THREADS
+        state = whisper_init_state(self->ctx);
+        Py_END_ALLOW_THREADS
+
+        if (!state) {
+            PyErr_SetString(PyExc_RuntimeError, "failed to initialize the state");
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(*self->mutex);
+        (*self->states)[tid] = state;
+    }
+
+    return py_full(self->ctx, state, audio, fp);
+}
+
+static PyObject * py_context_n_states(py_context * self, PyObject *) {
+    if (!py_context_check(self)) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(*self->mutex);
+
+    return PyLong_FromSize_t(self->states->size());
+}
+
+static PyMethodDef py_context_methods[] = {
+    { "new_state", (PyCFunction) py_context_new_state, METH_NOARGS,
+      "new_state()\nA new State of the model, for the transcriptions of one thread at a time" },
+    { "transcribe", (PyCFunction) (void (*)(void)) py_context_transcribe, METH_VARARGS | METH_KEYWORDS,
+      "transcribe(audio, language='en', n_threads=0, beam_size=0, translate=False, no_timestamps=False, initial_prompt=None)\n"
+      "State.transcribe() with the state of the calling thread, created on its first call" },
+    { "n_states", (PyCFunction) py_context_n_states, METH_NOARGS,
+      "n_states()\nThe number of states created by transcribe()" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+//
+// module
+//
+
+static void py_log_silent(ggml_log_level, const char *, void *) {
+}
+
+static PyObject * py_set_verbose(PyObject *, PyObject * args) {
+    int verbose = 1;
+
+    if (!PyArg_ParseTuple(args, "p", &verbose)) {
+        return nullptr;
+    }
+
+    whisper_log_set(verbose ? nullptr : py_log_silent, nullptr);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject * py_system_info(PyObject *, PyObject *) {
+    return PyUnicode_FromString(whisper_print_system_info());
+}
+
+static PyMethodDef py_methods[] = {
+    { "set_verbose", py_set_verbose, METH_VARARGS, "set_verbose(verbose)\nEnable or disable the log of whisper.cpp" },
+    { "system_info", py_system_info, METH_NOARGS,  "system_info()\nThe features of the backends" },
+    { nullptr, nullptr, 0, nullptr },
+};
+
+static struct PyModuleDef py_module = {
+    PyModuleDef_HEAD_INIT,
+    "whisper_cpp",
+    "Python module of whisper.cpp",
+    -1,
+    py_methods,
+};
+
+PyMODINIT_FUNC PyInit_whisper_cpp(void) {
+    py_context_type.tp_name      = "whisper_cpp.Context";
+    py_context_type.tp_doc       = "Context(model, use_gpu=True, flash_attn=..., gpu_device=0)\nA whisper model, shared by the threads";
+    py_context_type.tp_basicsize = sizeof(py_context);
+    py_context_type.tp_flags     = Py_TPFLAGS_DEFAULT;
+    py_context_type.tp_new       = PyType_GenericNew;
+    py_context_type.tp_init      = (initproc) py_context_init;
+    py_context_type.tp_dealloc   = (destructor) py_context_dealloc;
+    py_context_type.tp_methods   = py_context_methods;
+
+    py_state_type.tp_name      = "whisper_cpp.State";
+    py_state_type.tp_doc       = "The decoding state of a Context (see Context.new_state())";
+    py_state_type.tp_basicsize = sizeof(py_state);
+    py_state_type.tp_flags     = Py_TPFLAGS_DEFAULT;
+    py_state_type.tp_dealloc   = (destructor) py_state_dealloc;
+    py_state_type.tp_methods   = py_state_methods;
+
+    if (PyType_Ready(&py_context_type) < 0 || PyType_Ready(&py_state_type) < 0) {
+        return nullptr;
+    }
+
+    PyObject * m = PyModule_Create(&py_module);
+    if (!m) {
+        return nullptr;
+    }
+
+    Py_INCREF(&py_context_type);
+    Py_INCREF(&py_state_type);
+
+    if (PyModule_AddObject(m, "Context", (PyObject *) &py_context_type) < 0 ||
+        PyModule_AddObject(m, "State",   (PyObject *) &py_state_type)   < 0) {
+        Py_DECREF(m);
+        return nullptr;
+    }
+
+    return m;
+}
@@ -36,7 +36,7 @@ struct whisper_filters {
 };
 
 // quantize a model
-static bool whisper_model_quantize(const std::string & fname_inp, const std::string & fname_out, ggml_ftype ftype) {
+static bool whisper_model_quantize(const std::string & fname_inp, const std::string & fname_out, ggml_ftype ftype, const std::vector<ggml_tensor_type_rule> & rules, const ggml_imatrix & imatrix, float conv_max_err) {
     gpt_vocab vocab;
 
     printf("%s: loading model from '%s'\n", __func__, fname_inp.c_str());
@@ -164,7 +164,14 @@ static bool whisper_model_quantize(const std::string & fname_inp, const std::str
         "decoder.positional_embedding",
     };
 
-    if (!ggml_common_quantize_0(finp, fout, ftype, { ".*" }, to_skip)) {
+    // the kernels of the convolutions [3, IC, OC] are quantized as [3*IC, OC], the weight of a MUL_MAT over the im2col of
+    // the stem (see whisper_conv_1d_ph) - the first one keeps its type with 80 mels (rows of 240 values)
+    const std::vector<std::string> to_flatten = {
+        "encoder.conv1.weight",
+        "encoder.conv2.weight",
+    };
+
+    if (!ggml_common_quantize_0(finp, fout, ftype, { ".*" }, to_skip, rules, imatrix, to_flatten, conv_max_err)) {
         fprintf(stderr, "%s: failed to quantize model '%s'\n", __func__, fname_inp.c_str());
         return false;
     }
@@ -175,13 +182,155 @@ static bool whisper_model_quantize(const std::string & fname_inp, const std::str
     return true;
 }
 
+// a rule REGEX=TYPE of --tensor-type or of a line of --tensor-types
+static bool parse_tensor_type_rule(const std::string & str, std::vector<ggml_tensor_type_rule> & rules) {
+    const size_t pos = str.rfind('=');
+    if (pos == std::string::npos || pos == 0) {
+        fprintf(stderr, "error: invalid tensor type rule '%s', expected REGEX=TYPE\n", str.c_str());
+        return false;
+    }
+
+    const std::string pattern = str.substr(0, pos);
+    const std::string name    = str.substr(pos + 1);
+
+    const ggml_type type = ggml_parse_type(name.c_str());
+    if (type == GGML_TYPE_COUNT) {
+        fprintf(stderr, "error: unknown type '%s' in tensor type rule '%s'\n", name.c_str(), str.c_str());
+        return false;
+    }
+
+    try {
+        std::regex re(pattern);
+    } catch (const std::regex_error & e) {
+        fprintf(stderr, "error: invalid regex '%s' in tensor type rule: %s\n", pattern.c_str(), e.what());
+        return false;
+    }
+
+    rules.push_back({ pattern, type });
+
+    return true;
+}
+
+// the rules of a file, one REGEX=TYPE per line - the empty lines and the lines starting with # are ignored
+static bool read_tensor_type_rules(const std::string & fname, std::vector<ggml_tensor_type_rule> & rules) {
+    std::ifstream fin(fname);
+    if (!fin) {
+        fprintf(stderr, "error: failed to open '%s'\n", fname.c_str());
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(fin, line)) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        if (!parse_tensor_type_rule(line, rules)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the importance matrix written by whisper-cli --imatrix (see whisper_imatrix_write())
+static bool read_imatrix(const std::string & fname, ggml_imatrix & imatrix) {
+    std::ifstream fin(fname, std::ios::binary);
+    if (!fin) {
+        fprintf(stderr, "error: failed to open '%s'\n", fname.c_str());
+        return false;
+    }
+
+    int32_t n_entries = 0;
+    fin.read((char *) &n_entries, sizeof(n_entries));
+
+    for (int i = 0; i < n_entries && fin; ++i) {
+        int32_t len = 0;
+        fin.read((char *) &len, sizeof(len));
+        if (len <= 0 || len > 1024) {
+            break;
+        }
+
+        std::string name(len, 0);
+        fin.read(&name[0], len);
+
+        int32_t n_calls = 0;
+        int32_t n_vals  = 0;
+        fin.read((char *) &n_calls, sizeof(n_calls));
+        fin.read((char *) &n_vals,  sizeof(n_vals));
+        if (n_vals <= 0 || n_vals > (1 << 20)) {
+            break;
+        }
+
+        auto & values = imatrix[name];
+        values.resize(n_vals);
+        fin.read((char *) values.data(), n_vals*sizeof(float));
+
+        for (auto & v : values) {
+            v = n_calls > 0 ? v/n_calls : 0.0f;
+        }
+    }
+
+    if (!fin || (int) imatrix.size() != n_entries) {
+        fprintf(stderr, "error: failed to read the importance matrix from '%s'\n", fname.c_str());
+        return false;
+    }
+
+    printf("%s: loaded %d importance matrix entries from '%s'\n", __func__, n_entries, fname.c_str());
+
+    return true;
+}
+
+static void print_usage(const char * argv0) {
+    fprintf(stderr, "usage: %s model-f32.bin model-quant.bin type [options]\n", argv0);
+    ggml_print_ftypes(stderr);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "options:\n");
+    fprintf(stderr, "  --tensor-type REGEX=TYPE  type of the weights whose name matches REGEX (f32, f16 or a type above)\n");
+    fprintf(stderr, "  --tensor-types FNAME      file with one REGEX=TYPE per line\n");
+    fprintf(stderr, "  --imatrix FNAME           importance matrix of the weights (whisper-cli --imatrix FNAME)\n");
+    fprintf(stderr, "  --conv-max-err E          relative RMS error of the conv kernels above which they use q8_0 (default: 0.03)\n");
+    fprintf(stderr, "the first matching rule is used, e.g. --tensor-type 'decoder\\.token_embedding.*=f16'\n");
+}
+
 int main(int argc, char ** argv) {
-    if (argc != 4) {
-        fprintf(stderr, "usage: %s model-f32.bin model-quant.bin type\n", argv[0]);
-        ggml_print_ftypes(stderr);
+    if (argc < 4) {
+        print_usage(argv[0]);
         return 1;
     }
 
+    std::vector<ggml_tensor_type_rule> rules;
+    ggml_imatrix imatrix;
+
+    float conv_max_err = 0.03f;
+
+    for (int i = 4; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "--tensor-type" && i + 1 < argc) {
+            if (!parse_tensor_type_rule(argv[++i], rules)) {
+                return 1;
+            }
+        } else if (arg == "--tensor-types" && i + 1 < argc) {
+            if (!read_tensor_type_rules(argv[++i], rules)) {
+                return 1;
+            }
+        } else if (arg == "--imatrix" && i + 1 < argc) {
+            if (!read_imatrix(argv[++i], imatrix)) {
+                return 1;
+            }
+        } else if (arg == "--conv-max-err" && i + 1 < argc) {
+            conv_max_err = std::stof(argv[++i]);
+        } else {
+            fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
     // needed to initialize f16 tables
     {
         struct ggml_init_params params = { 0, NULL, false };
@@ -202,7 +351,7 @@ int main(int argc, char ** argv) {
     {
         const int64_t t_start_us = ggml_time_us();
 
-        if (!whisper_model_quantize(fname_inp, fname_out, ggml_ftype(ftype))) {
+        if (!whisper_model_quantize(fname_inp, fname_out, ggml_ftype(ftype), rules, imatrix, conv_max_err)) {
             fprintf(stderr, "%s: failed to quantize model from '%s'\n", __func__, fname_inp.c_str());
             return 1;
         }
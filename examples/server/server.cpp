@@ -1,14 +1,26 @@
 #include "common.h"
 #include "common-whisper.h"
+#include "common-download.h"
+#include "common-opus.h"
 
 #include "whisper.h"
 #include "httplib.h"
 #include "json.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <cstring>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -25,6 +37,8 @@ const std::string text_format   = "text";
 const std::string srt_format    = "srt";
 const std::string vjson_format  = "verbose_json";
 const std::string vtt_format    = "vtt";
+const std::string sse_format    = "sse";
+const std::string bin_format    = "bin";
 
 struct server_params
 {
@@ -36,8 +50,26 @@ struct server_params
     int32_t port          = 8080;
     int32_t read_timeout  = 600;
     int32_t write_timeout = 600;
+    int32_t n_workers     = 1;
+    int32_t n_queue       = 16;
+    int32_t n_streams     = 4;
+    int32_t n_batch       = 1;
+    int32_t batch_wait_ms = 10;
+    int32_t batch_max_ms  = 10000;
+    int32_t models_mem_mb = 0;
+    int32_t n_cache       = 0;
+    int32_t cache_mem_mb  = 64;
+
+    // name -> path of the models that are loaded on the first request that uses them
+    std::vector<std::pair<std::string, std::string>> models;
 
     bool ffmpeg_converter = false;
+
+    // cluster mode: the requests longer than peers_min_ms are split and transcribed by these servers (host:port[/path])
+    std::vector<std::string> peers;
+    int32_t     peers_min_ms = 300000;
+    int32_t     peers_jobs   = 4;
+    std::string peers_vad;
 };
 
 struct whisper_params {
@@ -74,13 +106,22 @@ struct whisper_params {
     bool no_timestamps   = false;
     bool use_gpu         = true;
     bool flash_attn      = false;
+    bool cpu_partition   = false;
     bool suppress_nst    = false;
     bool no_context      = false;
 
+    int32_t gpu_device    = 0;
+    int32_t n_gpu_devices = 1;
+
+    std::string encoder_device = "";
+    std::string decoder_device = "";
+    std::string rpc_servers    = "";
+
     std::string language        = "en";
     std::string prompt          = "";
     std::string font_path       = "/System/Library/Fonts/Supplemental/Courier New Bold.ttf";
     std::string model           = "models/ggml-base.en.bin";
+    std::string model_sha256    = "";
 
     std::string response_format     = json_format;
 
@@ -125,7 +166,8 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -l LANG,   --language LANG     [%-7s] spoken language ('auto' for auto-detect)\n",       params.language.c_str());
     fprintf(stderr, "  -dl,       --detect-language   [%-7s] exit after automatically detecting language\n",    params.detect_language ? "true" : "false");
     fprintf(stderr, "             --prompt PROMPT     [%-7s] initial prompt\n",                                 params.prompt.c_str());
-    fprintf(stderr, "  -m FNAME,  --model FNAME       [%-7s] model path\n",                                     params.model.c_str());
+    fprintf(stderr, "  -m FNAME,  --model FNAME       [%-7s] model path, or http(s) URL of the model to download in the cache ($WHISPER_CACHE_DIR)\n", params.model.c_str());
+    fprintf(stderr, "             --model-sha256 HASH [%-7s] expected SHA-256 of the model of the URL\n",      params.model_sha256.c_str());
     fprintf(stderr, "  -oved D,   --ov-e-device DNAME [%-7s] the OpenVINO device used for encode inference\n",  params.openvino_encode_device.c_str());
     // server params
     fprintf(stderr, "  -dtw MODEL --dtw MODEL         [%-7s] compute token-level timestamps\n", params.dtw.c_str());
@@ -134,11 +176,31 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  --public PATH,                 [%-7s] Path to the public folder\n", sparams.public_path.c_str());
     fprintf(stderr, "  --request-path PATH,           [%-7s] Request path for all requests\n", sparams.request_path.c_str());
     fprintf(stderr, "  --inference-path PATH,         [%-7s] Inference path for all requests\n", sparams.inference_path.c_str());
-    fprintf(stderr, "  --convert,                     [%-7s] Convert audio to WAV, requires ffmpeg on the server\n", sparams.ffmpeg_converter ? "true" : "false");
+    fprintf(stderr, "  --convert,                     [%-7s] Convert other formats with the ffmpeg command\n", sparams.ffmpeg_converter ? "true" : "false");
+    fprintf(stderr, "  --workers N,                   [%-7d] Number of requests processed at the same time\n", sparams.n_workers);
+    fprintf(stderr, "  --queue N,                     [%-7d] Number of requests waiting for a worker, more are rejected\n", sparams.n_queue);
+    fprintf(stderr, "  --streams N,                   [%-7d] Maximum number of open /stream sessions\n", sparams.n_streams);
+    fprintf(stderr, "  --batch N,                     [%-7d] Transcribe up to N short requests together (1 = disabled)\n", sparams.n_batch);
+    fprintf(stderr, "  --batch-wait N,                [%-7d] Time in ms that a request waits for others to join its batch\n", sparams.batch_wait_ms);
+    fprintf(stderr, "  --batch-max-ms N,              [%-7d] Maximum duration in ms of the audio of a batched request\n", sparams.batch_max_ms);
+    fprintf(stderr, "  --cache N,                     [%-7d] Keep the responses of the last N requests for repeated audio (0 = disabled)\n", sparams.n_cache);
+    fprintf(stderr, "  --cache-mem N,                 [%-7d] Maximum size in MiB of the cached responses\n", sparams.cache_mem_mb);
+    fprintf(stderr, "  --add-model NAME=FNAME,        [%-7s] Model selected by the 'model' field of the requests\n", "");
+    fprintf(stderr, "  --models-mem N,                [%-7d] Unload the least recently used models above N MiB (0 = no limit)\n", sparams.models_mem_mb);
+    fprintf(stderr, "  --peers LIST,                  [%-7s] comma-separated host:port[/path] of the servers that transcribe the chunks of long requests\n", "");
+    fprintf(stderr, "  --peers-min-ms N,              [%-7d] Minimum duration in ms of the audio of a request split over the peers\n", sparams.peers_min_ms);
+    fprintf(stderr, "  --peers-jobs N,                [%-7d] Number of chunks per peer\n", sparams.peers_jobs);
+    fprintf(stderr, "  --peers-vad FNAME,             [%-7s] VAD model to split the audio in the silences (default: at the quietest frames)\n", sparams.peers_vad.c_str());
     fprintf(stderr, "  -sns,      --suppress-nst      [%-7s] suppress non-speech tokens\n", params.suppress_nst ? "true" : "false");
     fprintf(stderr, "  -nth N,    --no-speech-thold N [%-7.2f] no speech threshold\n",   params.no_speech_thold);
     fprintf(stderr, "  -nc,       --no-context        [%-7s] do not use previous audio context\n", params.no_context ? "true" : "false");
     fprintf(stderr, "  -ng,       --no-gpu            [%-7s] do not use gpu\n", params.use_gpu ? "false" : "true");
+    fprintf(stderr, "  -dev N,    --device N          [%-7d] GPU device to use\n", params.gpu_device);
+    fprintf(stderr, "  -ngd N,    --gpu-devices N     [%-7d] replicate the models on N GPU devices from --device, the workers are spread over them\n", params.n_gpu_devices);
+    fprintf(stderr, "  -cpt,      --cpu-partition     [%-7s] pin the threads of each worker / processor to a disjoint part of the CPUs\n", params.cpu_partition ? "true" : "false");
+    fprintf(stderr, "  -ed NAME,  --encoder-device NAME [%-7s] device of the encoder (CPU, CUDA0, ...)\n", params.encoder_device.c_str());
+    fprintf(stderr, "  -dd NAME,  --decoder-device NAME [%-7s] device of the decoder (CPU, CUDA1, ...)\n", params.decoder_device.c_str());
+    fprintf(stderr, "  -rpc LIST, --rpc LIST          [%-7s] comma-separated host:port of RPC servers, the encoder runs on the first\n", params.rpc_servers.c_str());
     fprintf(stderr, "\n");
 }
 
@@ -179,9 +241,16 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (arg == "-dl"   || arg == "--detect-language") { params.detect_language = true; }
         else if (                  arg == "--prompt")          { params.prompt          = argv[++i]; }
         else if (arg == "-m"    || arg == "--model")           { params.model           = argv[++i]; }
+        else if (                  arg == "--model-sha256")    { params.model_sha256    = argv[++i]; }
         else if (arg == "-oved" || arg == "--ov-e-device")     { params.openvino_encode_device = argv[++i]; }
         else if (arg == "-dtw"  || arg == "--dtw")             { params.dtw             = argv[++i]; }
         else if (arg == "-ng"   || arg == "--no-gpu")          { params.use_gpu         = false; }
+        else if (arg == "-dev"  || arg == "--device")          { params.gpu_device      = std::stoi(argv[++i]); }
+        else if (arg == "-ngd"  || arg == "--gpu-devices")     { params.n_gpu_devices   = std::stoi(argv[++i]); }
+        else if (arg == "-cpt"  || arg == "--cpu-partition")   { params.cpu_partition   = true; }
+        else if (arg == "-ed"   || arg == "--encoder-device")  { params.encoder_device  = argv[++i]; }
+        else if (arg == "-dd"   || arg == "--decoder-device")  { params.decoder_device  = argv[++i]; }
+        else if (arg == "-rpc"  || arg == "--rpc")             { params.rpc_servers     = argv[++i]; }
         else if (arg == "-fa"   || arg == "--flash-attn")      { params.flash_attn      = true; }
         else if (arg == "-sns"  || arg == "--suppress-nst")    { params.suppress_nst    = true; }
         else if (arg == "-nth"  || arg == "--no-speech-thold") { params.no_speech_thold = std::stof(argv[++i]); }
@@ -194,6 +263,37 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
         else if (                  arg == "--request-path")    { sparams.request_path = argv[++i]; }
         else if (                  arg == "--inference-path")  { sparams.inference_path = argv[++i]; }
         else if (                  arg == "--convert")         { sparams.ffmpeg_converter     = true; }
+        else if (                  arg == "--workers")         { sparams.n_workers   = std::stoi(argv[++i]); }
+        else if (                  arg == "--queue")           { sparams.n_queue     = std::stoi(argv[++i]); }
+        else if (                  arg == "--streams")         { sparams.n_streams   = std::stoi(argv[++i]); }
+        else if (                  arg == "--batch")           { sparams.n_batch       = std::stoi(argv[++i]); }
+        else if (                  arg == "--batch-wait")      { sparams.batch_wait_ms = std::stoi(argv[++i]); }
+        else if (                  arg == "--batch-max-ms")    { sparams.batch_max_ms  = std::stoi(argv[++i]); }
+        else if (                  arg == "--cache")           { sparams.n_cache       = std::stoi(argv[++i]); }
+        else if (                  arg == "--cache-mem")       { sparams.cache_mem_mb  = std::stoi(argv[++i]); }
+        else if (                  arg == "--models-mem")      { sparams.models_mem_mb = std::stoi(argv[++i]); }
+        else if (                  arg == "--peers")           {
+            std::stringstream ss(argv[++i]);
+            std::string peer;
+            while (std::getline(ss, peer, ',')) {
+                if (!peer.empty()) {
+                    sparams.peers.push_back(peer);
+                }
+            }
+        }
+        else if (                  arg == "--peers-min-ms")    { sparams.peers_min_ms  = std::stoi(argv[++i]); }
+        else if (                  arg == "--peers-jobs")      { sparams.peers_jobs    = std::stoi(argv[++i]); }
+        else if (                  arg == "--peers-vad")       { sparams.peers_vad     = argv[++i]; }
+        else if (                  arg == "--add-model")       {
+            const std::string value = argv[++i];
+            const size_t pos = value.find('=');
+            if (pos == std::string::npos || pos == 0) {
+                fprintf(stderr, "error: --add-model expects NAME=FNAME, got '%s'\n", value.c_str());
+                whisper_print_usage(argc, argv, params, sparams);
+                exit(0);
+            }
+            sparams.models.emplace_back(value.substr(0, pos), value.substr(pos + 1));
+        }
         else {
             fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
             whisper_print_usage(argc, argv, params, sparams);
@@ -207,7 +307,7 @@ bool whisper_params_parse(int argc, char ** argv, whisper_params & params, serve
 struct whisper_print_user_data {
     const whisper_params * params;
 
-    const std::vector<std::vector<float>> * pcmf32s;
+    const stereo_energy * energy;
     int progress_prev;
 };
 
@@ -268,30 +368,8 @@ bool convert_to_wav(const std::string & temp_filename, std::string & error_resp)
     return true;
 }
 
-std::string estimate_diarization_speaker(std::vector<std::vector<float>> pcmf32s, int64_t t0, int64_t t1, bool id_only = false) {
-    std::string speaker = "";
-    const int64_t n_samples = pcmf32s[0].size();
-
-    const int64_t is0 = timestamp_to_sample(t0, n_samples, WHISPER_SAMPLE_RATE);
-    const int64_t is1 = timestamp_to_sample(t1, n_samples, WHISPER_SAMPLE_RATE);
-
-    double energy0 = 0.0f;
-    double energy1 = 0.0f;
-
-    for (int64_t j = is0; j < is1; j++) {
-        energy0 += fabs(pcmf32s[0][j]);
-        energy1 += fabs(pcmf32s[1][j]);
-    }
-
-    if (energy0 > 1.1*energy1) {
-        speaker = "0";
-    } else if (energy1 > 1.1*energy0) {
-        speaker = "1";
-    } else {
-        speaker = "?";
-    }
-
-    //printf("is0 = %lld, is1 = %lld, energy0 = %f, energy1 = %f, speaker = %s\n", is0, is1, energy0, energy1, speaker.c_str());
+std::string estimate_diarization_speaker(const stereo_energy & energy, int64_t t0, int64_t t1, bool id_only = false) {
+    std::string speaker = stereo_energy_speaker(energy, t0, t1);
 
     if (!id_only) {
         speaker.insert(0, "(speaker ");
@@ -310,11 +388,11 @@ void whisper_print_progress_callback(struct whisper_context * /*ctx*/, struct wh
     }
 }
 
-void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * /*state*/, int n_new, void * user_data) {
+void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data) {
     const auto & params  = *((whisper_print_user_data *) user_data)->params;
-    const auto & pcmf32s = *((whisper_print_user_data *) user_data)->pcmf32s;
+    const auto & energy  = *((whisper_print_user_data *) user_data)->energy;
 
-    const int n_segments = whisper_full_n_segments(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
 
     std::string speaker = "";
 
@@ -330,42 +408,42 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
 
     for (int i = s0; i < n_segments; i++) {
         if (!params.no_timestamps || params.diarize) {
-            t0 = whisper_full_get_segment_t0(ctx, i);
-            t1 = whisper_full_get_segment_t1(ctx, i);
+            t0 = whisper_full_get_segment_t0_from_state(state, i);
+            t1 = whisper_full_get_segment_t1_from_state(state, i);
         }
 
         if (!params.no_timestamps) {
             printf("[%s --> %s]  ", to_timestamp(t0).c_str(), to_timestamp(t1).c_str());
         }
 
-        if (params.diarize && pcmf32s.size() == 2) {
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+        if (params.diarize && energy.n_samples > 0) {
+            speaker = estimate_diarization_speaker(energy, t0, t1);
         }
 
         if (params.print_colors) {
-            for (int j = 0; j < whisper_full_n_tokens(ctx, i); ++j) {
+            for (int j = 0; j < whisper_full_n_tokens_from_state(state, i); ++j) {
                 if (params.print_special == false) {
-                    const whisper_token id = whisper_full_get_token_id(ctx, i, j);
+                    const whisper_token id = whisper_full_get_token_id_from_state(state, i, j);
                     if (id >= whisper_token_eot(ctx)) {
                         continue;
                     }
                 }
 
-                const char * text = whisper_full_get_token_text(ctx, i, j);
-                const float  p    = whisper_full_get_token_p   (ctx, i, j);
+                const char * text = whisper_full_get_token_text_from_state(ctx, state, i, j);
+                const float  p    = whisper_full_get_token_p_from_state(state, i, j);
 
                 const int col = std::max(0, std::min((int) k_colors.size() - 1, (int) (std::pow(p, 3)*float(k_colors.size()))));
 
                 printf("%s%s%s%s", speaker.c_str(), k_colors[col].c_str(), text, "\033[0m");
             }
         } else {
-            const char * text = whisper_full_get_segment_text(ctx, i);
+            const char * text = whisper_full_get_segment_text_from_state(state, i);
 
             printf("%s%s", speaker.c_str(), text);
         }
 
         if (params.tinydiarize) {
-            if (whisper_full_get_segment_speaker_turn_next(ctx, i)) {
+            if (whisper_full_get_segment_speaker_turn_next_from_state(state, i)) {
                 printf("%s", params.tdrz_speaker_turn.c_str());
             }
         }
@@ -378,23 +456,131 @@ void whisper_print_segment_callback(struct whisper_context * ctx, struct whisper
     }
 }
 
-std::string output_str(struct whisper_context * ctx, const whisper_params & params, std::vector<std::vector<float>> pcmf32s) {
-    std::stringstream result;
-    const int n_segments = whisper_full_n_segments(ctx);
+// the results of a request - the state of its worker, or the default state of the context after
+// whisper_full_parallel()
+// in the cluster mode, the segments are the ones stitched from the responses of the peers
+struct server_remote_token {
+    whisper_token_data data;
+    std::string        text;
+};
+
+struct server_remote_segment {
+    std::string text;
+    int64_t     t0             = 0;
+    int64_t     t1             = 0;
+    float       no_speech_prob = 0.0f;
+
+    std::vector<server_remote_token> tokens;
+};
+
+struct server_remote_result {
+    int                lang_id = 0;
+    std::vector<float> lang_probs; // of the first chunk
+
+    std::vector<server_remote_segment> segments;
+};
+
+struct server_result {
+    whisper_context * ctx;
+    whisper_state   * state;
+
+    const server_remote_result * remote = nullptr;
+
+    int n_segments() const {
+        if (remote) {
+            return remote->segments.size();
+        }
+        return state ? whisper_full_n_segments_from_state(state) : whisper_full_n_segments(ctx);
+    }
+
+    const char * segment_text(int i) const {
+        if (remote) {
+            return remote->segments[i].text.c_str();
+        }
+        return state ? whisper_full_get_segment_text_from_state(state, i) : whisper_full_get_segment_text(ctx, i);
+    }
+
+    int64_t segment_t0(int i) const {
+        if (remote) {
+            return remote->segments[i].t0;
+        }
+        return state ? whisper_full_get_segment_t0_from_state(state, i) : whisper_full_get_segment_t0(ctx, i);
+    }
+
+    int64_t segment_t1(int i) const {
+        if (remote) {
+            return remote->segments[i].t1;
+        }
+        return state ? whisper_full_get_segment_t1_from_state(state, i) : whisper_full_get_segment_t1(ctx, i);
+    }
+
+    float segment_no_speech_prob(int i) const {
+        if (remote) {
+            return remote->segments[i].no_speech_prob;
+        }
+        return state ? whisper_full_get_segment_no_speech_prob_from_state(state, i) : whisper_full_get_segment_no_speech_prob(ctx, i);
+    }
+
+    int n_tokens(int i) const {
+        if (remote) {
+            return remote->segments[i].tokens.size();
+        }
+        return state ? whisper_full_n_tokens_from_state(state, i) : whisper_full_n_tokens(ctx, i);
+    }
+
+    whisper_token_data token_data(int i, int j) const {
+        if (remote) {
+            return remote->segments[i].tokens[j].data;
+        }
+        return state ? whisper_full_get_token_data_from_state(state, i, j) : whisper_full_get_token_data(ctx, i, j);
+    }
+
+    const char * token_text(int i, int j) const {
+        if (remote) {
+            return remote->segments[i].tokens[j].text.c_str();
+        }
+        return state ? whisper_full_get_token_text_from_state(ctx, state, i, j) : whisper_full_get_token_text(ctx, i, j);
+    }
+
+    int lang_id() const {
+        if (remote) {
+            return remote->lang_id;
+        }
+        return state ? whisper_full_lang_id_from_state(state) : whisper_full_lang_id(ctx);
+    }
+
+    int lang_auto_detect(int n_threads, float * lang_probs) const {
+        if (remote) {
+            std::fill(lang_probs, lang_probs + whisper_lang_max_id() + 1, 0.0f);
+            if (remote->lang_probs.empty()) {
+                lang_probs[remote->lang_id] = 1.0f;
+                return remote->lang_id;
+            }
+            std::copy(remote->lang_probs.begin(), remote->lang_probs.end(), lang_probs);
+            return std::max_element(remote->lang_probs.begin(), remote->lang_probs.end()) - remote->lang_probs.begin();
+        }
+        return state ? whisper_lang_auto_detect_with_state(ctx, state, 0, n_threads, lang_probs) : whisper_lang_auto_detect(ctx, 0, n_threads, lang_probs);
+    }
+};
+
+// append the text of the segments to out
+void output_str(const server_result & result, const whisper_params & params, const stereo_energy & energy, std::string & out) {
+    const int n_segments = result.n_segments();
     for (int i = 0; i < n_segments; ++i) {
-        const char * text = whisper_full_get_segment_text(ctx, i);
+        const char * text = result.segment_text(i);
         std::string speaker = "";
 
-        if (params.diarize && pcmf32s.size() == 2)
+        if (params.diarize && energy.n_samples > 0)
         {
-            const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-            const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-            speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
+            const int64_t t0 = result.segment_t0(i);
+            const int64_t t1 = result.segment_t1(i);
+            speaker = estimate_diarization_speaker(energy, t0, t1);
         }
 
-        result << speaker << text << "\n";
+        out += speaker;
+        out += text;
+        out += "\n";
     }
-    return result.str();
 }
 
 bool parse_str_to_bool(const std::string & s) {
@@ -404,316 +590,2154 @@ bool parse_str_to_bool(const std::string & s) {
     return false;
 }
 
+// the fields are in the multipart form, or in the query string when the body is raw PCM
+bool has_req_field(const Request & req, const std::string & name) {
+    return req.has_file(name) || req.has_param(name);
+}
+
+std::string get_req_field(const Request & req, const std::string & name) {
+    return req.has_file(name) ? req.get_file_value(name).content : req.get_param_value(name);
+}
+
 void get_req_parameters(const Request & req, whisper_params & params)
 {
-    if (req.has_file("offset_t"))
+    if (has_req_field(req, "offset_t"))
     {
-        params.offset_t_ms = std::stoi(req.get_file_value("offset_t").content);
+        params.offset_t_ms = std::stoi(get_req_field(req, "offset_t"));
     }
-    if (req.has_file("offset_n"))
+    if (has_req_field(req, "offset_n"))
     {
-        params.offset_n = std::stoi(req.get_file_value("offset_n").content);
+        params.offset_n = std::stoi(get_req_field(req, "offset_n"));
     }
-    if (req.has_file("duration"))
+    if (has_req_field(req, "duration"))
     {
-        params.duration_ms = std::stoi(req.get_file_value("duration").content);
+        params.duration_ms = std::stoi(get_req_field(req, "duration"));
     }
-    if (req.has_file("max_context"))
+    if (has_req_field(req, "max_context"))
     {
-        params.max_context = std::stoi(req.get_file_value("max_context").content);
+        params.max_context = std::stoi(get_req_field(req, "max_context"));
     }
-    if (req.has_file("max_len"))
+    if (has_req_field(req, "max_len"))
     {
-        params.max_len = std::stoi(req.get_file_value("max_len").content);
+        params.max_len = std::stoi(get_req_field(req, "max_len"));
     }
-    if (req.has_file("best_of"))
+    if (has_req_field(req, "best_of"))
     {
-        params.best_of = std::stoi(req.get_file_value("best_of").content);
+        params.best_of = std::stoi(get_req_field(req, "best_of"));
     }
-    if (req.has_file("beam_size"))
+    if (has_req_field(req, "beam_size"))
     {
-        params.beam_size = std::stoi(req.get_file_value("beam_size").content);
+        params.beam_size = std::stoi(get_req_field(req, "beam_size"));
     }
-    if (req.has_file("audio_ctx"))
+    if (has_req_field(req, "audio_ctx"))
     {
-        params.audio_ctx = std::stof(req.get_file_value("audio_ctx").content);
+        params.audio_ctx = std::stof(get_req_field(req, "audio_ctx"));
     }
-    if (req.has_file("word_thold"))
+    if (has_req_field(req, "word_thold"))
     {
-        params.word_thold = std::stof(req.get_file_value("word_thold").content);
+        params.word_thold = std::stof(get_req_field(req, "word_thold"));
     }
-    if (req.has_file("entropy_thold"))
+    if (has_req_field(req, "entropy_thold"))
     {
-        params.entropy_thold = std::stof(req.get_file_value("entropy_thold").content);
+        params.entropy_thold = std::stof(get_req_field(req, "entropy_thold"));
     }
-    if (req.has_file("logprob_thold"))
+    if (has_req_field(req, "logprob_thold"))
     {
-        params.logprob_thold = std::stof(req.get_file_value("logprob_thold").content);
+        params.logprob_thold = std::stof(get_req_field(req, "logprob_thold"));
     }
-    if (req.has_file("debug_mode"))
+    if (has_req_field(req, "debug_mode"))
     {
-        params.debug_mode = parse_str_to_bool(req.get_file_value("debug_mode").content);
+        params.debug_mode = parse_str_to_bool(get_req_field(req, "debug_mode"));
     }
-    if (req.has_file("translate"))
+    if (has_req_field(req, "translate"))
     {
-        params.translate = parse_str_to_bool(req.get_file_value("translate").content);
+        params.translate = parse_str_to_bool(get_req_field(req, "translate"));
     }
-    if (req.has_file("diarize"))
+    if (has_req_field(req, "diarize"))
     {
-        params.diarize = parse_str_to_bool(req.get_file_value("diarize").content);
+        params.diarize = parse_str_to_bool(get_req_field(req, "diarize"));
     }
-    if (req.has_file("tinydiarize"))
+    if (has_req_field(req, "tinydiarize"))
     {
-        params.tinydiarize = parse_str_to_bool(req.get_file_value("tinydiarize").content);
+        params.tinydiarize = parse_str_to_bool(get_req_field(req, "tinydiarize"));
     }
-    if (req.has_file("split_on_word"))
+    if (has_req_field(req, "split_on_word"))
     {
-        params.split_on_word = parse_str_to_bool(req.get_file_value("split_on_word").content);
+        params.split_on_word = parse_str_to_bool(get_req_field(req, "split_on_word"));
     }
-    if (req.has_file("no_timestamps"))
+    if (has_req_field(req, "no_timestamps"))
     {
-        params.no_timestamps = parse_str_to_bool(req.get_file_value("no_timestamps").content);
+        params.no_timestamps = parse_str_to_bool(get_req_field(req, "no_timestamps"));
     }
-    if (req.has_file("language"))
+    if (has_req_field(req, "language"))
     {
-        params.language = req.get_file_value("language").content;
+        params.language = get_req_field(req, "language");
     }
-    if (req.has_file("detect_language"))
+    if (has_req_field(req, "detect_language"))
     {
-        params.detect_language = parse_str_to_bool(req.get_file_value("detect_language").content);
+        params.detect_language = parse_str_to_bool(get_req_field(req, "detect_language"));
     }
-    if (req.has_file("prompt"))
+    if (has_req_field(req, "prompt"))
     {
-        params.prompt = req.get_file_value("prompt").content;
+        params.prompt = get_req_field(req, "prompt");
     }
-    if (req.has_file("response_format"))
+    if (has_req_field(req, "response_format"))
     {
-        params.response_format = req.get_file_value("response_format").content;
+        params.response_format = get_req_field(req, "response_format");
     }
-    if (req.has_file("temperature"))
+    if (has_req_field(req, "temperature"))
     {
-        params.temperature = std::stof(req.get_file_value("temperature").content);
+        params.temperature = std::stof(get_req_field(req, "temperature"));
     }
-    if (req.has_file("temperature_inc"))
+    if (has_req_field(req, "temperature_inc"))
     {
-        params.temperature_inc = std::stof(req.get_file_value("temperature_inc").content);
+        params.temperature_inc = std::stof(get_req_field(req, "temperature_inc"));
     }
-    if (req.has_file("suppress_non_speech"))
+    if (has_req_field(req, "suppress_non_speech"))
     {
-        params.suppress_nst = parse_str_to_bool(req.get_file_value("suppress_non_speech").content);
+        params.suppress_nst = parse_str_to_bool(get_req_field(req, "suppress_non_speech"));
     }
-    if (req.has_file("suppress_nst"))
+    if (has_req_field(req, "suppress_nst"))
     {
-        params.suppress_nst = parse_str_to_bool(req.get_file_value("suppress_nst").content);
+        params.suppress_nst = parse_str_to_bool(get_req_field(req, "suppress_nst"));
     }
-    if (req.has_file("no_context"))
+    if (has_req_field(req, "no_context"))
     {
-        params.no_context = parse_str_to_bool(req.get_file_value("no_context").content);
+        params.no_context = parse_str_to_bool(get_req_field(req, "no_context"));
     }
 }
 
-}  // namespace
+// the whisper_full() parameters of a request
+whisper_full_params server_full_params(const whisper_params & params) {
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
 
-int main(int argc, char ** argv) {
-    whisper_params params;
-    server_params sparams;
+    wparams.strategy = params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
 
-    std::mutex whisper_mutex;
+    wparams.print_realtime   = false;
+    wparams.print_progress   = params.print_progress;
+    wparams.print_timestamps = !params.no_timestamps;
+    wparams.print_special    = params.print_special;
+    wparams.translate        = params.translate;
+    wparams.language         = params.language.c_str();
+    wparams.detect_language  = params.detect_language;
+    wparams.n_threads        = params.n_threads;
+    wparams.n_max_text_ctx   = params.max_context >= 0 ? params.max_context : wparams.n_max_text_ctx;
+    wparams.offset_ms        = params.offset_t_ms;
+    wparams.duration_ms      = params.duration_ms;
 
-    if (whisper_params_parse(argc, argv, params, sparams) == false) {
-        whisper_print_usage(argc, argv, params, sparams);
-        return 1;
-    }
+    wparams.thold_pt         = params.word_thold;
+    wparams.max_len          = params.max_len == 0 ? 60 : params.max_len;
+    wparams.split_on_word    = params.split_on_word;
+    wparams.audio_ctx        = params.audio_ctx;
 
-    if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1) {
-        fprintf(stderr, "error: unknown language '%s'\n", params.language.c_str());
-        whisper_print_usage(argc, argv, params, sparams);
-        exit(0);
-    }
+    wparams.debug_mode       = params.debug_mode;
 
-    if (params.diarize && params.tinydiarize) {
-        fprintf(stderr, "error: cannot use both --diarize and --tinydiarize\n");
-        whisper_print_usage(argc, argv, params, sparams);
-        exit(0);
+    wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+
+    wparams.initial_prompt   = params.prompt.c_str();
+
+    wparams.greedy.best_of        = params.best_of;
+    wparams.beam_search.beam_size = params.beam_size;
+
+    wparams.temperature      = params.temperature;
+    wparams.no_speech_thold = params.no_speech_thold;
+    wparams.temperature_inc  = params.temperature_inc;
+    wparams.entropy_thold    = params.entropy_thold;
+    wparams.logprob_thold    = params.logprob_thold;
+
+    wparams.no_timestamps    = params.no_timestamps;
+    wparams.token_timestamps = !params.no_timestamps && (params.response_format == vjson_format || params.response_format == bin_format);
+    wparams.no_context       = params.no_context;
+
+    wparams.suppress_nst     = params.suppress_nst;
+
+    return wparams;
+}
+
+// the buffers of a request: the decoded audio and the formatted response
+struct server_buffers {
+    std::vector<float>              pcmf32;  // mono-channel F32 PCM
+    std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
+    std::string                     out;     // the response is formatted here, then copied once to the body
+
+    bool empty() const {
+        return pcmf32.capacity() == 0 && (pcmf32s.empty() || pcmf32s[0].capacity() == 0) && out.capacity() == 0;
     }
 
-    if (sparams.ffmpeg_converter) {
-        check_ffmpeg_availibility();
+    void clear() {
+        pcmf32.clear();
+        for (auto & pcm : pcmf32s) {
+            pcm.clear();
+        }
+        out.clear();
     }
-    // whisper init
-    struct whisper_context_params cparams = whisper_context_default_params();
+};
 
-    cparams.use_gpu    = params.use_gpu;
-    cparams.flash_attn = params.flash_attn;
+// the buffers of the finished requests are kept for the next ones, so that in the steady state the audio and the
+// response of a request are written to memory that is already allocated, instead of large allocations per request
+struct server_buffer_pool {
+    std::mutex mutex;
+    std::vector<server_buffers> free;
 
-    if (!params.dtw.empty()) {
-        cparams.dtw_token_timestamps = true;
-        cparams.dtw_aheads_preset = WHISPER_AHEADS_NONE;
+    size_t n_max = 1;
 
-        if (params.dtw == "tiny") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_TINY;
-        }
-        if (params.dtw == "tiny.en") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_TINY_EN;
-        }
-        if (params.dtw == "base") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_BASE;
-        }
-        if (params.dtw == "base.en") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_BASE_EN;
-        }
-        if (params.dtw == "small") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_SMALL;
+    server_buffers acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free.empty()) {
+            return {};
         }
-        if (params.dtw == "small.en") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_SMALL_EN;
-        }
-        if (params.dtw == "medium") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_MEDIUM;
-        }
-        if (params.dtw == "medium.en") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_MEDIUM_EN;
-        }
-        if (params.dtw == "large.v1") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V1;
+        server_buffers buf = std::move(free.back());
+        free.pop_back();
+        return buf;
+    }
+
+    void release(server_buffers && buf) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free.size() < n_max && !buf.empty()) {
+            buf.clear();
+            free.push_back(std::move(buf));
         }
-        if (params.dtw == "large.v2") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V2;
+    }
+};
+
+struct server_buffers_lease {
+    server_buffer_pool & pool;
+    server_buffers       data;
+
+    server_buffers_lease(server_buffer_pool & pool) : pool(pool), data(pool.acquire()) {}
+    ~server_buffers_lease() { pool.release(std::move(data)); }
+};
+
+// convert a raw PCM body - 16 kHz mono, signed 16-bit or 32-bit float little-endian - without an intermediate copy
+bool server_read_pcm(const std::string & body, const std::string & format, std::vector<float> & pcmf32) {
+    if (format == "f32le") {
+        if (body.size() % sizeof(float) != 0) {
+            return false;
         }
-        if (params.dtw == "large.v3") {
-            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V3;
+        pcmf32.resize(body.size()/sizeof(float));
+        memcpy(pcmf32.data(), body.data(), body.size());
+    } else if (format == "s16le") {
+        if (body.size() % sizeof(int16_t) != 0) {
+            return false;
         }
-
-        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE) {
-            fprintf(stderr, "error: unknown DTW preset '%s'\n", params.dtw.c_str());
-            return 3;
+        const int16_t * samples = (const int16_t *) body.data();
+        pcmf32.resize(body.size()/sizeof(int16_t));
+        for (size_t i = 0; i < pcmf32.size(); ++i) {
+            pcmf32[i] = float(samples[i])/32768.0f;
         }
+    } else {
+        return false;
     }
+    return !pcmf32.empty();
+}
 
-    struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+// the inference requests are processed by n_workers states of the same context
+// up to n_queue more requests wait for a free state - the others are rejected right away, so that a burst of
+// requests does not pile up unbounded work (and memory for the audio) in the server
+// a free state goes to the waiting request with the highest priority, then the earliest deadline
+struct server_workers {
+    using clock = std::chrono::steady_clock;
 
-    if (ctx == nullptr) {
-        fprintf(stderr, "error: failed to initialize whisper context\n");
-        return 3;
-    }
+    struct ticket {
+        int               priority;
+        clock::time_point deadline;
+        uint64_t          seq;
+    };
 
-    // initialize openvino encoder. this has no effect on whisper.cpp builds that don't have OpenVINO configured
-    whisper_ctx_init_openvino_encoder(ctx, nullptr, params.openvino_encode_device.c_str(), nullptr);
+    std::mutex              mutex;
+    std::condition_variable cv;
 
-    Server svr;
-    svr.set_default_headers({{"Server", "whisper.cpp"},
-                             {"Access-Control-Allow-Origin", "*"},
-                             {"Access-Control-Allow-Headers", "content-type, authorization"}});
+    std::vector<whisper_state *> states_free;
+    std::vector<const ticket *>  waiters;
 
-    std::string const default_content = R"(
-    <html>
-    <head>
-        <title>Whisper.cpp Server</title>
-        <meta charset="utf-8">
-        <meta name="viewport" content="width=device-width">
-        <style>
-        body {
-            font-family: sans-serif;
+    std::map<int, int> n_running; // priority -> number of running requests
+
+    int n_workers = 1;
+    int n_queue   = 0;
+    int n_waiting = 0;
+
+    uint64_t n_seq = 0;
+
+    // moving average of the processing time of one second of audio, 0 until the first request is done
+    double rtf_avg = 0.0;
+
+    bool init(whisper_context * ctx, const std::string & openvino_encode_device, bool cpu_partition) {
+        for (int i = 0; i < n_workers; ++i) {
+            whisper_state * state = whisper_init_state(ctx);
+            if (state == nullptr) {
+                return false;
+            }
+            // the workers of a model do not compete for the cores
+            if (cpu_partition) {
+                whisper_state_set_cpu_part(state, i, n_workers);
+            }
+            // each worker gets an OpenVINO infer request of its own, the compiled model is shared
+            whisper_ctx_init_openvino_encoder_with_state(ctx, state, nullptr, openvino_encode_device.c_str(), nullptr);
+            states_free.push_back(state);
         }
-        form {
-            display: flex;
-            flex-direction: column;
-            align-items: flex-start;
+        return true;
+    }
+
+    void free() {
+        for (whisper_state * state : states_free) {
+            whisper_free_state(state);
         }
-        label {
-            margin-bottom: 0.5rem;
+        states_free.clear();
+    }
+
+    static bool before(const ticket & a, const ticket & b) {
+        if (a.priority != b.priority) {
+            return a.priority > b.priority;
         }
-        input, select {
-            margin-bottom: 1rem;
+        if (a.deadline != b.deadline) {
+            return a.deadline < b.deadline;
         }
-        button {
-            margin-top: 1rem;
+        return a.seq < b.seq;
+    }
+
+    // returns nullptr if the queue is full, or if the request cannot be done before its deadline (then *late is set)
+    // audio_s is the duration of the audio of the request, for the admission control of the deadlines
+    whisper_state * acquire(int priority = 0, clock::time_point deadline = clock::time_point::max(), float audio_s = 0.0f, bool * late = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (states_free.empty() && n_waiting >= n_queue) {
+            return nullptr;
         }
-        </style>
-    </head>
-    <body>
-        <h1>Whisper.cpp Server</h1>
 
-        <h2>/inference</h2>
-        <pre>
-    curl 127.0.0.1:)" + std::to_string(sparams.port) + R"(/inference \
-    -H "Content-Type: multipart/form-data" \
-    -F file="@&lt;file-path&gt;" \
-    -F temperature="0.0" \
-    -F temperature_inc="0.2" \
-    -F response_format="json"
-        </pre>
+        const ticket t = { priority, deadline, n_seq++ };
 
-        <h2>/load</h2>
-        <pre>
-    curl 127.0.0.1:)" + std::to_string(sparams.port) + R"(/load \
-    -H "Content-Type: multipart/form-data" \
-    -F model="&lt;path-to-model-file&gt;"
-        </pre>
+        if (deadline != clock::time_point::max() && rtf_avg > 0.0) {
+            // the requests that go first, and the running ones if there is no free state
+            int n_ahead = states_free.empty() ? n_workers : 0;
+            for (const ticket * w : waiters) {
+                n_ahead += before(*w, t) ? 1 : 0;
+            }
 
-        <div>
-            <h2>Try it out</h2>
-            <form action="/inference" method="POST" enctype="multipart/form-data">
-                <label for="file">Choose an audio file:</label>
-                <input type="file" id="file" name="file" accept="audio/*" required><br>
+            const double t_est_s = rtf_avg*audio_s*(1.0 + (double) n_ahead/n_workers);
+            if (clock::now() + std::chrono::duration<double>(t_est_s) > deadline) {
+                if (late) {
+                    *late = true;
+                }
+                return nullptr;
+            }
+        }
 
-                <label for="temperature">Temperature:</label>
-                <input type="number" id="temperature" name="temperature" value="0.0" step="0.01" placeholder="e.g., 0.0"><br>
+        waiters.push_back(&t);
+        n_waiting++;
 
-                <label for="response_format">Response Format:</label>
-                <select id="response_format" name="response_format">
-                    <option value="verbose_json">Verbose JSON</option>
-                    <option value="json">JSON</option>
-                    <option value="text">Text</option>
-                    <option value="srt">SRT</option>
-                    <option value="vtt">VTT</option>
-                </select><br>
+        const auto ready = [&] {
+            if (states_free.empty()) {
+                return false;
+            }
+            for (const ticket * w : waiters) {
+                if (before(*w, t)) {
+                    return false;
+                }
+            }
+            return true;
+        };
 
-                <button type="submit">Submit</button>
-            </form>
-        </div>
-    </body>
-    </html>
-    )";
+        const bool ok = deadline == clock::time_point::max() ? (cv.wait(lock, ready), true) : cv.wait_until(lock, deadline, ready);
 
-    // store default params so we can reset after each inference request
-    whisper_params default_params = params;
+        waiters.erase(std::find(waiters.begin(), waiters.end(), &t));
+        n_waiting--;
 
-    // this is only called if no index.html is found in the public --path
-    svr.Get(sparams.request_path + "/", [&default_content](const Request &, Response &res){
-        res.set_content(default_content, "text/html");
-        return false;
-    });
+        // let the next waiter check for a free state
+        cv.notify_all();
 
-    svr.Options(sparams.request_path + sparams.inference_path, [&](const Request &, Response &){
-    });
+        if (!ok) {
+            if (late) {
+                *late = true;
+            }
+            return nullptr;
+        }
 
-    svr.Post(sparams.request_path + sparams.inference_path, [&](const Request &req, Response &res){
-        // acquire whisper model mutex lock
-        std::lock_guard<std::mutex> lock(whisper_mutex);
+        whisper_state * state = states_free.back();
+        states_free.pop_back();
 
-        // first check user requested fields of the request
-        if (!req.has_file("file"))
+        n_running[priority]++;
+
+        return state;
+    }
+
+    void release(whisper_state * state, int priority = 0) {
         {
-            fprintf(stderr, "error: no 'file' field in the request\n");
-            const std::string error_resp = "{\"error\":\"no 'file' field in the request\"}";
-            res.set_content(error_resp, "application/json");
-            return;
+            std::lock_guard<std::mutex> lock(mutex);
+            states_free.push_back(state);
+            n_running[priority]--;
         }
-        auto audio_file = req.get_file_value("file");
+        cv.notify_all();
+    }
 
-        // check non-required fields
-        get_req_parameters(req, params);
+    // called between the windows of a request: waits while requests with a higher priority are running,
+    // so that they get the CPU / GPU for themselves
+    // returns false if is_closed() becomes true while waiting (checked every 100 ms), e.g. the client went away
+    bool yield(int priority, ggml_abort_callback is_closed = nullptr, void * is_closed_data = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
 
-        std::string filename{audio_file.filename};
-        printf("Received request: %s\n", filename.c_str());
+        const auto ready = [&] {
+            for (auto it = n_running.upper_bound(priority); it != n_running.end(); ++it) {
+                if (it->second > 0) {
+                    return false;
+                }
+            }
+            return true;
+        };
 
-        // audio arrays
-        std::vector<float> pcmf32;               // mono-channel F32 PCM
-        std::vector<std::vector<float>> pcmf32s; // stereo-channel F32 PCM
+        while (!cv.wait_for(lock, std::chrono::milliseconds(100), ready)) {
+            if (is_closed && is_closed(is_closed_data)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void observe(double processing_s, float audio_s) {
+        if (audio_s <= 0.0f) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const double rtf = processing_s/audio_s;
+        rtf_avg = rtf_avg == 0.0 ? rtf : 0.8*rtf_avg + 0.2*rtf;
+    }
+};
+
+struct server_worker_lease {
+    server_workers & workers;
+    whisper_state  * state;
+
+    int priority;
+
+    server_worker_lease(server_workers & workers, int priority = 0, server_workers::clock::time_point deadline = server_workers::clock::time_point::max(), float audio_s = 0.0f, bool * late = nullptr) :
+        workers(workers), state(workers.acquire(priority, deadline, audio_s, late)), priority(priority) {}
+
+    server_worker_lease(server_workers & workers, whisper_state * state, int priority) : workers(workers), state(state), priority(priority) {}
+
+    ~server_worker_lease() {
+        if (state) {
+            workers.release(state, priority);
+        }
+    }
+};
+
+// whisper_full_params::encoder_begin_callback of the requests with a priority
+// is_closed: the abort_callback of the request - a request that waits for its turn is aborted when its client is gone
+struct server_yield_data {
+    server_workers * workers;
+    int              priority;
+
+    ggml_abort_callback is_closed      = nullptr;
+    void *              is_closed_data = nullptr;
+};
+
+bool server_yield_callback(struct whisper_context * /*ctx*/, struct whisper_state * /*state*/, void * user_data) {
+    auto * data = (server_yield_data *) user_data;
+    return data->workers->yield(data->priority, data->is_closed, data->is_closed_data);
+}
+
+// coalesces the short requests that arrive within wait_ms into a single whisper_full_batch() call,
+// so that their first windows go through the encoder together - each request brings the state of its worker
+struct server_batcher {
+    struct item {
+        whisper_state *     state;
+        whisper_full_params wparams;
+        const float *       samples;
+        int                 n_samples;
+
+        int  ret  = 0;
+        bool done = false;
+    };
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    std::vector<item *> pending;
+
+    bool collecting = false;
+
+    int n_batch = 1;
+    int wait_ms = 10;
+
+    int run(whisper_context * ctx, whisper_state * state, const whisper_full_params & wparams, const float * samples, int n_samples) {
+        item it = { state, wparams, samples, n_samples };
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        pending.push_back(&it);
+        cv.notify_all();
+
+        while (!it.done) {
+            if (collecting || pending.front() != &it) {
+                cv.wait(lock);
+                continue;
+            }
+
+            // the oldest pending request collects the batch and runs it
+            collecting = true;
+            cv.wait_for(lock, std::chrono::milliseconds(wait_ms), [&] { return (int) pending.size() >= n_batch; });
+
+            const int n = std::min((int) pending.size(), n_batch);
+            std::vector<item *> batch(pending.begin(), pending.begin() + n);
+            pending.erase(pending.begin(), pending.begin() + n);
+
+            // the next batch can be collected in the meantime
+            collecting = false;
+            cv.notify_all();
+
+            lock.unlock();
+
+            std::vector<whisper_state *>      states;
+            std::vector<whisper_full_params>  params;
+            std::vector<const float *>        pcm;
+            std::vector<int>                  n_pcm;
+            std::vector<int>                  rets(n, 0);
+
+            for (item * b : batch) {
+                states.push_back(b->state);
+                params.push_back(b->wparams);
+                pcm   .push_back(b->samples);
+                n_pcm .push_back(b->n_samples);
+            }
+
+            if (n > 1) {
+                fprintf(stderr, "%s: transcribing %d requests in a batch\n", __func__, n);
+            }
+
+            whisper_full_batch(ctx, states.data(), params.data(), pcm.data(), n_pcm.data(), n, rets.data());
+
+            lock.lock();
+
+            for (int i = 0; i < n; ++i) {
+                batch[i]->ret  = rets[i];
+                batch[i]->done = true;
+            }
+            cv.notify_all();
+        }
+
+        return it.ret;
+    }
+};
+
+// a resident model and the worker states of its requests
+// the requests hold a reference, so a model that is replaced or unloaded is freed when its last request is done
+struct server_model {
+    std::string name;
+    std::string path;
+
+    whisper_context * ctx = nullptr;
+    server_workers    workers;
+    server_batcher    batcher;
+
+    size_t  size      = 0; // approximated by the size of the file
+    int64_t t_last_ms = 0;
+
+    ~server_model() {
+        workers.free();
+        if (ctx) {
+            whisper_free(ctx);
+        }
+    }
+};
+
+size_t server_file_size(const std::string & path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? (size_t) file.tellg() : 0;
+}
+
+// the models that can be selected with the 'model' field of a request
+// the models are loaded on their first request and the least recently used ones are unloaded above mem_budget
+struct server_models {
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    std::map<std::string, std::string>                   paths;
+    std::map<std::string, std::shared_ptr<server_model>> resident;
+    std::set<std::string>                                loading;
+
+    std::string name_default = "default";
+
+    size_t mem_budget = 0; // 0 - no limit
+
+    whisper_context_params cparams;
+    std::string            openvino_encode_device;
+
+    int n_workers = 1;
+    int n_queue   = 0;
+
+    int n_batch       = 1;
+    int batch_wait_ms = 10;
+
+    std::shared_ptr<server_model> init(const std::string & name, const std::string & path) const {
+        auto model = std::make_shared<server_model>();
+
+        model->name = name;
+        model->path = path;
+        model->size = server_file_size(path);
+
+        model->ctx = whisper_init_from_file_with_params(path.c_str(), cparams);
+        if (model->ctx == nullptr) {
+            fprintf(stderr, "error: failed to load model '%s' from '%s'\n", name.c_str(), path.c_str());
+            return nullptr;
+        }
+
+        // initialize openvino encoder. this has no effect on whisper.cpp builds that don't have OpenVINO configured
+        whisper_ctx_init_openvino_encoder(model->ctx, nullptr, openvino_encode_device.c_str(), nullptr);
+
+        model->workers.n_workers = n_workers;
+        model->workers.n_queue   = n_queue;
+
+        model->batcher.n_batch = n_batch;
+        model->batcher.wait_ms = batch_wait_ms;
+
+        if (!model->workers.init(model->ctx, openvino_encode_device, cparams.cpu_partition)) {
+            fprintf(stderr, "error: failed to initialize the worker states of model '%s'\n", name.c_str());
+            return nullptr;
+        }
+
+        return model;
+    }
+
+    // must be called with the mutex locked
+    void add_locked(const std::shared_ptr<server_model> & model) {
+        model->t_last_ms = ggml_time_ms();
+
+        paths[model->name]    = model->path;
+        resident[model->name] = model;
+
+        fprintf(stderr, "%s: model '%s' loaded from '%s' (%.1f MiB)\n", __func__, model->name.c_str(), model->path.c_str(), model->size/1024.0/1024.0);
+
+        while (mem_budget > 0) {
+            size_t mem_total = 0;
+            std::shared_ptr<server_model> lru;
+            for (const auto & it : resident) {
+                mem_total += it.second->size;
+                if (it.first == name_default || it.first == model->name) {
+                    continue;
+                }
+                if (!lru || it.second->t_last_ms < lru->t_last_ms) {
+                    lru = it.second;
+                }
+            }
+
+            if (mem_total <= mem_budget || !lru) {
+                break;
+            }
+
+            fprintf(stderr, "%s: unloading model '%s' (%.1f MiB)\n", __func__, lru->name.c_str(), lru->size/1024.0/1024.0);
+            resident.erase(lru->name);
+        }
+    }
+
+    // load the model outside of the lock - the requests of the other models are not blocked
+    // without reload, a model that is already resident is returned as it is
+    std::shared_ptr<server_model> load(const std::string & name, const std::string & path, bool reload = true) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        cv.wait(lock, [&] { return loading.count(name) == 0; });
+
+        if (!reload && resident.count(name)) {
+            return resident[name];
+        }
+
+        loading.insert(name);
+
+        lock.unlock();
+        auto model = init(name, path);
+        lock.lock();
+
+        loading.erase(name);
+        if (model) {
+            add_locked(model);
+        }
+        cv.notify_all();
+
+        return model;
+    }
+
+    // unknown names select the default model (e.g. "whisper-1" of the OpenAI clients)
+    std::shared_ptr<server_model> get(const std::string & name) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        const std::string key = paths.count(name) ? name : name_default;
+
+        cv.wait(lock, [&] { return loading.count(key) == 0; });
+
+        auto it = resident.find(key);
+        if (it != resident.end()) {
+            it->second->t_last_ms = ggml_time_ms();
+            return it->second;
+        }
+
+        const std::string path = paths[key];
+
+        lock.unlock();
+
+        return load(key, path, false);
+    }
+
+    // the worker gauges of the resident models
+    void print_metrics(std::stringstream & ss) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        ss << "# HELP whisper_workers Number of worker states\n";
+        ss << "# TYPE whisper_workers gauge\n";
+        for (const auto & it : resident) {
+            ss << "whisper_workers{model=\"" << it.first << "\"} " << it.second->workers.n_workers << "\n";
+        }
+
+        ss << "# HELP whisper_workers_busy Number of worker states that process a request\n";
+        ss << "# TYPE whisper_workers_busy gauge\n";
+        for (const auto & it : resident) {
+            std::lock_guard<std::mutex> lock_workers(it.second->workers.mutex);
+            ss << "whisper_workers_busy{model=\"" << it.first << "\"} " << it.second->workers.n_workers - it.second->workers.states_free.size() << "\n";
+        }
+
+        ss << "# HELP whisper_queue_depth Number of requests waiting for a worker\n";
+        ss << "# TYPE whisper_queue_depth gauge\n";
+        for (const auto & it : resident) {
+            std::lock_guard<std::mutex> lock_workers(it.second->workers.mutex);
+            ss << "whisper_queue_depth{model=\"" << it.first << "\"} " << it.second->workers.n_waiting << "\n";
+        }
+    }
+
+    json list() {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        json res = json::array();
+        for (const auto & it : paths) {
+            res.push_back({
+                {"name",     it.first},
+                {"path",     it.second},
+                {"default",  it.first == name_default},
+                {"resident", resident.count(it.first) > 0},
+            });
+        }
+
+        return res;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        resident.clear();
+    }
+};
+
+struct server_histogram {
+    std::vector<double>   bounds;
+    std::vector<uint64_t> counts; // not cumulative, the last one is +Inf
+
+    double   sum   = 0.0;
+    uint64_t count = 0;
+
+    server_histogram(std::vector<double> bounds) : bounds(std::move(bounds)), counts(this->bounds.size() + 1, 0) {}
+
+    void observe(double v) {
+        size_t i = 0;
+        while (i < bounds.size() && v > bounds[i]) {
+            i++;
+        }
+        counts[i]++;
+        sum += v;
+        count++;
+    }
+
+    void print(std::stringstream & ss, const char * name, const char * help) const {
+        ss << "# HELP " << name << " " << help << "\n";
+        ss << "# TYPE " << name << " histogram\n";
+
+        uint64_t cum = 0;
+        for (size_t i = 0; i < bounds.size(); ++i) {
+            cum += counts[i];
+            ss << name << "_bucket{le=\"" << bounds[i] << "\"} " << cum << "\n";
+        }
+        ss << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+        ss << name << "_sum " << sum << "\n";
+        ss << name << "_count " << count << "\n";
+    }
+};
+
+// the metrics of the /inference requests, exported in the Prometheus text format by /metrics
+struct server_metrics {
+    std::mutex mutex;
+
+    uint64_t n_requests = 0;
+    uint64_t n_failed   = 0;
+    uint64_t n_rejected = 0;
+
+    double audio_s = 0.0;
+
+    server_histogram latency { { 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0 } };
+    server_histogram rtf     { { 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.0 } };
+
+    // totals of the whisper_state_counters deltas of the requests
+    int64_t t_mel_us    = 0;
+    int64_t t_sample_us = 0;
+    int64_t t_encode_us = 0;
+    int64_t t_decode_us = 0; // single token, batch and prompt decoding
+
+    int64_t n_tokens  = 0;
+    int64_t n_encode  = 0;
+    int64_t n_decode  = 0;
+    int64_t n_fail_p  = 0;
+    int64_t n_fail_h  = 0;
+
+    int32_t kv_self_size = 0;
+    int32_t kv_self_used = 0;
+
+    void reject() {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_rejected++;
+    }
+
+    void fail() {
+        std::lock_guard<std::mutex> lock(mutex);
+        n_failed++;
+    }
+
+    // c0 and c1 are the counters of the state before and after the request, or nullptr if they are not known
+    void record(int64_t t_start_us, float duration_s, int n_tokens_res, const whisper_state_counters * c0, const whisper_state_counters * c1) {
+        const double latency_s = 1e-6*(ggml_time_us() - t_start_us);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        n_requests++;
+        n_tokens += n_tokens_res;
+        audio_s  += duration_s;
+
+        latency.observe(latency_s);
+        if (duration_s > 0.0f) {
+            rtf.observe(latency_s/duration_s);
+        }
+
+        if (c0 && c1) {
+            // the state was reset during the request
+            const whisper_state_counters zero = {};
+            const whisper_state_counters & b = c1->n_encode < c0->n_encode ? zero : *c0;
+
+            t_mel_us    += c1->t_mel_us    - b.t_mel_us;
+            t_sample_us += c1->t_sample_us - b.t_sample_us;
+            t_encode_us += c1->t_encode_us - b.t_encode_us;
+            t_decode_us += (c1->t_decode_us + c1->t_batchd_us + c1->t_prompt_us) - (b.t_decode_us + b.t_batchd_us + b.t_prompt_us);
+
+            n_encode += c1->n_encode - b.n_encode;
+            n_decode += (c1->n_decode + c1->n_batchd + c1->n_prompt) - (b.n_decode + b.n_batchd + b.n_prompt);
+            n_fail_p += c1->n_fail_p - b.n_fail_p;
+            n_fail_h += c1->n_fail_h - b.n_fail_h;
+
+            kv_self_size = c1->kv_self_size;
+            kv_self_used = c1->kv_self_used;
+        }
+    }
+
+    void print(std::stringstream & ss) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        const auto counter = [&](const char * name, const char * help, double value) {
+            ss << "# HELP " << name << " " << help << "\n";
+            ss << "# TYPE " << name << " counter\n";
+            ss << name << " " << value << "\n";
+        };
+
+        const auto gauge = [&](const char * name, const char * help, double value) {
+            ss << "# HELP " << name << " " << help << "\n";
+            ss << "# TYPE " << name << " gauge\n";
+            ss << name << " " << value << "\n";
+        };
+
+        counter("whisper_requests_total",          "Number of /inference requests that were processed", n_requests);
+        counter("whisper_requests_failed_total",   "Number of /inference requests that failed",         n_failed);
+        counter("whisper_requests_rejected_total", "Number of /inference requests rejected with 503",   n_rejected);
+        counter("whisper_audio_seconds_total",     "Duration of the processed audio",                   audio_s);
+
+        latency.print(ss, "whisper_request_duration_seconds", "Time from the request to its result");
+        rtf    .print(ss, "whisper_request_rtf",              "Real-time factor of the requests (duration of the request / duration of the audio)");
+
+        counter("whisper_mel_seconds_total",     "Time spent computing the mel spectrograms", 1e-6*t_mel_us);
+        counter("whisper_sample_seconds_total",  "Time spent sampling the tokens",            1e-6*t_sample_us);
+        counter("whisper_encode_seconds_total",  "Time spent in the encoder",                 1e-6*t_encode_us);
+        counter("whisper_decode_seconds_total",  "Time spent in the decoder",                 1e-6*t_decode_us);
+        counter("whisper_encoder_calls_total",   "Number of encoder calls",                   n_encode);
+        counter("whisper_decoder_calls_total",   "Number of decoder calls",                   n_decode);
+        counter("whisper_tokens_total",          "Number of tokens in the results",           n_tokens);
+
+        ss << "# HELP whisper_fallbacks_total Number of temperature fallbacks\n";
+        ss << "# TYPE whisper_fallbacks_total counter\n";
+        ss << "whisper_fallbacks_total{reason=\"logprob\"} " << n_fail_p << "\n";
+        ss << "whisper_fallbacks_total{reason=\"entropy\"} " << n_fail_h << "\n";
+
+        gauge("whisper_kv_self_cells",      "Cells of the self-attention KV cache of the last request",     kv_self_size);
+        gauge("whisper_kv_self_cells_used", "Cells of the self-attention KV cache used by the last request", kv_self_used);
+    }
+};
+
+// the responses of recent requests, keyed by a hash of their audio and of the parameters that change the result
+// a repeated upload (a retry, the same prompt of an IVR) is answered from here without running whisper_full()
+struct server_cache {
+    struct entry {
+        std::string key;
+        std::string body;
+        std::string content_type;
+    };
+
+    std::mutex mutex;
+
+    std::list<entry> lru; // most recently used first
+    std::map<std::string, std::list<entry>::iterator> entries;
+
+    size_t n_max   = 0; // 0 = disabled
+    size_t mem_max = 0;
+    size_t mem     = 0;
+
+    uint64_t n_hits   = 0;
+    uint64_t n_misses = 0;
+
+    bool enabled() const {
+        return n_max > 0;
+    }
+
+    bool get(const std::string & key, std::string & body, std::string & content_type) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            n_misses++;
+            return false;
+        }
+
+        n_hits++;
+        lru.splice(lru.begin(), lru, it->second);
+
+        body         = it->second->body;
+        content_type = it->second->content_type;
+
+        return true;
+    }
+
+    void put(const std::string & key, const std::string & body, const std::string & content_type) {
+        const size_t size = key.size() + body.size();
+        if (size > mem_max) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (entries.count(key)) {
+            return;
+        }
+
+        lru.push_front({ key, body, content_type });
+        entries[key] = lru.begin();
+        mem += size;
+
+        while (entries.size() > n_max || mem > mem_max) {
+            const entry & e = lru.back();
+            mem -= e.key.size() + e.body.size();
+            entries.erase(e.key);
+            lru.pop_back();
+        }
+    }
+
+    void print(std::stringstream & ss) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        ss << "# HELP whisper_cache_requests_total Number of /inference requests looked up in the result cache\n";
+        ss << "# TYPE whisper_cache_requests_total counter\n";
+        ss << "whisper_cache_requests_total{result=\"hit\"} "  << n_hits   << "\n";
+        ss << "whisper_cache_requests_total{result=\"miss\"} " << n_misses << "\n";
+        ss << "# HELP whisper_cache_entries Number of responses in the result cache\n";
+        ss << "# TYPE whisper_cache_entries gauge\n";
+        ss << "whisper_cache_entries " << entries.size() << "\n";
+        ss << "# HELP whisper_cache_bytes Size of the responses in the result cache\n";
+        ss << "# TYPE whisper_cache_bytes gauge\n";
+        ss << "whisper_cache_bytes " << mem << "\n";
+    }
+};
+
+// FNV-1a
+uint64_t server_hash(const void * data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+    const uint8_t * p = (const uint8_t *) data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string server_cache_key(const server_model & model, const whisper_params & params, const std::vector<float> & pcmf32, const std::vector<std::vector<float>> & pcmf32s) {
+    uint64_t hash = server_hash(pcmf32.data(), pcmf32.size()*sizeof(float));
+    for (const auto & pcm : pcmf32s) {
+        hash = server_hash(pcm.data(), pcm.size()*sizeof(float), hash);
+    }
+
+    std::stringstream ss;
+    ss << model.name << '|' << model.path << '|' << pcmf32.size() << '|' << std::hex << hash << std::dec << '|'
+       << params.offset_t_ms << '|' << params.offset_n << '|' << params.duration_ms << '|' << params.max_context << '|'
+       << params.max_len << '|' << params.best_of << '|' << params.beam_size << '|' << params.audio_ctx << '|'
+       << params.word_thold << '|' << params.entropy_thold << '|' << params.logprob_thold << '|'
+       << params.temperature_inc << '|' << params.no_speech_thold << '|'
+       << params.translate << params.detect_language << params.diarize << params.tinydiarize << params.split_on_word
+       << params.no_timestamps << params.suppress_nst << params.no_context << '|'
+       << params.language << '|' << params.response_format << '|' << params.prompt;
+
+    return ss.str();
+}
+
+// a request with response_format = sse - whisper_full() runs in the content provider, after the handler returned
+struct server_sse_task {
+    std::shared_ptr<server_model> model;
+
+    server_worker_lease lease;
+
+    whisper_params params;
+    std::string    filename;
+
+    std::vector<float> pcmf32;
+    stereo_energy      energy;
+
+    server_metrics * metrics    = nullptr;
+    int64_t          t_start_us = 0;
+
+    server_yield_data yield;
+
+    server_sse_task(const std::shared_ptr<server_model> & model, whisper_state * state, int priority) :
+        model(model), lease(model->workers, state, priority) {
+        yield.workers  = &model->workers;
+        yield.priority = priority;
+    }
+};
+
+struct server_sse_user_data {
+    DataSink * sink;
+
+    const server_sse_task * task;
+
+    whisper_print_user_data print;
+};
+
+bool server_sse_event(DataSink & sink, const char * event, const json & data) {
+    const std::string msg = std::string("event: ") + event + "\ndata: " + data.dump(-1, ' ', false, json::error_handler_t::replace) + "\n\n";
+    return sink.write(msg.data(), msg.size());
+}
+
+void server_sse_segment_callback(struct whisper_context * ctx, struct whisper_state * state, int n_new, void * user_data) {
+    auto & data = *(server_sse_user_data *) user_data;
+
+    const whisper_params & params = data.task->params;
+
+    if (params.print_realtime) {
+        whisper_print_segment_callback(ctx, state, n_new, &data.print);
+    }
+
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int i = std::max(0, n_segments - n_new); i < n_segments; ++i) {
+        json segment = json{
+            {"id",   i},
+            {"text", whisper_full_get_segment_text_from_state(state, i)},
+        };
+
+        const int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+        const int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
+
+        if (!params.no_timestamps) {
+            segment["start"] = t0*0.01;
+            segment["end"]   = t1*0.01;
+        }
+
+        if (params.diarize && data.task->energy.n_samples > 0) {
+            segment["speaker"] = estimate_diarization_speaker(data.task->energy, t0, t1, true);
+        }
+
+        server_sse_event(*data.sink, "segment", segment);
+    }
+}
+
+// a /stream session: the audio is posted in chunks and transcribed with a sliding window, as in examples/stream
+// every step_ms of new audio, the current line is decoded again and returned as "partial"
+// once the line reaches length_ms, it is returned in "segments" and the next line starts with the last keep_ms of audio
+struct server_stream {
+    std::mutex mutex; // the chunks of a session are processed one at a time
+
+    std::shared_ptr<server_model> model;
+
+    whisper_state * state = nullptr;
+    whisper_params  params;
+
+    int n_samples_step = 0;
+    int n_samples_len  = 0;
+    int n_samples_keep = 0;
+
+    std::vector<float> pcmf32_old; // audio of the current line
+    std::vector<float> pcmf32_new; // audio that was not decoded yet
+
+    opus_ingest * opus = nullptr; // the chunks are Opus packets (codec = "opus")
+
+    std::vector<whisper_token> prompt_tokens;
+
+    std::string partial;
+
+    int64_t n_samples_done = 0; // samples before pcmf32_new
+    int64_t t_last_ms      = 0;
+
+    ~server_stream() {
+        if (state) {
+            whisper_free_state(state);
+        }
+#ifdef WHISPER_OPUS
+        opus_ingest_free(opus);
+#endif
+    }
+};
+
+struct server_streams {
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<server_stream>> sessions;
+
+    std::mt19937_64 rng { std::random_device{}() };
+
+    int     n_max      = 4;
+    int64_t timeout_ms = 600*1000;
+
+    // returns an empty id if there are too many sessions
+    std::string add(const std::shared_ptr<server_stream> & stream) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // close the sessions that were abandoned by their clients
+        const int64_t t_now_ms = ggml_time_ms();
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            if (t_now_ms - it->second->t_last_ms > timeout_ms) {
+                fprintf(stderr, "%s: closing idle stream %s\n", __func__, it->first.c_str());
+                it = sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if ((int) sessions.size() >= n_max) {
+            return "";
+        }
+
+        char id[32];
+        snprintf(id, sizeof(id), "%016llx", (unsigned long long) rng());
+
+        stream->t_last_ms = t_now_ms;
+        sessions[id] = stream;
+
+        return id;
+    }
+
+    std::shared_ptr<server_stream> get(const std::string & id) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto it = sessions.find(id);
+        if (it == sessions.end()) {
+            return nullptr;
+        }
+
+        it->second->t_last_ms = ggml_time_ms();
+
+        return it->second;
+    }
+
+    void erase(const std::string & id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.erase(id);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.clear();
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sessions.size();
+    }
+};
+
+// decode the new audio of a session - the lines that are complete are appended to segments
+// with flush, the remaining audio is decoded as the last line
+bool server_stream_process(whisper_context * ctx, server_stream & stream, const Request & req, bool flush, json & segments) {
+    const whisper_params & params = stream.params;
+
+    while ((int) stream.pcmf32_new.size() >= stream.n_samples_step || (flush && !stream.pcmf32_new.empty())) {
+        const int n_samples_take = std::min((int) stream.pcmf32_new.size(), stream.n_samples_len);
+
+        // take up to keep + len - take samples from the previous window
+        const int n_samples_old = std::min((int) stream.pcmf32_old.size(), std::max(0, stream.n_samples_keep + stream.n_samples_len - n_samples_take));
+
+        std::vector<float> pcmf32(stream.pcmf32_old.end() - n_samples_old, stream.pcmf32_old.end());
+        pcmf32.insert(pcmf32.end(), stream.pcmf32_new.begin(), stream.pcmf32_new.begin() + n_samples_take);
+
+        stream.pcmf32_new.erase(stream.pcmf32_new.begin(), stream.pcmf32_new.begin() + n_samples_take);
+        stream.n_samples_done += n_samples_take;
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+        wparams.print_progress   = false;
+        wparams.print_special    = params.print_special;
+        wparams.print_realtime   = false;
+        wparams.print_timestamps = false;
+        wparams.translate        = params.translate;
+        wparams.single_segment   = true;
+        wparams.no_timestamps    = true;
+        wparams.max_tokens       = 0;
+        wparams.language         = params.language.c_str();
+        wparams.n_threads        = params.n_threads;
+        wparams.audio_ctx        = params.audio_ctx != 0 ? params.audio_ctx : -1; // fit the encoder to the window
+        wparams.temperature      = params.temperature;
+        wparams.temperature_inc  = params.temperature_inc;
+        wparams.no_speech_thold  = params.no_speech_thold;
+        wparams.suppress_nst     = params.suppress_nst;
+        wparams.no_context       = true;
+
+        if (stream.prompt_tokens.empty()) {
+            wparams.initial_prompt = params.prompt.c_str();
+        } else {
+            wparams.prompt_tokens   = stream.prompt_tokens.data();
+            wparams.prompt_n_tokens = stream.prompt_tokens.size();
+        }
+
+        wparams.abort_callback = [](void * user_data) {
+            return static_cast<const httplib::Request *>(user_data)->is_connection_closed();
+        };
+        wparams.abort_callback_user_data = (void *) &req;
+
+        if (whisper_full_with_state(ctx, stream.state, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+            return false;
+        }
+
+        std::string text;
+        const int n_segments = whisper_full_n_segments_from_state(stream.state);
+        for (int i = 0; i < n_segments; ++i) {
+            text += whisper_full_get_segment_text_from_state(stream.state, i);
+        }
+
+        if ((int) pcmf32.size() < stream.n_samples_len && !(flush && stream.pcmf32_new.empty())) {
+            stream.pcmf32_old = std::move(pcmf32);
+            stream.partial    = text;
+            continue;
+        }
+
+        // the line is complete
+        const int64_t t1 = stream.n_samples_done*100/WHISPER_SAMPLE_RATE;
+        const int64_t t0 = t1 - (int64_t) pcmf32.size()*100/WHISPER_SAMPLE_RATE;
+
+        segments.push_back({
+            {"start", t0*0.01},
+            {"end",   t1*0.01},
+            {"text",  text},
+        });
+
+        stream.pcmf32_old.assign(pcmf32.end() - std::min((int) pcmf32.size(), stream.n_samples_keep), pcmf32.end());
+        stream.partial.clear();
+
+        // the text of the line is the prompt of the next one
+        stream.prompt_tokens.clear();
+        if (!params.no_context) {
+            for (int i = 0; i < n_segments; ++i) {
+                const int n_tokens = whisper_full_n_tokens_from_state(stream.state, i);
+                for (int j = 0; j < n_tokens; ++j) {
+                    stream.prompt_tokens.push_back(whisper_full_get_token_id_from_state(stream.state, i, j));
+                }
+            }
+        }
+    }
+
+    // the partial line was already decoded with all of its audio
+    if (flush && !stream.partial.empty()) {
+        const int64_t t1 = stream.n_samples_done*100/WHISPER_SAMPLE_RATE;
+        const int64_t t0 = t1 - (int64_t) stream.pcmf32_old.size()*100/WHISPER_SAMPLE_RATE;
+
+        segments.push_back({
+            {"start", t0*0.01},
+            {"end",   t1*0.01},
+            {"text",  stream.partial},
+        });
+
+        stream.partial.clear();
+    }
+
+    return true;
+}
+
+// cluster mode: the audio of a long request is split at the silences into chunks that are transcribed by the peer
+// servers, and their segments are moved to the time of the input audio, as whisper_full_parallel() does with its jobs
+struct server_peer {
+    std::string host;
+    int         port = 8080;
+    std::string path = "/inference";
+};
+
+// host:port[/path]
+bool server_peer_parse(const std::string & value, server_peer & peer) {
+    const size_t pos_path = value.find('/');
+    const std::string addr = value.substr(0, pos_path);
+    if (pos_path != std::string::npos) {
+        peer.path = value.substr(pos_path);
+    }
+
+    const size_t pos_port = addr.rfind(':');
+    if (pos_port == std::string::npos || pos_port == 0 || pos_port + 1 == addr.size()) {
+        return false;
+    }
+
+    peer.host = addr.substr(0, pos_port);
+    peer.port = std::stoi(addr.substr(pos_port + 1));
+
+    return true;
+}
+
+struct server_cluster {
+    std::vector<server_peer> peers;
+
+    int n_min_samples   = 0; // the shorter requests are transcribed locally
+    int n_jobs_per_peer = 4; // more chunks than peers, so that the fast peers take more of them
+    int timeout_s       = 600;
+
+    // the speech segments of the audio, to split it in the silences - without VAD, at the quietest frames
+    whisper_vad_context * vctx = nullptr;
+    std::mutex            vad_mutex;
+
+    ~server_cluster() {
+        if (vctx) {
+            whisper_vad_free(vctx);
+        }
+    }
+
+    bool enabled() const {
+        return !peers.empty();
+    }
+};
+
+// split the samples into up to n_chunks ranges, returns the n + 1 bounds of the n ranges
+// with VAD, the ranges have the same duration of speech and are split in the middle of the silence between two speech
+// segments, else they have the same duration and are split at the quietest 100 ms within 2 s
+std::vector<int> server_cluster_split(server_cluster & cluster, const float * samples, int n_samples, int n_chunks) {
+    std::vector<int> bounds;
+
+    if (cluster.vctx) {
+        std::lock_guard<std::mutex> lock(cluster.vad_mutex);
+
+        whisper_vad_segments * segs = whisper_vad_segments_from_samples(cluster.vctx, whisper_vad_default_params(), samples, n_samples);
+        if (segs) {
+            const int n_segs = whisper_vad_segments_n_segments(segs);
+
+            float t_speech = 0.0f;
+            for (int i = 0; i < n_segs; ++i) {
+                t_speech += whisper_vad_segments_get_segment_t1(segs, i) - whisper_vad_segments_get_segment_t0(segs, i);
+            }
+
+            bounds.push_back(0);
+
+            float t_cur = 0.0f;
+            for (int i = 0; i + 1 < n_segs && (int) bounds.size() < n_chunks; ++i) {
+                t_cur += whisper_vad_segments_get_segment_t1(segs, i) - whisper_vad_segments_get_segment_t0(segs, i);
+
+                if (t_cur >= bounds.size()*t_speech/n_chunks) {
+                    const float t_split = 0.5f*(whisper_vad_segments_get_segment_t1(segs, i) + whisper_vad_segments_get_segment_t0(segs, i + 1));
+                    bounds.push_back(std::min(n_samples, (int) (t_split*WHISPER_SAMPLE_RATE)));
+                }
+            }
+
+            bounds.push_back(n_samples);
+
+            whisper_vad_free_segments(segs);
+        } else {
+            fprintf(stderr, "%s: failed to detect the speech segments - splitting at the quietest frames\n", __func__);
+        }
+    }
+
+    if (bounds.empty()) {
+        const int n_frame  = WHISPER_SAMPLE_RATE/10;
+        const int n_search = 2*WHISPER_SAMPLE_RATE;
+
+        bounds.push_back(0);
+        for (int i = 1; i < n_chunks; ++i) {
+            const int center = (int) ((int64_t) n_samples*i/n_chunks);
+
+            int    best   = center;
+            double e_best = INFINITY;
+            for (int j = std::max(bounds.back() + n_frame, center - n_search); j + n_frame <= std::min(n_samples, center + n_search); j += n_frame/2) {
+                double e = 0.0;
+                for (int k = j; k < j + n_frame; ++k) {
+                    e += samples[k]*samples[k];
+                }
+                if (e < e_best) {
+                    e_best = e;
+                    best   = j + n_frame/2;
+                }
+            }
+
+            if (best > bounds.back() && best < n_samples) {
+                bounds.push_back(best);
+            }
+        }
+        bounds.push_back(n_samples);
+    }
+
+    return bounds;
+}
+
+// transcribe the samples with the peers - each peer takes the next chunk as soon as it is done with the previous one
+// the fields of the request are forwarded, and the audio of a chunk is posted as raw f32le PCM
+// a chunk that fails is given to another peer, and the peer that failed is not used anymore for this request
+// t_offset is the time of the first sample in the input audio
+bool server_cluster_transcribe(server_cluster & cluster, const Request & req, const float * samples, int n_samples, int64_t t_offset, server_remote_result & result) {
+    const std::vector<int> bounds = server_cluster_split(cluster, samples, n_samples, cluster.peers.size()*cluster.n_jobs_per_peer);
+
+    const int n_jobs = bounds.size() - 1;
+
+    Params fields;
+    for (const auto & it : req.files) {
+        if (it.first != "file") {
+            fields.emplace(it.first, it.second.content);
+        }
+    }
+    for (const auto & it : req.params) {
+        fields.emplace(it.first, it.second);
+    }
+
+    // the offset and the duration are applied by the coordinator
+    for (const char * name : { "format", "response_format", "offset_t", "duration", "offset_n" }) {
+        fields.erase(name);
+    }
+    fields.emplace("format", "f32le");
+    fields.emplace("response_format", vjson_format);
+
+    const std::string query = append_query_params("", fields);
+
+    std::vector<json> responses(n_jobs);
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    std::deque<int> pending;
+    for (int i = 0; i < n_jobs; ++i) {
+        pending.push_back(i);
+    }
+    int n_running = 0;
+
+    auto process = [&](const server_peer & peer) {
+        Client cli(peer.host, peer.port);
+        cli.set_read_timeout(cluster.timeout_s, 0);
+        cli.set_write_timeout(cluster.timeout_s, 0);
+
+        while (true) {
+            int i_job = -1;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                // the chunks that are running on the other peers can still fail
+                cv.wait(lock, [&] { return !pending.empty() || n_running == 0; });
+                if (pending.empty()) {
+                    return;
+                }
+
+                i_job = pending.front();
+                pending.pop_front();
+                n_running++;
+            }
+
+            const float * data = samples + bounds[i_job];
+            const size_t  size = (size_t) (bounds[i_job + 1] - bounds[i_job])*sizeof(float);
+
+            // the peer must not split the chunk again
+            auto res = cli.Post(peer.path + query, Headers{{"X-Whisper-Cluster", "1"}}, (const char *) data, size, "application/octet-stream");
+
+            json jres;
+            bool ok = res && res->status == 200;
+            if (ok) {
+                jres = json::parse(res->body, nullptr, false);
+                ok = !jres.is_discarded() && jres.contains("segments");
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+
+                n_running--;
+                if (ok) {
+                    responses[i_job] = std::move(jres);
+                } else {
+                    fprintf(stderr, "server_cluster_transcribe: peer %s:%d failed on chunk %d (%s)\n", peer.host.c_str(), peer.port, i_job,
+                            res ? ("HTTP " + std::to_string(res->status)).c_str() : to_string(res.error()).c_str());
+                    pending.push_front(i_job);
+                }
+            }
+            cv.notify_all();
+
+            if (!ok) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (const auto & peer : cluster.peers) {
+        threads.emplace_back(process, std::cref(peer));
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    if (!pending.empty()) {
+        fprintf(stderr, "%s: no peer could transcribe chunk %d\n", __func__, pending.front());
+        return false;
+    }
+
+    // stitch the segments of the chunks, in the time of the input audio
+    result = server_remote_result();
+
+    for (int i_job = 0; i_job < n_jobs; ++i_job) {
+        const json & jres = responses[i_job];
+
+        const int64_t t_job     = t_offset + 100*(int64_t) bounds[i_job    ]/WHISPER_SAMPLE_RATE;
+        const int64_t t_job_end = t_offset + 100*(int64_t) bounds[i_job + 1]/WHISPER_SAMPLE_RATE;
+
+        auto to_input_time = [&](double t) {
+            return std::min(t_job + (int64_t) std::llround(100.0*t), t_job_end);
+        };
+
+        if (i_job == 0) {
+            const int lang_id = whisper_lang_id(jres.value("language", "english").c_str());
+            result.lang_id = std::max(lang_id, 0);
+
+            if (jres.contains("language_probabilities")) {
+                result.lang_probs.assign(whisper_lang_max_id() + 1, 0.0f);
+                for (const auto & it : jres["language_probabilities"].items()) {
+                    const int id = whisper_lang_id(it.key().c_str());
+                    if (id >= 0) {
+                        result.lang_probs[id] = it.value().get<float>();
+                    }
+                }
+            }
+        }
+
+        for (const auto & jseg : jres["segments"]) {
+            server_remote_segment seg;
+
+            seg.text           = jseg.value("text", "");
+            seg.t0             = to_input_time(jseg.value("start", 0.0));
+            seg.t1             = to_input_time(jseg.value("end",   0.0));
+            seg.no_speech_prob = jseg.value("no_speech_prob", 0.0f);
+
+            // make sure that segments are not overlapping
+            if (!result.segments.empty()) {
+                seg.t0 = std::max(seg.t0, result.segments.back().t1);
+            }
+            seg.t1 = std::max(seg.t1, seg.t0);
+
+            // the log probabilities of the tokens are not in the response - their average is
+            const float avg_logprob = jseg.value("avg_logprob", 0.0f);
+
+            if (jseg.contains("words") && jseg.contains("tokens")) {
+                const auto & words  = jseg["words"];
+                const auto & tokens = jseg["tokens"];
+
+                for (size_t k = 0; k < words.size() && k < tokens.size(); ++k) {
+                    server_remote_token token;
+
+                    token.data       = whisper_token_data();
+                    token.data.id    = tokens[k].get<whisper_token>();
+                    token.data.p     = words[k].value("probability", 0.0f);
+                    token.data.plog  = avg_logprob;
+                    token.data.t0    = to_input_time(words[k].value("start", 0.0));
+                    token.data.t1    = to_input_time(words[k].value("end",   0.0));
+                    token.data.t_dtw = words[k].value("t_dtw", (int64_t) -1);
+                    if (token.data.t_dtw >= 0) {
+                        token.data.t_dtw += t_job;
+                    }
+                    token.text = words[k].value("word", "");
+
+                    seg.tokens.push_back(std::move(token));
+                }
+            }
+
+            result.segments.push_back(std::move(seg));
+        }
+    }
+
+    return true;
+}
+
+// compact binary responses (response_format = bin), for the internal callers that do not need JSON
+// all the numbers are little-endian, the strings are a u32 size and the UTF-8 bytes
+//
+// /inference:  "WHSR", u32 version, i32 lang_id, f32 duration, u32 n_segments, then for each segment:
+//              i64 t0, i64 t1 (in 10 ms), f32 no_speech_prob, str text, u32 n_tokens, then for each token:
+//              i32 id, f32 p, i64 t0, i64 t1, str text (the special tokens are not included)
+// /stream:     "WHSS", u32 version, f32 duration, u32 n_segments, then for each segment: i64 t0, i64 t1, str text,
+//              then str partial
+struct server_bin_writer {
+    std::string & buf;
+
+    server_bin_writer(std::string & buf) : buf(buf) {}
+
+    void u32(uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            buf.push_back((char) ((v >> (8*i)) & 0xff));
+        }
+    }
+
+    void i64(int64_t v) {
+        for (int i = 0; i < 8; ++i) {
+            buf.push_back((char) (((uint64_t) v >> (8*i)) & 0xff));
+        }
+    }
+
+    void i32(int32_t v) {
+        u32((uint32_t) v);
+    }
+
+    void f32(float v) {
+        uint32_t u;
+        memcpy(&u, &v, sizeof(u));
+        u32(u);
+    }
+
+    void str(const char * s, size_t n) {
+        u32((uint32_t) n);
+        buf.append(s, n);
+    }
+
+    void str(const std::string & s) {
+        str(s.data(), s.size());
+    }
+};
+
+const uint32_t server_bin_version = 1;
+
+void server_bin_result(const server_result & result, float duration, std::string & out) {
+    server_bin_writer w(out);
+
+    w.buf.append("WHSR", 4);
+    w.u32(server_bin_version);
+    w.i32(result.lang_id());
+    w.f32(duration);
+
+    const int n_segments = result.n_segments();
+    w.u32(n_segments);
+    for (int i = 0; i < n_segments; ++i) {
+        const char * text = result.segment_text(i);
+
+        w.i64(result.segment_t0(i));
+        w.i64(result.segment_t1(i));
+        w.f32(result.segment_no_speech_prob(i));
+        w.str(text, strlen(text));
+
+        const int n_tokens = result.n_tokens(i);
+
+        int n_text = 0;
+        for (int j = 0; j < n_tokens; ++j) {
+            n_text += result.token_data(i, j).id < whisper_token_eot(result.ctx);
+        }
+
+        w.u32(n_text);
+        for (int j = 0; j < n_tokens; ++j) {
+            const whisper_token_data token = result.token_data(i, j);
+            if (token.id >= whisper_token_eot(result.ctx)) {
+                continue;
+            }
+
+            const char * token_text = result.token_text(i, j);
+
+            w.i32(token.id);
+            w.f32(token.p);
+            w.i64(token.t0);
+            w.i64(token.t1);
+            w.str(token_text, strlen(token_text));
+        }
+    }
+
+}
+
+std::string server_bin_stream(const json & segments, const std::string & partial, float duration) {
+    std::string out;
+    server_bin_writer w(out);
+
+    w.buf.append("WHSS", 4);
+    w.u32(server_bin_version);
+    w.f32(duration);
+
+    w.u32(segments.size());
+    for (const auto & segment : segments) {
+        w.i64(std::llround(100.0*segment["start"].get<double>()));
+        w.i64(std::llround(100.0*segment["end"].get<double>()));
+        w.str(segment["text"].get<std::string>());
+    }
+
+    w.str(partial);
+
+    return out;
+}
+
+// dump the JSON at the end of out, without a temporary string
+void server_dump_json(const json & j, std::string & out) {
+    nlohmann::detail::serializer<json> serializer(nlohmann::detail::output_adapter<char>(out), ' ', json::error_handler_t::replace);
+    serializer.dump(j, false, false, 0);
+}
+
+// write the result of a request in its response_format
+// the response is formatted in out, that can be a buffer kept between the requests, and then copied to the body
+void server_write_result(const server_result & result, const whisper_params & params, const stereo_energy & energy, float duration, std::string & out, Response & res) {
+    const char * content_type = "application/json";
+
+    out.clear();
+
+    if (params.response_format == text_format)
+    {
+        output_str(result, params, energy, out);
+        content_type = "text/html; charset=utf-8";
+    }
+    else if (params.response_format == srt_format)
+    {
+        const int n_segments = result.n_segments();
+        for (int i = 0; i < n_segments; ++i) {
+            const char * text = result.segment_text(i);
+            const int64_t t0 = result.segment_t0(i);
+            const int64_t t1 = result.segment_t1(i);
+            std::string speaker = "";
+
+            if (params.diarize && energy.n_samples > 0)
+            {
+                speaker = estimate_diarization_speaker(energy, t0, t1);
+            }
+
+            out += std::to_string(i + 1 + params.offset_n);
+            out += "\n";
+            out += to_timestamp(t0, true);
+            out += " --> ";
+            out += to_timestamp(t1, true);
+            out += "\n";
+            out += speaker;
+            out += text;
+            out += "\n\n";
+        }
+        content_type = "application/x-subrip";
+    } else if (params.response_format == vtt_format) {
+        out += "WEBVTT\n\n";
+
+        const int n_segments = result.n_segments();
+        for (int i = 0; i < n_segments; ++i) {
+            const char * text = result.segment_text(i);
+            const int64_t t0 = result.segment_t0(i);
+            const int64_t t1 = result.segment_t1(i);
+            std::string speaker = "";
+
+            if (params.diarize && energy.n_samples > 0)
+            {
+                speaker = estimate_diarization_speaker(energy, t0, t1, true);
+                speaker.insert(0, "<v Speaker");
+                speaker.append(">");
+            }
+
+            out += to_timestamp(t0);
+            out += " --> ";
+            out += to_timestamp(t1);
+            out += "\n";
+            out += speaker;
+            out += text;
+            out += "\n\n";
+        }
+        content_type = "text/vtt";
+    } else if (params.response_format == vjson_format) {
+        /* try to match openai/whisper's Python format */
+        std::string results;
+        output_str(result, params, energy, results);
+        // Get language probabilities
+        std::vector<float> lang_probs(whisper_lang_max_id() + 1, 0.0f);
+        const auto detected_lang_id = result.lang_auto_detect(params.n_threads, lang_probs.data());
+        json jres = json{
+            {"task", params.translate ? "translate" : "transcribe"},
+            {"language", whisper_lang_str_full(result.lang_id())},
+            {"duration", duration},
+            {"text", results},
+            {"segments", json::array()},
+            {"detected_language", whisper_lang_str_full(detected_lang_id)},
+            {"detected_language_probability", lang_probs[detected_lang_id]},
+            {"language_probabilities", json::object()}
+        };
+        // Add all language probabilities
+        for (int i = 0; i <= whisper_lang_max_id(); ++i) {
+            if (lang_probs[i] > 0.001f) { // Only include non-negligible probabilities
+                jres["language_probabilities"][whisper_lang_str(i)] = lang_probs[i];
+            }
+        }
+        const int n_segments = result.n_segments();
+        for (int i = 0; i < n_segments; ++i)
+        {
+            json segment = json{
+                {"id", i},
+                {"text", result.segment_text(i)},
+            };
+
+            if (!params.no_timestamps) {
+                segment["start"] = result.segment_t0(i) * 0.01;
+                segment["end"] = result.segment_t1(i) * 0.01;
+            }
+
+            float total_logprob = 0;
+            const int n_tokens = result.n_tokens(i);
+            for (int j = 0; j < n_tokens; ++j) {
+                whisper_token_data token = result.token_data(i, j);
+                if (token.id >= whisper_token_eot(result.ctx)) {
+                    continue;
+                }
+
+                segment["tokens"].push_back(token.id);
+                json word = json{{"word", result.token_text(i, j)}};
+                if (!params.no_timestamps) {
+                    word["start"] = token.t0 * 0.01;
+                    word["end"] = token.t1 * 0.01;
+                    word["t_dtw"] = token.t_dtw;
+                }
+                word["probability"] = token.p;
+                total_logprob += token.plog;
+                segment["words"].push_back(word);
+            }
+
+            segment["temperature"] = params.temperature;
+            segment["avg_logprob"] = total_logprob / n_tokens;
+
+            // TODO compression_ratio and no_speech_prob are not implemented yet
+            // segment["compression_ratio"] = 0;
+            segment["no_speech_prob"] = result.segment_no_speech_prob(i);
+
+            jres["segments"].push_back(segment);
+        }
+        server_dump_json(jres, out);
+    } else if (params.response_format == bin_format) {
+        server_bin_result(result, duration, out);
+        content_type = "application/octet-stream";
+    }
+    // TODO add more output formats
+    else
+    {
+        std::string results;
+        output_str(result, params, energy, results);
+        json jres = json{
+            {"text", results}
+        };
+        server_dump_json(jres, out);
+    }
+
+    res.set_content(out.data(), out.size(), content_type);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv) {
+    whisper_params params;
+    server_params sparams;
+
+    if (whisper_params_parse(argc, argv, params, sparams) == false) {
+        whisper_print_usage(argc, argv, params, sparams);
+        return 1;
+    }
+
+    if (sparams.n_workers < 1) {
+        fprintf(stderr, "error: the number of workers must be at least 1\n");
+        return 1;
+    }
+
+    // each request of a batch runs on its own worker state
+    if (sparams.n_batch > sparams.n_workers) {
+        fprintf(stderr, "warning: --batch %d is limited by --workers %d\n", sparams.n_batch, sparams.n_workers);
+        sparams.n_batch = sparams.n_workers;
+    }
+
+    // whisper_full_parallel() uses the default state of the context, which only one request can use at a time
+    if (sparams.n_workers > 1 && params.n_processors > 1) {
+        fprintf(stderr, "warning: --processors is not supported with --workers > 1 - using 1 processor\n");
+        params.n_processors = 1;
+    }
+
+    if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1) {
+        fprintf(stderr, "error: unknown language '%s'\n", params.language.c_str());
+        whisper_print_usage(argc, argv, params, sparams);
+        exit(0);
+    }
+
+    if (params.diarize && params.tinydiarize) {
+        fprintf(stderr, "error: cannot use both --diarize and --tinydiarize\n");
+        whisper_print_usage(argc, argv, params, sparams);
+        exit(0);
+    }
+
+    if (sparams.ffmpeg_converter) {
+        check_ffmpeg_availibility();
+    }
+    // whisper init
+    struct whisper_context_params cparams = whisper_context_default_params();
+
+    cparams.use_gpu       = params.use_gpu;
+    cparams.flash_attn    = params.flash_attn;
+    cparams.gpu_device    = params.gpu_device;
+    cparams.n_gpu_devices = params.n_gpu_devices;
+    cparams.cpu_partition = params.cpu_partition;
+
+    if (!params.encoder_device.empty()) {
+        cparams.encoder_device = params.encoder_device.c_str();
+    }
+    if (!params.decoder_device.empty()) {
+        cparams.decoder_device = params.decoder_device.c_str();
+    }
+    if (!params.rpc_servers.empty()) {
+        cparams.rpc_servers = params.rpc_servers.c_str();
+    }
+
+    if (!params.dtw.empty()) {
+        cparams.dtw_token_timestamps = true;
+        cparams.dtw_aheads_preset = WHISPER_AHEADS_NONE;
+
+        if (params.dtw == "tiny") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_TINY;
+        }
+        if (params.dtw == "tiny.en") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_TINY_EN;
+        }
+        if (params.dtw == "base") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_BASE;
+        }
+        if (params.dtw == "base.en") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_BASE_EN;
+        }
+        if (params.dtw == "small") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_SMALL;
+        }
+        if (params.dtw == "small.en") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_SMALL_EN;
+        }
+        if (params.dtw == "medium") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_MEDIUM;
+        }
+        if (params.dtw == "medium.en") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_MEDIUM_EN;
+        }
+        if (params.dtw == "large.v1") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V1;
+        }
+        if (params.dtw == "large.v2") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V2;
+        }
+        if (params.dtw == "large.v3") {
+            cparams.dtw_aheads_preset = WHISPER_AHEADS_LARGE_V3;
+        }
+
+        if (cparams.dtw_aheads_preset == WHISPER_AHEADS_NONE) {
+            fprintf(stderr, "error: unknown DTW preset '%s'\n", params.dtw.c_str());
+            return 3;
+        }
+    }
+
+    server_models models;
+    models.cparams                = cparams;
+    models.openvino_encode_device = params.openvino_encode_device;
+    models.n_workers              = sparams.n_workers;
+    models.n_queue                = sparams.n_queue;
+    models.mem_budget             = (size_t) sparams.models_mem_mb*1024*1024;
+    models.n_batch                = sparams.n_batch;
+    models.batch_wait_ms          = sparams.batch_wait_ms;
+
+    for (const auto & it : sparams.models) {
+        models.paths[it.first] = it.second;
+    }
+
+    if (is_url(params.model)) {
+        fetch_params fparams;
+        fparams.sha256 = params.model_sha256;
+
+        params.model = fetch_model(params.model, fparams);
+        if (params.model.empty()) {
+            fprintf(stderr, "error: failed to download the model\n");
+            return 3;
+        }
+    }
+
+    if (!models.load(models.name_default, params.model)) {
+        fprintf(stderr, "error: failed to initialize whisper context\n");
+        return 3;
+    }
+
+    server_metrics metrics;
+
+    // one buffer for each request that can be running or waiting
+    server_buffer_pool buffer_pool;
+    buffer_pool.n_max = sparams.n_workers + sparams.n_queue;
+
+    server_cache cache;
+    cache.n_max   = std::max(sparams.n_cache, 0);
+    cache.mem_max = (size_t) std::max(sparams.cache_mem_mb, 0)*1024*1024;
+
+    server_streams streams;
+    streams.n_max      = sparams.n_streams;
+    streams.timeout_ms = (int64_t) sparams.read_timeout*1000;
+
+    server_cluster cluster;
+    cluster.n_min_samples   = (int) ((int64_t) std::max(sparams.peers_min_ms, 0)*WHISPER_SAMPLE_RATE/1000);
+    cluster.n_jobs_per_peer = std::max(sparams.peers_jobs, 1);
+    cluster.timeout_s       = sparams.read_timeout;
+
+    for (const auto & value : sparams.peers) {
+        server_peer peer;
+        if (!server_peer_parse(value, peer)) {
+            fprintf(stderr, "error: --peers expects host:port[/path], got '%s'\n", value.c_str());
+            return 1;
+        }
+        cluster.peers.push_back(peer);
+    }
+
+    if (cluster.enabled() && !sparams.peers_vad.empty()) {
+        cluster.vctx = whisper_vad_init_from_file_with_params(sparams.peers_vad.c_str(), whisper_vad_default_context_params());
+        if (cluster.vctx == nullptr) {
+            fprintf(stderr, "error: failed to load the VAD model '%s'\n", sparams.peers_vad.c_str());
+            return 3;
+        }
+    }
+
+    Server svr;
+
+    // one HTTP thread for each running or waiting request and each stream, plus one to reject the others and serve the rest
+    svr.new_task_queue = [&sparams] {
+        return new ThreadPool(std::max<size_t>(CPPHTTPLIB_THREAD_POOL_COUNT, sparams.n_workers + sparams.n_queue + sparams.n_streams + 1));
+    };
+    svr.set_default_headers({{"Server", "whisper.cpp"},
+                             {"Access-Control-Allow-Origin", "*"},
+                             {"Access-Control-Allow-Headers", "content-type, authorization"}});
+
+    std::string const default_content = R"(
+    <html>
+    <head>
+        <title>Whisper.cpp Server</title>
+        <meta charset="utf-8">
+        <meta name="viewport" content="width=device-width">
+        <style>
+        body {
+            font-family: sans-serif;
+        }
+        form {
+            display: flex;
+            flex-direction: column;
+            align-items: flex-start;
+        }
+        label {
+            margin-bottom: 0.5rem;
+        }
+        input, select {
+            margin-bottom: 1rem;
+        }
+        button {
+            margin-top: 1rem;
+        }
+        </style>
+    </head>
+    <body>
+        <h1>Whisper.cpp Server</h1>
+
+        <h2>/inference</h2>
+        <pre>
+    curl 127.0.0.1:)" + std::to_string(sparams.port) + R"(/inference \
+    -H "Content-Type: multipart/form-data" \
+    -F file="@&lt;file-path&gt;" \
+    -F temperature="0.0" \
+    -F temperature_inc="0.2" \
+    -F response_format="json"
+        </pre>
+
+        <h2>/load</h2>
+        <pre>
+    curl 127.0.0.1:)" + std::to_string(sparams.port) + R"(/load \
+    -H "Content-Type: multipart/form-data" \
+    -F model="&lt;path-to-model-file&gt;"
+        </pre>
+
+        <div>
+            <h2>Try it out</h2>
+            <form action="/inference" method="POST" enctype="multipart/form-data">
+                <label for="file">Choose an audio file:</label>
+                <input type="file" id="file" name="file" accept="audio/*" required><br>
+
+                <label for="temperature">Temperature:</label>
+                <input type="number" id="temperature" name="temperature" value="0.0" step="0.01" placeholder="e.g., 0.0"><br>
+
+                <label for="response_format">Response Format:</label>
+                <select id="response_format" name="response_format">
+                    <option value="verbose_json">Verbose JSON</option>
+                    <option value="json">JSON</option>
+                    <option value="text">Text</option>
+                    <option value="srt">SRT</option>
+                    <option value="vtt">VTT</option>
+                </select><br>
+
+                <button type="submit">Submit</button>
+            </form>
+        </div>
+    </body>
+    </html>
+    )";
+
+    // store default params so we can reset after each inference request
+    whisper_params default_params = params;
+
+    // this is only called if no index.html is found in the public --path
+    svr.Get(sparams.request_path + "/", [&default_content](const Request &, Response &res){
+        res.set_content(default_content, "text/html");
+        return false;
+    });
+
+    svr.Options(sparams.request_path + sparams.inference_path, [&](const Request &, Response &){
+    });
+
+    svr.Post(sparams.request_path + sparams.inference_path, [&](const Request &req, Response &res){
+        const int64_t t_start_us = ggml_time_us();
+        const auto    t_arrival  = server_workers::clock::now();
+
+        // the requests run concurrently - each has its own copy of the parameters
+        whisper_params params = default_params;
+
+        // the audio is either the 'file' field of a multipart form, or a raw PCM body with the fields in the query string
+        const bool is_raw = !req.is_multipart_form_data() && req.get_header_value("Content-Type").rfind("application/octet-stream", 0) == 0;
+
+        // first check user requested fields of the request
+        if (!is_raw && !req.has_file("file"))
+        {
+            fprintf(stderr, "error: no 'file' field in the request\n");
+            const std::string error_resp = "{\"error\":\"no 'file' field in the request\"}";
+            res.set_content(error_resp, "application/json");
+            return;
+        }
+        const MultipartFormData audio_file = is_raw ? MultipartFormData() : req.get_file_value("file");
+
+        // check non-required fields
+        get_req_parameters(req, params);
+
+        std::string filename = is_raw ? std::string("raw") : audio_file.filename;
+        printf("Received request: %s\n", filename.c_str());
+
+        // audio arrays
+        server_buffers_lease buffers(buffer_pool);
+        std::vector<float> & pcmf32 = buffers.data.pcmf32;               // mono-channel F32 PCM
+        std::vector<std::vector<float>> & pcmf32s = buffers.data.pcmf32s; // stereo-channel F32 PCM
+
+        if (is_raw) {
+            const std::string format = has_req_field(req, "format") ? get_req_field(req, "format") : "s16le";
+            if (!server_read_pcm(req.body, format, pcmf32)) {
+                fprintf(stderr, "error: invalid raw PCM body (format = %s)\n", format.c_str());
+                res.status = 400;
+                res.set_content("{\"error\":\"invalid raw PCM body, expected 16 kHz mono s16le or f32le samples\"}", "application/json");
+                return;
+            }
+        } else if (!::read_audio_data_from_memory(audio_file.content.data(), audio_file.content.size(), pcmf32, pcmf32s, params.diarize)) {
+            if (!sparams.ffmpeg_converter) {
+                fprintf(stderr, "error: failed to read audio data\n");
+                const std::string error_resp = "{\"error\":\"failed to read audio data\"}";
+                res.set_content(error_resp, "application/json");
+                return;
+            }
 
-        if (sparams.ffmpeg_converter) {
-            // if file is not wav, convert to wav
+            // fallback for the formats that cannot be decoded in memory: convert with the ffmpeg command
             // write to temporary file
             const std::string temp_filename = generate_temp_filename("whisper-server", ".wav");
             std::ofstream temp_file{temp_filename, std::ios::binary};
@@ -738,23 +2762,115 @@ int main(int argc, char ** argv) {
             }
             // remove temp file
             std::remove(temp_filename.c_str());
-        } else {
-            if (!::read_audio_data(audio_file.content, pcmf32, pcmf32s, params.diarize))
-            {
-                fprintf(stderr, "error: failed to read audio data\n");
-                const std::string error_resp = "{\"error\":\"failed to read audio data\"}";
-                res.set_content(error_resp, "application/json");
+        }
+
+        printf("Successfully loaded %s\n", filename.c_str());
+
+        // the speakers of --diarize are estimated from the energy of the channels
+        stereo_energy energy;
+        stereo_energy_init(energy, pcmf32s);
+
+        const std::shared_ptr<server_model> model = models.get(has_req_field(req, "model") ? get_req_field(req, "model") : "");
+        if (model == nullptr) {
+            res.status = 500;
+            res.set_content("{\"error\":\"failed to load the model\"}", "application/json");
+            return;
+        }
+
+        whisper_context * ctx = model->ctx;
+
+        // a sampled result (temperature > 0) is not reused, and a streamed one is not kept
+        std::string cache_key;
+        if (cache.enabled() && params.temperature <= 0.0f && params.response_format != sse_format) {
+            cache_key = server_cache_key(*model, params, pcmf32, pcmf32s);
+
+            std::string body;
+            std::string content_type;
+            if (cache.get(cache_key, body, content_type)) {
+                printf("Cached result for %s\n", filename.c_str());
+                res.set_content(body, content_type);
                 return;
             }
         }
 
-        printf("Successfully loaded %s\n", filename.c_str());
+        // cluster mode: the long requests are split over the peers - not the chunks that a coordinator sent here
+        if (cluster.enabled() && params.response_format != sse_format && !req.has_header("X-Whisper-Cluster") &&
+            (int) pcmf32.size() >= cluster.n_min_samples) {
+            const int n_samples      = pcmf32.size();
+            const int offset_samples = std::min(n_samples, (int) ((int64_t) std::max(params.offset_t_ms, 0)*WHISPER_SAMPLE_RATE/1000));
+            const int end_samples    = params.duration_ms > 0 ? std::min(n_samples, offset_samples + (int) ((int64_t) params.duration_ms*WHISPER_SAMPLE_RATE/1000)) : n_samples;
+
+            printf("Transcribing %s with %d peers\n", filename.c_str(), (int) cluster.peers.size());
+
+            server_remote_result remote;
+            if (!server_cluster_transcribe(cluster, req, pcmf32.data() + offset_samples, end_samples - offset_samples,
+                                           100*(int64_t) offset_samples/WHISPER_SAMPLE_RATE, remote)) {
+                metrics.fail();
+                res.status = 502;
+                res.set_content("{\"error\":\"failed to transcribe the audio with the peers\"}", "application/json");
+                return;
+            }
+
+            const server_result result = { ctx, nullptr, &remote };
+
+            int n_tokens = 0;
+            for (int i = 0; i < result.n_segments(); ++i) {
+                n_tokens += result.n_tokens(i);
+            }
+
+            metrics.record(t_start_us, float(pcmf32.size())/WHISPER_SAMPLE_RATE, n_tokens, nullptr, nullptr);
+
+            server_write_result(result, params, energy, float(pcmf32.size())/WHISPER_SAMPLE_RATE, buffers.data.out, res);
+
+            if (!cache_key.empty()) {
+                cache.put(cache_key, res.body, res.get_header_value("Content-Type"));
+            }
+
+            return;
+        }
+
+        // higher priorities go first, and the requests with a lower priority pause between their windows while they run
+        // deadline_ms is the time budget of the request - it is rejected if it cannot be done in time
+        const int priority    = has_req_field(req, "priority")    ? std::stoi(get_req_field(req, "priority"))    : 0;
+        const int deadline_ms = has_req_field(req, "deadline_ms") ? std::stoi(get_req_field(req, "deadline_ms")) : 0;
+
+        const auto deadline = deadline_ms > 0 ? t_arrival + std::chrono::milliseconds(deadline_ms) : server_workers::clock::time_point::max();
+
+        // wait for a free worker - the audio is decoded and the response is formatted outside of it
+        bool late = false;
+        server_worker_lease lease(model->workers, priority, deadline, float(pcmf32.size())/WHISPER_SAMPLE_RATE, &late);
+        if (lease.state == nullptr) {
+            metrics.reject();
+            res.status = 503;
+            if (late) {
+                fprintf(stderr, "error: '%s' cannot be done within its deadline of %d ms, rejecting\n", filename.c_str(), deadline_ms);
+                res.set_content("{\"error\":\"the deadline cannot be met\"}", "application/json");
+                return;
+            }
+            fprintf(stderr, "error: too many requests, rejecting '%s'\n", filename.c_str());
+            res.set_header("Retry-After", "1");
+            res.set_content("{\"error\":\"server busy, try again later\"}", "application/json");
+            return;
+        }
+
+        server_yield_data yield;
+        yield.workers  = &model->workers;
+        yield.priority = priority;
+
+        const int64_t t_run_us = ggml_time_us();
+
+        // with several processors, the results are in the default state of the context
+        const server_result result = { ctx, params.n_processors > 1 ? nullptr : lease.state };
 
         // print system information
         {
             fprintf(stderr, "\n");
+            // with --cpu-partition, the processors have at most one thread per CPU of their part
+            const int n_threads_proc = params.cpu_partition && params.n_processors > 1 ?
+                std::min<int>(params.n_threads, std::max<int>(1, std::thread::hardware_concurrency()/params.n_processors)) : params.n_threads;
+
             fprintf(stderr, "system_info: n_threads = %d / %d | %s\n",
-                    params.n_threads*params.n_processors, std::thread::hardware_concurrency(), whisper_print_system_info());
+                    n_threads_proc*params.n_processors, std::thread::hardware_concurrency(), whisper_print_system_info());
         }
 
         // print some info about the processing
@@ -781,52 +2897,100 @@ int main(int argc, char ** argv) {
             fprintf(stderr, "\n");
         }
 
-        // run the inference
-        {
-            printf("Running whisper.cpp inference on %s\n", filename.c_str());
-            whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+        // send each segment as a server-sent event as soon as it is decoded
+        // the segment callback is not called by whisper_full_parallel(), so the state of the worker is used
+        if (params.response_format == sse_format) {
+            auto task = std::make_shared<server_sse_task>(model, lease.state, priority);
+            lease.state = nullptr;
+
+            task->params   = params;
+            task->filename = filename;
+            task->pcmf32   = std::move(pcmf32);
+            task->energy   = std::move(energy);
+
+            task->metrics    = &metrics;
+            task->t_start_us = t_start_us;
+
+            whisper_context * ctx_task = ctx;
+
+            res.set_chunked_content_provider("text/event-stream", [task, ctx_task](size_t, DataSink & sink) {
+                const whisper_params & params = task->params;
 
-            wparams.strategy = params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
+                printf("Running whisper.cpp inference on %s\n", task->filename.c_str());
 
-            wparams.print_realtime   = false;
-            wparams.print_progress   = params.print_progress;
-            wparams.print_timestamps = !params.no_timestamps;
-            wparams.print_special    = params.print_special;
-            wparams.translate        = params.translate;
-            wparams.language         = params.language.c_str();
-            wparams.detect_language  = params.detect_language;
-            wparams.n_threads        = params.n_threads;
-            wparams.n_max_text_ctx   = params.max_context >= 0 ? params.max_context : wparams.n_max_text_ctx;
-            wparams.offset_ms        = params.offset_t_ms;
-            wparams.duration_ms      = params.duration_ms;
+                whisper_full_params wparams = server_full_params(params);
 
-            wparams.thold_pt         = params.word_thold;
-            wparams.max_len          = params.max_len == 0 ? 60 : params.max_len;
-            wparams.split_on_word    = params.split_on_word;
-            wparams.audio_ctx        = params.audio_ctx;
+                server_sse_user_data user_data = { &sink, task.get(), { &params, &task->energy, 0 } };
 
-            wparams.debug_mode       = params.debug_mode;
+                wparams.new_segment_callback           = server_sse_segment_callback;
+                wparams.new_segment_callback_user_data = &user_data;
+
+                wparams.encoder_begin_callback           = server_yield_callback;
+                wparams.encoder_begin_callback_user_data = &task->yield;
+
+                if (wparams.print_progress) {
+                    wparams.progress_callback           = whisper_print_progress_callback;
+                    wparams.progress_callback_user_data = &user_data.print;
+                }
+
+                // stop when the client goes away
+                wparams.abort_callback = [](void * user_data) {
+                    return !static_cast<server_sse_user_data *>(user_data)->sink->is_writable();
+                };
+                wparams.abort_callback_user_data = &user_data;
+
+                task->yield.is_closed      = wparams.abort_callback;
+                task->yield.is_closed_data = wparams.abort_callback_user_data;
+
+                whisper_state * state = task->lease.state;
 
-            wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+                whisper_state_counters c0;
+                whisper_get_state_counters(state, &c0);
 
-            wparams.initial_prompt   = params.prompt.c_str();
+                const int64_t t_run_us = ggml_time_us();
 
-            wparams.greedy.best_of        = params.best_of;
-            wparams.beam_search.beam_size = params.beam_size;
+                if (whisper_full_with_state(ctx_task, state, wparams, task->pcmf32.data(), task->pcmf32.size()) != 0) {
+                    fprintf(stderr, "%s: failed to process audio\n", __func__);
+                    task->metrics->fail();
+                    server_sse_event(sink, "error", json{{"error", "failed to process audio"}});
+                    sink.done();
+                    return true;
+                }
+
+                whisper_state_counters c1;
+                whisper_get_state_counters(state, &c1);
+
+                std::string text;
+                int n_tokens = 0;
+                const int n_segments = whisper_full_n_segments_from_state(state);
+                for (int i = 0; i < n_segments; ++i) {
+                    text     += whisper_full_get_segment_text_from_state(state, i);
+                    n_tokens += whisper_full_n_tokens_from_state(state, i);
+                }
 
-            wparams.temperature      = params.temperature;
-            wparams.no_speech_thold = params.no_speech_thold;
-            wparams.temperature_inc  = params.temperature_inc;
-            wparams.entropy_thold    = params.entropy_thold;
-            wparams.logprob_thold    = params.logprob_thold;
+                task->metrics->record(task->t_start_us, float(task->pcmf32.size())/WHISPER_SAMPLE_RATE, n_tokens, &c0, &c1);
+                task->model->workers.observe(1e-6*(ggml_time_us() - t_run_us), float(task->pcmf32.size())/WHISPER_SAMPLE_RATE);
 
-            wparams.no_timestamps    = params.no_timestamps;
-            wparams.token_timestamps = !params.no_timestamps && params.response_format == vjson_format;
-            wparams.no_context       = params.no_context;
+                server_sse_event(sink, "done", json{
+                    {"task",     params.translate ? "translate" : "transcribe"},
+                    {"language", whisper_lang_str_full(whisper_full_lang_id_from_state(state))},
+                    {"duration", float(task->pcmf32.size())/WHISPER_SAMPLE_RATE},
+                    {"text",     text},
+                });
+                sink.done();
+
+                return true;
+            });
+
+            return;
+        }
 
-            wparams.suppress_nst     = params.suppress_nst;
+        // run the inference
+        {
+            printf("Running whisper.cpp inference on %s\n", filename.c_str());
+            whisper_full_params wparams = server_full_params(params);
 
-            whisper_print_user_data user_data = { &params, &pcmf32s, 0 };
+            whisper_print_user_data user_data = { &params, &energy, 0 };
 
             // this callback is called on each new segment
             if (params.print_realtime) {
@@ -847,7 +3011,32 @@ int main(int argc, char ** argv) {
             };
             wparams.abort_callback_user_data = (void*)&req;
 
-            if (whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) != 0) {
+            yield.is_closed      = wparams.abort_callback;
+            yield.is_closed_data = wparams.abort_callback_user_data;
+
+            wparams.encoder_begin_callback           = server_yield_callback;
+            wparams.encoder_begin_callback_user_data = &yield;
+
+            // the counters of the default state used by whisper_full_parallel() are not accessible
+            whisper_state_counters c0;
+            whisper_get_state_counters(lease.state, &c0);
+
+            // the short requests are batched with the other ones that arrive at the same time
+            const bool batched = sparams.n_batch > 1 && params.n_processors == 1 &&
+                (int64_t) pcmf32.size() <= (int64_t) sparams.batch_max_ms*WHISPER_SAMPLE_RATE/1000;
+
+            const int ret = params.n_processors > 1 ?
+                whisper_full_parallel(ctx, wparams, pcmf32.data(), pcmf32.size(), params.n_processors) :
+                batched ?
+                model->batcher.run(ctx, lease.state, wparams, pcmf32.data(), pcmf32.size()) :
+                whisper_full_with_state(ctx, lease.state, wparams, pcmf32.data(), pcmf32.size());
+
+            whisper_state_counters c1;
+            whisper_get_state_counters(lease.state, &c1);
+
+            if (ret != 0) {
+                metrics.fail();
+
                 // handle failure or early abort
                 if (req.is_connection_closed()) {
                     // log client disconnect
@@ -862,140 +3051,206 @@ int main(int argc, char ** argv) {
                 res.set_content(error_resp, "application/json");
                 return;
             }
+
+            int n_tokens = 0;
+            for (int i = 0; i < result.n_segments(); ++i) {
+                n_tokens += result.n_tokens(i);
+            }
+
+            const bool has_counters = params.n_processors == 1;
+            metrics.record(t_start_us, float(pcmf32.size())/WHISPER_SAMPLE_RATE, n_tokens, has_counters ? &c0 : nullptr, has_counters ? &c1 : nullptr);
+            model->workers.observe(1e-6*(ggml_time_us() - t_run_us), float(pcmf32.size())/WHISPER_SAMPLE_RATE);
         }
 
         // return results to user
-        if (params.response_format == text_format)
+        server_write_result(result, params, energy, float(pcmf32.size())/WHISPER_SAMPLE_RATE, buffers.data.out, res);
+
+        if (!cache_key.empty()) {
+            cache.put(cache_key, res.body, res.get_header_value("Content-Type"));
+        }
+    });
+    // open a stream session - the fields of the request are the same as for /inference, plus step_ms, length_ms and keep_ms
+    svr.Post(sparams.request_path + "/stream", [&](const Request &req, Response &res){
+        auto stream = std::make_shared<server_stream>();
+
+        stream->params = default_params;
+        get_req_parameters(req, stream->params);
+
+        int32_t step_ms   = 500;
+        int32_t length_ms = 5000;
+        int32_t keep_ms   = 200;
+
+        if (has_req_field(req, "step_ms"))
         {
-            std::string results = output_str(ctx, params, pcmf32s);
-            res.set_content(results.c_str(), "text/html; charset=utf-8");
+            step_ms = std::stoi(get_req_field(req, "step_ms"));
         }
-        else if (params.response_format == srt_format)
+        if (has_req_field(req, "length_ms"))
         {
-            std::stringstream ss;
-            const int n_segments = whisper_full_n_segments(ctx);
-            for (int i = 0; i < n_segments; ++i) {
-                const char * text = whisper_full_get_segment_text(ctx, i);
-                const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-                std::string speaker = "";
-
-                if (params.diarize && pcmf32s.size() == 2)
-                {
-                    speaker = estimate_diarization_speaker(pcmf32s, t0, t1);
-                }
+            length_ms = std::stoi(get_req_field(req, "length_ms"));
+        }
+        if (has_req_field(req, "keep_ms"))
+        {
+            keep_ms = std::stoi(get_req_field(req, "keep_ms"));
+        }
 
-                ss << i + 1 + params.offset_n << "\n";
-                ss << to_timestamp(t0, true) << " --> " << to_timestamp(t1, true) << "\n";
-                ss << speaker << text << "\n\n";
+        if (has_req_field(req, "codec") && get_req_field(req, "codec") != "pcm")
+        {
+            if (get_req_field(req, "codec") != "opus") {
+                res.status = 400;
+                res.set_content("{\"error\":\"unknown codec\"}", "application/json");
+                return;
             }
-            res.set_content(ss.str(), "application/x-subrip");
-        } else if (params.response_format == vtt_format) {
-            std::stringstream ss;
+#ifdef WHISPER_OPUS
+            const int jitter_ms = has_req_field(req, "jitter_ms") ? std::stoi(get_req_field(req, "jitter_ms")) : 60;
 
-            ss << "WEBVTT\n\n";
+            stream->opus = opus_ingest_init(jitter_ms);
+            if (stream->opus == nullptr) {
+                res.status = 500;
+                res.set_content("{\"error\":\"failed to initialize the Opus decoder\"}", "application/json");
+                return;
+            }
+#else
+            res.status = 400;
+            res.set_content("{\"error\":\"the server is built without Opus support (WHISPER_OPUS)\"}", "application/json");
+            return;
+#endif
+        }
 
-            const int n_segments = whisper_full_n_segments(ctx);
-            for (int i = 0; i < n_segments; ++i) {
-                const char * text = whisper_full_get_segment_text(ctx, i);
-                const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-                std::string speaker = "";
-
-                if (params.diarize && pcmf32s.size() == 2)
-                {
-                    speaker = estimate_diarization_speaker(pcmf32s, t0, t1, true);
-                    speaker.insert(0, "<v Speaker");
-                    speaker.append(">");
-                }
+        stream->n_samples_step = (int) (1e-3*std::max(step_ms, 100)*WHISPER_SAMPLE_RATE);
+        stream->n_samples_len  = (int) (1e-3*std::max(length_ms, step_ms)*WHISPER_SAMPLE_RATE);
+        stream->n_samples_keep = (int) (1e-3*std::min(std::max(keep_ms, 0), step_ms)*WHISPER_SAMPLE_RATE);
 
-                ss << to_timestamp(t0) << " --> " << to_timestamp(t1) << "\n";
-                ss << speaker << text << "\n\n";
-            }
-            res.set_content(ss.str(), "text/vtt");
-        } else if (params.response_format == vjson_format) {
-            /* try to match openai/whisper's Python format */
-            std::string results = output_str(ctx, params, pcmf32s); 
-            // Get language probabilities
-            std::vector<float> lang_probs(whisper_lang_max_id() + 1, 0.0f);
-            const auto detected_lang_id = whisper_lang_auto_detect(ctx, 0, params.n_threads, lang_probs.data());
-            json jres = json{
-                {"task", params.translate ? "translate" : "transcribe"},
-                {"language", whisper_lang_str_full(whisper_full_lang_id(ctx))},
-                {"duration", float(pcmf32.size())/WHISPER_SAMPLE_RATE},
-                {"text", results},
-                {"segments", json::array()},
-                {"detected_language", whisper_lang_str_full(detected_lang_id)},
-                {"detected_language_probability", lang_probs[detected_lang_id]},
-                {"language_probabilities", json::object()}
-            };
-            // Add all language probabilities
-            for (int i = 0; i <= whisper_lang_max_id(); ++i) {
-                if (lang_probs[i] > 0.001f) { // Only include non-negligible probabilities
-                    jres["language_probabilities"][whisper_lang_str(i)] = lang_probs[i];
-                }
-            }
-            const int n_segments = whisper_full_n_segments(ctx);
-            for (int i = 0; i < n_segments; ++i)
-            {
-                json segment = json{
-                    {"id", i},
-                    {"text", whisper_full_get_segment_text(ctx, i)},
-                };
+        stream->model = models.get(has_req_field(req, "model") ? get_req_field(req, "model") : "");
+        if (stream->model == nullptr) {
+            res.status = 500;
+            res.set_content("{\"error\":\"failed to load the model\"}", "application/json");
+            return;
+        }
 
-                if (!params.no_timestamps) {
-                    segment["start"] = whisper_full_get_segment_t0(ctx, i) * 0.01;
-                    segment["end"] = whisper_full_get_segment_t1(ctx, i) * 0.01;
-                }
+        stream->state = whisper_init_state(stream->model->ctx);
+        if (stream->state == nullptr) {
+            res.status = 500;
+            res.set_content("{\"error\":\"failed to initialize the stream state\"}", "application/json");
+            return;
+        }
 
-                float total_logprob = 0;
-                const int n_tokens = whisper_full_n_tokens(ctx, i);
-                for (int j = 0; j < n_tokens; ++j) {
-                    whisper_token_data token = whisper_full_get_token_data(ctx, i, j);
-                    if (token.id >= whisper_token_eot(ctx)) {
-                        continue;
-                    }
+        const std::string id = streams.add(stream);
+        if (id.empty()) {
+            fprintf(stderr, "error: too many streams\n");
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.set_content("{\"error\":\"too many streams, try again later\"}", "application/json");
+            return;
+        }
 
-                    segment["tokens"].push_back(token.id);
-                    json word = json{{"word", whisper_full_get_token_text(ctx, i, j)}};
-                    if (!params.no_timestamps) {
-                        word["start"] = token.t0 * 0.01;
-                        word["end"] = token.t1 * 0.01;
-                        word["t_dtw"] = token.t_dtw;
-                    }
-                    word["probability"] = token.p;
-                    total_logprob += token.plog;
-                    segment["words"].push_back(word);
+        printf("Opened stream %s\n", id.c_str());
+
+        res.set_content(json{{"id", id}}.dump(), "application/json");
+    });
+
+    // post the next chunk of a stream: raw 16 kHz mono PCM, signed 16-bit little-endian
+    // or, with codec = "opus", Opus packets - each one is a 16-bit sequence number and a 16-bit size (big-endian)
+    // followed by the packet. They are decoded once they leave the jitter buffer
+    // the response has the lines completed by this chunk and the current partial line
+    // with /end, the remaining audio is decoded and the session is closed
+    const auto stream_chunk = [&](const Request &req, Response &res, bool flush) {
+        const std::string id = req.matches[1];
+
+        auto stream = streams.get(id);
+        if (stream == nullptr) {
+            res.status = 404;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(stream->mutex);
+
+#ifdef WHISPER_OPUS
+        if (stream->opus) {
+            const uint8_t * p   = (const uint8_t *) req.body.data();
+            const uint8_t * end = p + req.body.size();
+
+            while (end - p >= 4) {
+                const uint16_t seq  = (uint16_t) ((p[0] << 8) | p[1]);
+                const size_t   size = (size_t)   ((p[2] << 8) | p[3]);
+                p += 4;
+
+                if ((size_t) (end - p) < size) {
+                    break;
                 }
 
-                segment["temperature"] = params.temperature;
-                segment["avg_logprob"] = total_logprob / n_tokens;
+                opus_ingest_push(stream->opus, seq, p, size);
+                p += size;
+            }
 
-                // TODO compression_ratio and no_speech_prob are not implemented yet
-                // segment["compression_ratio"] = 0;
-                segment["no_speech_prob"] = whisper_full_get_segment_no_speech_prob(ctx, i);
+            if (p != end) {
+                fprintf(stderr, "warning: stream %s: truncated Opus packet\n", id.c_str());
+            }
 
-                jres["segments"].push_back(segment);
+            // the audio is decoded straight into the samples of the session
+            if (opus_ingest_decode(stream->opus, stream->pcmf32_new, flush) < 0) {
+                res.status = 500;
+                res.set_content("{\"error\":\"failed to decode the Opus packets\"}", "application/json");
+                streams.erase(id);
+                return;
             }
-            res.set_content(jres.dump(-1, ' ', false, json::error_handler_t::replace),
-                            "application/json");
-        }
-        // TODO add more output formats
-        else
+        } else
+#endif
         {
-            std::string results = output_str(ctx, params, pcmf32s);
-            json jres = json{
-                {"text", results}
-            };
-            res.set_content(jres.dump(-1, ' ', false, json::error_handler_t::replace),
-                            "application/json");
+            const size_t n_samples = req.body.size()/sizeof(int16_t);
+            const int16_t * samples = (const int16_t *) req.body.data();
+            for (size_t i = 0; i < n_samples; ++i) {
+                stream->pcmf32_new.push_back(float(samples[i])/32768.0f);
+            }
+        }
+
+        json segments = json::array();
+        if (!server_stream_process(stream->model->ctx, *stream, req, flush, segments)) {
+            fprintf(stderr, "error: failed to process stream %s\n", id.c_str());
+            res.status = 500;
+            res.set_content("{\"error\":\"failed to process audio\"}", "application/json");
+            streams.erase(id);
+            return;
+        }
+
+        if (flush) {
+            streams.erase(id);
+            printf("Closed stream %s\n", id.c_str());
+        }
+
+        const float duration = float(stream->n_samples_done + stream->pcmf32_new.size())/WHISPER_SAMPLE_RATE;
+
+        if (stream->params.response_format == bin_format) {
+            res.set_content(server_bin_stream(segments, stream->partial, duration), "application/octet-stream");
+            return;
+        }
+
+        json jres = json{
+            {"segments", segments},
+            {"partial",  stream->partial},
+            {"duration", duration},
+        };
+
+#ifdef WHISPER_OPUS
+        if (stream->opus) {
+            const opus_ingest_stats stats = opus_ingest_get_stats(stream->opus);
+
+            jres["packets_lost"] = stats.n_lost;
+            jres["packets_late"] = stats.n_late;
         }
+#endif
 
-        // reset params to their defaults
-        params = default_params;
+        res.set_content(jres.dump(-1, ' ', false, json::error_handler_t::replace), "application/json");
+    };
+
+    svr.Post(sparams.request_path + R"(/stream/([0-9a-f]+))", [&](const Request &req, Response &res){
+        stream_chunk(req, res, false);
+    });
+
+    svr.Post(sparams.request_path + R"(/stream/([0-9a-f]+)/end)", [&](const Request &req, Response &res){
+        stream_chunk(req, res, true);
     });
+
     svr.Post(sparams.request_path + "/load", [&](const Request &req, Response &res){
-        std::lock_guard<std::mutex> lock(whisper_mutex);
         if (!req.has_file("model"))
         {
             fprintf(stderr, "error: no 'model' field in the request\n");
@@ -1012,27 +3267,40 @@ int main(int argc, char ** argv) {
             return;
         }
 
-        // clean up
-        whisper_free(ctx);
+        // without a 'name', the default model is replaced
+        // the model is loaded in the background of the other requests, the old one is freed when its requests are done
+        const std::string name = req.has_file("name") ? req.get_file_value("name").content : models.name_default;
 
-        // whisper init
-        ctx = whisper_init_from_file_with_params(model.c_str(), cparams);
-
-        // TODO perhaps load prior model here instead of exit
-        if (ctx == nullptr) {
-            fprintf(stderr, "error: model init  failed, no model loaded must exit\n");
-            exit(1);
+        if (models.load(name, model) == nullptr) {
+            res.status = 500;
+            res.set_content("{\"error\":\"failed to load the model\"}", "application/json");
+            return;
         }
 
-        // initialize openvino encoder. this has no effect on whisper.cpp builds that don't have OpenVINO configured
-        whisper_ctx_init_openvino_encoder(ctx, nullptr, params.openvino_encode_device.c_str(), nullptr);
-
         const std::string success = "Load was successful!";
         res.set_content(success, "application/text");
 
         // check if the model is in the file system
     });
 
+    svr.Get(sparams.request_path + "/metrics", [&](const Request &, Response &res){
+        std::stringstream ss;
+
+        metrics.print(ss);
+        models.print_metrics(ss);
+        cache.print(ss);
+
+        ss << "# HELP whisper_streams_open Number of open /stream sessions\n";
+        ss << "# TYPE whisper_streams_open gauge\n";
+        ss << "whisper_streams_open " << streams.size() << "\n";
+
+        res.set_content(ss.str(), "text/plain; version=0.0.4");
+    });
+
+    svr.Get(sparams.request_path + "/models", [&](const Request &, Response &res){
+        res.set_content(json{{"models", models.list()}}.dump(), "application/json");
+    });
+
     svr.Get(sparams.request_path + "/health", [&](const Request &, Response &res){
         const std::string health_response = "{\"status\":\"ok\"}";
         res.set_content(health_response, "application/json");
@@ -1055,6 +3323,8 @@ int main(int argc, char ** argv) {
     svr.set_error_handler([](const Request &req, Response &res) {
         if (res.status == 400) {
             res.set_content("Invalid request", "text/plain");
+        } else if (res.status == 503) {
+            // the inference queue is full - keep the response of the handler
         } else if (res.status != 500) {
             res.set_content("File Not Found (" + req.path + ")", "text/plain");
             res.status = 404;
@@ -1083,8 +3353,11 @@ int main(int argc, char ** argv) {
         return 1;
     }
 
-    whisper_print_timings(ctx);
-    whisper_free(ctx);
+    if (auto model = models.get(models.name_default)) {
+        whisper_print_timings(model->ctx);
+    }
+    streams.clear();
+    models.clear();
 
     return 0;
 }
@@ -24,7 +24,11 @@ std::string g_status        = "";
 std::string g_status_forced = "";
 std::string g_transcribed   = "";
 
+// the new samples since the last iteration of the worker
+// the JS side passes the whole recording, g_n_received is the number of its samples already received
 std::vector<float> g_pcmf32;
+size_t g_n_received = 0;
+bool   g_restart    = false;
 
 void stream_set_status(const std::string & status) {
     std::lock_guard<std::mutex> lock(g_mutex);
@@ -61,12 +65,17 @@ void stream_main(size_t index) {
     // whisper context
     auto & ctx = g_contexts[index];
 
+    // the log mel spectrogram is computed incrementally in the state - only the frames of the new samples are computed
+    struct whisper_state * state = whisper_state_pool_acquire(ctx);
+
     // 5 seconds interval
     const int64_t window_samples = 5*WHISPER_SAMPLE_RATE;
 
     while (g_running) {
         stream_set_status("waiting for audio ...");
 
+        bool restart = false;
+
         {
             std::unique_lock<std::mutex> lock(g_mutex);
 
@@ -78,8 +87,17 @@ void stream_main(size_t index) {
                 continue;
             }
 
-            pcmf32 = std::vector<float>(g_pcmf32.end() - std::min((int64_t) g_pcmf32.size(), window_samples), g_pcmf32.end());
+            pcmf32.swap(g_pcmf32);
             g_pcmf32.clear();
+
+            restart = g_restart;
+            g_restart = false;
+        }
+
+        // a new recording - start over with a clean state
+        if (restart) {
+            whisper_state_pool_release(ctx, state);
+            state = whisper_state_pool_acquire(ctx);
         }
 
         {
@@ -87,7 +105,10 @@ void stream_main(size_t index) {
 
             stream_set_status("running whisper ...");
 
-            int ret = whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size());
+            whisper_pcm_append_with_state(ctx, state, pcmf32.data(), pcmf32.size(), wparams.n_threads);
+            whisper_pcm_append_trim_with_state(ctx, state, window_samples);
+
+            int ret = whisper_full_with_state(ctx, state, wparams, nullptr, 0);
             if (ret != 0) {
                 printf("whisper_full() failed: %d\n", ret);
                 break;
@@ -102,12 +123,12 @@ void stream_main(size_t index) {
             std::string text_heard;
 
             {
-                const int n_segments = whisper_full_n_segments(ctx);
+                const int n_segments = whisper_full_n_segments_from_state(state);
                 if (n_segments > 0) {
-                    const char * text = whisper_full_get_segment_text(ctx, n_segments - 1);
+                    const char * text = whisper_full_get_segment_text_from_state(state, n_segments - 1);
 
-                    const int64_t t0 = whisper_full_get_segment_t0(ctx, n_segments - 1);
-                    const int64_t t1 = whisper_full_get_segment_t1(ctx, n_segments - 1);
+                    const int64_t t0 = whisper_full_get_segment_t0_from_state(state, n_segments - 1);
+                    const int64_t t1 = whisper_full_get_segment_t1_from_state(state, n_segments - 1);
 
                     printf("transcribed: %s\n", text);
 
@@ -122,6 +143,8 @@ void stream_main(size_t index) {
         }
     }
 
+    whisper_state_pool_release(ctx, state);
+
     if (index < g_contexts.size()) {
         whisper_free(g_contexts[index]);
         g_contexts[index] = nullptr;
@@ -171,15 +194,28 @@ EMSCRIPTEN_BINDINGS(stream) {
 
         {
             std::lock_guard<std::mutex> lock(g_mutex);
-            const int n = audio["length"].as<int>();
+            const size_t n = audio["length"].as<size_t>();
+
+            // a shorter audio is a new recording
+            if (n < g_n_received) {
+                g_pcmf32.clear();
+                g_n_received = 0;
+                g_restart = true;
+            }
+
+            // copy only the samples that were not received yet
+            const size_t n_new = n - g_n_received;
+            const size_t n_old = g_pcmf32.size();
+
+            g_pcmf32.resize(n_old + n_new);
 
             emscripten::val heap = emscripten::val::module_property("HEAPU8");
             emscripten::val memory = heap["buffer"];
 
-            g_pcmf32.resize(n);
+            emscripten::val memoryView = audio["constructor"].new_(memory, reinterpret_cast<uintptr_t>(g_pcmf32.data() + n_old), n_new);
+            memoryView.call<void>("set", audio.call<emscripten::val>("subarray", g_n_received, n));
 
-            emscripten::val memoryView = audio["constructor"].new_(memory, reinterpret_cast<uintptr_t>(g_pcmf32.data()), n);
-            memoryView.call<void>("set", audio);
+            g_n_received = n;
         }
 
         return 0;
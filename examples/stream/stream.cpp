@@ -7,9 +7,14 @@
 #include "common-whisper.h"
 #include "whisper.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -24,6 +29,7 @@ struct whisper_params {
     int32_t max_tokens = 32;
     int32_t audio_ctx  = 0;
     int32_t beam_size  = -1;
+    int32_t n_jobs     = 1;
 
     float vad_thold    = 0.6f;
     float freq_thold   = 100.0f;
@@ -38,10 +44,15 @@ struct whisper_params {
     bool use_gpu       = true;
     bool flash_attn    = false;
     bool use_stdin      = false;  // use stdin instead of microphone
+    bool local_agreement = false; // commit the text on which consecutive steps agree
+    bool adaptive        = false; // degrade the decoding when the steps are not processed in real time
 
     std::string language  = "en";
     std::string model     = "models/ggml-base.en.bin";
     std::string fname_out;
+    std::string vad_model; // Silero VAD model, instead of vad_simple()
+
+    std::vector<std::string> inputs; // raw 32-bit float PCM files, instead of the microphone
 };
 
 void whisper_print_usage(int argc, char ** argv, const whisper_params & params);
@@ -63,6 +74,9 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-ac"   || arg == "--audio-ctx")     { params.audio_ctx     = std::stoi(argv[++i]); }
         else if (arg == "-bs"   || arg == "--beam-size")     { params.beam_size     = std::stoi(argv[++i]); }
         else if (arg == "-vth"  || arg == "--vad-thold")     { params.vad_thold     = std::stof(argv[++i]); }
+        else if (arg == "-vm"   || arg == "--vad-model")     { params.vad_model     = argv[++i]; }
+        else if (arg == "-i"    || arg == "--input")         { params.inputs.push_back(argv[++i]); }
+        else if (arg == "-j"    || arg == "--jobs")          { params.n_jobs        = std::stoi(argv[++i]); }
         else if (arg == "-fth"  || arg == "--freq-thold")    { params.freq_thold    = std::stof(argv[++i]); }
         else if (arg == "-tr"   || arg == "--translate")     { params.translate     = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")   { params.no_fallback   = true; }
@@ -76,6 +90,8 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-ng"   || arg == "--no-gpu")        { params.use_gpu       = false; }
         else if (arg == "-fa"   || arg == "--flash-attn")    { params.flash_attn    = true; }
         else if (arg == "--stdin")                { params.use_stdin      = true; }
+        else if (arg == "-la"   || arg == "--local-agreement") { params.local_agreement = true; }
+        else if (arg == "-aq"   || arg == "--adaptive")      { params.adaptive      = true; }
 
         else {
             fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
@@ -102,6 +118,7 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -ac N,    --audio-ctx N   [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
     fprintf(stderr, "  -bs N,    --beam-size N   [%-7d] beam size for beam search\n",                      params.beam_size);
     fprintf(stderr, "  -vth N,   --vad-thold N   [%-7.2f] voice activity detection threshold\n",           params.vad_thold);
+    fprintf(stderr, "  -vm FNAME, --vad-model FNAME [%-7s] Silero VAD model for the sliding window mode\n", params.vad_model.c_str());
     fprintf(stderr, "  -fth N,   --freq-thold N  [%-7.2f] high-pass frequency cutoff\n",                   params.freq_thold);
     fprintf(stderr, "  -tr,      --translate     [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     fprintf(stderr, "  -nf,      --no-fallback   [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
@@ -115,10 +132,360 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -ng,      --no-gpu        [%-7s] disable GPU inference\n",                          params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,      --flash-attn    [%-7s] flash attention during inference\n",               params.flash_attn ? "true" : "false");
     fprintf(stderr, "            --stdin         [%-7s] use stdin for audio input instead of microphone\n", params.use_stdin ? "true" : "false");
+    fprintf(stderr, "  -i FNAME, --input FNAME   [%-7s] transcribe a raw 32-bit float PCM file or FIFO (repeatable)\n", "");
+    fprintf(stderr, "  -j N,     --jobs N        [%-7d] number of inputs transcribed at the same time\n",   params.n_jobs);
+    fprintf(stderr, "  -la,      --local-agreement [%-5s] commit the text on which consecutive steps agree, decode only the rest\n", params.local_agreement ? "true" : "false");
+    fprintf(stderr, "  -aq,      --adaptive      [%-7s] lower the quality of the decoding while the steps lag behind real time\n", params.adaptive ? "true" : "false");
 
     fprintf(stderr, "\n");
 }
 
+static whisper_full_params stream_full_params(const whisper_params & params, bool use_vad) {
+    whisper_full_params wparams = whisper_full_default_params(params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+
+    wparams.print_progress   = false;
+    wparams.print_special    = params.print_special;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = !params.no_timestamps;
+    wparams.translate        = params.translate;
+    wparams.single_segment   = !use_vad;
+    wparams.max_tokens       = params.max_tokens;
+    wparams.language         = params.language.c_str();
+    wparams.n_threads        = params.n_threads;
+    wparams.beam_search.beam_size = params.beam_size;
+
+    wparams.audio_ctx        = params.audio_ctx;
+
+    wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+
+    // disable temperature fallback
+    //wparams.temperature_inc  = -1.0f;
+    wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
+
+    return wparams;
+}
+
+// --adaptive: the decoding is degraded while the steps are not processed in real time, and restored once they are
+//
+// the real-time factor of a step is its processing time over the duration of its new audio, averaged over the last
+// steps: above rtf_hi the next level is used, below rtf_lo the previous one, at most one change every n_hold steps
+//
+//   level 1: greedy decoding instead of beam search, and a single decoder for the fallbacks
+//   level 2: no temperature fallback
+//   level 3: audio_ctx fit to the length of the window instead of the full 30 s (see whisper_full_params::audio_ctx)
+//   level 4: the steps without speech are not decoded (energy of the new audio close to the noise floor)
+struct stream_quality {
+    static constexpr int   n_levels = 5;
+    static constexpr int   n_hold   = 3;
+    static constexpr float rtf_hi   = 0.9f;
+    static constexpr float rtf_lo   = 0.5f;
+
+    int   level = 0;
+    int   n_cur = 0;     // steps since the last change of level
+    float rtf   = 0.0f;  // moving average of the real-time factor
+    float noise = -1.0f; // noise floor - mean absolute value of the quietest steps
+
+    // returns true when the level changes
+    bool update(double t_proc_ms, double t_audio_ms) {
+        if (t_audio_ms <= 0.0) {
+            return false;
+        }
+
+        const float rtf_cur = t_proc_ms/t_audio_ms;
+
+        rtf = n_cur == 0 ? rtf_cur : 0.7f*rtf + 0.3f*rtf_cur;
+        n_cur++;
+
+        if (n_cur < n_hold) {
+            return false;
+        }
+
+        const int level_prev = level;
+
+        if (rtf > rtf_hi && level < n_levels - 1) {
+            level++;
+        } else if (rtf < rtf_lo && level > 0) {
+            level--;
+        }
+
+        if (level != level_prev) {
+            n_cur = 0;
+        }
+
+        return level != level_prev;
+    }
+
+    void apply(whisper_full_params & wparams) const {
+        if (level >= 1) {
+            wparams.strategy       = WHISPER_SAMPLING_GREEDY;
+            wparams.greedy.best_of = 1;
+        }
+        if (level >= 2) {
+            wparams.temperature_inc = 0.0f;
+        }
+        if (level >= 3 && wparams.audio_ctx == 0) {
+            wparams.audio_ctx = -1;
+        }
+    }
+
+    // the noise floor follows the quiet steps at once and the loud ones slowly - a step is skipped at level 4 when
+    // its energy is below twice the floor
+    bool skip(const float * pcm, int n) {
+        if (n <= 0) {
+            return true;
+        }
+
+        float energy = 0.0f;
+        for (int i = 0; i < n; ++i) {
+            energy += fabsf(pcm[i]);
+        }
+        energy /= n;
+
+        noise = noise < 0.0f ? energy : std::min(energy, 1.02f*noise);
+
+        return level >= 4 && energy < 2.0f*noise;
+    }
+
+    void print(const char * name) const {
+        static const char * desc[n_levels] = {
+            "full quality",
+            "greedy decoding",
+            "greedy decoding, no fallback",
+            "greedy decoding, no fallback, audio_ctx fit to the window",
+            "greedy decoding, no fallback, audio_ctx fit to the window, silent steps skipped",
+        };
+
+        fprintf(stderr, "\n%s%s%squality level %d (real-time factor %.2f): %s\n", name ? "[" : "", name ? name : "", name ? "] " : "", level, rtf, desc[level]);
+    }
+};
+
+// --input: the audio of each input is transcribed by its own whisper_state of the shared context
+// the steps of all the inputs are processed by --jobs threads, in the order in which their audio arrives
+struct stream_input {
+    std::string fname;
+    FILE *      file = nullptr;
+
+    whisper_state * state = nullptr;
+
+    std::thread reader;
+
+    // written by the reader thread
+    std::mutex         mutex;
+    std::vector<float> pcm;
+    bool               eof = false;
+
+    // guarded by the mutex of the jobs
+    bool busy = false;
+    bool done = false;
+
+    int n_iter = 0;
+
+    std::vector<whisper_token> prompt_tokens;
+
+    stream_quality quality;
+};
+
+static int stream_inputs(whisper_context * ctx, const whisper_params & params) {
+    const int n_samples_step = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
+    const int n_samples_len  = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
+    const int n_samples_keep = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
+
+    const int n_new_line = std::max(1, params.length_ms / params.step_ms - 1);
+
+    std::vector<std::unique_ptr<stream_input>> inputs;
+
+    for (const auto & fname : params.inputs) {
+        std::unique_ptr<stream_input> input(new stream_input);
+
+        input->fname = fname;
+        input->file  = fname == "-" ? stdin : fopen(fname.c_str(), "rb");
+        if (input->file == nullptr) {
+            fprintf(stderr, "%s: failed to open input '%s'\n", __func__, fname.c_str());
+            return 1;
+        }
+
+        input->state = whisper_init_state(ctx);
+        if (input->state == nullptr) {
+            fprintf(stderr, "%s: failed to initialize the state of input '%s'\n", __func__, fname.c_str());
+            return 1;
+        }
+
+        inputs.push_back(std::move(input));
+    }
+
+    fprintf(stderr, "%s: %d inputs, %d jobs\n", __func__, (int) inputs.size(), params.n_jobs);
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    // the readers block on their input, 0.1 s of audio at a time
+    for (auto & input : inputs) {
+        stream_input * in = input.get();
+        in->reader = std::thread([in, &mutex, &cv]() {
+            std::vector<float> buf(WHISPER_SAMPLE_RATE/10);
+            while (true) {
+                const size_t n_read = fread(buf.data(), sizeof(float), buf.size(), in->file);
+                {
+                    std::lock_guard<std::mutex> lock(in->mutex);
+                    in->pcm.insert(in->pcm.end(), buf.begin(), buf.begin() + n_read);
+                    in->eof = n_read == 0;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    cv.notify_all();
+                }
+                if (n_read == 0) {
+                    break;
+                }
+            }
+        });
+    }
+
+    // an input is ready when it has a step of audio, or the rest of its audio after the end of the input
+    const auto ready = [&](stream_input & in) {
+        std::lock_guard<std::mutex> lock(in.mutex);
+        return !in.busy && !in.done && ((int) in.pcm.size() >= n_samples_step || in.eof);
+    };
+
+    const auto process = [&](stream_input & in) {
+        // one step at a time, so that the audio of a file is not dropped from the window before it is decoded
+        std::vector<float> pcm;
+        bool eof;
+        {
+            std::lock_guard<std::mutex> lock(in.mutex);
+            const size_t n = std::min(in.pcm.size(), (size_t) n_samples_step);
+            pcm.assign(in.pcm.begin(), in.pcm.begin() + n);
+            in.pcm.erase(in.pcm.begin(), in.pcm.begin() + n);
+            eof = in.eof && in.pcm.empty();
+        }
+
+        bool ok = true;
+
+        if (!pcm.empty()) {
+            const auto t_start = std::chrono::high_resolution_clock::now();
+
+            ok = whisper_pcm_append_with_state(ctx, in.state, pcm.data(), pcm.size(), params.n_threads) == 0 &&
+                 whisper_pcm_append_trim_with_state(ctx, in.state, n_samples_keep + n_samples_len) == 0;
+
+            whisper_full_params wparams = stream_full_params(params, false);
+
+            wparams.prompt_tokens   = params.no_context ? nullptr : in.prompt_tokens.data();
+            wparams.prompt_n_tokens = params.no_context ? 0       : in.prompt_tokens.size();
+
+            if (params.adaptive) {
+                in.quality.apply(wparams);
+            }
+
+            const bool skip = params.adaptive && in.quality.skip(pcm.data(), pcm.size()) && !eof;
+
+            ok = ok && (skip || whisper_full_with_state(ctx, in.state, wparams, nullptr, 0) == 0);
+
+            if (params.adaptive && !skip) {
+                const double t_proc_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+                if (in.quality.update(t_proc_ms, 1e3*pcm.size()/WHISPER_SAMPLE_RATE)) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    in.quality.print(in.fname.c_str());
+                }
+            }
+
+            in.n_iter++;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s: failed to process input '%s'\n", __func__, in.fname.c_str());
+        }
+
+        // print the line of the last window once it is complete
+        if (ok && ((in.n_iter % n_new_line) == 0 || eof)) {
+            std::string text;
+
+            const int n_segments = whisper_full_n_segments_from_state(in.state);
+            for (int i = 0; i < n_segments; ++i) {
+                text += whisper_full_get_segment_text_from_state(in.state, i);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                printf("[%s] %s\n", in.fname.c_str(), text.c_str());
+                fflush(stdout);
+            }
+
+            whisper_pcm_append_trim_with_state(ctx, in.state, n_samples_keep);
+
+            if (!params.no_context) {
+                in.prompt_tokens.clear();
+                for (int i = 0; i < n_segments; ++i) {
+                    const int token_count = whisper_full_n_tokens_from_state(in.state, i);
+                    for (int j = 0; j < token_count; ++j) {
+                        in.prompt_tokens.push_back(whisper_full_get_token_id_from_state(in.state, i, j));
+                    }
+                }
+            }
+        }
+
+        bool done = !ok;
+        {
+            std::lock_guard<std::mutex> lock(in.mutex);
+            done = done || (in.eof && in.pcm.empty());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        in.busy = false;
+        in.done = done;
+        cv.notify_all();
+    };
+
+    std::vector<std::thread> jobs;
+    for (int j = 0; j < std::max(1, params.n_jobs); ++j) {
+        jobs.emplace_back([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                stream_input * next = nullptr;
+                bool all_done = true;
+
+                for (auto & input : inputs) {
+                    all_done = all_done && input->done;
+                    if (next == nullptr && ready(*input)) {
+                        next = input.get();
+                    }
+                }
+
+                if (all_done) {
+                    break;
+                }
+
+                if (next == nullptr) {
+                    cv.wait(lock);
+                    continue;
+                }
+
+                next->busy = true;
+
+                // the inputs that waited the longest go first
+                std::rotate(inputs.begin(), std::find_if(inputs.begin(), inputs.end(), [&](const std::unique_ptr<stream_input> & in) { return in.get() == next; }) + 1, inputs.end());
+
+                lock.unlock();
+                process(*next);
+                lock.lock();
+            }
+        });
+    }
+
+    for (auto & job : jobs) {
+        job.join();
+    }
+
+    for (auto & input : inputs) {
+        input->reader.join();
+        if (input->file != stdin) {
+            fclose(input->file);
+        }
+        whisper_free_state(input->state);
+    }
+
+    return 0;
+}
+
 int main(int argc, char ** argv) {
     whisper_params params;
 
@@ -136,29 +503,41 @@ int main(int argc, char ** argv) {
 
     const bool use_vad = n_samples_step <= 0; // sliding window mode uses VAD
 
+    if (use_vad && params.local_agreement) {
+        fprintf(stderr, "%s: WARNING: --local-agreement requires --step > 0, ignoring it\n", __func__);
+        params.local_agreement = false;
+    }
+
     const int n_new_line = !use_vad ? std::max(1, params.length_ms / params.step_ms - 1) : 1; // number of steps to print new line
 
     params.no_timestamps  = !use_vad;
     params.no_context    |= use_vad;
     params.max_tokens     = 0;
 
+    if (!params.inputs.empty() && (use_vad || params.local_agreement)) {
+        fprintf(stderr, "%s: --input requires --step > 0 and no --local-agreement\n", __func__);
+        return 1;
+    }
+
     // init audio
 
     audio_async audio(params.length_ms);
-    if (params.use_stdin) {
+    if (!params.inputs.empty()) {
+        // the inputs are read by stream_inputs()
+    } else if (params.use_stdin) {
         if (!audio.init_stdin(WHISPER_SAMPLE_RATE)) {
             fprintf(stderr, "%s: audio.init_stdin() failed!\n", __func__);
             return 1;
         }
+        audio.resume();
     } else {
         if (!audio.init(params.capture_id, WHISPER_SAMPLE_RATE)) {
             fprintf(stderr, "%s: audio.init() failed!\n", __func__);
             return 1;
         }
+        audio.resume();
     }
 
-    audio.resume();
-
     // whisper init
     if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1){
         fprintf(stderr, "error: unknown language '%s'\n", params.language.c_str());
@@ -173,12 +552,65 @@ int main(int argc, char ** argv) {
 
     struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
 
+    if (!params.inputs.empty()) {
+        const int ret = ctx ? stream_inputs(ctx, params) : 1;
+        whisper_free(ctx);
+        return ret;
+    }
+
     std::vector<float> pcmf32    (n_samples_30s, 0.0f);
-    std::vector<float> pcmf32_old;
     std::vector<float> pcmf32_new(n_samples_30s, 0.0f);
 
+    // with a Silero VAD model, the new audio goes through the VAD as it is captured, and the Whisper model runs only
+    // at the end of each utterance
+    struct whisper_vad_context * vctx = nullptr;
+    if (use_vad && !params.vad_model.empty()) {
+        struct whisper_vad_context_params vparams = whisper_vad_default_context_params();
+
+        vparams.n_threads = params.n_threads;
+        vparams.use_gpu   = params.use_gpu;
+
+        vctx = whisper_vad_init_from_file_with_params(params.vad_model.c_str(), vparams);
+        if (vctx == nullptr) {
+            fprintf(stderr, "error: failed to initialize the VAD model '%s'\n", params.vad_model.c_str());
+            return 1;
+        }
+    }
+
+    // an utterance ends after 1 second of silence, or when it reaches params.length_ms
+    struct whisper_vad_params vad_params = whisper_vad_default_params();
+
+    vad_params.threshold               = params.vad_thold;
+    vad_params.min_silence_duration_ms = 1000;
+    vad_params.max_speech_duration_s   = 1e-3f*params.length_ms;
+    vad_params.speech_pad_ms           = 200;
+
+    uint64_t n_vad_pos    = 0; // end of the audio pushed to the VAD, in samples since the start of the capture
+    int64_t  n_vad_offset = 0; // position in the capture of the start of the VAD stream
+    int64_t  n_vad_beg    = 0; // start of the current utterance in the capture
+
+    // copy the samples [beg, end) of the capture that are still in the span
+    const auto copy_span = [](const audio_async::span & span, uint64_t beg, uint64_t end, std::vector<float> & out) {
+        beg = std::max(beg, span.pos);
+        end = std::min(end, span.pos + span.size());
+
+        out.resize(end > beg ? end - beg : 0);
+        for (size_t i = 0; i < out.size(); ++i) {
+            const size_t k = beg - span.pos + i;
+            out[i] = k < span.n0 ? span.p0[k] : span.p1[k - span.n0];
+        }
+    };
+
     std::vector<whisper_token> prompt_tokens;
 
+    stream_quality quality;
+
+    // --local-agreement: the audio of the committed text is dropped from the buffer, and the committed tokens are
+    // the prompt of the next steps - only the uncommitted tail of the audio is decoded again
+    std::vector<whisper_token_data> hyp_prev; // uncommitted tokens of the previous step
+    std::string line;                         // committed text of the current line
+    int n_samples_buf = 0;                    // audio in the buffer
+
     // print some info about the processing
     {
         fprintf(stderr, "\n");
@@ -211,6 +643,9 @@ int main(int argc, char ** argv) {
 
     int n_iter = 0;
 
+    // the new audio of the step, for the real-time factor of --adaptive
+    int n_samples_step_cur = 0;
+
     bool is_running = true;
 
     std::ofstream fout;
@@ -245,7 +680,7 @@ int main(int argc, char ** argv) {
 
     // main audio loop
     while (is_running) {
-        if (params.save_audio) {
+        if (params.save_audio && use_vad) {
             wavWriter.write(pcmf32_new.data(), pcmf32_new.size());
         }
         // handle Ctrl + C
@@ -258,21 +693,24 @@ int main(int argc, char ** argv) {
         // process new audio
 
         if (!use_vad) {
+            // the new audio is read in place from the ring buffer of the capture
+            audio_async::span span;
+
             while (true) {
                 // handle Ctrl + C
                 is_running = sdl_poll_events();
                 if (!is_running) {
                     break;
                 }
-                audio.get(params.step_ms, pcmf32_new);
+                span = audio.get_span(2*params.step_ms + 1);
 
-                if ((int) pcmf32_new.size() > 2*n_samples_step) {
+                if ((int) span.size() > 2*n_samples_step) {
                     fprintf(stderr, "\n\n%s: WARNING: cannot process audio fast enough, dropping audio ...\n\n", __func__);
                     audio.clear();
                     continue;
                 }
 
-                if ((int) pcmf32_new.size() >= n_samples_step) {
+                if ((int) span.size() >= n_samples_step) {
                     audio.clear();
                     break;
                 }
@@ -280,22 +718,90 @@ int main(int argc, char ** argv) {
                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
 
-            const int n_samples_new = pcmf32_new.size();
+            if (!is_running) {
+                break;
+            }
+
+            const int n_samples_new = span.size();
+
+            if (params.save_audio) {
+                wavWriter.write(span.p0, span.n0);
+                wavWriter.write(span.p1, span.n1);
+            }
+
+            // compute the spectrogram only for the new audio and keep up to params.length_ms audio from previous iterations
+            if (whisper_pcm_append(ctx, span.p0, span.n0, params.n_threads) != 0 ||
+                (span.n1 > 0 && whisper_pcm_append(ctx, span.p1, span.n1, params.n_threads) != 0) ||
+                (!params.local_agreement && whisper_pcm_append_trim(ctx, n_samples_keep + n_samples_len) != 0)) {
+                fprintf(stderr, "%s: failed to compute log mel spectrogram\n", argv[0]);
+                return 6;
+            }
 
-            // take up to params.length_ms audio from previous iteration
-            const int n_samples_take = std::min((int) pcmf32_old.size(), std::max(0, n_samples_keep + n_samples_len - n_samples_new));
+            if (!audio.valid(span)) {
+                fprintf(stderr, "\n\n%s: WARNING: the audio was overwritten before it was processed\n\n", __func__);
+            }
 
-            //printf("processing: take = %d, new = %d, old = %d\n", n_samples_take, n_samples_new, (int) pcmf32_old.size());
+            n_samples_buf += n_samples_new;
 
-            pcmf32.resize(n_samples_new + n_samples_take);
+            // the steps without speech are not decoded at the last level of --adaptive - without --local-agreement,
+            // whose buffer is only trimmed after a decode
+            if (params.adaptive && !params.local_agreement) {
+                pcmf32_new.assign(span.p0, span.p0 + span.n0);
+                pcmf32_new.insert(pcmf32_new.end(), span.p1, span.p1 + span.n1);
 
-            for (int i = 0; i < n_samples_take; i++) {
-                pcmf32[i] = pcmf32_old[pcmf32_old.size() - n_samples_take + i];
+                if (quality.skip(pcmf32_new.data(), pcmf32_new.size())) {
+                    continue;
+                }
             }
 
-            memcpy(pcmf32.data() + n_samples_take, pcmf32_new.data(), n_samples_new*sizeof(float));
+            n_samples_step_cur = n_samples_new;
+        } else if (vctx) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
-            pcmf32_old = pcmf32;
+            const audio_async::span span = audio.get_span(params.length_ms);
+
+            // the audio that was overwritten before it went to the VAD is skipped
+            if (span.pos > n_vad_pos) {
+                n_vad_offset += span.pos - n_vad_pos;
+                n_vad_pos     = span.pos;
+            }
+
+            copy_span(span, n_vad_pos, span.pos + span.size(), pcmf32_new);
+            if (pcmf32_new.empty()) {
+                continue;
+            }
+
+            n_vad_pos += pcmf32_new.size();
+
+            if (!whisper_vad_push(vctx, vad_params, pcmf32_new.data(), pcmf32_new.size())) {
+                fprintf(stderr, "%s: failed to detect speech\n", argv[0]);
+                return 6;
+            }
+
+            int64_t n_vad_end = -1;
+
+            const whisper_vad_event * events = whisper_vad_events(vctx);
+            for (int i = 0; i < whisper_vad_n_events(vctx); ++i) {
+                if (events[i].speech) {
+                    n_vad_beg = n_vad_offset + events[i].sample;
+                } else {
+                    n_vad_end = n_vad_offset + events[i].sample;
+                }
+            }
+
+            if (n_vad_end < 0) {
+                continue;
+            }
+
+            // transcribe the utterance
+            copy_span(audio.get_span(params.length_ms), n_vad_beg, n_vad_end, pcmf32);
+            if (pcmf32.empty()) {
+                continue;
+            }
+
+            n_samples_step_cur = pcmf32.size();
+
+            t_last = std::chrono::high_resolution_clock::now();
         } else {
             const auto t_now  = std::chrono::high_resolution_clock::now();
             const auto t_diff = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last).count();
@@ -310,6 +816,8 @@ int main(int argc, char ** argv) {
 
             if (::vad_simple(pcmf32_new, WHISPER_SAMPLE_RATE, 1000, params.vad_thold, params.freq_thold, false)) {
                 audio.get(params.length_ms, pcmf32);
+
+                n_samples_step_cur = pcmf32.size();
             } else {
                 std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
@@ -321,35 +829,120 @@ int main(int argc, char ** argv) {
 
         // run the inference
         {
-            whisper_full_params wparams = whisper_full_default_params(params.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
-
-            wparams.print_progress   = false;
-            wparams.print_special    = params.print_special;
-            wparams.print_realtime   = false;
-            wparams.print_timestamps = !params.no_timestamps;
-            wparams.translate        = params.translate;
-            wparams.single_segment   = !use_vad;
-            wparams.max_tokens       = params.max_tokens;
-            wparams.language         = params.language.c_str();
-            wparams.n_threads        = params.n_threads;
-            wparams.beam_search.beam_size = params.beam_size;
+            const auto t_proc_start = std::chrono::high_resolution_clock::now();
 
-            wparams.audio_ctx        = params.audio_ctx;
+            whisper_full_params wparams = stream_full_params(params, use_vad);
 
-            wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
-
-            // disable temperature fallback
-            //wparams.temperature_inc  = -1.0f;
-            wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
+            if (params.adaptive) {
+                quality.apply(wparams);
+            }
 
             wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
             wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
 
-            if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
+            if (params.local_agreement) {
+                // the timestamps of the tokens tell how much audio the committed text covers
+                wparams.token_timestamps = true;
+
+                wparams.prompt_tokens    = prompt_tokens.data();
+                wparams.prompt_n_tokens  = prompt_tokens.size();
+            }
+
+            // in sliding window mode the spectrogram has already been computed by whisper_pcm_append()
+            const int n_samples_full = use_vad ? (int) pcmf32.size() : 0;
+
+            if (whisper_full(ctx, wparams, pcmf32.data(), n_samples_full) != 0) {
                 fprintf(stderr, "%s: failed to process audio\n", argv[0]);
                 return 6;
             }
 
+            if (params.adaptive) {
+                const double t_proc_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_proc_start).count();
+                if (quality.update(t_proc_ms, 1e3*n_samples_step_cur/WHISPER_SAMPLE_RATE)) {
+                    quality.print(nullptr);
+                }
+            }
+
+            if (params.local_agreement) {
+                const whisper_token token_eot = whisper_token_eot(ctx);
+
+                // the text tokens of the new hypothesis, with timestamps relative to the start of the buffer
+                std::vector<whisper_token_data> hyp;
+
+                const int n_segments = whisper_full_n_segments(ctx);
+                for (int i = 0; i < n_segments; ++i) {
+                    const int n_tokens = whisper_full_n_tokens(ctx, i);
+                    for (int j = 0; j < n_tokens; ++j) {
+                        const whisper_token_data token = whisper_full_get_token_data(ctx, i, j);
+                        if (token.id < token_eot) {
+                            hyp.push_back(token);
+                        }
+                    }
+                }
+
+                // commit the prefix on which this hypothesis and the previous one agree - all of it once the
+                // uncommitted audio reaches --length, so that the buffer stays bounded
+                const bool is_full = n_samples_buf >= n_samples_len;
+
+                size_t n_commit = 0;
+                if (is_full) {
+                    n_commit = hyp.size();
+                } else {
+                    while (n_commit < hyp.size() && n_commit < hyp_prev.size() && hyp[n_commit].id == hyp_prev[n_commit].id) {
+                        n_commit++;
+                    }
+                }
+
+                std::string text;
+                for (size_t i = 0; i < n_commit; ++i) {
+                    text += whisper_token_to_str(ctx, hyp[i].id);
+                    prompt_tokens.push_back(hyp[i].id);
+                }
+
+                // the prompt is limited to the last n_text_ctx/2 tokens by whisper_full() anyway
+                const size_t n_prompt_max = whisper_n_text_ctx(ctx)/2;
+                if (prompt_tokens.size() > n_prompt_max) {
+                    prompt_tokens.erase(prompt_tokens.begin(), prompt_tokens.end() - n_prompt_max);
+                }
+
+                // drop the audio of the committed tokens
+                if (is_full) {
+                    n_samples_buf = std::min(n_samples_buf, n_samples_keep);
+                } else if (n_commit > 0) {
+                    const int n_samples_commit = (int) (hyp[n_commit - 1].t1*WHISPER_SAMPLE_RATE/100);
+                    n_samples_buf = std::max(0, n_samples_buf - std::max(0, n_samples_commit));
+                }
+                if (whisper_pcm_append_trim(ctx, n_samples_buf) != 0) {
+                    fprintf(stderr, "%s: failed to trim the audio buffer\n", argv[0]);
+                    return 6;
+                }
+
+                hyp_prev.assign(hyp.begin() + n_commit, hyp.end());
+
+                std::string tail;
+                for (const auto & token : hyp_prev) {
+                    tail += whisper_token_to_str(ctx, token.id);
+                }
+
+                line += text;
+
+                if (params.fname_out.length() > 0) {
+                    fout << text;
+                }
+
+                // the committed text stays, the tail is printed again at the next step
+                printf("\33[2K\r%s%s", line.c_str(), tail.c_str());
+                if (line.size() >= 80) {
+                    printf("\33[2K\r%s\n%s", line.c_str(), tail.c_str());
+                    line.clear();
+                }
+                fflush(stdout);
+
+                ++n_iter;
+
+                continue;
+            }
+
             // print result;
             {
                 if (!use_vad) {
@@ -416,7 +1009,7 @@ int main(int argc, char ** argv) {
                 printf("\n");
 
                 // keep part of the audio for next iteration to try to mitigate word boundary issues
-                pcmf32_old = std::vector<float>(pcmf32.end() - n_samples_keep, pcmf32.end());
+                whisper_pcm_append_trim(ctx, n_samples_keep);
 
                 // Add tokens of the last full length segment as the prompt
                 if (!params.no_context) {
@@ -437,6 +1030,10 @@ int main(int argc, char ** argv) {
 
     audio.pause();
 
+    if (vctx) {
+        whisper_vad_free(vctx);
+    }
+
     whisper_print_timings(ctx);
     whisper_free(ctx);
 
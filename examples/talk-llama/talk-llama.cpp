@@ -8,9 +8,10 @@
 #include "llama.h"
 
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <fstream>
-#include <regex>
+#include <mutex>
 #include <regex>
 #include <sstream>
 #include <string>
@@ -71,6 +72,7 @@ struct whisper_params {
     bool verbose_prompt = false;
     bool use_gpu        = true;
     bool flash_attn     = false;
+    bool pipeline       = true;
 
     std::string person      = "Georgi";
     std::string bot_name    = "LLaMA";
@@ -110,6 +112,7 @@ static bool whisper_params_parse(int argc, char ** argv, whisper_params & params
         else if (arg == "-vp"  || arg == "--verbose-prompt") { params.verbose_prompt = true; }
         else if (arg == "-ng"  || arg == "--no-gpu")         { params.use_gpu        = false; }
         else if (arg == "-fa"  || arg == "--flash-attn")     { params.flash_attn     = true; }
+        else if (arg == "-npl" || arg == "--no-pipeline")    { params.pipeline       = false; }
         else if (arg == "-p"   || arg == "--person")         { params.person         = argv[++i]; }
         else if (arg == "-bn"   || arg == "--bot-name")      { params.bot_name       = argv[++i]; }
         else if (arg == "--session")                         { params.path_session   = argv[++i]; }
@@ -158,6 +161,7 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "  -vp,      --verbose-prompt [%-7s] print prompt at start\n",                       params.verbose_prompt ? "true" : "false");
     fprintf(stderr, "  -ng,      --no-gpu         [%-7s] disable GPU\n",                                 params.use_gpu ? "false" : "true");
     fprintf(stderr, "  -fa,      --flash-attn     [%-7s] flash attention\n",                             params.flash_attn ? "true" : "false");
+    fprintf(stderr, "  -npl,     --no-pipeline    [%-7s] evaluate the heard text only after the transcription\n", params.pipeline ? "false" : "true");
     fprintf(stderr, "  -p NAME,  --person NAME    [%-7s] person name (for prompt selection)\n",          params.person.c_str());
     fprintf(stderr, "  -bn NAME, --bot-name NAME  [%-7s] bot name (to display)\n",                       params.bot_name.c_str());
     fprintf(stderr, "  -w TEXT,  --wake-command T [%-7s] wake-up command to listen for\n",               params.wake_cmd.c_str());
@@ -173,13 +177,225 @@ void whisper_print_usage(int /*argc*/, char ** argv, const whisper_params & para
     fprintf(stderr, "\n");
 }
 
+// the text of the transcription that is passed to LLaMA
+static std::string filter_heard(std::string text) {
+    // remove text between brackets using regex
+    {
+        std::regex re("\\[.*?\\]");
+        text = std::regex_replace(text, re, "");
+    }
+
+    // remove text between brackets using regex
+    {
+        std::regex re("\\(.*?\\)");
+        text = std::regex_replace(text, re, "");
+    }
+
+    // remove all characters, except for letters, numbers, punctuation and ':', '\'', '-', ' '
+    text = std::regex_replace(text, std::regex("[^a-zA-Z0-9\\.,\\?!\\s\\:\\'\\-]"), "");
+
+    // take first line
+    text = text.substr(0, text.find_first_of('\n'));
+
+    // remove leading and trailing whitespace
+    text = std::regex_replace(text, std::regex("^\\s+"), "");
+    text = std::regex_replace(text, std::regex("\\s+$"), "");
+
+    return text;
+}
+
+// evaluates the words of the transcription in the LLaMA context in a worker thread while whisper is still decoding,
+// so that only the last words and the bot prefix are left to evaluate when the transcription is done
+// the tokens are evaluated at n_past and are matched with the final tokens in finish() - the mismatching ones (e.g.
+// after a temperature fallback of whisper) are removed from the KV cache
+struct llama_pipeline {
+    llama_context * ctx   = nullptr;
+    llama_batch   * batch = nullptr;
+
+    int n_past = 0;
+    int n_max  = 0; // max number of tokens to evaluate
+
+    std::vector<llama_token> evaluated;
+
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    std::string text;
+    bool        has_text = false;
+    bool        stop     = false;
+    bool        failed   = false;
+
+    std::thread worker;
+
+    ~llama_pipeline() {
+        finish({});
+    }
+
+    void start(llama_context * ctx, llama_batch * batch, int n_past, int n_max) {
+        this->ctx    = ctx;
+        this->batch  = batch;
+        this->n_past = n_past;
+        this->n_max  = n_max;
+
+        evaluated.clear();
+
+        has_text = false;
+        stop     = false;
+        failed   = false;
+
+        worker = std::thread([this]() { run(); });
+    }
+
+    // called with the filtered text of the complete words heard so far
+    void push(const std::string & text_new) {
+        std::lock_guard<std::mutex> lock(mutex);
+        text     = text_new;
+        has_text = true;
+        cv.notify_one();
+    }
+
+    void run() {
+        while (true) {
+            std::string text_cur;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return has_text || stop; });
+                if (stop) {
+                    return;
+                }
+                text_cur = text;
+                has_text = false;
+            }
+
+            // the last token can still merge with the next word
+            std::vector<llama_token> tokens = ::llama_tokenize(ctx, " " + text_cur, false);
+            if (tokens.size() <= 1) {
+                continue;
+            }
+            tokens.pop_back();
+
+            if ((int) tokens.size() > n_max) {
+                continue;
+            }
+
+            const int n_match = drop_mismatch(tokens);
+
+            if (n_match == (int) tokens.size()) {
+                continue;
+            }
+
+            batch->n_tokens = tokens.size() - n_match;
+
+            for (int i = 0; i < batch->n_tokens; i++) {
+                batch->token[i]     = tokens[n_match + i];
+                batch->pos[i]       = n_past + n_match + i;
+                batch->n_seq_id[i]  = 1;
+                batch->seq_id[i][0] = 0;
+                batch->logits[i]    = false;
+            }
+
+            if (llama_decode(ctx, *batch)) {
+                drop_mismatch({});
+                failed = true;
+                return;
+            }
+
+            evaluated = std::move(tokens);
+        }
+    }
+
+    // keep the common prefix of the evaluated tokens and tokens in the KV cache, returns its length
+    int drop_mismatch(const std::vector<llama_token> & tokens) {
+        size_t n_match = 0;
+        while (n_match < evaluated.size() && n_match < tokens.size() && evaluated[n_match] == tokens[n_match]) {
+            n_match++;
+        }
+
+        if (n_match < evaluated.size()) {
+            llama_kv_self_seq_rm(ctx, 0, n_past + n_match, -1);
+            evaluated.resize(n_match);
+        }
+
+        return n_match;
+    }
+
+    // stop the worker and return the number of the leading tokens that are already evaluated at n_past
+    int finish(const std::vector<llama_token> & tokens) {
+        if (!worker.joinable()) {
+            return 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+            cv.notify_one();
+        }
+
+        worker.join();
+
+        if (failed) {
+            return 0;
+        }
+
+        int n_match = drop_mismatch(tokens);
+
+        // the logits of the last token are always computed by the caller
+        if (n_match > 0 && n_match == (int) tokens.size()) {
+            n_match--;
+            drop_mismatch({ tokens.begin(), tokens.begin() + n_match });
+        }
+
+        return n_match;
+    }
+};
+
+struct transcribe_pipeline_data {
+    llama_pipeline * pipeline;
+    size_t           n_len; // length of the pushed text
+};
+
+// observes the tokens of the decoder and pushes the complete words to the pipeline
+static void transcribe_pipeline_cb(
+        struct whisper_context * ctx,
+          struct whisper_state * /*state*/,
+      const whisper_token_data * tokens,
+                           int   n_tokens,
+                         float * /*logits*/,
+                          void * user_data) {
+    auto * data = (transcribe_pipeline_data *) user_data;
+
+    std::string text;
+    std::string text_done;
+    for (int i = 0; i < n_tokens; ++i) {
+        if (tokens[i].id >= whisper_token_eot(ctx)) {
+            continue;
+        }
+
+        const char * piece = whisper_token_to_str(ctx, tokens[i].id);
+
+        // a word is complete once the next one has started
+        if (piece[0] == ' ') {
+            text_done = text;
+        }
+
+        text += piece;
+    }
+
+    if (text_done.size() > data->n_len) {
+        data->n_len = text_done.size();
+        data->pipeline->push(filter_heard(text_done));
+    }
+}
+
 static std::string transcribe(
         whisper_context * ctx,
         const whisper_params & params,
         const std::vector<float> & pcmf32,
         const std::string prompt_text,
         float & prob,
-        int64_t & t_ms) {
+        int64_t & t_ms,
+        ggml_threadpool * threadpool,
+        llama_pipeline * pipeline) {
     const auto t_start = std::chrono::high_resolution_clock::now();
 
     prob = 0.0f;
@@ -208,6 +424,15 @@ static std::string transcribe(
 
     wparams.audio_ctx        = params.audio_ctx;
 
+    wparams.threadpool       = threadpool;
+
+    transcribe_pipeline_data pipeline_data = { pipeline, 0 };
+
+    if (pipeline) {
+        wparams.logits_filter_callback           = transcribe_pipeline_cb;
+        wparams.logits_filter_callback_user_data = &pipeline_data;
+    }
+
     if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
         return "";
     }
@@ -285,12 +510,18 @@ int main(int argc, char ** argv) {
         exit(0);
     }
 
+    // whisper and LLaMA run on the same GPU device - whisper computes on the backend of this program, and its
+    // compute buffers are freed after each transcription for the compute buffers of LLaMA (see below)
+    ggml_backend_dev_t dev_gpu     = params.use_gpu ? ggml_backend_dev_by_type(GGML_BACKEND_DEVICE_TYPE_GPU) : nullptr;
+    ggml_backend_t     backend_gpu = dev_gpu ? ggml_backend_dev_init(dev_gpu, nullptr) : nullptr;
+
     // whisper init
 
     struct whisper_context_params cparams = whisper_context_default_params();
 
     cparams.use_gpu    = params.use_gpu;
     cparams.flash_attn = params.flash_attn;
+    cparams.backend    = backend_gpu;
 
     struct whisper_context * ctx_wsp = whisper_init_from_file_with_params(params.model_wsp.c_str(), cparams);
     if (!ctx_wsp) {
@@ -309,6 +540,11 @@ int main(int argc, char ** argv) {
         lmparams.n_gpu_layers = params.n_gpu_layers;
     }
 
+    ggml_backend_dev_t devs_llama[] = { dev_gpu, nullptr };
+    if (dev_gpu) {
+        lmparams.devices = devs_llama;
+    }
+
     struct llama_model * model_llama = llama_model_load_from_file(params.model_llama.c_str(), lmparams);
     if (!model_llama) {
         fprintf(stderr, "No llama.cpp model specified. Please provide using -ml <modelfile>\n");
@@ -326,6 +562,15 @@ int main(int argc, char ** argv) {
 
     struct llama_context * ctx_llama = llama_init_from_model(model_llama, lcparams);
 
+    // the CPU threads are shared by whisper and LLaMA, which take turns - except for the words evaluated by the
+    // pipeline during the transcription, which use threads of their own
+    ggml_threadpool_params tpp = ggml_threadpool_params_default(params.n_threads);
+
+    ggml_threadpool * threadpool = whisper_threadpool_new(&tpp);
+    if (threadpool) {
+        llama_attach_threadpool(ctx_llama, threadpool, threadpool);
+    }
+
     // print some info about the processing
     {
         fprintf(stderr, "\n");
@@ -546,6 +791,11 @@ int main(int argc, char ** argv) {
         params.person + chat_symb,
     };
 
+    // the words before the wake-up command and the session tokens are not known during the transcription
+    const bool use_pipeline = params.pipeline && !use_wake_cmd && path_session.empty();
+
+    llama_pipeline pipeline;
+
     // main loop
     while (is_running) {
         // handle Ctrl + C
@@ -570,8 +820,20 @@ int main(int argc, char ** argv) {
 
                 std::string all_heard;
 
+                // the pipeline evaluates the heard words after the current dialog
+                const bool use_pipeline_cur = use_pipeline && !force_speak && n_past + 4 < n_ctx;
+
+                if (use_pipeline_cur) {
+                    llama_detach_threadpool(ctx_llama);
+                    pipeline.start(ctx_llama, &batch, n_past, n_ctx - n_past - 4);
+                }
+
                 if (!force_speak) {
-                    all_heard = ::trim(::transcribe(ctx_wsp, params, pcmf32_cur, prompt_whisper, prob0, t_ms));
+                    all_heard = ::trim(::transcribe(ctx_wsp, params, pcmf32_cur, prompt_whisper, prob0, t_ms, threadpool, use_pipeline_cur ? &pipeline : nullptr));
+
+                    if (backend_gpu) {
+                        whisper_state_release_compute(ctx_wsp, nullptr);
+                    }
                 }
 
                 const auto words = get_words(all_heard);
@@ -602,27 +864,7 @@ int main(int argc, char ** argv) {
                     speak_with_file(params.speak, params.heard_ok, params.speak_file, voice_id);
                 }
 
-                // remove text between brackets using regex
-                {
-                    std::regex re("\\[.*?\\]");
-                    text_heard = std::regex_replace(text_heard, re, "");
-                }
-
-                // remove text between brackets using regex
-                {
-                    std::regex re("\\(.*?\\)");
-                    text_heard = std::regex_replace(text_heard, re, "");
-                }
-
-                // remove all characters, except for letters, numbers, punctuation and ':', '\'', '-', ' '
-                text_heard = std::regex_replace(text_heard, std::regex("[^a-zA-Z0-9\\.,\\?!\\s\\:\\'\\-]"), "");
-
-                // take first line
-                text_heard = text_heard.substr(0, text_heard.find_first_of('\n'));
-
-                // remove leading and trailing whitespace
-                text_heard = std::regex_replace(text_heard, std::regex("^\\s+"), "");
-                text_heard = std::regex_replace(text_heard, std::regex("\\s+$"), "");
+                text_heard = filter_heard(text_heard);
 
                 const std::vector<llama_token> tokens = llama_tokenize(ctx_llama, text_heard.c_str(), false);
 
@@ -630,6 +872,12 @@ int main(int argc, char ** argv) {
                     //fprintf(stdout, "%s: Heard nothing, skipping ...\n", __func__);
                     audio.clear();
 
+                    // drop the words evaluated by the pipeline
+                    if (use_pipeline_cur) {
+                        pipeline.finish({});
+                        llama_attach_threadpool(ctx_llama, threadpool, threadpool);
+                    }
+
                     continue;
                 }
 
@@ -642,6 +890,18 @@ int main(int argc, char ** argv) {
 
                 embd = ::llama_tokenize(ctx_llama, text_heard, false);
 
+                // skip the leading tokens evaluated by the pipeline during the transcription
+                if (use_pipeline_cur) {
+                    const int n_done = pipeline.finish(embd);
+
+                    llama_attach_threadpool(ctx_llama, threadpool, threadpool);
+
+                    embd_inp.insert(embd_inp.end(), embd.begin(), embd.begin() + n_done);
+                    n_past += n_done;
+
+                    embd.erase(embd.begin(), embd.begin() + n_done);
+                }
+
                 // Append the new input tokens to the session_tokens vector
                 if (!path_session.empty()) {
                     session_tokens.insert(session_tokens.end(), tokens.begin(), tokens.end());
@@ -782,6 +1042,10 @@ int main(int argc, char ** argv) {
     whisper_print_timings(ctx_wsp);
     whisper_free(ctx_wsp);
 
+    if (backend_gpu) {
+        ggml_backend_free(backend_gpu);
+    }
+
     llama_perf_sampler_print(smpl);
     llama_perf_context_print(ctx_llama);
 
@@ -789,6 +1053,10 @@ int main(int argc, char ** argv) {
     llama_batch_free(batch);
     llama_free(ctx_llama);
 
+    if (threadpool) {
+        whisper_threadpool_free(threadpool);
+    }
+
     llama_backend_free();
 
     return 0;
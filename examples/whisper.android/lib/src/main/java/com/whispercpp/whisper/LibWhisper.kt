@@ -35,6 +35,18 @@ class WhisperContext private constructor(private var ptr: Long) {
         }
     }
 
+    // Streaming transcription: the state of the stream is kept until it is released (release it before the context)
+    suspend fun createStream(stepMs: Int = 3000): WhisperStream = withContext(scope.coroutineContext) {
+        require(ptr != 0L)
+        val numThreads = WhisperCpuConfig.preferredThreadCount
+        Log.d(LOG_TAG, "Selecting $numThreads threads for the stream")
+        val streamPtr = WhisperLib.initStream(ptr, numThreads, stepMs)
+        if (streamPtr == 0L) {
+            throw java.lang.RuntimeException("Couldn't create stream")
+        }
+        return@withContext WhisperStream(streamPtr, scope)
+    }
+
     suspend fun benchMemory(nthreads: Int): String = withContext(scope.coroutineContext) {
         return@withContext WhisperLib.benchMemcpy(nthreads)
     }
@@ -89,6 +101,37 @@ class WhisperContext private constructor(private var ptr: Long) {
     }
 }
 
+// Timestamps are in units of 10 ms from the start of the utterance
+fun interface WhisperSegmentCallback {
+    fun onNewSegment(text: String, t0: Long, t1: Long)
+}
+
+class WhisperStream internal constructor(private var ptr: Long, private val scope: CoroutineScope) {
+    // Push 16 kHz mono PCM - the window is transcribed again every stepMs of new audio, and the segments are
+    // passed to onSegment once they are final
+    suspend fun push(data: FloatArray, onSegment: WhisperSegmentCallback) = withContext(scope.coroutineContext) {
+        require(ptr != 0L)
+        if (WhisperLib.streamPush(ptr, data, onSegment) != 0) {
+            Log.w(LOG_TAG, "Failed to transcribe the stream")
+        }
+    }
+
+    // End of the utterance: the remaining segments are passed to onSegment, and the stream is ready for the next one
+    suspend fun finish(onSegment: WhisperSegmentCallback) = withContext(scope.coroutineContext) {
+        require(ptr != 0L)
+        if (WhisperLib.streamFinish(ptr, onSegment) != 0) {
+            Log.w(LOG_TAG, "Failed to transcribe the stream")
+        }
+    }
+
+    suspend fun release() = withContext(scope.coroutineContext) {
+        if (ptr != 0L) {
+            WhisperLib.freeStream(ptr)
+            ptr = 0
+        }
+    }
+}
+
 private class WhisperLib {
     companion object {
         init {
@@ -135,6 +178,10 @@ private class WhisperLib {
         external fun initContext(modelPath: String): Long
         external fun freeContext(contextPtr: Long)
         external fun fullTranscribe(contextPtr: Long, numThreads: Int, audioData: FloatArray)
+        external fun initStream(contextPtr: Long, numThreads: Int, stepMs: Int): Long
+        external fun streamPush(streamPtr: Long, audioData: FloatArray, callback: WhisperSegmentCallback): Int
+        external fun streamFinish(streamPtr: Long, callback: WhisperSegmentCallback): Int
+        external fun freeStream(streamPtr: Long)
         external fun getTextSegmentCount(contextPtr: Long): Int
         external fun getTextSegment(contextPtr: Long, index: Int): String
         external fun getTextSegmentT0(contextPtr: Long, index: Int): Long
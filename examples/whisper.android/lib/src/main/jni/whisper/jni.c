@@ -193,6 +193,215 @@ Java_com_whispercpp_whisper_WhisperLib_00024Companion_fullTranscribe(
     (*env)->ReleaseFloatArrayElements(env, audio_data, audio_data_arr, JNI_ABORT);
 }
 
+// streaming: the audio is pushed in chunks and the window of the audio that is not committed yet (at most 30 s)
+// is transcribed again every step_ms of new audio with the same whisper_state, which is kept for the whole stream
+// the segments are committed (passed to the callback and their audio dropped from the window) once they are
+// followed by another segment, or when the window is full or the stream is finished
+
+#define STREAM_WINDOW_SAMPLES (30*WHISPER_SAMPLE_RATE)
+#define STREAM_PROMPT_SIZE    512
+
+struct stream_context {
+    struct whisper_context * ctx;
+    struct whisper_state   * state;
+    struct ggml_threadpool * threadpool; // pinned to the big cores, NULL if they are not known
+
+    int n_threads;
+    int n_step;
+
+    float * pcm;     // the window
+    int     n_pcm;
+    int     n_new;   // samples pushed since the last transcription
+    int64_t n_past;  // samples dropped from the window since the start of the stream
+
+    char prompt[STREAM_PROMPT_SIZE]; // the end of the committed text, prompt of the next transcription
+};
+
+static void stream_prompt_append(struct stream_context * sc, const char * text) {
+    const size_t n_prompt = strlen(sc->prompt);
+    const size_t n_text   = strlen(text);
+
+    if (n_text >= STREAM_PROMPT_SIZE - 1) {
+        strcpy(sc->prompt, text + n_text - (STREAM_PROMPT_SIZE - 1));
+        return;
+    }
+
+    // drop the start of the prompt to make room for the text
+    const size_t n_drop = n_prompt + n_text >= STREAM_PROMPT_SIZE ? n_prompt + n_text - (STREAM_PROMPT_SIZE - 1) : 0;
+
+    memmove(sc->prompt, sc->prompt + n_drop, n_prompt - n_drop);
+    memcpy(sc->prompt + n_prompt - n_drop, text, n_text + 1);
+}
+
+static int stream_transcribe(JNIEnv * env, struct stream_context * sc, jobject callback, bool flush) {
+    sc->n_new = 0;
+
+    if (sc->n_pcm == 0) {
+        return 0;
+    }
+
+    struct whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    params.print_realtime = false;
+    params.print_progress = false;
+    params.print_timestamps = false;
+    params.print_special = false;
+    params.translate = false;
+    params.language = "en";
+    params.n_threads = sc->n_threads;
+    params.threadpool = sc->threadpool;
+    params.no_context = true;
+    params.single_segment = false;
+    params.initial_prompt = sc->prompt[0] ? sc->prompt : NULL;
+
+    if (whisper_full_with_state(sc->ctx, sc->state, params, sc->pcm, sc->n_pcm) != 0) {
+        LOGW("Failed to run the model");
+        return -1;
+    }
+
+    const bool commit_all = flush || sc->n_pcm >= STREAM_WINDOW_SAMPLES;
+
+    const int n_segments = whisper_full_n_segments_from_state(sc->state);
+    const int n_commit   = commit_all ? n_segments : n_segments - 1;
+
+    jclass cls = (*env)->GetObjectClass(env, callback);
+    jmethodID mid_segment = (*env)->GetMethodID(env, cls, "onNewSegment", "(Ljava/lang/String;JJ)V");
+
+    // segment timestamps are in units of 10 ms
+    const int64_t t_past = sc->n_past*100/WHISPER_SAMPLE_RATE;
+
+    int64_t t_commit = 0;
+
+    for (int i = 0; i < n_commit; ++i) {
+        const char * text = whisper_full_get_segment_text_from_state(sc->state, i);
+
+        const int64_t t0 = whisper_full_get_segment_t0_from_state(sc->state, i);
+        const int64_t t1 = whisper_full_get_segment_t1_from_state(sc->state, i);
+
+        jstring string = (*env)->NewStringUTF(env, text);
+        (*env)->CallVoidMethod(env, callback, mid_segment, string, (jlong) (t_past + t0), (jlong) (t_past + t1));
+        (*env)->DeleteLocalRef(env, string);
+
+        stream_prompt_append(sc, text);
+
+        t_commit = t1;
+    }
+
+    (*env)->DeleteLocalRef(env, cls);
+
+    const int n_drop = commit_all ? sc->n_pcm : min((int) (t_commit*WHISPER_SAMPLE_RATE/100), sc->n_pcm);
+
+    memmove(sc->pcm, sc->pcm + n_drop, (sc->n_pcm - n_drop)*sizeof(float));
+
+    sc->n_pcm  -= n_drop;
+    sc->n_past += n_drop;
+
+    return 0;
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_whispercpp_whisper_WhisperLib_00024Companion_initStream(
+        JNIEnv *env, jobject thiz, jlong context_ptr, jint num_threads, jint step_ms) {
+    UNUSED(env);
+    UNUSED(thiz);
+    struct whisper_context *context = (struct whisper_context *) context_ptr;
+
+    struct stream_context * sc = calloc(1, sizeof(struct stream_context));
+
+    sc->ctx   = context;
+    sc->state = whisper_init_state(context);
+    sc->pcm   = malloc(STREAM_WINDOW_SAMPLES*sizeof(float));
+
+    if (sc->state == NULL || sc->pcm == NULL) {
+        LOGW("Failed to initialize the stream");
+        if (sc->state) {
+            whisper_free_state(sc->state);
+        }
+        free(sc->pcm);
+        free(sc);
+        return 0;
+    }
+
+    sc->n_threads = num_threads;
+    sc->n_step    = max(1, step_ms)*(WHISPER_SAMPLE_RATE/1000);
+
+    // on big.LITTLE, keep the threads on the big cores - a graph is only as fast as its slowest thread
+    struct ggml_threadpool_params tpp = ggml_threadpool_params_default(num_threads);
+
+    const int n_perf = whisper_cpu_perf_cores(tpp.cpumask);
+    if (n_perf > 0) {
+        tpp.n_threads  = min(num_threads, n_perf);
+        tpp.strict_cpu = true;
+
+        sc->threadpool = whisper_threadpool_new(&tpp);
+        LOGI("Stream threads pinned to %d big cores", tpp.n_threads);
+    }
+
+    // the first transcription does not pay for the allocation of the compute buffers
+    whisper_warmup_with_state(context, sc->state, num_threads);
+
+    return (jlong) sc;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_whispercpp_whisper_WhisperLib_00024Companion_streamPush(
+        JNIEnv *env, jobject thiz, jlong stream_ptr, jfloatArray audio_data, jobject callback) {
+    UNUSED(thiz);
+    struct stream_context *sc = (struct stream_context *) stream_ptr;
+    jfloat *audio_data_arr = (*env)->GetFloatArrayElements(env, audio_data, NULL);
+    const jsize audio_data_length = (*env)->GetArrayLength(env, audio_data);
+
+    int ret = 0;
+
+    for (jsize i = 0; i < audio_data_length && ret == 0;) {
+        const int n = min(audio_data_length - i, STREAM_WINDOW_SAMPLES - sc->n_pcm);
+
+        memcpy(sc->pcm + sc->n_pcm, audio_data_arr + i, n*sizeof(float));
+
+        sc->n_pcm += n;
+        sc->n_new += n;
+        i += n;
+
+        if (sc->n_new >= sc->n_step || sc->n_pcm >= STREAM_WINDOW_SAMPLES) {
+            ret = stream_transcribe(env, sc, callback, false);
+        }
+    }
+
+    (*env)->ReleaseFloatArrayElements(env, audio_data, audio_data_arr, JNI_ABORT);
+
+    return ret;
+}
+
+JNIEXPORT jint JNICALL
+Java_com_whispercpp_whisper_WhisperLib_00024Companion_streamFinish(
+        JNIEnv *env, jobject thiz, jlong stream_ptr, jobject callback) {
+    UNUSED(thiz);
+    struct stream_context *sc = (struct stream_context *) stream_ptr;
+
+    const int ret = stream_transcribe(env, sc, callback, true);
+
+    // the next utterance starts from a clean window, with the same state
+    sc->n_pcm  = 0;
+    sc->n_past = 0;
+    sc->prompt[0] = '\0';
+
+    return ret;
+}
+
+JNIEXPORT void JNICALL
+Java_com_whispercpp_whisper_WhisperLib_00024Companion_freeStream(
+        JNIEnv *env, jobject thiz, jlong stream_ptr) {
+    UNUSED(env);
+    UNUSED(thiz);
+    struct stream_context *sc = (struct stream_context *) stream_ptr;
+
+    whisper_free_state(sc->state);
+    if (sc->threadpool) {
+        whisper_threadpool_free(sc->threadpool);
+    }
+    free(sc->pcm);
+    free(sc);
+}
+
 JNIEXPORT jint JNICALL
 Java_com_whispercpp_whisper_WhisperLib_00024Companion_getTextSegmentCount(
         JNIEnv *env, jobject thiz, jlong context_ptr) {
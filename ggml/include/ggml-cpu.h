@@ -58,6 +58,10 @@ extern "C" {
     GGML_BACKEND_API void                          ggml_threadpool_pause         (struct ggml_threadpool * threadpool);
     GGML_BACKEND_API void                          ggml_threadpool_resume        (struct ggml_threadpool * threadpool);
 
+    // polling statistics of the worker threads since the threadpool was created: the time spent spinning for work,
+    // the number of times work was found while spinning and the number of times the threads went to sleep instead
+    GGML_BACKEND_API void ggml_threadpool_get_poll_stats(struct ggml_threadpool * threadpool, int64_t * t_spin_us, int64_t * n_spin, int64_t * n_sleep);
+
     // ggml_graph_plan() has to be called before ggml_graph_compute()
     // when plan.work_size > 0, caller must allocate memory for plan.work_data
     GGML_BACKEND_API struct ggml_cplan ggml_graph_plan(
@@ -518,6 +518,8 @@ extern "C" {
         GGML_OP_CROSS_ENTROPY_LOSS_BACK,
         GGML_OP_OPT_STEP_ADAMW,
 
+        GGML_OP_NORM_AFFINE, // normalize, then scale and shift (layer norm)
+
         GGML_OP_COUNT,
     };
 
@@ -1076,6 +1078,15 @@ extern "C" {
             struct ggml_tensor  * a,
             float                 eps);
 
+    // normalize along rows, then multiply by w and add b (vectors of a->ne[0] elements) in the same pass
+    // same result as ggml_add(ggml_mul(ggml_norm(a, eps), w), b)
+    GGML_API struct ggml_tensor * ggml_norm_affine(
+            struct ggml_context * ctx,
+            struct ggml_tensor  * a,
+            struct ggml_tensor  * w,
+            struct ggml_tensor  * b,
+            float                 eps);
+
     GGML_API struct ggml_tensor * ggml_rms_norm(
             struct ggml_context * ctx,
             struct ggml_tensor  * a,
@@ -2175,6 +2186,7 @@ extern "C" {
         int                 n_threads;                   // number of threads
         enum ggml_sched_priority prio;                   // thread priority
         uint32_t            poll;                        // polling level (0 - no polling, 100 - aggressive polling)
+        uint32_t            poll_us;                     // hybrid polling: spin for at most poll_us microseconds, then sleep (0 - use poll)
         bool                strict_cpu;                  // strict cpu placement
         bool                paused;                      // start in paused state
     };
@@ -396,6 +396,26 @@ void ggml_cann_norm(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
     ggml_cann_release_resources(ctx, norm, acl_src, acl_dst);
 }
 
+void ggml_cann_norm_affine(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
+    ggml_tensor* src = dst->src[0];
+    ggml_tensor* w = dst->src[1];
+    ggml_tensor* b = dst->src[2];
+
+    aclTensor* acl_src = ggml_cann_create_tensor(src);
+    aclTensor* acl_w = ggml_cann_create_tensor(w, w->ne, w->nb, 1);
+    aclTensor* acl_b = ggml_cann_create_tensor(b, b->ne, b->nb, 1);
+    aclTensor* acl_dst = ggml_cann_create_tensor(dst);
+
+    float eps;
+    memcpy(&eps, dst->op_params, sizeof(float));
+
+    std::vector<int64_t> normData = {dst->ne[0]};
+    aclIntArray* norm = aclCreateIntArray(normData.data(), normData.size());
+    GGML_CANN_CALL_ACLNN_OP(ctx, LayerNorm, acl_src, norm, acl_w, acl_b,
+                    eps, acl_dst, nullptr, nullptr);
+    ggml_cann_release_resources(ctx, norm, acl_src, acl_w, acl_b, acl_dst);
+}
+
 void ggml_cann_group_norm(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
     ggml_tensor* src = dst->src[0];
 
@@ -1523,8 +1543,10 @@ void ggml_cann_softmax(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
             for (int i = 1; i < GGML_MAX_DIMS; i++) {
                 tmp_mask_nb[i] = tmp_mask_nb[i - 1] * tmp_mask_ne[i - 1];
             }
+            // the FP16 mask has been cast to the FP32 buffer
+            void* mask_data = use_f16 ? src1_fp32_allocator.get() : src1->data;
             tmp_mask_tensor = ggml_cann_create_tensor(
-                src1->data, ACL_FLOAT, sizeof(float), tmp_mask_ne, tmp_mask_nb,
+                mask_data, ACL_FLOAT, sizeof(float), tmp_mask_ne, tmp_mask_nb,
                 GGML_MAX_DIMS, ACL_FORMAT_ND);
         }
 
@@ -1999,6 +2021,83 @@ void ggml_cann_mul_mat(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
     }
 }
 
+void ggml_cann_flash_attn_ext(ggml_backend_cann_context& ctx, ggml_tensor* dst) {
+    ggml_tensor* q = dst->src[0];
+    ggml_tensor* k = dst->src[1];
+    ggml_tensor* v = dst->src[2];
+    ggml_tensor* mask = dst->src[3];
+
+    const int64_t n_kv = k->ne[1];
+    const int64_t d_v = v->ne[0];
+
+    float scale;
+    float max_bias;
+    memcpy(&scale, (float*)dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias, (float*)dst->op_params + 1, sizeof(float));
+
+    // KQ = K^T * Q: [n_kv, n_q, n_head, ne3]
+    ggml_tensor kq;
+    memset(&kq, 0, sizeof(kq));
+    kq.type = GGML_TYPE_F32;
+    kq.ne[0] = n_kv;
+    kq.ne[1] = q->ne[1];
+    kq.ne[2] = q->ne[2];
+    kq.ne[3] = q->ne[3];
+    kq.nb[0] = sizeof(float);
+    for (int i = 1; i < GGML_MAX_DIMS; i++) {
+        kq.nb[i] = kq.nb[i - 1] * kq.ne[i - 1];
+    }
+    ggml_cann_pool_alloc kq_allocator(ctx.pool(), ggml_nbytes(&kq));
+    kq.data = kq_allocator.get();
+    kq.op = GGML_OP_MUL_MAT;
+    kq.src[0] = k;
+    kq.src[1] = q;
+    ggml_cann_mat_mul_fp(ctx, &kq);
+
+    // softmax(KQ*scale + mask), in place
+    ggml_tensor kq_soft_max = kq;
+    kq_soft_max.op = GGML_OP_SOFT_MAX;
+    kq_soft_max.src[0] = &kq;
+    kq_soft_max.src[1] = mask;
+    memcpy((float*)kq_soft_max.op_params + 0, &scale, sizeof(float));
+    memcpy((float*)kq_soft_max.op_params + 1, &max_bias, sizeof(float));
+    ggml_cann_softmax(ctx, &kq_soft_max);
+
+    // V^T: the rows of V are the columns of the weight of the product
+    ggml_tensor vt = *v;
+    vt.ne[0] = v->ne[1];
+    vt.ne[1] = v->ne[0];
+    vt.nb[0] = v->nb[1];
+    vt.nb[1] = v->nb[0];
+
+    // KQV = V^T * softmax(KQ): [d_v, n_q, n_head, ne3]
+    ggml_tensor kqv;
+    memset(&kqv, 0, sizeof(kqv));
+    kqv.type = GGML_TYPE_F32;
+    kqv.ne[0] = d_v;
+    kqv.ne[1] = q->ne[1];
+    kqv.ne[2] = q->ne[2];
+    kqv.ne[3] = q->ne[3];
+    kqv.nb[0] = sizeof(float);
+    for (int i = 1; i < GGML_MAX_DIMS; i++) {
+        kqv.nb[i] = kqv.nb[i - 1] * kqv.ne[i - 1];
+    }
+    ggml_cann_pool_alloc kqv_allocator(ctx.pool(), ggml_nbytes(&kqv));
+    kqv.data = kqv_allocator.get();
+    kqv.op = GGML_OP_MUL_MAT;
+    kqv.src[0] = &vt;
+    kqv.src[1] = &kq;
+    ggml_cann_mat_mul_fp(ctx, &kqv);
+
+    // dst is [d_v, n_head, n_q, ne3]
+    int64_t dst_ne[] = {d_v, q->ne[1], q->ne[2], q->ne[3]};
+    size_t dst_nb[] = {dst->nb[0], dst->nb[2], dst->nb[1], dst->nb[3]};
+    aclTensor* acl_kqv = ggml_cann_create_tensor(&kqv);
+    aclTensor* acl_dst = ggml_cann_create_tensor(dst, dst_ne, dst_nb, GGML_MAX_DIMS);
+    cann_copy(ctx, acl_kqv, acl_dst);
+    ggml_cann_release_resources(ctx, acl_kqv, acl_dst);
+}
+
 /**
  * @brief Rolls the elements of a tensor along a specified dimension.
  *
@@ -186,6 +186,23 @@ void ggml_cann_argsort(ggml_backend_cann_context& ctx, ggml_tensor* dst);
  */
 void ggml_cann_norm(ggml_backend_cann_context& ctx, ggml_tensor* dst);
 
+/**
+ * @brief   Computes the Layer Normalization with a scale and a shift for a
+ *          ggml tensor using the CANN backend.
+ *
+ * @details Same as ggml_cann_norm, with the weight (dst->src[1]) and the bias
+ *          (dst->src[2]) of dst->ne[0] elements applied by the same LayerNorm
+ *          call:
+ *          \f[
+ *              \text { out }=\frac{x-\mathrm{E}[x]}{\sqrt{\text{Var}[x]+eps}} * w + b
+ *          \f]
+ *
+ * @param ctx The CANN context used for operations.
+ * @param dst The destination tensor where the normalized values will be stored.
+ *            dst->op is `GGML_OP_NORM_AFFINE`.
+ */
+void ggml_cann_norm_affine(ggml_backend_cann_context& ctx, ggml_tensor* dst);
+
 /**
  * @brief  Computes the Group Normalization for a ggml tensor using the CANN
  *         backend.
@@ -418,6 +435,24 @@ void ggml_cann_cpy(ggml_backend_cann_context& ctx, ggml_tensor* dst);
  */
 void ggml_cann_softmax(ggml_backend_cann_context& ctx, ggml_tensor* dst);
 
+/**
+ * @brief   Computes the attention of the queries over the keys and values.
+ *
+ * @details The attention is composed of the existing operators:
+ *          1. KQ = K^T * Q, with the broadcast of the heads of K (GQA).
+ *          2. The softmax of KQ with the scale and the mask of the operator,
+ *             in place.
+ *          3. KQV = V^T * softmax(KQ).
+ *          4. KQV is copied to dst with the heads and the rows swapped.
+ *          KQ and KQV are kept in the memory pool of the context.
+ *
+ * @param ctx The backend CANN context for executing operations.
+ * @param dst The destination tensor where the result will be stored. dst->op is
+ *            `GGML_OP_FLASH_ATTN_EXT`.
+ * @attention The logit softcap is not supported.
+ */
+void ggml_cann_flash_attn_ext(ggml_backend_cann_context& ctx, ggml_tensor* dst);
+
 /**
  * @brief   Extracts specific rows from a tensor based on indices.
  *
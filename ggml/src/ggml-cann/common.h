@@ -44,6 +44,7 @@
 
 #define MATRIX_ROW_PADDING 512
 #define GGML_CANN_MAX_STREAMS 8
+#define GGML_CANN_MAX_GRAPHS 4
 
 /**
  * @brief Handles CANN-related errors by printing an error message and
@@ -333,6 +334,39 @@ private:
     int32_t device_;
 };
 
+#ifdef USE_ACL_GRAPH
+/**
+ * @brief What a node of a graph depends on when it is replayed: the addresses
+ *        of its tensors, its shape and its parameters.
+ */
+struct ggml_cann_graph_node_properties {
+    void* node_address;
+    ggml_op node_op;
+    int64_t ne[GGML_MAX_DIMS];
+    size_t nb[GGML_MAX_DIMS];
+    void* src_address[GGML_MAX_SRC];
+    int32_t op_params[GGML_MAX_OP_PARAMS / sizeof(int32_t)];
+};
+
+/**
+ * @brief A ggml graph captured as an ACL model runtime instance.
+ *
+ * The operators of the graph are launched once, in capture mode, and then
+ * replayed by a single aclmdlRIExecuteAsync for as long as the nodes keep
+ * their properties.
+ */
+struct ggml_cann_graph {
+    aclmdlRI graph = nullptr;
+    std::vector<ggml_cann_graph_node_properties> props;
+
+    ~ggml_cann_graph() {
+        if (graph != nullptr) {
+            aclmdlRIDestroy(graph);
+        }
+    }
+};
+#endif  // USE_ACL_GRAPH
+
 /**
  * @brief Context for managing CANN backend operations.
  */
@@ -343,6 +377,11 @@ struct ggml_backend_cann_context {
     aclrtEvent copy_event = nullptr; /**< Event for managing copy operations. */
     cann_task_queue task_queue;
     bool async_mode;
+#ifdef USE_ACL_GRAPH
+    bool acl_graph_mode = true;
+    std::vector<std::unique_ptr<ggml_cann_graph>> graphs;  /**< Captured graphs, most recently used first. */
+    std::vector<uint64_t> graph_hashes;                     /**< Hashes of the graphs computed once. */
+#endif
 
     aclrtStream streams[GGML_CANN_MAX_STREAMS] = {nullptr}; /**< Array of streams for the device. */
 
@@ -357,6 +396,15 @@ struct ggml_backend_cann_context {
         async_mode = (getenv("GGML_CANN_ASYNC_MODE") != nullptr);
         GGML_LOG_INFO("%s: device %d async operator submission is %s\n", __func__,
             device, async_mode ? "ON" : "OFF");
+#ifdef USE_ACL_GRAPH
+        // the captured operators keep the addresses of their buffers of the pool:
+        // they must not be released by another pool, nor launched from the task queue
+        acl_graph_mode = getenv("GGML_CANN_DISABLE_ACL_GRAPH") == nullptr &&
+                         getenv("GGML_CANN_DISABLE_VMM_POOL") == nullptr &&
+                         ggml_cann_info().devices[device].vmm && !async_mode;
+        GGML_LOG_INFO("%s: device %d execution mode is %s\n", __func__,
+            device, acl_graph_mode ? "GRAPH" : "EAGER");
+#endif
     }
 
     /**
@@ -365,6 +413,9 @@ struct ggml_backend_cann_context {
     ~ggml_backend_cann_context() {
         ggml_cann_set_device(device);
         task_queue.stop();
+#ifdef USE_ACL_GRAPH
+        graphs.clear();
+#endif
         if (copy_event != nullptr) {
             ACL_CHECK(aclrtDestroyEvent(copy_event));
         }
@@ -25,6 +25,7 @@
 #include <acl/acl.h>
 #include <stdarg.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
@@ -1644,6 +1645,9 @@ static bool ggml_cann_compute_forward(ggml_backend_cann_context& ctx,
         case GGML_OP_NORM:
             ggml_cann_norm(ctx, dst);
             break;
+        case GGML_OP_NORM_AFFINE:
+            ggml_cann_norm_affine(ctx, dst);
+            break;
         case GGML_OP_GROUP_NORM:
             ggml_cann_group_norm(ctx, dst);
             break;
@@ -1705,6 +1709,9 @@ static bool ggml_cann_compute_forward(ggml_backend_cann_context& ctx,
         case GGML_OP_SOFT_MAX:
             ggml_cann_softmax(ctx, dst);
             break;
+        case GGML_OP_FLASH_ATTN_EXT:
+            ggml_cann_flash_attn_ext(ctx, dst);
+            break;
         case GGML_OP_ROPE:
             ggml_cann_rope(ctx, dst);
             break;
@@ -1938,6 +1945,136 @@ static void ggml_backend_cann_synchronize(ggml_backend_t backend) {
     ACL_CHECK(aclrtSynchronizeStream(cann_ctx->stream()));
 }
 
+/**
+ * @brief Launches the operators of the nodes of a graph on the stream of the
+ *        context.
+ *
+ * @param cann_ctx The CANN backend context.
+ * @param cgraph The graph to compute.
+ */
+static void ggml_cann_compute_nodes(ggml_backend_cann_context* cann_ctx,
+                                    ggml_cgraph* cgraph) {
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        ggml_tensor* node = cgraph->nodes[i];
+
+        if (ggml_is_empty(node) || node->op == GGML_OP_NONE) {
+            continue;
+        }
+
+        bool ok = ggml_cann_compute_forward(*cann_ctx, node);
+
+        if (!ok) {
+            GGML_LOG_ERROR("%s: error: op not supported %s (%s)\n", __func__,
+                    node->name, ggml_op_name(node->op));
+        }
+        GGML_ASSERT(ok);
+    }
+}
+
+#ifdef USE_ACL_GRAPH
+/**
+ * @brief Records the properties of the nodes of a graph that a captured graph
+ *        depends on.
+ */
+static void ggml_cann_graph_get_properties(ggml_cgraph* cgraph,
+        std::vector<ggml_cann_graph_node_properties>& props) {
+    props.resize(cgraph->n_nodes);
+    for (int i = 0; i < cgraph->n_nodes; i++) {
+        ggml_tensor* node = cgraph->nodes[i];
+        ggml_cann_graph_node_properties& prop = props[i];
+
+        memset(&prop, 0, sizeof(prop));
+        prop.node_address = node->data;
+        prop.node_op = node->op;
+        for (int d = 0; d < GGML_MAX_DIMS; d++) {
+            prop.ne[d] = node->ne[d];
+            prop.nb[d] = node->nb[d];
+        }
+        for (int s = 0; s < GGML_MAX_SRC; s++) {
+            prop.src_address[s] = node->src[s] ? node->src[s]->data : nullptr;
+        }
+        memcpy(prop.op_params, node->op_params, GGML_MAX_OP_PARAMS);
+    }
+}
+
+/**
+ * @brief FNV-1a hash of the properties of the nodes of a graph.
+ */
+static uint64_t ggml_cann_graph_hash(
+        const std::vector<ggml_cann_graph_node_properties>& props) {
+    const uint8_t* data = (const uint8_t*)props.data();
+    const size_t size = props.size() * sizeof(ggml_cann_graph_node_properties);
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Computes a graph with the captured ACL graphs of the context.
+ *
+ * A graph is replayed when the properties of its nodes match a captured graph.
+ * Otherwise, it is captured the second time it is computed with the same
+ * properties: the graphs that are computed only once (e.g. a decoder graph
+ * that writes the KV cache at a new offset each token) are launched operator
+ * by operator, without the cost of the capture. The GGML_CANN_MAX_GRAPHS most
+ * recently used graphs are kept.
+ *
+ * @param cann_ctx The CANN backend context.
+ * @param cgraph The graph to compute.
+ */
+static void ggml_cann_graph_compute_acl_graph(
+        ggml_backend_cann_context* cann_ctx, ggml_cgraph* cgraph) {
+    std::vector<ggml_cann_graph_node_properties> props;
+    ggml_cann_graph_get_properties(cgraph, props);
+
+    auto& graphs = cann_ctx->graphs;
+    for (size_t i = 0; i < graphs.size(); i++) {
+        const auto& cur = graphs[i]->props;
+        if (cur.size() == props.size() &&
+            memcmp(cur.data(), props.data(),
+                   props.size() * sizeof(ggml_cann_graph_node_properties)) == 0) {
+            std::rotate(graphs.begin(), graphs.begin() + i, graphs.begin() + i + 1);
+            ACL_CHECK(aclmdlRIExecuteAsync(graphs[0]->graph, cann_ctx->stream()));
+            return;
+        }
+    }
+
+    const uint64_t hash = ggml_cann_graph_hash(props);
+
+    auto& hashes = cann_ctx->graph_hashes;
+    auto it = std::find(hashes.begin(), hashes.end(), hash);
+    if (it == hashes.end()) {
+        // first time: remember the graph and compute it eagerly
+        hashes.insert(hashes.begin(), hash);
+        if (hashes.size() > 4 * GGML_CANN_MAX_GRAPHS) {
+            hashes.pop_back();
+        }
+        ggml_cann_compute_nodes(cann_ctx, cgraph);
+        return;
+    }
+    hashes.erase(it);
+
+    std::unique_ptr<ggml_cann_graph> graph(new ggml_cann_graph());
+    graph->props = std::move(props);
+
+    ACL_CHECK(aclmdlRICaptureBegin(cann_ctx->stream(), ACL_MODEL_RI_CAPTURE_MODE_GLOBAL));
+    ggml_cann_compute_nodes(cann_ctx, cgraph);
+    ACL_CHECK(aclmdlRICaptureEnd(cann_ctx->stream(), &graph->graph));
+
+    // the capture only records the operators
+    ACL_CHECK(aclmdlRIExecuteAsync(graph->graph, cann_ctx->stream()));
+
+    graphs.insert(graphs.begin(), std::move(graph));
+    if (graphs.size() > GGML_CANN_MAX_GRAPHS) {
+        graphs.pop_back();
+    }
+}
+#endif  // USE_ACL_GRAPH
+
 /**
  * @brief Computes a computational graph using a CANN backend.
  *
@@ -1957,21 +2094,14 @@ static enum ggml_status ggml_backend_cann_graph_compute(
 
     ggml_cann_set_device(cann_ctx->device);
 
-    for (int i = 0; i < cgraph->n_nodes; i++) {
-        ggml_tensor* node = cgraph->nodes[i];
-
-        if (ggml_is_empty(node) || node->op == GGML_OP_NONE) {
-            continue;
-        }
-
-        bool ok = ggml_cann_compute_forward(*cann_ctx, node);
-
-        if (!ok) {
-            GGML_LOG_ERROR("%s: error: op not supported %s (%s)\n", __func__,
-                    node->name, ggml_op_name(node->op));
-        }
-        GGML_ASSERT(ok);
+#ifdef USE_ACL_GRAPH
+    if (cann_ctx->acl_graph_mode) {
+        ggml_cann_graph_compute_acl_graph(cann_ctx, cgraph);
+        return GGML_STATUS_SUCCESS;
     }
+#endif
+
+    ggml_cann_compute_nodes(cann_ctx, cgraph);
 
     return GGML_STATUS_SUCCESS;
 }
@@ -2121,6 +2251,33 @@ static bool ggml_backend_cann_supports_op(ggml_backend_dev_t dev,
             // value of paddingW should be at most half of kernelW
             return (p0 <= (k0 / 2)) && (p1 <= (k1 / 2));
         }
+        case GGML_OP_NORM_AFFINE:
+            return op->src[0]->type == GGML_TYPE_F32 &&
+                   op->src[1]->type == GGML_TYPE_F32 &&
+                   op->src[2]->type == GGML_TYPE_F32;
+        case GGML_OP_FLASH_ATTN_EXT: {
+            const ggml_tensor * q    = op->src[0];
+            const ggml_tensor * k    = op->src[1];
+            const ggml_tensor * v    = op->src[2];
+            const ggml_tensor * mask = op->src[3];
+
+            float logit_softcap;
+            memcpy(&logit_softcap, (const float *) op->op_params + 2, sizeof(float));
+            if (logit_softcap != 0.0f) {
+                return false;
+            }
+            if (q->type != GGML_TYPE_F32) {
+                return false;
+            }
+            if ((k->type != GGML_TYPE_F32 && k->type != GGML_TYPE_F16) || v->type != k->type) {
+                return false;
+            }
+            if (mask && mask->type != GGML_TYPE_F32 && mask->type != GGML_TYPE_F16) {
+                return false;
+            }
+            // the mask is broadcast over the heads by the softmax
+            return mask == nullptr || (ggml_is_contiguous(mask) && mask->ne[2] == 1 && mask->ne[3] == 1);
+        }
         case GGML_OP_SUM:
         case GGML_OP_DUP:
         case GGML_OP_IM2COL:
@@ -2078,7 +2078,7 @@ void tinygemm_kernel_amx(int M, int N, int KB, const void * RESTRICT _A, const v
         _tile_stored(TMM5, Tile5(C_pre), TILE_N * sizeof(int32_t));
 
         if (need_unpack) {
-            unpack_B<TB>(Tile1, B_blk0);
+            unpack_B<TB>(Tile1, B_blk1);
             _tile_loadd(TMM1, Tile1, TILE_N * VNNI_BLK);
         } else {
             _tile_loadd(TMM1, B_blk1, TILE_N * VNNI_BLK);
@@ -2422,25 +2422,26 @@ void ggml_backend_amx_mul_mat(const ggml_compute_params * params, struct ggml_te
     // pointer to work space, used convert A from float to quantized type
     void * wdata = params->wdata;
 
-    //TODO: performance improvement: merge quant A
-    if (params->ith == 0) {
-        GGML_DISPATCH_QTYPES(TYPE, [&] {
-            const size_t row_size_A = K / blck_size * sizeof(vec_dot_type);
-            const size_t desired_wsize = M * row_size_A;
-            if (params->wsize < desired_wsize) {
-                GGML_ABORT("insufficient work space size");
-            }
+    // quantize A, the rows are split over the threads
+    // for the large M of prompt processing or of an audio encoder (1500 frames) this is a large part of the time
+    GGML_DISPATCH_QTYPES(TYPE, [&] {
+        const size_t row_size_A = K / blck_size * sizeof(vec_dot_type);
+        const size_t desired_wsize = M * row_size_A;
+        if (params->wsize < desired_wsize) {
+            GGML_ABORT("insufficient work space size");
+        }
 
-            // Q4_0, Q4_1, Q8_0 handles 1 TILE_K per blck_size
-            // Q4_K, Q5_K, Q6_K, IQ4_XS handles 8 TILE_K per blck_size
-            GGML_ASSERT(TILE_K == blck_size || TILE_K * 8 == blck_size);
+        // Q4_0, Q4_1, Q8_0 handles 1 TILE_K per blck_size
+        // Q4_K, Q5_K, Q6_K, IQ4_XS handles 8 TILE_K per blck_size
+        GGML_ASSERT(TILE_K == blck_size || TILE_K * 8 == blck_size);
 
-            const float * A_data = static_cast<const float *>(src1->data);
-            for (int m = 0; m < M; ++m) {
+        const float * A_data = static_cast<const float *>(src1->data);
+        parallel_for_ggml(params, M, [&](int begin, int end) {
+            for (int m = begin; m < end; ++m) {
                 from_float<vec_dot_type>(A_data + m * K, (char *)wdata + m * row_size_A, K);
             }
         });
-    }
+    });
 
     ggml_barrier(params->threadpool);
 
@@ -0,0 +1,152 @@
+#include "ggml-backend.h"
+#include "ggml-backend-impl.h"
+#include "ggml-cpu.h"
+#include "ggml-impl.h"
+
+#include "ggml-cpu-hugepages.h"
+
+#include <algorithm>
+
+// buffer type on huge pages
+//
+// the buffers are allocated on the pages of hugetlbfs of the requested size (2 MB or 1 GB) when the pool of the
+// kernel has enough of them (see /proc/sys/vm/nr_hugepages), else on transparent huge pages: 2 MB aligned anonymous
+// memory marked with MADV_HUGEPAGE, so that the kernel backs it with 2 MB pages on the first touch even when
+// /sys/kernel/mm/transparent_hugepage/enabled is [madvise]
+// the size of the buffers is rounded up to the size of their pages
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#define GGML_HUGEPAGE_2M ((size_t) 2 << 20)
+#define GGML_HUGEPAGE_1G ((size_t) 1 << 30)
+
+static const char * ggml_backend_cpu_hugepage_buffer_type_get_name(ggml_backend_buffer_type_t buft) {
+    return *(size_t *) buft->context == GGML_HUGEPAGE_1G ? "CPU_HUGE_1G" : "CPU_HUGE_2M";
+}
+
+static void ggml_backend_cpu_hugepage_buffer_free_buffer(ggml_backend_buffer_t buffer) {
+#if defined(__linux__)
+    munmap(buffer->context, buffer->size);
+#else
+    ggml_aligned_free(buffer->context, buffer->size);
+#endif
+}
+
+#if defined(__linux__)
+// size is rounded up to the size of the pages that back the buffer
+static void * ggml_cpu_hugepage_alloc(size_t * size, size_t page_size) {
+#if defined(MAP_HUGETLB)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+        flags |= (page_size == GGML_HUGEPAGE_1G ? 30 : 21) << MAP_HUGE_SHIFT;
+#endif
+        const size_t n = GGML_PAD(*size, page_size);
+
+        void * ptr = mmap(NULL, n, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (ptr != MAP_FAILED) {
+            *size = n;
+            return ptr;
+        }
+    }
+#endif
+
+    // transparent huge pages - map one more page to align the start of the buffer, then unmap the rest
+    const size_t align = GGML_HUGEPAGE_2M;
+    const size_t n     = GGML_PAD(*size, align);
+
+    uint8_t * raw = (uint8_t *) mmap(NULL, n + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    uint8_t * ptr = (uint8_t *) GGML_PAD((uintptr_t) raw, align);
+
+    if (ptr > raw) {
+        munmap(raw, ptr - raw);
+    }
+    if (raw + n + align > ptr + n) {
+        munmap(ptr + n, (raw + n + align) - (ptr + n));
+    }
+
+#if defined(MADV_HUGEPAGE)
+    madvise(ptr, n, MADV_HUGEPAGE);
+#endif
+
+    *size = n;
+    return ptr;
+}
+#endif
+
+static ggml_backend_buffer_t ggml_backend_cpu_hugepage_buffer_type_alloc_buffer(ggml_backend_buffer_type_t buft, size_t size) {
+    const size_t page_size = *(size_t *) buft->context;
+
+    // at least one page - the size is 0 for the buffers without tensors
+    size = std::max<size_t>(size, 1);
+
+#if defined(__linux__)
+    void * ptr = ggml_cpu_hugepage_alloc(&size, page_size);
+#else
+    GGML_UNUSED(page_size);
+
+    void * ptr = ggml_aligned_malloc(size);
+#endif
+    if (ptr == NULL) {
+        GGML_LOG_ERROR("%s: failed to allocate a buffer of size %zu on huge pages\n", __func__, size);
+        return NULL;
+    }
+
+    ggml_backend_buffer_t buffer = ggml_backend_cpu_buffer_from_ptr(ptr, size);
+    buffer->buft                 = buft;
+    buffer->iface.free_buffer    = ggml_backend_cpu_hugepage_buffer_free_buffer;
+
+    return buffer;
+}
+
+static size_t ggml_backend_cpu_hugepage_buffer_type_get_alignment(ggml_backend_buffer_type_t buft) {
+    return ggml_backend_buft_get_alignment(ggml_backend_cpu_buffer_type());
+
+    GGML_UNUSED(buft);
+}
+
+static bool ggml_backend_cpu_hugepage_buffer_type_is_host(ggml_backend_buffer_type_t buft) {
+    return true;
+
+    GGML_UNUSED(buft);
+}
+
+ggml_backend_buffer_type_t ggml_backend_cpu_hugepage_buffer_type(size_t page_size) {
+    static size_t page_size_2m = GGML_HUGEPAGE_2M;
+    static size_t page_size_1g = GGML_HUGEPAGE_1G;
+
+    static struct ggml_backend_buffer_type ggml_backend_cpu_buffer_type_hugepage[2] = {
+        {
+            /* .iface    = */ {
+                               /* .get_name         = */ ggml_backend_cpu_hugepage_buffer_type_get_name,
+                               /* .alloc_buffer     = */ ggml_backend_cpu_hugepage_buffer_type_alloc_buffer,
+                               /* .get_alignment    = */ ggml_backend_cpu_hugepage_buffer_type_get_alignment,
+                               /* .get_max_size     = */ nullptr,  // defaults to SIZE_MAX
+                               /* .get_alloc_size   = */ nullptr,  // defaults to ggml_nbytes
+                               /* .is_host          = */ ggml_backend_cpu_hugepage_buffer_type_is_host,
+                               },
+            /* .device   = */ ggml_backend_reg_dev_get(ggml_backend_cpu_reg(), 0),
+            /* .context  = */ &page_size_2m,
+        },
+        {
+            /* .iface    = */ {
+                               /* .get_name         = */ ggml_backend_cpu_hugepage_buffer_type_get_name,
+                               /* .alloc_buffer     = */ ggml_backend_cpu_hugepage_buffer_type_alloc_buffer,
+                               /* .get_alignment    = */ ggml_backend_cpu_hugepage_buffer_type_get_alignment,
+                               /* .get_max_size     = */ nullptr,  // defaults to SIZE_MAX
+                               /* .get_alloc_size   = */ nullptr,  // defaults to ggml_nbytes
+                               /* .is_host          = */ ggml_backend_cpu_hugepage_buffer_type_is_host,
+                               },
+            /* .device   = */ ggml_backend_reg_dev_get(ggml_backend_cpu_reg(), 0),
+            /* .context  = */ &page_size_1g,
+        },
+    };
+
+    return &ggml_backend_cpu_buffer_type_hugepage[page_size >= GGML_HUGEPAGE_1G ? 1 : 0];
+}
@@ -24,6 +24,15 @@ struct ggml_compute_params {
     void * wdata;
 
     struct ggml_threadpool * threadpool;
+
+    // the src1 of the previous node if it was a MUL_MAT that left it in wdata, converted to the vec_dot_type
+    // the next MUL_MAT with the same src1 and vec_dot_type (e.g. the Q, K and V of an attention) reuses it
+    const struct ggml_tensor * wdata_src1;
+    enum ggml_type             wdata_type;
+
+    // set by a MUL_MAT that leaves its src1 in wdata - per thread, all the threads take the same path
+    const struct ggml_tensor ** wdata_src1_out;
+    enum ggml_type            * wdata_type_out;
 };
 
 
@@ -449,6 +449,7 @@ struct ggml_threadpool {
 
     int32_t      prio;        // Scheduling priority
     uint32_t     poll;        // Polling level (0 - no polling)
+    uint32_t     poll_us;     // Polling time in microseconds (0 - use poll)
 
     enum ggml_status ec;
 };
@@ -460,6 +461,11 @@ struct ggml_compute_state {
     bool cpumask[GGML_MAX_N_THREADS];
     int  last_graph;
     bool pending;
+
+    // polling stats, written only by the thread itself
+    int64_t t_spin_us;
+    int64_t n_spin;
+    int64_t n_sleep;
 #endif
     struct ggml_threadpool * threadpool;
     int ith;
@@ -1312,7 +1318,10 @@ static void ggml_compute_forward_mul_mat(
 UseGgmlGemm1:;
 #endif
 
-    if (src1->type != vec_dot_type) {
+    // src1 is already in wdata when the previous node was a MUL_MAT of the same src1 and vec_dot_type
+    const bool src1_in_wdata = params->wdata_src1 == src1 && params->wdata_type == vec_dot_type;
+
+    if (src1->type != vec_dot_type && !src1_in_wdata) {
         char * wdata = params->wdata;
 
         const size_t nbw0 = ggml_type_size(vec_dot_type);
@@ -1349,6 +1358,11 @@ UseGgmlGemm1:;
     #endif
     }
 
+    if (src1->type != vec_dot_type && params->wdata_src1_out) {
+        *params->wdata_src1_out = src1;
+        *params->wdata_type_out = vec_dot_type;
+    }
+
     if (ith == 0) {
         // Every thread starts at ith, so the first unprocessed chunk is nth.  This save a bit of coordination right at the start.
         atomic_store_explicit(&params->threadpool->current_chunk, nth, memory_order_relaxed);
@@ -1823,6 +1837,10 @@ static void ggml_compute_forward(struct ggml_compute_params * params, struct ggm
             {
                 ggml_compute_forward_l2_norm(params, tensor);
             } break;
+        case GGML_OP_NORM_AFFINE:
+            {
+                ggml_compute_forward_norm_affine(params, tensor);
+            } break;
         case GGML_OP_MUL_MAT:
             {
                 ggml_compute_forward_mul_mat(params, tensor);
@@ -2214,6 +2232,7 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
         case GGML_OP_RMS_NORM:
         case GGML_OP_RMS_NORM_BACK:
         case GGML_OP_L2_NORM:
+        case GGML_OP_NORM_AFFINE:
         case GGML_OP_GROUP_NORM:
         case GGML_OP_CONCAT:
         case GGML_OP_MUL_MAT:
@@ -2631,6 +2650,23 @@ void ggml_threadpool_resume(struct ggml_threadpool * threadpool) {
 #endif
 }
 
+void ggml_threadpool_get_poll_stats(struct ggml_threadpool * threadpool, int64_t * t_spin_us, int64_t * n_spin, int64_t * n_sleep) {
+    *t_spin_us = 0;
+    *n_spin    = 0;
+    *n_sleep   = 0;
+
+#ifndef GGML_USE_OPENMP
+    // the main thread does not poll
+    for (int j = 1; j < threadpool->n_threads_max; j++) {
+        *t_spin_us += threadpool->workers[j].t_spin_us;
+        *n_spin    += threadpool->workers[j].n_spin;
+        *n_sleep   += threadpool->workers[j].n_sleep;
+    }
+#else
+    UNUSED(threadpool);
+#endif
+}
+
 struct ggml_cplan ggml_graph_plan(
           const struct ggml_cgraph * cgraph,
                                int   n_threads,
@@ -2773,6 +2809,10 @@ struct ggml_cplan ggml_graph_plan(
                         const int64_t ne20 = node->src[2]->ne[0]; // DV
 
                         cur = sizeof(float)*(1*ne10 + 2*ne20)*n_tasks; // 1x head size K + 2x head size V (per thread)
+
+                        if (ggml_flash_attn_ext_use_tiled(node->src[0], node->src[1], node->src[2])) {
+                            cur = MAX(cur, (ggml_flash_attn_ext_tiled_wsize(ne10, ne20) + CACHE_LINE_SIZE)*n_tasks);
+                        }
                     } break;
                 case GGML_OP_FLASH_ATTN_BACK:
                     {
@@ -2834,11 +2874,27 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
         /*.wsize     =*/ cplan->work_size,
         /*.wdata     =*/ cplan->work_data,
         /*.threadpool=*/ tp,
+        /*.wdata_src1=*/ NULL,
+        /*.wdata_type=*/ GGML_TYPE_COUNT,
+        /*.wdata_src1_out=*/ NULL,
+        /*.wdata_type_out=*/ NULL,
     };
 
+    // the src1 that the last node left in wdata (see ggml_compute_forward_mul_mat)
+    const struct ggml_tensor * wdata_src1 = NULL;
+    enum ggml_type             wdata_type = GGML_TYPE_COUNT;
+
+    params.wdata_src1_out = &wdata_src1;
+    params.wdata_type_out = &wdata_type;
+
     for (int node_n = 0; node_n < cgraph->n_nodes && atomic_load_explicit(&tp->abort, memory_order_relaxed) != node_n; node_n++) {
         struct ggml_tensor * node = cgraph->nodes[node_n];
 
+        // the other ops can overwrite wdata
+        params.wdata_src1 = wdata_src1;
+        params.wdata_type = wdata_type;
+        wdata_src1 = NULL;
+
         ggml_compute_forward(&params, node);
 
         if (state->ith == 0 && cplan->abort_callback &&
@@ -2901,15 +2957,31 @@ static inline bool ggml_graph_compute_poll_for_work(struct ggml_compute_state *
         return state->pending;
     }
 
-    // This seems to make 0 ... 100 a decent range for polling level across modern processors.
-    // Perhaps, we can adjust it dynamically based on load and things.
-    const uint64_t n_rounds = 1024UL * 128 * threadpool->poll;
+    const int64_t t_start_us = ggml_time_us();
 
-    for (uint64_t i=0; !ggml_graph_compute_thread_ready(state) && i < n_rounds; i++) {
-        // No new work. Keep polling.
-        ggml_thread_cpu_relax();
+    if (threadpool->poll_us > 0) {
+        // Spin for at most poll_us microseconds, the time is checked every 64 rounds
+        for (uint64_t i=0; !ggml_graph_compute_thread_ready(state); i++) {
+            ggml_thread_cpu_relax();
+
+            if ((i & 63) == 63 && ggml_time_us() - t_start_us >= threadpool->poll_us) {
+                break;
+            }
+        }
+    } else {
+        // This seems to make 0 ... 100 a decent range for polling level across modern processors.
+        // Perhaps, we can adjust it dynamically based on load and things.
+        const uint64_t n_rounds = 1024UL * 128 * threadpool->poll;
+
+        for (uint64_t i=0; !ggml_graph_compute_thread_ready(state) && i < n_rounds; i++) {
+            // No new work. Keep polling.
+            ggml_thread_cpu_relax();
+        }
     }
 
+    state->t_spin_us += ggml_time_us() - t_start_us;
+    state->n_spin    += state->pending;
+
     return state->pending;
 }
 
@@ -2922,6 +2994,9 @@ static inline bool ggml_graph_compute_check_for_work(struct ggml_compute_state *
     }
 
     ggml_mutex_lock_shared(&threadpool->mutex);
+    if (!ggml_graph_compute_thread_ready(state)) {
+        state->n_sleep++;
+    }
     while (!ggml_graph_compute_thread_ready(state)) {
         // No new work. Wait for the signal.
         GGML_PRINT_DEBUG("thread #%d waiting for work (sleeping)\n", state->ith);
@@ -3025,6 +3100,7 @@ static struct ggml_threadpool * ggml_threadpool_new_impl(
         threadpool->n_threads_max    = tpp->n_threads;
         threadpool->n_threads_cur    = tpp->n_threads;
         threadpool->poll             = tpp->poll;
+        threadpool->poll_us          = tpp->poll_us;
         threadpool->prio             = tpp->prio;
         threadpool->ec               = GGML_STATUS_SUCCESS;
     }
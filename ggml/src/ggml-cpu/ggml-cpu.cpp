@@ -3,7 +3,9 @@
 #include "ggml-cpu.h"
 #include "ggml-cpu-aarch64.h"
 #include "ggml-cpu-traits.h"
+#include "ggml-cpu-hugepages.h"
 #include "ggml-impl.h"
+#include "vec.h"
 #include "amx/amx.h"
 
 #include <cctype>
@@ -409,6 +411,10 @@ static bool ggml_backend_cpu_device_supports_op(ggml_backend_dev_t dev, const st
 
     // the other case need host buffer.
     for (int i = 0; i < GGML_MAX_SRC; i++) {
+        // only the shape of the kernel of IM2COL is used, it can be the weight of an extra buffer
+        if (op->op == GGML_OP_IM2COL && i == 0) {
+            continue;
+        }
         if (op->src[i] && op->src[i]->buffer && !ggml_backend_buft_is_host(op->src[i]->buffer->buft)) {
             return false;
         }
@@ -438,6 +444,8 @@ static bool ggml_backend_cpu_device_supports_op(ggml_backend_dev_t dev, const st
         }
         case GGML_OP_IM2COL_BACK:
             return src0->type == GGML_TYPE_F32 && src1->type == GGML_TYPE_F32;
+        case GGML_OP_NORM_AFFINE:
+            return src0->type == GGML_TYPE_F32 && src1->type == GGML_TYPE_F32 && op->src[2]->type == GGML_TYPE_F32;
         case GGML_OP_GET_ROWS_BACK:
             return src0->type == GGML_TYPE_F32 || src0->type == GGML_TYPE_F16;
         case GGML_OP_OUT_PROD:
@@ -610,6 +618,12 @@ static ggml_backend_feature * ggml_backend_cpu_get_features(ggml_backend_reg_t r
     GGML_UNUSED(reg);
 }
 
+// the F32 GELU of the CPU backend (GGML_UNARY_OP_GELU), for the custom ops that fuse it with another op
+// y can be x
+static void ggml_backend_cpu_vec_gelu_f32(int n, float * y, const float * x) {
+    ggml_vec_gelu_f32(n, y, x);
+}
+
 static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const char * name) {
     if (strcmp(name, "ggml_backend_set_n_threads") == 0) {
         ggml_backend_set_n_threads_t fct = ggml_backend_cpu_set_n_threads;
@@ -639,9 +653,21 @@ static void * ggml_backend_cpu_get_proc_address(ggml_backend_reg_t reg, const ch
     if (strcmp(name, "ggml_threadpool_free") == 0) {
         return (void *)ggml_threadpool_free;
     }
+    if (strcmp(name, "ggml_threadpool_resume") == 0) {
+        return (void *)ggml_threadpool_resume;
+    }
+    if (strcmp(name, "ggml_threadpool_get_poll_stats") == 0) {
+        return (void *)ggml_threadpool_get_poll_stats;
+    }
     if (strcmp(name, "ggml_backend_cpu_set_threadpool") == 0) {
         return (void *)ggml_backend_cpu_set_threadpool;
     }
+    if (strcmp(name, "ggml_backend_cpu_hugepage_buffer_type") == 0) {
+        return (void *)ggml_backend_cpu_hugepage_buffer_type;
+    }
+    if (strcmp(name, "ggml_backend_cpu_vec_gelu_f32") == 0) {
+        return (void *)ggml_backend_cpu_vec_gelu_f32;
+    }
 
     return NULL;
 
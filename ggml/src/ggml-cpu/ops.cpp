@@ -3162,6 +3162,81 @@ void ggml_compute_forward_norm(
     }
 }
 
+// ggml_compute_forward_norm_affine
+
+static void ggml_compute_forward_norm_affine_f32(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+    const ggml_tensor * src1 = dst->src[1];
+    const ggml_tensor * src2 = dst->src[2];
+
+    GGML_ASSERT(ggml_are_same_shape(src0, dst));
+
+    GGML_ASSERT(src0->nb[0] == sizeof(float));
+    GGML_ASSERT(src1->type == GGML_TYPE_F32 && ggml_is_contiguous(src1));
+    GGML_ASSERT(src2->type == GGML_TYPE_F32 && ggml_is_contiguous(src2));
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    GGML_TENSOR_UNARY_OP_LOCALS
+
+    float eps;
+    memcpy(&eps, dst->op_params, sizeof(float));
+
+    GGML_ASSERT(eps >= 0.0f);
+
+    const float * w = (const float *) src1->data;
+    const float * b = (const float *) src2->data;
+
+    // a single pass writes dst, instead of one for each of norm, mul and add
+    for (int64_t i03 = 0; i03 < ne03; i03++) {
+        for (int64_t i02 = 0; i02 < ne02; i02++) {
+            for (int64_t i01 = ith; i01 < ne01; i01 += nth) {
+                const float * x = (float *) ((char *) src0->data + i01*nb01 + i02*nb02 + i03*nb03);
+
+                ggml_float sum = 0.0;
+                ggml_vec_sum_f32_ggf(ne00, &sum, x);
+
+                const float mean = sum/ne00;
+
+                ggml_float sum2 = 0.0;
+                for (int64_t i00 = 0; i00 < ne00; i00++) {
+                    const float v = x[i00] - mean;
+                    sum2 += (ggml_float)(v*v);
+                }
+
+                const float variance = sum2/ne00;
+                const float scale = 1.0f/sqrtf(variance + eps);
+
+                float * y = (float *) ((char *) dst->data + i01*nb1 + i02*nb2 + i03*nb3);
+
+                ggml_vec_norm_affine_f32(ne00, y, x, mean, scale, w, b);
+            }
+        }
+    }
+}
+
+void ggml_compute_forward_norm_affine(
+        const ggml_compute_params * params,
+        ggml_tensor * dst) {
+
+    const ggml_tensor * src0 = dst->src[0];
+
+    switch (src0->type) {
+        case GGML_TYPE_F32:
+            {
+                ggml_compute_forward_norm_affine_f32(params, dst);
+            } break;
+        default:
+            {
+                GGML_ABORT("fatal error");
+            }
+    }
+}
+
 // ggml_compute_forward_group_rms_norm
 
 static void ggml_compute_forward_rms_norm_f32(
@@ -7061,6 +7136,497 @@ static void ggml_compute_forward_flash_attn_ext_f16(
     }
 }
 
+// cache-blocked variant for F16 K and V and many query rows (e.g. the encoder of whisper, with 1500 rows):
+// each thread processes a tile of GGML_FA_TILE_Q rows of a head against tiles of GGML_FA_TILE_KV rows of K and V,
+// so that K and V are read from memory once per tile of queries instead of once per query row
+// the accumulators are F32
+static void ggml_compute_forward_flash_attn_ext_f16_tiled(
+        const ggml_compute_params * params,
+        const ggml_tensor * q,
+        const ggml_tensor * k,
+        const ggml_tensor * v,
+        const ggml_tensor * mask,
+        ggml_tensor * dst) {
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t DK = nek0;
+    const int64_t DV = nev0;
+    const int64_t N  = neq1;
+
+    const int64_t BQ = GGML_FA_TILE_Q;
+    const int64_t BK = GGML_FA_TILE_KV;
+
+    GGML_ASSERT(ne0 == DV);
+    GGML_ASSERT(ne2 == N);
+
+    // input tensor rows must be contiguous
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == ggml_type_size(k->type));
+    GGML_ASSERT(nbv0 == ggml_type_size(v->type));
+
+    GGML_ASSERT(neq0 == DK);
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    // broadcast factors
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    const int64_t rv2 = neq2/nev2;
+    const int64_t rv3 = neq3/nev3;
+
+    // parallelize by tiles of q rows
+    const int64_t nq = (N + BQ - 1)/BQ;
+    const int64_t nr = nq*neq2*neq3;
+
+    const int64_t dr = (nr + nth - 1)/nth;
+
+    const int64_t ir0 = dr*ith;
+    const int64_t ir1 = MIN(ir0 + dr, nr);
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    ggml_vec_dot_t const kq_vec_dot = ggml_get_type_traits_cpu(k->type)->vec_dot;
+
+    // per thread: | Q (BQ*DK F16) | KQ (BQ*BK) | V (BK*DV) | VKQ (BQ*DV) | M (BQ) | S (BQ) |
+    float       * wdata = (float *) params->wdata + ith*(ggml_flash_attn_ext_tiled_wsize(DK, DV)/sizeof(float) + CACHE_LINE_SIZE_F32);
+    ggml_fp16_t * Q16   = (ggml_fp16_t *) wdata;
+    float       * KQ    = wdata + (BQ*DK + 1)/2;
+    float       * V32   = KQ    + BQ*BK;
+    float       * VKQ   = V32   + BK*DV;
+    float       * M     = VKQ   + BQ*DV;
+    float       * S     = M     + BQ;
+
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        // tile indices
+        const int64_t iq3 = ir/(neq2*nq);
+        const int64_t iq2 = (ir - iq3*neq2*nq)/nq;
+        const int64_t iqt = (ir - iq3*neq2*nq - iq2*nq);
+
+        const int64_t iq1 = iqt*BQ;
+        const int64_t nq1 = MIN(BQ, N - iq1);
+
+        const uint32_t h = iq2; // head index
+        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+        // k indices
+        const int64_t ik3 = iq3 / rk3;
+        const int64_t ik2 = iq2 / rk2;
+
+        // v indices
+        const int64_t iv3 = iq3 / rv3;
+        const int64_t iv2 = iq2 / rv2;
+
+        for (int64_t i = 0; i < nq1; ++i) {
+            const float * pq = (const float *) ((char *) q->data + ((iq1 + i)*nbq1 + iq2*nbq2 + iq3*nbq3));
+            ggml_cpu_fp32_to_fp16(pq, Q16 + i*DK, DK);
+
+            M[i] = -INFINITY;
+            S[i] = 0.0f;
+        }
+        memset(VKQ, 0, nq1*DV*sizeof(float));
+
+        for (int64_t ic0 = 0; ic0 < nek1; ic0 += BK) {
+            const int64_t nc = MIN(BK, nek1 - ic0);
+
+            // KQ = K*Q for the tile, scaled and masked
+            for (int64_t i = 0; i < nq1; ++i) {
+                const ggml_fp16_t * mp = mask ? (ggml_fp16_t *)((char *) mask->data + (iq1 + i)*mask->nb[1]) + ic0 : NULL;
+
+                for (int64_t c = 0; c < nc; ++c) {
+                    const float mv = mp ? slope*GGML_FP16_TO_FP32(mp[c]) : 0.0f;
+                    if (mv == -INFINITY) {
+                        KQ[i*BK + c] = -INFINITY;
+                        continue;
+                    }
+
+                    const char * k_data = (const char *) k->data + ((ic0 + c)*nbk1 + ik2*nbk2 + ik3*nbk3);
+
+                    float s;
+                    kq_vec_dot(DK, &s, 0, k_data, 0, Q16 + i*DK, 0, 1);
+
+                    s = s*scale;
+
+                    if (logit_softcap != 0.0f) {
+                        s = logit_softcap*tanhf(s);
+                    }
+
+                    KQ[i*BK + c] = s + mv;
+                }
+            }
+
+            // the V rows of the tile, once for all the rows of Q
+            for (int64_t c = 0; c < nc; ++c) {
+                const char * v_data = (const char *) v->data + ((ic0 + c)*nbv1 + iv2*nbv2 + iv3*nbv3);
+                ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) v_data, V32 + c*DV, DV);
+            }
+
+            // online softmax
+            // ref: https://arxiv.org/pdf/2112.05682.pdf
+            for (int64_t i = 0; i < nq1; ++i) {
+                float * kq = KQ + i*BK;
+
+                float Mnew = M[i];
+                for (int64_t c = 0; c < nc; ++c) {
+                    Mnew = MAX(Mnew, kq[c]);
+                }
+                if (Mnew == -INFINITY) {
+                    continue;
+                }
+
+                if (Mnew > M[i]) {
+                    const float ms = expf(M[i] - Mnew);
+                    ggml_vec_scale_f32(DV, VKQ + i*DV, ms);
+                    S[i] *= ms;
+                    M[i] = Mnew;
+                }
+
+                float sum = 0.0f;
+                for (int64_t c = 0; c < nc; ++c) {
+                    const float vs = kq[c] == -INFINITY ? 0.0f : expf(kq[c] - Mnew);
+                    if (vs != 0.0f) {
+                        ggml_vec_mad_f32(DV, VKQ + i*DV, V32 + c*DV, vs);
+                    }
+                    sum += vs;
+                }
+                S[i] += sum;
+            }
+        }
+
+        for (int64_t i = 0; i < nq1; ++i) {
+            // V /= S
+            ggml_vec_scale_f32(DV, VKQ + i*DV, S[i] > 0.0f ? 1.0f/S[i] : 0.0f);
+
+            // permute(0, 2, 1, 3)
+            memcpy((char *) dst->data + (iq3*ne2*ne1 + iq2 + (iq1 + i)*ne1)*nb1, VKQ + i*DV, nb1);
+        }
+    }
+}
+
+// head dimension specialized variant of the cache-blocked kernel, for F16 K and V and any number of query rows (e.g. the
+// head dim 64 of all the whisper models, in the self-attention of the encoder and the cross-attention of the decoder)
+// the rows of K and V of a tile are converted to F32 once - K transposed, so that the scores of a row of Q are updated
+// for the whole tile at once - and all the loops over the head dimension have D iterations known at compile time,
+// which the compiler unrolls and vectorizes. the softmax uses the vectorized exp of ggml_vec_soft_max_f32
+// the tiles with a few rows of Q (the decoder) convert the rows of K and V as they are used, with dot products instead
+// of the transpose
+
+// the rows of Q of a tile from which K is transposed
+#define GGML_FA_HD_MIN_Q_T 4
+
+template <int D>
+static inline float ggml_fa_hd_dot(const float * x, const float * y) {
+    // independent partial sums, so that the loop is vectorized without reassociating the sum
+    constexpr int L = 16;
+    static_assert(D % L == 0, "head dim must be a multiple of 16");
+
+    float acc[L] = { 0.0f };
+    for (int d = 0; d < D; d += L) {
+        for (int j = 0; j < L; ++j) {
+            acc[j] += x[d + j]*y[d + j];
+        }
+    }
+
+    // pairwise, so that the halves are added as vectors
+    for (int w = L/2; w > 0; w /= 2) {
+        for (int j = 0; j < w; ++j) {
+            acc[j] += acc[j + w];
+        }
+    }
+    return acc[0];
+}
+
+template <int D>
+static void ggml_compute_forward_flash_attn_ext_f16_hd(
+        const ggml_compute_params * params,
+        const ggml_tensor * q,
+        const ggml_tensor * k,
+        const ggml_tensor * v,
+        const ggml_tensor * mask,
+        ggml_tensor * dst) {
+
+    GGML_TENSOR_LOCALS(int64_t, neq, q,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbq, q,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nek, k,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbk, k,   nb)
+    GGML_TENSOR_LOCALS(int64_t, nev, v,   ne)
+    GGML_TENSOR_LOCALS(size_t,  nbv, v,   nb)
+    GGML_TENSOR_LOCALS(int64_t, ne,  dst, ne)
+    GGML_TENSOR_LOCALS(size_t,  nb,  dst, nb)
+
+    const int ith = params->ith;
+    const int nth = params->nth;
+
+    const int64_t N = neq1;
+
+    constexpr int64_t BQ = GGML_FA_TILE_Q;
+    constexpr int64_t BK = GGML_FA_TILE_KV;
+
+    GGML_ASSERT(neq0 == D && nek0 == D && nev0 == D);
+    GGML_ASSERT(k->type == GGML_TYPE_F16 && v->type == GGML_TYPE_F16);
+
+    GGML_ASSERT(ne0 == D);
+    GGML_ASSERT(ne2 == N);
+
+    // input tensor rows must be contiguous
+    GGML_ASSERT(nbq0 == ggml_type_size(q->type));
+    GGML_ASSERT(nbk0 == sizeof(ggml_fp16_t));
+    GGML_ASSERT(nbv0 == sizeof(ggml_fp16_t));
+
+    // dst cannot be transposed or permuted
+    GGML_ASSERT(nb0 == sizeof(float));
+    GGML_ASSERT(nb0 <= nb1);
+    GGML_ASSERT(nb1 <= nb2);
+    GGML_ASSERT(nb2 <= nb3);
+
+    // broadcast factors
+    const int64_t rk2 = neq2/nek2;
+    const int64_t rk3 = neq3/nek3;
+
+    const int64_t rv2 = neq2/nev2;
+    const int64_t rv3 = neq3/nev3;
+
+    // parallelize by tiles of q rows
+    const int64_t nq = (N + BQ - 1)/BQ;
+    const int64_t nr = nq*neq2*neq3;
+
+    const int64_t dr = (nr + nth - 1)/nth;
+
+    const int64_t ir0 = dr*ith;
+    const int64_t ir1 = MIN(ir0 + dr, nr);
+
+    float scale         = 1.0f;
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+
+    memcpy(&scale,         (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&max_bias,      (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (float *) dst->op_params + 2, sizeof(float));
+
+    if (logit_softcap != 0) {
+        scale /= logit_softcap;
+    }
+
+    const uint32_t n_head      = neq2;
+    const uint32_t n_head_log2 = 1u << (uint32_t) floor(log2(n_head));
+
+    const float m0 = powf(2.0f, -(max_bias       ) / n_head_log2);
+    const float m1 = powf(2.0f, -(max_bias / 2.0f) / n_head_log2);
+
+    // per thread: | Q (BQ*D) | KQ (BQ*BK) | K^T or K (D*BK) | V (BK*D) | VKQ (BQ*D) | M (BQ) | S (BQ) |
+    float * wdata = (float *) params->wdata + ith*(ggml_flash_attn_ext_tiled_wsize(D, D)/sizeof(float) + CACHE_LINE_SIZE_F32);
+    float * Q32   = wdata;
+    float * KQ    = Q32 + BQ*D;
+    float * KT    = KQ  + BQ*BK;
+    float * V32   = KT  + D*BK;
+    float * VKQ   = V32 + BK*D;
+    float * M     = VKQ + BQ*D;
+    float * S     = M   + BQ;
+
+    float tmp[D];
+
+    for (int64_t ir = ir0; ir < ir1; ++ir) {
+        // tile indices
+        const int64_t iq3 = ir/(neq2*nq);
+        const int64_t iq2 = (ir - iq3*neq2*nq)/nq;
+        const int64_t iqt = (ir - iq3*neq2*nq - iq2*nq);
+
+        const int64_t iq1 = iqt*BQ;
+        const int64_t nq1 = MIN(BQ, N - iq1);
+
+        const uint32_t h = iq2; // head index
+        const float slope = (max_bias > 0.0f) ? h < n_head_log2 ? powf(m0, h + 1) : powf(m1, 2*(h - n_head_log2) + 1) : 1.0f;
+
+        // k indices
+        const int64_t ik3 = iq3 / rk3;
+        const int64_t ik2 = iq2 / rk2;
+
+        // v indices
+        const int64_t iv3 = iq3 / rv3;
+        const int64_t iv2 = iq2 / rv2;
+
+        // the scale is applied to Q
+        for (int64_t i = 0; i < nq1; ++i) {
+            const float * pq = (const float *) ((char *) q->data + ((iq1 + i)*nbq1 + iq2*nbq2 + iq3*nbq3));
+            for (int d = 0; d < D; ++d) {
+                Q32[i*D + d] = pq[d]*scale;
+            }
+
+            M[i] = -INFINITY;
+            S[i] = 0.0f;
+        }
+        memset(VKQ, 0, nq1*D*sizeof(float));
+
+        const bool use_kt = nq1 >= GGML_FA_HD_MIN_Q_T;
+
+        for (int64_t ic0 = 0; ic0 < nek1; ic0 += BK) {
+            const int64_t nc = MIN(BK, nek1 - ic0);
+
+            if (use_kt) {
+                // the K rows of the tile, transposed - the columns past the end of K are 0
+                for (int64_t c = 0; c < nc; ++c) {
+                    const char * k_data = (const char *) k->data + ((ic0 + c)*nbk1 + ik2*nbk2 + ik3*nbk3);
+                    ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) k_data, tmp, D);
+                    for (int d = 0; d < D; ++d) {
+                        KT[d*BK + c] = tmp[d];
+                    }
+                }
+                if (nc < BK) {
+                    for (int d = 0; d < D; ++d) {
+                        memset(KT + d*BK + nc, 0, (BK - nc)*sizeof(float));
+                    }
+                }
+
+                // the V rows of the tile, once for all the rows of Q
+                for (int64_t c = 0; c < nc; ++c) {
+                    const char * v_data = (const char *) v->data + ((ic0 + c)*nbv1 + iv2*nbv2 + iv3*nbv3);
+                    ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) v_data, V32 + c*D, D);
+                }
+            }
+
+            for (int64_t i = 0; i < nq1; ++i) {
+                float * kq = KQ + i*BK;
+
+                // KQ = K*Q for the tile
+                if (use_kt) {
+                    for (int64_t c = 0; c < BK; ++c) {
+                        kq[c] = 0.0f;
+                    }
+                    for (int d = 0; d < D; ++d) {
+                        const float   qd = Q32[i*D + d];
+                        const float * kt = KT + d*BK;
+                        for (int64_t c = 0; c < BK; ++c) {
+                            kq[c] += qd*kt[c];
+                        }
+                    }
+                } else {
+                    // the rows of K are converted as they are used
+                    for (int64_t c = 0; c < nc; ++c) {
+                        const char * k_data = (const char *) k->data + ((ic0 + c)*nbk1 + ik2*nbk2 + ik3*nbk3);
+                        ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) k_data, tmp, D);
+                        kq[c] = ggml_fa_hd_dot<D>(Q32 + i*D, tmp);
+                    }
+                }
+
+                if (logit_softcap != 0.0f) {
+                    for (int64_t c = 0; c < nc; ++c) {
+                        kq[c] = logit_softcap*tanhf(kq[c]);
+                    }
+                }
+
+                if (mask) {
+                    const ggml_fp16_t * mp = (const ggml_fp16_t *) ((const char *) mask->data + (iq1 + i)*mask->nb[1]) + ic0;
+                    for (int64_t c = 0; c < nc; ++c) {
+                        kq[c] += slope*GGML_FP16_TO_FP32(mp[c]);
+                    }
+                }
+
+                // online softmax
+                // ref: https://arxiv.org/pdf/2112.05682.pdf
+                float Mnew = M[i];
+                for (int64_t c = 0; c < nc; ++c) {
+                    Mnew = MAX(Mnew, kq[c]);
+                }
+                if (Mnew == -INFINITY) {
+                    continue;
+                }
+
+                float * vkq = VKQ + i*D;
+
+                if (Mnew > M[i]) {
+                    const float ms = expf(M[i] - Mnew);
+                    for (int d = 0; d < D; ++d) {
+                        vkq[d] *= ms;
+                    }
+                    S[i] *= ms;
+                    M[i] = Mnew;
+                }
+
+                S[i] += ggml_vec_soft_max_f32(nc, kq, kq, Mnew);
+
+                for (int64_t c = 0; c < nc; ++c) {
+                    const float vs = kq[c];
+                    if (vs == 0.0f) {
+                        continue;
+                    }
+                    const float * vc = V32 + c*D;
+                    if (!use_kt) {
+                        const char * v_data = (const char *) v->data + ((ic0 + c)*nbv1 + iv2*nbv2 + iv3*nbv3);
+                        ggml_cpu_fp16_to_fp32((const ggml_fp16_t *) v_data, tmp, D);
+                        vc = tmp;
+                    }
+                    for (int d = 0; d < D; ++d) {
+                        vkq[d] += vs*vc[d];
+                    }
+                }
+            }
+        }
+
+        for (int64_t i = 0; i < nq1; ++i) {
+            // V /= S
+            const float S_inv = S[i] > 0.0f ? 1.0f/S[i] : 0.0f;
+
+            // permute(0, 2, 1, 3)
+            float * out = (float *) ((char *) dst->data + (iq3*ne2*ne1 + iq2 + (iq1 + i)*ne1)*nb1);
+            for (int d = 0; d < D; ++d) {
+                out[d] = VKQ[i*D + d]*S_inv;
+            }
+        }
+    }
+}
+
+size_t ggml_flash_attn_ext_tiled_wsize(int64_t DK, int64_t DV) {
+    const int64_t BQ = GGML_FA_TILE_Q;
+    const int64_t BK = GGML_FA_TILE_KV;
+
+    // the larger of the layouts of the generic kernel (Q in F16) and of the head dim specialized ones (Q and K^T in F32)
+    return sizeof(float)*(BQ*DK + BQ*BK + DK*BK + BK*DV + BQ*DV + 2*BQ);
+}
+
+// the head dims with a specialized kernel
+static bool ggml_flash_attn_ext_use_hd(const ggml_tensor * q, const ggml_tensor * k, const ggml_tensor * v) {
+    return k->type == GGML_TYPE_F16 && v->type == GGML_TYPE_F16 &&
+           q->ne[0] == 64 && k->ne[0] == 64 && v->ne[0] == 64;
+}
+
+bool ggml_flash_attn_ext_use_tiled(const ggml_tensor * q, const ggml_tensor * k, const ggml_tensor * v) {
+    if (ggml_flash_attn_ext_use_hd(q, k, v)) {
+        return true;
+    }
+    return k->type == GGML_TYPE_F16 && v->type == GGML_TYPE_F16 && q->ne[1] >= GGML_FA_TILE_Q && k->ne[1] >= GGML_FA_TILE_KV;
+}
+
 void ggml_compute_forward_flash_attn_ext(
         const ggml_compute_params * params,
         const ggml_tensor * q,
@@ -7073,7 +7639,13 @@ void ggml_compute_forward_flash_attn_ext(
         case GGML_PREC_F32:
             {
                 // uses F32 accumulators
-                ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                if (ggml_flash_attn_ext_use_hd(q, k, v)) {
+                    ggml_compute_forward_flash_attn_ext_f16_hd<64>(params, q, k, v, mask, dst);
+                } else if (ggml_flash_attn_ext_use_tiled(q, k, v)) {
+                    ggml_compute_forward_flash_attn_ext_f16_tiled(params, q, k, v, mask, dst);
+                } else {
+                    ggml_compute_forward_flash_attn_ext_f16(params, q, k, v, mask, dst);
+                }
             } break;
         default:
             {
@@ -20,10 +20,21 @@
 
 static const size_t CACHE_LINE_SIZE_F32 = CACHE_LINE_SIZE/sizeof(float);
 
+//
+// flash attention tiles (rows of Q x rows of K and V) of the cache-blocked CPU kernel
+//
+
+#define GGML_FA_TILE_Q  32
+#define GGML_FA_TILE_KV 64
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// work buffer per thread of the cache-blocked flash attention, and whether it is used for these tensors
+size_t ggml_flash_attn_ext_tiled_wsize(int64_t DK, int64_t DV);
+bool   ggml_flash_attn_ext_use_tiled(const struct ggml_tensor * q, const struct ggml_tensor * k, const struct ggml_tensor * v);
+
 void ggml_compute_forward_dup(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_add(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_add1(const struct ggml_compute_params * params, struct ggml_tensor * dst);
@@ -42,6 +53,7 @@ void ggml_compute_forward_rms_norm(const struct ggml_compute_params * params, st
 void ggml_compute_forward_rms_norm_back(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_group_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_l2_norm(const struct ggml_compute_params * params, struct ggml_tensor * dst);
+void ggml_compute_forward_norm_affine(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_out_prod(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_scale(const struct ggml_compute_params * params, struct ggml_tensor * dst);
 void ggml_compute_forward_set(const struct ggml_compute_params * params, struct ggml_tensor * dst);
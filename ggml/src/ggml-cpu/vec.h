@@ -13,7 +13,12 @@
 // floating point type used to accumulate sums
 typedef double ggml_float;
 
+// the F32 GELU looks up the F16 table (with the precision of F16) when built with GGML_CPU_GELU_FP16 or without
+// a vectorized expf, otherwise it is computed in F32 with ggml_v_expf
+#if defined(GGML_CPU_GELU_FP16) || !((defined(__ARM_NEON) && defined(__aarch64__)) || (defined(__AVX512F__) && defined(__AVX512DQ__)) || \
+                                     (defined(__AVX2__) && defined(__FMA__)) || defined(__SSE2__))
 #define GGML_GELU_FP16
+#endif
 #define GGML_GELU_QUICK_FP16
 
 #define GGML_SOFT_MAX_UNROLL 4
@@ -43,6 +48,9 @@ void ggml_vec_dot_bf16(int n, float * GGML_RESTRICT s, size_t bs, ggml_bf16_t *
 void ggml_vec_dot_f16(int n, float * GGML_RESTRICT s, size_t bs, ggml_fp16_t * GGML_RESTRICT x, size_t bx, ggml_fp16_t * GGML_RESTRICT y, size_t by, int nrc);
 
 void ggml_vec_silu_f32(const int n, float * y, const float * x);
+#ifndef GGML_GELU_FP16
+void ggml_vec_gelu_f32(const int n, float * y, const float * x);
+#endif
 ggml_float ggml_vec_soft_max_f32(const int n, float * y, const float * x, float max);
 ggml_float ggml_vec_log_soft_max_f32(const int n, float * y, const float * x, float max);
 
@@ -321,6 +329,39 @@ inline static void ggml_vec_scale_f16(const int n, ggml_fp16_t * y, const float
 #endif
 }
 
+// y = (x - mean)*scale*w + b
+inline static void ggml_vec_norm_affine_f32(const int n, float * GGML_RESTRICT y, const float * GGML_RESTRICT x, const float mean, const float scale,
+        const float * GGML_RESTRICT w, const float * GGML_RESTRICT b) {
+#if defined(GGML_SIMD)
+    const int np = (n & ~(GGML_F32_STEP - 1));
+
+    GGML_F32_VEC vm = GGML_F32_VEC_SET1(-mean);
+    GGML_F32_VEC vs = GGML_F32_VEC_SET1(scale);
+
+    GGML_F32_VEC ay[GGML_F32_ARR];
+
+    for (int i = 0; i < np; i += GGML_F32_STEP) {
+        for (int j = 0; j < GGML_F32_ARR; j++) {
+            ay[j] = GGML_F32_VEC_LOAD(x + i + j*GGML_F32_EPR);
+            ay[j] = GGML_F32_VEC_MUL(GGML_F32_VEC_ADD(ay[j], vm), vs);
+            ay[j] = GGML_F32_VEC_FMA(GGML_F32_VEC_LOAD(b + i + j*GGML_F32_EPR), ay[j], GGML_F32_VEC_LOAD(w + i + j*GGML_F32_EPR));
+
+            GGML_F32_VEC_STORE(y + i + j*GGML_F32_EPR, ay[j]);
+        }
+    }
+
+    // leftovers
+    for (int i = np; i < n; ++i) {
+        y[i] = (x[i] - mean)*scale*w[i] + b[i];
+    }
+#else
+    // scalar
+    for (int i = 0; i < n; ++i) {
+        y[i] = (x[i] - mean)*scale*w[i] + b[i];
+    }
+#endif
+}
+
 inline static void ggml_vec_norm_f32 (const int n, float * s, const float * x) { ggml_vec_dot_f32(n, s, 0, x, 0, x, 0, 1); *s = sqrtf(*s);   }
 inline static void ggml_vec_sqr_f32  (const int n, float * y, const float * x) { for (int i = 0; i < n; ++i) y[i] = x[i]*x[i];   }
 inline static void ggml_vec_sqr_f16 (const int n, ggml_fp16_t * y, const ggml_fp16_t * x) {
@@ -455,12 +496,6 @@ inline static void ggml_vec_gelu_f32(const int n, float * y, const float * x) {
         }
     }
 }
-#else
-inline static void ggml_vec_gelu_f32(const int n, float * y, const float * x) {
-    for (int i = 0; i < n; ++i) {
-        y[i] = ggml_gelu_f32(x[i]);
-    }
-}
 #endif
 
 inline static float ggml_gelu_quick_f32(float x) {
@@ -551,6 +586,15 @@ inline static float32x4_t ggml_v_silu(float32x4_t x) {
     return vdivq_f32(x, one_plus_exp_neg_x);
 }
 
+// computes gelu 0.5*x*(1+tanh(z)) = x/(1+exp(-2z)) in single precision vector
+inline static float32x4_t ggml_v_gelu(float32x4_t x) {
+    const float32x4_t c1 = vdupq_n_f32(-2.0f*SQRT_2_OVER_PI);
+    const float32x4_t c2 = vdupq_n_f32(-2.0f*SQRT_2_OVER_PI*GELU_COEF_A);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t neg_2z = vmulq_f32(x, vfmaq_f32(c1, c2, vmulq_f32(x, x)));
+    return vdivq_f32(x, vaddq_f32(one, ggml_v_expf(neg_2z)));
+}
+
 #elif defined(__AVX512F__) && defined(__AVX512DQ__)
 
 // adapted from arm limited optimized routine
@@ -594,6 +638,15 @@ inline static __m512 ggml_v_silu(__m512 x) {
     return _mm512_div_ps(x, one_plus_exp_neg_x);
 }
 
+// computes gelu 0.5*x*(1+tanh(z)) = x/(1+exp(-2z)) in single precision vector
+inline static __m512 ggml_v_gelu(__m512 x) {
+    const __m512 c1 = _mm512_set1_ps(-2.0f*SQRT_2_OVER_PI);
+    const __m512 c2 = _mm512_set1_ps(-2.0f*SQRT_2_OVER_PI*GELU_COEF_A);
+    const __m512 one = _mm512_set1_ps(1);
+    const __m512 neg_2z = _mm512_mul_ps(x, _mm512_fmadd_ps(c2, _mm512_mul_ps(x, x), c1));
+    return _mm512_div_ps(x, _mm512_add_ps(one, ggml_v_expf(neg_2z)));
+}
+
 #elif defined(__AVX2__) && defined(__FMA__)
 
 // adapted from arm limited optimized routine
@@ -649,6 +702,15 @@ inline static __m256 ggml_v_silu(__m256 x) {
     return _mm256_div_ps(x, one_plus_exp_neg_x);
 }
 
+// computes gelu 0.5*x*(1+tanh(z)) = x/(1+exp(-2z)) in single precision vector
+inline static __m256 ggml_v_gelu(__m256 x) {
+    const __m256 c1 = _mm256_set1_ps(-2.0f*SQRT_2_OVER_PI);
+    const __m256 c2 = _mm256_set1_ps(-2.0f*SQRT_2_OVER_PI*GELU_COEF_A);
+    const __m256 one = _mm256_set1_ps(1);
+    const __m256 neg_2z = _mm256_mul_ps(x, _mm256_fmadd_ps(c2, _mm256_mul_ps(x, x), c1));
+    return _mm256_div_ps(x, _mm256_add_ps(one, ggml_v_expf(neg_2z)));
+}
+
 #elif defined(__SSE2__) // __AVX2__ / __ARM_NEON
 
 #if defined(__FMA__)
@@ -703,6 +765,15 @@ inline static __m128 ggml_v_silu(__m128 x) {
     return _mm_div_ps(x, one_plus_exp_neg_x);
 }
 
+// computes gelu 0.5*x*(1+tanh(z)) = x/(1+exp(-2z)) in single precision vector
+inline static __m128 ggml_v_gelu(__m128 x) {
+    const __m128 c1 = _mm_set1_ps(-2.0f*SQRT_2_OVER_PI);
+    const __m128 c2 = _mm_set1_ps(-2.0f*SQRT_2_OVER_PI*GELU_COEF_A);
+    const __m128 one = _mm_set1_ps(1);
+    const __m128 neg_2z = _mm_mul_ps(x, MADD128(c2, _mm_mul_ps(x, x), c1));
+    return _mm_div_ps(x, _mm_add_ps(one, ggml_v_expf(neg_2z)));
+}
+
 #endif // __ARM_NEON / __AVX2__ / __SSE2__
 
 inline static void ggml_vec_silu_f16(const int n, ggml_fp16_t * y, const ggml_fp16_t * x) {
@@ -8,6 +8,8 @@
 
 #import <Metal/Metal.h>
 
+#import <pthread.h>
+
 #undef MIN
 #undef MAX
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -40,30 +42,44 @@ static const NSInteger MTLGPUFamilyMetal3_GGML = 5001;
 static struct ggml_backend_reg    g_ggml_backend_metal_reg;
 static struct ggml_backend_device g_ggml_backend_metal_device;
 
+struct ggml_metal_kernel;
+
 // information about a Metal device
 // note: assumes single GPU device - the default one
 // TODO: support multiple GPU devices
 static struct ggml_backend_metal_device_context {
+    pthread_mutex_t mutex; // the backends can be created and freed from several threads
+
     id<MTLDevice> mtl_device;
     int           mtl_device_ref_count;
     id<MTLLibrary> mtl_library;
 
+    // the compute pipelines are shared by the backends of the device - each backend only has its own command queue,
+    // so that the graphs of several backends (e.g. one per whisper_state) are executed concurrently on the GPU
+    struct ggml_metal_kernel * kernels;
+    int                        n_kernels;
+
     bool has_simdgroup_reduction;
     bool has_simdgroup_mm;
     bool has_residency_sets;
     bool has_bfloat;
     bool use_bfloat;
+    bool use_fusion;
 
     char name[128];
 } g_ggml_ctx_dev_main = {
+    /*.mutex                   =*/ PTHREAD_MUTEX_INITIALIZER,
     /*.mtl_device              =*/ nil,
     /*.mtl_device_ref_count    =*/ 0,
     /*.mtl_library             =*/ nil,
+    /*.kernels                 =*/ NULL,
+    /*.n_kernels               =*/ 0,
     /*.has_simdgroup_reduction =*/ false,
     /*.has_simdgroup_mm        =*/ false,
     /*.has_residency_sets      =*/ false,
     /*.has_bfloat              =*/ false,
     /*.use_bfloat              =*/ false,
+    /*.use_fusion              =*/ true,
     /*.name                    =*/ "",
 };
 
@@ -71,6 +87,8 @@ static struct ggml_backend_metal_device_context {
 static id<MTLDevice> ggml_backend_metal_device_acq(struct ggml_backend_metal_device_context * ctx) {
     assert(ctx != NULL);
 
+    pthread_mutex_lock(&ctx->mutex);
+
     if (ctx->mtl_device == nil) {
         ctx->mtl_device = MTLCreateSystemDefaultDevice();
     }
@@ -94,22 +112,38 @@ static id<MTLDevice> ggml_backend_metal_device_acq(struct ggml_backend_metal_dev
         ctx->use_bfloat = false;
 #endif
 
+        ctx->use_fusion = getenv("GGML_METAL_NO_FUSION") == NULL;
+
         strncpy(ctx->name, [[ctx->mtl_device name] UTF8String], sizeof(ctx->name) - 1);
     }
 
     ctx->mtl_device_ref_count++;
 
-    return ctx->mtl_device;
+    id<MTLDevice> device = ctx->mtl_device;
+
+    pthread_mutex_unlock(&ctx->mutex);
+
+    return device;
 }
 
+static void ggml_metal_kernels_free(struct ggml_metal_kernel * kernels, int n_kernels);
+
 // release
 static void ggml_backend_metal_device_rel(struct ggml_backend_metal_device_context * ctx) {
     assert(ctx != NULL);
     assert(ctx->mtl_device_ref_count > 0);
 
+    pthread_mutex_lock(&ctx->mutex);
+
     ctx->mtl_device_ref_count--;
 
     if (ctx->mtl_device_ref_count == 0) {
+        if (ctx->kernels) {
+            ggml_metal_kernels_free(ctx->kernels, ctx->n_kernels);
+            ctx->kernels   = NULL;
+            ctx->n_kernels = 0;
+        }
+
         if (ctx->mtl_library) {
             [ctx->mtl_library release];
             ctx->mtl_library = nil;
@@ -120,6 +154,8 @@ static void ggml_backend_metal_device_rel(struct ggml_backend_metal_device_conte
             ctx->mtl_device = nil;
         }
     }
+
+    pthread_mutex_unlock(&ctx->mutex);
 }
 
 // kernels
@@ -128,9 +164,18 @@ struct ggml_metal_kernel {
     id<MTLComputePipelineState> pipeline;
 };
 
+static void ggml_metal_kernels_free(struct ggml_metal_kernel * kernels, int n_kernels) {
+    for (int i = 0; i < n_kernels; ++i) {
+        [kernels[i].pipeline release];
+    }
+
+    free(kernels);
+}
+
 enum ggml_metal_kernel_type {
     GGML_METAL_KERNEL_TYPE_ADD,
     GGML_METAL_KERNEL_TYPE_ADD_ROW,
+    GGML_METAL_KERNEL_TYPE_ADD_ROW_GELU,
     GGML_METAL_KERNEL_TYPE_SUB,
     GGML_METAL_KERNEL_TYPE_SUB_ROW,
     GGML_METAL_KERNEL_TYPE_MUL,
@@ -187,6 +232,7 @@ enum ggml_metal_kernel_type {
     GGML_METAL_KERNEL_TYPE_L2_NORM,
     GGML_METAL_KERNEL_TYPE_GROUP_NORM,
     GGML_METAL_KERNEL_TYPE_NORM,
+    GGML_METAL_KERNEL_TYPE_NORM_AFFINE,
     GGML_METAL_KERNEL_TYPE_SSM_CONV_F32,
     GGML_METAL_KERNEL_TYPE_SSM_SCAN_F32,
     GGML_METAL_KERNEL_TYPE_RWKV_WKV6_F32,
@@ -495,7 +541,8 @@ struct ggml_backend_metal_context {
 
     dispatch_queue_t d_queue;
 
-    struct ggml_metal_kernel kernels[GGML_METAL_KERNEL_TYPE_COUNT];
+    // the pipelines of the device (ggml_backend_metal_device_context::kernels)
+    const struct ggml_metal_kernel * kernels;
 
     // capture state
     bool capture_next_compute;
@@ -567,12 +614,31 @@ static id<MTLLibrary> ggml_metal_load_library(id<MTLDevice> device, bool use_bfl
     NSString * src = nil;
 
 #if GGML_METAL_EMBED_LIBRARY
-    GGML_LOG_INFO("%s: using embedded metal library\n", __func__);
-
     extern const char ggml_metallib_start[];
     extern const char ggml_metallib_end[];
 
+#if GGML_METAL_EMBED_PRECOMPILED
+    GGML_LOG_INFO("%s: using embedded precompiled metal library\n", __func__);
+
+    // the kernels were compiled at build time, so there is no compilation of the source during init
+    // note: the preprocessor macros were fixed at build time as well (see GGML_METAL_USE_BF16)
+    dispatch_data_t data = dispatch_data_create(ggml_metallib_start, ggml_metallib_end-ggml_metallib_start, nil, DISPATCH_DATA_DESTRUCTOR_DEFAULT);
+
+    metal_library = [device newLibraryWithData:data error:&error];
+
+#if !__has_feature(objc_arc)
+    dispatch_release(data);
+#endif
+
+    if (error) {
+        GGML_LOG_ERROR("%s: error: %s\n", __func__, [[error description] UTF8String]);
+        return NULL;
+    }
+#else
+    GGML_LOG_INFO("%s: using embedded metal library\n", __func__);
+
     src = [[NSString alloc] initWithBytes:ggml_metallib_start length:(ggml_metallib_end-ggml_metallib_start) encoding:NSUTF8StringEncoding];
+#endif // GGML_METAL_EMBED_PRECOMPILED
 
 #else
 
@@ -716,10 +782,12 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
     ctx->d_queue = dispatch_queue_create("ggml-metal", DISPATCH_QUEUE_CONCURRENT);
 
     // load library
+    pthread_mutex_lock(&ctx_dev->mutex);
     if (ctx_dev->mtl_library == nil) {
         ctx_dev->mtl_library = ggml_metal_load_library(device, ctx_dev->use_bfloat);
     }
     id<MTLLibrary> metal_library = ctx_dev->mtl_library;
+    pthread_mutex_unlock(&ctx_dev->mutex);
     if (metal_library == nil) {
         GGML_LOG_ERROR("%s: error: metal library is nil\n", __func__);
         return NULL;
@@ -759,6 +827,7 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
     GGML_LOG_INFO("%s: has residency sets    = %s\n", __func__, ctx_dev->has_residency_sets          ? "true" : "false");
     GGML_LOG_INFO("%s: has bfloat            = %s\n", __func__, ctx_dev->has_bfloat                  ? "true" : "false");
     GGML_LOG_INFO("%s: use bfloat            = %s\n", __func__, ctx_dev->use_bfloat                  ? "true" : "false");
+    GGML_LOG_INFO("%s: use fusion            = %s\n", __func__, ctx_dev->use_fusion                  ? "true" : "false");
     GGML_LOG_INFO("%s: hasUnifiedMemory      = %s\n", __func__, ctx_dev->mtl_device.hasUnifiedMemory ? "true" : "false");
 
     ctx->capture_next_compute = false;
@@ -777,17 +846,16 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
     }
 #endif
 
-    // load kernels
-    {
+    // load kernels - once per device, the next backends use the same pipelines
+    pthread_mutex_lock(&ctx_dev->mutex);
+    if (ctx_dev->kernels == NULL) {
         NSError * error = nil;
 
-        for (int i = 0; i < GGML_METAL_KERNEL_TYPE_COUNT; ++i) {
-            ctx->kernels[i].pipeline = nil;
-        }
+        struct ggml_metal_kernel * kernels = calloc(GGML_METAL_KERNEL_TYPE_COUNT, sizeof(struct ggml_metal_kernel));
 
 #define GGML_METAL_ADD_KERNEL(e, name, supported) \
         if (supported) { \
-            struct ggml_metal_kernel * kernel = &ctx->kernels[e]; \
+            struct ggml_metal_kernel * kernel = &kernels[e]; \
             id<MTLFunction> metal_function = [metal_library newFunctionWithName:@"kernel_"#name]; \
             kernel->pipeline = [device newComputePipelineStateWithFunction:metal_function error:&error]; \
             GGML_LOG_DEBUG("%s: loaded %-40s %16p | th_max = %4d | th_width = %4d\n", __func__, "kernel_"#name, (void *) kernel->pipeline, \
@@ -796,6 +864,8 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
             [metal_function release]; \
             if (error) { \
                 GGML_LOG_ERROR("%s: error: load pipeline error: %s\n", __func__, [[error description] UTF8String]); \
+                ggml_metal_kernels_free(kernels, GGML_METAL_KERNEL_TYPE_COUNT); \
+                pthread_mutex_unlock(&ctx_dev->mutex); \
                 return NULL; \
             } \
         } else { \
@@ -810,6 +880,7 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
 
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_ADD,                             add,                             true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_ADD_ROW,                         add_row,                         true);
+        GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_ADD_ROW_GELU,                    add_row_gelu,                    true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_SUB,                             sub,                             true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_SUB_ROW,                         sub_row,                         true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_MUL,                             mul,                             true);
@@ -866,6 +937,7 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_L2_NORM,                         l2_norm,                         has_simdgroup_reduction);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_GROUP_NORM,                      group_norm,                      has_simdgroup_reduction);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_NORM,                            norm,                            true);
+        GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_NORM_AFFINE,                     norm_affine,                     true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_SSM_CONV_F32,                    ssm_conv_f32,                    true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_SSM_SCAN_F32,                    ssm_scan_f32,                    true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_RWKV_WKV6_F32,                   rwkv_wkv6_f32,                   true);
@@ -1165,7 +1237,12 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_ARGMAX,                          argmax,                          true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_POOL_2D_AVG_F32,                 pool_2d_avg_f32,                 true);
         GGML_METAL_ADD_KERNEL(GGML_METAL_KERNEL_TYPE_POOL_2D_MAX_F32,                 pool_2d_max_f32,                 true);
+
+        ctx_dev->kernels   = kernels;
+        ctx_dev->n_kernels = GGML_METAL_KERNEL_TYPE_COUNT;
     }
+    ctx->kernels = ctx_dev->kernels;
+    pthread_mutex_unlock(&ctx_dev->mutex);
 
     return ctx;
 }
@@ -1173,9 +1250,7 @@ static struct ggml_backend_metal_context * ggml_metal_init(ggml_backend_dev_t de
 static void ggml_metal_free(struct ggml_backend_metal_context * ctx) {
     GGML_LOG_INFO("%s: deallocating\n", __func__);
 
-    for (int i = 0; i < GGML_METAL_KERNEL_TYPE_COUNT; ++i) {
-        [ctx->kernels[i].pipeline release];
-    }
+    // the pipelines are released with the device (ggml_backend_metal_device_rel)
 
     Block_release(ctx->encode_async);
 
@@ -1364,6 +1439,9 @@ static bool ggml_metal_supports_op(const struct ggml_backend_metal_device_contex
             return true;
         case GGML_OP_NORM:
             return has_simdgroup_reduction && (op->ne[0] % 4 == 0 && ggml_is_contiguous_1(op->src[0]));
+        case GGML_OP_NORM_AFFINE:
+            return has_simdgroup_reduction && (op->ne[0] % 4 == 0 && ggml_is_contiguous_1(op->src[0])) &&
+                op->src[1]->type == GGML_TYPE_F32 && op->src[2]->type == GGML_TYPE_F32;
         case GGML_OP_ROPE:
             {
                 const int mode = ((const int32_t *) op->op_params)[2];
@@ -1486,9 +1564,50 @@ static bool ggml_metal_supports_op(const struct ggml_backend_metal_device_contex
     }
 }
 
-static void ggml_metal_encode_node(
+// check if the ADD at node idx can be encoded together with the GELU that follows it: dst = gelu(src0 + bias)
+// the GELU must be the next node of the same command buffer and the only consumer of the sum, since the sum is never written
+static bool ggml_metal_can_fuse_add_gelu(struct ggml_cgraph * gf, int idx, int idx_end) {
+    if (idx + 1 >= idx_end) {
+        return false;
+    }
+
+    const struct ggml_tensor * add  = ggml_graph_node(gf, idx);
+    const struct ggml_tensor * gelu = ggml_graph_node(gf, idx + 1);
+
+    if (add->op != GGML_OP_ADD || gelu->op != GGML_OP_UNARY || ggml_get_unary_op(gelu) != GGML_UNARY_OP_GELU) {
+        return false;
+    }
+
+    if (gelu->src[0] != add || gelu->type != GGML_TYPE_F32 || !ggml_are_same_shape(add, gelu) || !ggml_is_contiguous(gelu)) {
+        return false;
+    }
+
+    if (add->flags & GGML_TENSOR_FLAG_OUTPUT) {
+        return false;
+    }
+
+    for (int i = idx + 2; i < ggml_graph_n_nodes(gf); ++i) {
+        const struct ggml_tensor * node = ggml_graph_node(gf, i);
+
+        if (node->view_src == add) {
+            return false;
+        }
+
+        for (int j = 0; j < GGML_MAX_SRC; ++j) {
+            if (node->src[j] == add) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// returns the number of graph nodes that were encoded
+static int ggml_metal_encode_node(
                         ggml_backend_t   backend,
                                    int   idx,
+                                   int   idx_end,
           id<MTLComputeCommandEncoder>   encoder) {
     struct ggml_backend_metal_context        * ctx     = backend->context;
     struct ggml_backend_metal_device_context * ctx_dev = backend->device->context;
@@ -1505,7 +1624,7 @@ static void ggml_metal_encode_node(
     struct ggml_tensor * dst  = node;
 
     if (ggml_is_empty(dst)) {
-        return;
+        return 1;
     }
 
     switch (dst->op) {
@@ -1516,7 +1635,7 @@ static void ggml_metal_encode_node(
         case GGML_OP_PERMUTE:
             {
                 // noop -> next node
-            } return;
+            } return 1;
         default:
             {
             } break;
@@ -1581,6 +1700,8 @@ static void ggml_metal_encode_node(
     id<MTLBuffer> id_src2 = src2 ? ggml_metal_get_buffer(src2, &offs_src2) : nil;
     id<MTLBuffer> id_dst  = dst  ? ggml_metal_get_buffer(dst,  &offs_dst)  : nil;
 
+    int n_fuse = 1;
+
 #if 0
     GGML_LOG_INFO("%s: op - %s\n", __func__, ggml_op_name(dst->op));
     if (src0) {
@@ -1665,7 +1786,19 @@ static void ggml_metal_encode_node(
                     GGML_ASSERT(ne11 == 1);
 
                     switch (dst->op) {
-                        case GGML_OP_ADD: pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_ADD_ROW].pipeline; break;
+                        case GGML_OP_ADD:
+                            {
+                                pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_ADD_ROW].pipeline;
+
+                                // bias + GELU of the MLP blocks: write gelu(src0 + src1) directly into the output of the GELU
+                                if (ctx_dev->use_fusion && ggml_metal_can_fuse_add_gelu(gf, idx, idx_end)) {
+                                    pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_ADD_ROW_GELU].pipeline;
+
+                                    id_dst = ggml_metal_get_buffer(ggml_graph_node(gf, idx + 1), &offs_dst);
+
+                                    n_fuse = 2;
+                                }
+                            } break;
                         case GGML_OP_SUB: pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_SUB_ROW].pipeline; break;
                         case GGML_OP_MUL: pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_MUL_ROW].pipeline; break;
                         case GGML_OP_DIV: pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_DIV_ROW].pipeline; break;
@@ -3395,6 +3528,44 @@ static void ggml_metal_encode_node(
 
                 const int64_t nrows = ggml_nrows(src0);
 
+                [encoder dispatchThreadgroups:MTLSizeMake(nrows, 1, 1) threadsPerThreadgroup:MTLSizeMake(nth, 1, 1)];
+            } break;
+        case GGML_OP_NORM_AFFINE:
+            {
+                GGML_ASSERT(ne00 % 4 == 0);
+                GGML_ASSERT(ggml_is_contiguous_1(src0));
+
+                float eps;
+                memcpy(&eps, dst->op_params, sizeof(float));
+
+                id<MTLComputePipelineState> pipeline = ctx->kernels[GGML_METAL_KERNEL_TYPE_NORM_AFFINE].pipeline;
+
+                int nth = 32; // SIMD width
+
+                while (nth < ne00/4 && nth < (int) pipeline.maxTotalThreadsPerThreadgroup) {
+                    nth *= 2;
+                }
+
+                nth = MIN(nth, ne00/4);
+
+                ggml_metal_kargs_norm args = {
+                    /*.ne00   =*/ ne00,
+                    /*.ne00_4 =*/ ne00/4,
+                    /*.nb01   =*/ nb01,
+                    /*.eps    =*/ eps,
+                };
+
+                [encoder setComputePipelineState:pipeline];
+                [encoder setBytes:&args length:sizeof(args) atIndex:0];
+                [encoder setBuffer:id_src0 offset:offs_src0 atIndex:1];
+                [encoder setBuffer:id_src1 offset:offs_src1 atIndex:2];
+                [encoder setBuffer:id_src2 offset:offs_src2 atIndex:3];
+                [encoder setBuffer:id_dst  offset:offs_dst  atIndex:4];
+
+                [encoder setThreadgroupMemoryLength:32*sizeof(float) atIndex:0];
+
+                const int64_t nrows = ggml_nrows(src0);
+
                 [encoder dispatchThreadgroups:MTLSizeMake(nrows, 1, 1) threadsPerThreadgroup:MTLSizeMake(nth, 1, 1)];
             } break;
         case GGML_OP_ROPE:
@@ -4601,6 +4772,8 @@ static void ggml_metal_encode_node(
                 GGML_ABORT("fatal error");
             }
     }
+
+    return n_fuse;
 }
 
 static enum ggml_status ggml_metal_graph_compute(
@@ -5105,12 +5278,12 @@ static void ggml_backend_metal_set_n_cb(ggml_backend_t backend, int n_cb) {
 
         const bool should_capture = ctx->capture_next_compute;
 
-        for (int idx = node_start; idx < node_end; ++idx) {
+        for (int idx = node_start; idx < node_end;) {
             if (should_capture) {
                 [encoder pushDebugGroup:[NSString stringWithCString:ggml_op_desc(ggml_graph_node(ctx->gf, idx)) encoding:NSUTF8StringEncoding]];
             }
 
-            ggml_metal_encode_node(backend, idx, encoder);
+            idx += ggml_metal_encode_node(backend, idx, node_end, encoder);
 
             if (should_capture) {
                 [encoder popDebugGroup];
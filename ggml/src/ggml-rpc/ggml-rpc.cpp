@@ -42,6 +42,14 @@ typedef int sockfd_t;
 // cross-platform socket
 struct socket_t {
     sockfd_t fd;
+    // the commands of the backends and buffers that share the socket are serialized
+    std::mutex mutex;
+    // minor version of the server protocol
+    uint8_t minor = 0;
+    // RPC_CMD_GRAPH_COMPUTE responses that have not been read yet
+    uint32_t n_pending = 0;
+    // first failure of these graphs, returned by the next RPC_CMD_GRAPH_COMPUTE
+    enum ggml_status status = GGML_STATUS_SUCCESS;
     socket_t(sockfd_t fd) : fd(fd) {}
     ~socket_t() {
         GGML_PRINT_DEBUG("[%s] closing socket %d\n", __func__, this->fd);
@@ -93,6 +101,8 @@ enum rpc_cmd {
     RPC_CMD_INIT_TENSOR,
     RPC_CMD_GET_ALLOC_SIZE,
     RPC_CMD_HELLO,
+    RPC_CMD_SET_TENSOR_F16,
+    RPC_CMD_GET_TENSOR_F16,
     RPC_CMD_COUNT,
 };
 
@@ -378,8 +388,8 @@ static bool parse_endpoint(const std::string & endpoint, std::string & host, int
 }
 
 // RPC request : | rpc_cmd (1 byte) | request_size (8 bytes) | request_data (request_size bytes) |
-// No response
-static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cmd, const void * input, size_t input_size) {
+// the caller holds sock->mutex
+static bool send_rpc_req(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cmd, const void * input, size_t input_size) {
     uint8_t cmd_byte = cmd;
     if (!send_data(sock->fd, &cmd_byte, sizeof(cmd_byte))) {
         return false;
@@ -393,12 +403,9 @@ static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cm
     return true;
 }
 
-// RPC request : | rpc_cmd (1 byte) | request_size (8 bytes) | request_data (request_size bytes) |
 // RPC response: | response_size (8 bytes) | response_data (response_size bytes) |
-static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cmd, const void * input, size_t input_size, void * output, size_t output_size) {
-    if (!send_rpc_cmd(sock, cmd, input, input_size)) {
-        return false;
-    }
+// the caller holds sock->mutex
+static bool recv_rpc_rsp(const std::shared_ptr<socket_t> & sock, void * output, size_t output_size) {
     // TODO: currently the output_size is always known, do we need support for commands with variable output size?
     // even if we do, we can skip sending output_size from the server for commands with known output size
     uint64_t out_size;
@@ -414,6 +421,42 @@ static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cm
     return true;
 }
 
+// the server processes the commands of a socket in order, so the responses of the graphs that are computed
+// asynchronously come before the response of any later command
+// the caller holds sock->mutex
+static bool recv_rpc_pending(const std::shared_ptr<socket_t> & sock) {
+    for (; sock->n_pending > 0; sock->n_pending--) {
+        rpc_msg_graph_compute_rsp response;
+        if (!recv_rpc_rsp(sock, &response, sizeof(response))) {
+            return false;
+        }
+        if (response.result != GGML_STATUS_SUCCESS) {
+            GGML_LOG_ERROR("[%s] graph compute failed with status %d\n", __func__, (int) response.result);
+            if (sock->status == GGML_STATUS_SUCCESS) {
+                sock->status = (enum ggml_status) response.result;
+            }
+        }
+    }
+    return true;
+}
+
+// No response
+static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cmd, const void * input, size_t input_size) {
+    std::lock_guard<std::mutex> lock(sock->mutex);
+    return send_rpc_req(sock, cmd, input, input_size);
+}
+
+static bool send_rpc_cmd(const std::shared_ptr<socket_t> & sock, enum rpc_cmd cmd, const void * input, size_t input_size, void * output, size_t output_size) {
+    std::lock_guard<std::mutex> lock(sock->mutex);
+    if (!recv_rpc_pending(sock)) {
+        return false;
+    }
+    if (!send_rpc_req(sock, cmd, input, input_size)) {
+        return false;
+    }
+    return recv_rpc_rsp(sock, output, output_size);
+}
+
 // RPC client-side implementation
 
 static bool check_server_version(const std::shared_ptr<socket_t> & sock) {
@@ -427,9 +470,23 @@ static bool check_server_version(const std::shared_ptr<socket_t> & sock) {
     if (response.minor != RPC_PROTO_MINOR_VERSION || response.patch != RPC_PROTO_PATCH_VERSION) {
         fprintf(stderr, "WARNING: RPC server version mismatch: %d.%d.%d\n", response.major, response.minor, response.patch);
     }
+    sock->minor = response.minor;
     return true;
 }
 
+// with GGML_RPC_F16=1, the F32 tensors of the compute buffers (the inputs and the outputs of the graphs) are sent
+// as F16, which halves the traffic at the cost of the precision - the weights are always sent as they are
+static bool use_f16_payload(ggml_backend_buffer_t buffer, const std::shared_ptr<socket_t> & sock, const ggml_tensor * tensor, size_t offset, size_t size) {
+    static const bool enabled = [] {
+        const char * env = getenv("GGML_RPC_F16");
+        return env != nullptr && atoi(env) != 0;
+    }();
+
+    return enabled && sock->minor >= 1 && tensor->type == GGML_TYPE_F32 &&
+           ggml_backend_buffer_get_usage(buffer) == GGML_BACKEND_BUFFER_USAGE_COMPUTE &&
+           offset % sizeof(float) == 0 && size % sizeof(float) == 0;
+}
+
 static std::shared_ptr<socket_t> get_socket(const std::string & endpoint) {
     static std::mutex mutex;
     std::lock_guard<std::mutex> lock(mutex);
@@ -563,6 +620,17 @@ static void ggml_backend_rpc_buffer_set_tensor(ggml_backend_buffer_t buffer, ggm
             return;
         }
     }
+    if (use_f16_payload(buffer, ctx->sock, tensor, offset, size)) {
+        // input serialization format: | rpc_tensor | offset (8 bytes) | data (size/2 bytes, F16)
+        const int64_t n = size / sizeof(float);
+        std::vector<uint8_t> input(sizeof(rpc_tensor) + sizeof(uint64_t) + n*sizeof(ggml_fp16_t), 0);
+        memcpy(input.data(), &rpc_tensor, sizeof(rpc_tensor));
+        memcpy(input.data() + sizeof(rpc_tensor), &offset, sizeof(offset));
+        ggml_fp32_to_fp16_row((const float *) data, (ggml_fp16_t *)(input.data() + sizeof(rpc_tensor) + sizeof(offset)), n);
+        bool status = send_rpc_cmd(ctx->sock, RPC_CMD_SET_TENSOR_F16, input.data(), input.size());
+        GGML_ASSERT(status);
+        return;
+    }
     // input serialization format: | rpc_tensor | offset (8 bytes) | data (size bytes)
     size_t input_size = sizeof(rpc_tensor) + sizeof(uint64_t) + size;
     std::vector<uint8_t> input(input_size, 0);
@@ -579,6 +647,14 @@ static void ggml_backend_rpc_buffer_get_tensor(ggml_backend_buffer_t buffer, con
     request.tensor = serialize_tensor(tensor);
     request.offset = offset;
     request.size = size;
+    if (use_f16_payload(buffer, ctx->sock, tensor, offset, size)) {
+        const int64_t n = size / sizeof(float);
+        std::vector<ggml_fp16_t> response(n);
+        bool status = send_rpc_cmd(ctx->sock, RPC_CMD_GET_TENSOR_F16, &request, sizeof(request), response.data(), n*sizeof(ggml_fp16_t));
+        GGML_ASSERT(status);
+        ggml_fp16_to_fp32_row(response.data(), (float *) data, n);
+        return;
+    }
     bool status = send_rpc_cmd(ctx->sock, RPC_CMD_GET_TENSOR, &request, sizeof(request), data, size);
     GGML_ASSERT(status);
 }
@@ -710,8 +786,14 @@ static void ggml_backend_rpc_free(ggml_backend_t backend) {
 }
 
 static void ggml_backend_rpc_synchronize(ggml_backend_t backend) {
-    GGML_UNUSED(backend);
-    // this is no-op because we don't have any async operations
+    ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
+    auto sock = get_socket(rpc_ctx->endpoint);
+    if (sock == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(sock->mutex);
+    bool status = recv_rpc_pending(sock);
+    GGML_ASSERT(status);
 }
 
 static void add_tensor(ggml_tensor * tensor, std::vector<rpc_tensor> & tensors, std::unordered_set<ggml_tensor*> & visited) {
@@ -751,15 +833,25 @@ static void serialize_graph(const ggml_cgraph * cgraph, std::vector<uint8_t> & o
     memcpy(out_tensors, tensors.data(), n_tensors * sizeof(rpc_tensor));
 }
 
+// the graph is computed asynchronously: the response is read by ggml_backend_rpc_synchronize() or before the next
+// command that has a response, so the inputs of the next graph can be sent while the server computes this one
+// a failure of the computation is recorded there and returned by the next graph compute of the socket, which
+// is not sent - the caller does not go on with the outputs of a failed graph
 static enum ggml_status ggml_backend_rpc_graph_compute(ggml_backend_t backend, ggml_cgraph * cgraph) {
     ggml_backend_rpc_context * rpc_ctx = (ggml_backend_rpc_context *)backend->context;
     std::vector<uint8_t> input;
     serialize_graph(cgraph, input);
-    rpc_msg_graph_compute_rsp response;
     auto sock = get_socket(rpc_ctx->endpoint);
-    bool status = send_rpc_cmd(sock, RPC_CMD_GRAPH_COMPUTE, input.data(), input.size(), &response, sizeof(response));
+    std::lock_guard<std::mutex> lock(sock->mutex);
+    if (sock->status != GGML_STATUS_SUCCESS) {
+        const enum ggml_status result = sock->status;
+        sock->status = GGML_STATUS_SUCCESS;
+        return result;
+    }
+    bool status = send_rpc_req(sock, RPC_CMD_GRAPH_COMPUTE, input.data(), input.size());
     GGML_ASSERT(status);
-    return (enum ggml_status)response.result;
+    sock->n_pending++;
+    return GGML_STATUS_SUCCESS;
 }
 
 static ggml_backend_i ggml_backend_rpc_interface = {
@@ -864,8 +956,10 @@ public:
     bool free_buffer(const rpc_msg_free_buffer_req & request);
     bool buffer_clear(const rpc_msg_buffer_clear_req & request);
     bool set_tensor(const std::vector<uint8_t> & input);
+    bool set_tensor_f16(const std::vector<uint8_t> & input);
     bool set_tensor_hash(const std::vector<uint8_t> & input, rpc_msg_set_tensor_hash_rsp & response);
     bool get_tensor(const rpc_msg_get_tensor_req & request, std::vector<uint8_t> & response);
+    bool get_tensor_f16(const rpc_msg_get_tensor_req & request, std::vector<uint8_t> & response);
     bool copy_tensor(const rpc_msg_copy_tensor_req & request, rpc_msg_copy_tensor_rsp & response);
     bool graph_compute(const std::vector<uint8_t> & input, rpc_msg_graph_compute_rsp & response);
     bool init_tensor(const rpc_msg_init_tensor_req & request);
@@ -1082,6 +1176,25 @@ bool rpc_server::set_tensor(const std::vector<uint8_t> & input) {
     return true;
 }
 
+bool rpc_server::set_tensor_f16(const std::vector<uint8_t> & input) {
+    // serialization format: | rpc_tensor | offset (8 bytes) | data (size/2 bytes, F16) |
+    const size_t header_size = sizeof(rpc_tensor) + sizeof(uint64_t);
+    if (input.size() < header_size || (input.size() - header_size) % sizeof(ggml_fp16_t) != 0) {
+        return false;
+    }
+    const rpc_tensor * in_tensor = (const rpc_tensor *)input.data();
+    if (in_tensor->type != GGML_TYPE_F32) {
+        GGML_LOG_ERROR("[%s] F16 payload for a tensor of type %u\n", __func__, in_tensor->type);
+        return false;
+    }
+    // converted to the format of set_tensor
+    const int64_t n = (input.size() - header_size) / sizeof(ggml_fp16_t);
+    std::vector<uint8_t> input_f32(header_size + n*sizeof(float));
+    memcpy(input_f32.data(), input.data(), header_size);
+    ggml_fp16_to_fp32_row((const ggml_fp16_t *)(input.data() + header_size), (float *)(input_f32.data() + header_size), n);
+    return set_tensor(input_f32);
+}
+
 bool rpc_server::get_cached_file(uint64_t hash, std::vector<uint8_t> & data) {
     if (!cache_dir) {
         return false;
@@ -1216,6 +1329,21 @@ bool rpc_server::get_tensor(const rpc_msg_get_tensor_req & request, std::vector<
     return true;
 }
 
+bool rpc_server::get_tensor_f16(const rpc_msg_get_tensor_req & request, std::vector<uint8_t> & response) {
+    if (request.tensor.type != GGML_TYPE_F32 || request.size % sizeof(float) != 0) {
+        GGML_LOG_ERROR("[%s] F16 payload for a tensor of type %u\n", __func__, request.tensor.type);
+        return false;
+    }
+    std::vector<uint8_t> response_f32;
+    if (!get_tensor(request, response_f32)) {
+        return false;
+    }
+    const int64_t n = request.size / sizeof(float);
+    response.resize(n*sizeof(ggml_fp16_t));
+    ggml_fp32_to_fp16_row((const float *) response_f32.data(), (ggml_fp16_t *) response.data(), n);
+    return true;
+}
+
 bool rpc_server::copy_tensor(const rpc_msg_copy_tensor_req & request, rpc_msg_copy_tensor_rsp & response) {
     struct ggml_init_params params {
         /*.mem_size   =*/ 2*ggml_tensor_overhead(),
@@ -1502,6 +1630,16 @@ static void rpc_serve_client(ggml_backend_t backend, const char * cache_dir,
                 }
                 break;
             }
+            case RPC_CMD_SET_TENSOR_F16: {
+                std::vector<uint8_t> input;
+                if (!recv_msg(sockfd, input)) {
+                    return;
+                }
+                if (!server.set_tensor_f16(input)) {
+                    return;
+                }
+                break;
+            }
             case RPC_CMD_SET_TENSOR_HASH: {
                 std::vector<uint8_t> input;
                 if (!recv_msg(sockfd, input)) {
@@ -1543,6 +1681,20 @@ static void rpc_serve_client(ggml_backend_t backend, const char * cache_dir,
                 }
                 break;
             }
+            case RPC_CMD_GET_TENSOR_F16: {
+                rpc_msg_get_tensor_req request;
+                if (!recv_msg(sockfd, &request, sizeof(request))) {
+                    return;
+                }
+                std::vector<uint8_t> response;
+                if (!server.get_tensor_f16(request, response)) {
+                    return;
+                }
+                if (!send_msg(sockfd, response.data(), response.size())) {
+                    return;
+                }
+                break;
+            }
             case RPC_CMD_COPY_TENSOR: {
                 rpc_msg_copy_tensor_req request;
                 if (!recv_msg(sockfd, &request, sizeof(request))) {
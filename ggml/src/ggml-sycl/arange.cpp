@@ -0,0 +1,47 @@
+//
+// MIT license
+// SPDX-License-Identifier: MIT
+//
+
+#include "arange.hpp"
+
+static void arange_f32(float * dst, const int ne0, const float start, const float step,
+                       const sycl::nd_item<3> & item_ct1) {
+    const int i = item_ct1.get_local_id(2) + item_ct1.get_group(2) * item_ct1.get_local_range(2);
+    if (i >= ne0) {
+        return;
+    }
+    dst[i] = start + step * i;
+}
+
+static void arange_f32_sycl(float * dst, const int ne0, const float start, const float step,
+                            const queue_ptr & stream) {
+    const int num_blocks = (ne0 + SYCL_ARANGE_BLOCK_SIZE - 1) / SYCL_ARANGE_BLOCK_SIZE;
+    const sycl::range<3> block_dims(1, 1, SYCL_ARANGE_BLOCK_SIZE);
+    const sycl::range<3> block_nums(1, 1, num_blocks);
+    stream->parallel_for(
+        sycl::nd_range<3>(block_nums * block_dims, block_dims),
+        [=](sycl::nd_item<3> item_ct1) {
+            arange_f32(dst, ne0, start, step, item_ct1);
+        });
+}
+
+void ggml_sycl_op_arange(ggml_backend_sycl_context & ctx, ggml_tensor * dst) {
+    float * dst_d = (float *) dst->data;
+    dpct::queue_ptr stream = ctx.stream();
+
+    GGML_ASSERT(dst->type == GGML_TYPE_F32);
+
+    float start;
+    float stop;
+    float step;
+    memcpy(&start, (float *) dst->op_params + 0, sizeof(float));
+    memcpy(&stop,  (float *) dst->op_params + 1, sizeof(float));
+    memcpy(&step,  (float *) dst->op_params + 2, sizeof(float));
+
+    SYCL_CHECK(ggml_sycl_set_device(ctx.device));
+
+    arange_f32_sycl(dst_d, dst->ne[0], start, step, stream);
+
+    GGML_UNUSED(stop);
+}
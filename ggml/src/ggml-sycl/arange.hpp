@@ -0,0 +1,13 @@
+//
+// MIT license
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef GGML_SYCL_ARANGE_HPP
+#define GGML_SYCL_ARANGE_HPP
+
+#include "common.hpp"
+
+void ggml_sycl_op_arange(ggml_backend_sycl_context & ctx, ggml_tensor * dst);
+
+#endif // GGML_SYCL_ARANGE_HPP
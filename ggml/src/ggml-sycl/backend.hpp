@@ -32,5 +32,7 @@
 #include "element_wise.hpp"
 #include "cpy.hpp"
 #include "gla.hpp"
+#include "fattn.hpp"
+#include "arange.hpp"
 
 #endif // GGML_SYCL_BACKEND_HPP
@@ -0,0 +1,210 @@
+//
+// MIT license
+// SPDX-License-Identifier: MIT
+//
+
+#include "fattn.hpp"
+
+// Flash attention for the F16 KV caches of the encoder and decoder graphs of whisper
+//
+// One sub-group computes one row of queries of one head: the lanes score WARP_SIZE keys at a time (lane j computes
+// the dot product of the query with key j), the maximum and the sum of the softmax are updated online, and each lane
+// accumulates D/WARP_SIZE columns of the output from the values, so that the values are read in whole rows
+
+template <int D>
+static void flash_attn_ext_f16(
+        const char * q, const char * k, const char * v, const char * mask, float * dst,
+        const float scale, const int n_kv, const int n_head, const int n_q,
+        const int ne13_ratio, const int gqa_ratio,
+        const size_t nb01, const size_t nb02, const size_t nb03,
+        const size_t nb11, const size_t nb12, const size_t nb13,
+        const size_t nb21, const size_t nb22, const size_t nb23,
+        const size_t nb31,
+        const sycl::nd_item<3> & item_ct1, float * q_s) {
+    constexpr int n_col = D/WARP_SIZE; // columns of the output per lane
+
+    const int i3   = item_ct1.get_group(0);
+    const int iq   = item_ct1.get_group(1);
+    const int h    = item_ct1.get_group(2);
+    const int lane = item_ct1.get_local_id(2);
+
+    auto sg = item_ct1.get_sub_group();
+
+    const float * q_row = (const float *) (q + iq*nb01 + h*nb02 + i3*nb03);
+
+    // the query is used by all the lanes - scaled once
+    for (int d = lane; d < D; d += WARP_SIZE) {
+        q_s[d] = q_row[d]*scale;
+    }
+    item_ct1.barrier(sycl::access::fence_space::local_space);
+
+    const char * k_head = k + (h/gqa_ratio)*nb12 + (i3/ne13_ratio)*nb13;
+    const char * v_head = v + (h/gqa_ratio)*nb22 + (i3/ne13_ratio)*nb23;
+
+    const sycl::half * mask_row = mask ? (const sycl::half *) (mask + iq*nb31) : nullptr;
+
+    float acc[n_col];
+#pragma unroll
+    for (int c = 0; c < n_col; ++c) {
+        acc[c] = 0.0f;
+    }
+
+    float m = -INFINITY; // running maximum of the scores
+    float l = 0.0f;      // running sum of the softmax
+
+    for (int kv0 = 0; kv0 < n_kv; kv0 += WARP_SIZE) {
+        const int ikv = kv0 + lane;
+
+        float s = -INFINITY;
+        if (ikv < n_kv) {
+            const sycl::half * k_row = (const sycl::half *) (k_head + ikv*nb11);
+
+            float sum = 0.0f;
+#pragma unroll
+            for (int d = 0; d < D; ++d) {
+                sum += q_s[d]*static_cast<float>(k_row[d]);
+            }
+
+            s = mask_row ? sum + static_cast<float>(mask_row[ikv]) : sum;
+        }
+
+        const float m_new = sycl::fmax(m, warp_reduce_max(s, item_ct1));
+        if (m_new == -INFINITY) {
+            // all the keys so far are masked
+            continue;
+        }
+
+        const float p    = s == -INFINITY ? 0.0f : sycl::native::exp(s - m_new);
+        const float corr = m == -INFINITY ? 0.0f : sycl::native::exp(m - m_new);
+
+        l = l*corr + warp_reduce_sum(p, item_ct1);
+        m = m_new;
+
+#pragma unroll
+        for (int c = 0; c < n_col; ++c) {
+            acc[c] *= corr;
+        }
+
+        const int n_cur = sycl::min(WARP_SIZE, n_kv - kv0);
+        for (int j = 0; j < n_cur; ++j) {
+            const float pj = sycl::select_from_group(sg, p, j);
+            if (pj == 0.0f) {
+                continue;
+            }
+
+            const sycl::half * v_row = (const sycl::half *) (v_head + (kv0 + j)*nb21);
+#pragma unroll
+            for (int c = 0; c < n_col; ++c) {
+                acc[c] += pj*static_cast<float>(v_row[c*WARP_SIZE + lane]);
+            }
+        }
+    }
+
+    // dst is [D, n_head, n_q, ne3]
+    float * dst_row = dst + (((int64_t) i3*n_q + iq)*n_head + h)*D;
+
+    const float inv_l = l > 0.0f ? 1.0f/l : 0.0f;
+#pragma unroll
+    for (int c = 0; c < n_col; ++c) {
+        dst_row[c*WARP_SIZE + lane] = acc[c]*inv_l;
+    }
+}
+
+template <int D>
+static void flash_attn_ext_f16_sycl(const ggml_tensor * dst, const float scale, queue_ptr stream) {
+    const ggml_tensor * Q    = dst->src[0];
+    const ggml_tensor * K    = dst->src[1];
+    const ggml_tensor * V    = dst->src[2];
+    const ggml_tensor * mask = dst->src[3];
+
+    const char * q_d    = (const char *) Q->data;
+    const char * k_d    = (const char *) K->data;
+    const char * v_d    = (const char *) V->data;
+    const char * mask_d = mask ? (const char *) mask->data : nullptr;
+    float      * dst_d  = (float *) dst->data;
+
+    const int n_kv   = K->ne[1];
+    const int n_head = Q->ne[2];
+    const int n_q    = Q->ne[1];
+
+    const int ne13_ratio = Q->ne[3]/K->ne[3];
+    const int gqa_ratio  = Q->ne[2]/K->ne[2];
+
+    const size_t nb01 = Q->nb[1], nb02 = Q->nb[2], nb03 = Q->nb[3];
+    const size_t nb11 = K->nb[1], nb12 = K->nb[2], nb13 = K->nb[3];
+    const size_t nb21 = V->nb[1], nb22 = V->nb[2], nb23 = V->nb[3];
+    const size_t nb31 = mask ? mask->nb[1] : 0;
+
+    const sycl::range<3> block_dims(1, 1, WARP_SIZE);
+    const sycl::range<3> block_nums(Q->ne[3], n_q, n_head);
+
+    stream->submit([&](sycl::handler & cgh) {
+        sycl::local_accessor<float, 1> q_s(sycl::range<1>(D), cgh);
+
+        cgh.parallel_for(
+            sycl::nd_range<3>(block_nums * block_dims, block_dims),
+            [=](sycl::nd_item<3> item_ct1) [[sycl::reqd_sub_group_size(WARP_SIZE)]] {
+                flash_attn_ext_f16<D>(q_d, k_d, v_d, mask_d, dst_d, scale, n_kv, n_head, n_q, ne13_ratio, gqa_ratio,
+                                      nb01, nb02, nb03, nb11, nb12, nb13, nb21, nb22, nb23, nb31,
+                                      item_ct1, get_pointer(q_s));
+            });
+    });
+}
+
+bool ggml_sycl_flash_attn_ext_supported(const ggml_tensor * op) {
+    const ggml_tensor * Q    = op->src[0];
+    const ggml_tensor * K    = op->src[1];
+    const ggml_tensor * V    = op->src[2];
+    const ggml_tensor * mask = op->src[3];
+
+    float max_bias      = 0.0f;
+    float logit_softcap = 0.0f;
+    memcpy(&max_bias,      (const float *) op->op_params + 1, sizeof(float));
+    memcpy(&logit_softcap, (const float *) op->op_params + 2, sizeof(float));
+
+    if (max_bias != 0.0f || logit_softcap != 0.0f) {
+        return false;
+    }
+
+    if (Q->ne[0] != 64 && Q->ne[0] != 128) {
+        return false;
+    }
+
+    if (V->ne[0] != Q->ne[0]) {
+        return false;
+    }
+
+    if (Q->type != GGML_TYPE_F32 || K->type != GGML_TYPE_F16 || V->type != GGML_TYPE_F16) {
+        return false;
+    }
+
+    if (mask && mask->type != GGML_TYPE_F16) {
+        return false;
+    }
+
+    // the rows are read element by element
+    return Q->nb[0] == sizeof(float) && K->nb[0] == sizeof(sycl::half) && V->nb[0] == sizeof(sycl::half) &&
+           Q->ne[2] % K->ne[2] == 0 && Q->ne[3] % K->ne[3] == 0 && K->ne[2] == V->ne[2];
+}
+
+void ggml_sycl_op_flash_attn_ext(ggml_backend_sycl_context & ctx, ggml_tensor * dst) {
+    GGML_ASSERT(dst->type == GGML_TYPE_F32);
+    GGML_ASSERT(ggml_sycl_flash_attn_ext_supported(dst));
+
+    float scale;
+    memcpy(&scale, (const float *) dst->op_params + 0, sizeof(float));
+
+    dpct::queue_ptr main_stream = ctx.stream();
+    SYCL_CHECK(ggml_sycl_set_device(ctx.device));
+
+    switch (dst->src[0]->ne[0]) {
+        case 64:
+            flash_attn_ext_f16_sycl<64>(dst, scale, main_stream);
+            break;
+        case 128:
+            flash_attn_ext_f16_sycl<128>(dst, scale, main_stream);
+            break;
+        default:
+            GGML_ABORT("fatal error");
+    }
+}
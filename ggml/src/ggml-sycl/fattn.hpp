@@ -0,0 +1,16 @@
+//
+// MIT license
+// SPDX-License-Identifier: MIT
+//
+
+#ifndef GGML_SYCL_FATTN_HPP
+#define GGML_SYCL_FATTN_HPP
+
+#include "common.hpp"
+
+// F16 K and V, head size 64 or 128, no ALiBi and no logit softcap
+bool ggml_sycl_flash_attn_ext_supported(const ggml_tensor * op);
+
+void ggml_sycl_op_flash_attn_ext(ggml_backend_sycl_context & ctx, ggml_tensor * dst);
+
+#endif // GGML_SYCL_FATTN_HPP
@@ -3372,6 +3372,9 @@ static bool ggml_sycl_compute_forward(ggml_backend_sycl_context & ctx, struct gg
         case GGML_OP_NORM:
             ggml_sycl_norm(ctx, dst);
             break;
+        case GGML_OP_NORM_AFFINE:
+            ggml_sycl_op_norm_affine(ctx, dst);
+            break;
         case GGML_OP_GROUP_NORM:
             ggml_sycl_group_norm(ctx, dst);
             break;
@@ -3464,6 +3467,12 @@ static bool ggml_sycl_compute_forward(ggml_backend_sycl_context & ctx, struct gg
         case GGML_OP_ARGSORT:
             ggml_sycl_argsort(ctx, dst);
             break;
+        case GGML_OP_ARANGE:
+            ggml_sycl_op_arange(ctx, dst);
+            break;
+        case GGML_OP_FLASH_ATTN_EXT:
+            ggml_sycl_op_flash_attn_ext(ctx, dst);
+            break;
         case GGML_OP_TIMESTEP_EMBEDDING:
             ggml_sycl_op_timestep_embedding(ctx, dst);
             break;
@@ -3996,6 +4005,14 @@ static bool ggml_backend_sycl_device_supports_op(ggml_backend_dev_t dev, const g
         case GGML_OP_L2_NORM:
         case GGML_OP_GROUP_NORM:
             return ggml_is_contiguous(op->src[0]);
+        case GGML_OP_NORM_AFFINE:
+            // the rows of the kernel are whole multiples of the sub-group
+            return ggml_is_contiguous(op->src[0]) && op->src[0]->ne[0] % WARP_SIZE == 0 &&
+                op->src[0]->type == GGML_TYPE_F32 && op->src[1]->type == GGML_TYPE_F32 && op->src[2]->type == GGML_TYPE_F32;
+        case GGML_OP_FLASH_ATTN_EXT:
+            return ggml_sycl_flash_attn_ext_supported(op);
+        case GGML_OP_ARANGE:
+            return op->type == GGML_TYPE_F32;
         case GGML_OP_SCALE:
             return true;
         case GGML_OP_CONT:
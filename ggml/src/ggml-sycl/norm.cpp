@@ -1,7 +1,10 @@
 #include "norm.hpp"
 
+// with affine, dst = w*norm(x) + b (GGML_OP_NORM_AFFINE)
+template <bool affine = false>
 static void norm_f32(const float* x, float* dst, const int ncols, const float eps,
-    const sycl::nd_item<3>& item_ct1, sycl::float2* s_sum, int block_size) {
+    const sycl::nd_item<3>& item_ct1, sycl::float2* s_sum, int block_size,
+    const float* w = nullptr, const float* b = nullptr) {
     const int row = item_ct1.get_group(2) * item_ct1.get_local_range(1) +
         item_ct1.get_local_id(1);
     const int tid = item_ct1.get_local_id(2);
@@ -44,7 +47,8 @@ static void norm_f32(const float* x, float* dst, const int ncols, const float ep
     const float inv_std = sycl::rsqrt(var + eps);
 
     for (int col = tid; col < ncols; col += block_size) {
-        dst[row * ncols + col] = (x[row * ncols + col] - mean) * inv_std;
+        const float yi = (x[row * ncols + col] - mean) * inv_std;
+        dst[row * ncols + col] = affine ? w[col] * yi + b[col] : yi;
     }
 }
 
@@ -224,9 +228,11 @@ static void l2_norm_f32(const float* x, float* dst, const int ncols, const float
     }
 }
 
+template <bool affine = false>
 static void norm_f32_sycl(const float* x, float* dst, const int ncols,
     const int nrows, const float eps,
-    queue_ptr stream, int device) {
+    queue_ptr stream, int device,
+    const float* w = nullptr, const float* b = nullptr) {
     GGML_ASSERT(ncols % WARP_SIZE == 0);
     if (ncols < 1024) {
         const sycl::range<3> block_dims(1, 1, WARP_SIZE);
@@ -236,8 +242,8 @@ static void norm_f32_sycl(const float* x, float* dst, const int ncols,
                     block_dims),
                 [=](sycl::nd_item<3> item_ct1)
                 [[sycl::reqd_sub_group_size(WARP_SIZE)]] {
-                    norm_f32(x, dst, ncols, eps, item_ct1,
-                        nullptr, WARP_SIZE);
+                    norm_f32<affine>(x, dst, ncols, eps, item_ct1,
+                        nullptr, WARP_SIZE, w, b);
                 });
             });
     }
@@ -259,8 +265,8 @@ static void norm_f32_sycl(const float* x, float* dst, const int ncols,
                     block_dims),
                 [=](sycl::nd_item<3> item_ct1)
                 [[sycl::reqd_sub_group_size(WARP_SIZE)]] {
-                    norm_f32(x, dst, ncols, eps, item_ct1,
-                        get_pointer(s_sum_acc_ct1), work_group_size);
+                    norm_f32<affine>(x, dst, ncols, eps, item_ct1,
+                        get_pointer(s_sum_acc_ct1), work_group_size, w, b);
                 });
             });
     }
@@ -415,6 +421,28 @@ void ggml_sycl_op_norm(ggml_backend_sycl_context& ctx, ggml_tensor* dst) {
     norm_f32_sycl(src0_dd, dst_dd, ne00, nrows, eps, main_stream, ctx.device);
 }
 
+void ggml_sycl_op_norm_affine(ggml_backend_sycl_context& ctx, ggml_tensor* dst) {
+
+    GGML_ASSERT(dst->src[0]->type == GGML_TYPE_F32);
+    GGML_ASSERT(dst->src[1]->type == GGML_TYPE_F32);
+    GGML_ASSERT(dst->src[2]->type == GGML_TYPE_F32);
+    GGML_ASSERT(dst->type == GGML_TYPE_F32);
+
+    const int64_t ne00 = dst->src[0]->ne[0];
+    const int64_t nrows = ggml_nrows(dst->src[0]);
+    dpct::queue_ptr main_stream = ctx.stream();
+    SYCL_CHECK(ggml_sycl_set_device(ctx.device));
+    const float * src0_dd = static_cast<const float *>(dst->src[0]->data);
+    const float * src1_dd = static_cast<const float *>(dst->src[1]->data);
+    const float * src2_dd = static_cast<const float *>(dst->src[2]->data);
+    float *       dst_dd  = static_cast<float *>(dst->data);
+
+    float eps;
+    memcpy(&eps, dst->op_params, sizeof(float));
+
+    norm_f32_sycl<true>(src0_dd, dst_dd, ne00, nrows, eps, main_stream, ctx.device, src1_dd, src2_dd);
+}
+
 void ggml_sycl_op_group_norm(ggml_backend_sycl_context& ctx, ggml_tensor* dst) {
 
     GGML_ASSERT(dst->src[0]->type == GGML_TYPE_F32);
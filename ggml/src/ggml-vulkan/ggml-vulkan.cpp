@@ -23,6 +23,9 @@
 #include <mutex>
 #include <future>
 #include <thread>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
 
 #if defined(_MSC_VER)
 # define NOMINMAX 1
@@ -413,6 +416,10 @@ struct vk_device_struct {
     std::unordered_map<std::string, vk_pipeline_ref> pipelines;
     std::unordered_map<std::string, uint64_t> pipeline_descriptor_set_requirements;
 
+    // pipeline cache, persisted to pipeline_cache_path when GGML_VK_PIPELINE_CACHE is set
+    vk::PipelineCache pipeline_cache;
+    std::string pipeline_cache_path;
+
     std::vector<std::tuple<void*, size_t, vk_buffer>> pinned_memory;
 
     vk::Fence fence;
@@ -449,6 +456,10 @@ struct vk_device_struct {
         }
         pipelines.clear();
 
+        if (pipeline_cache) {
+            device.destroyPipelineCache(pipeline_cache);
+        }
+
         device.destroy();
     }
 };
@@ -1081,7 +1092,7 @@ static void ggml_vk_create_pipeline_func(vk_device& device, vk_pipeline& pipelin
     }
 
     try {
-        pipeline->pipeline = device->device.createComputePipeline(VK_NULL_HANDLE, compute_pipeline_create_info).value;
+        pipeline->pipeline = device->device.createComputePipeline(device->pipeline_cache, compute_pipeline_create_info).value;
     } catch (const vk::SystemError& e) {
         std::cerr << "ggml_vulkan: Compute pipeline creation failed for " << pipeline->name << std::endl;
         std::cerr << "ggml_vulkan: " << e.what() << std::endl;
@@ -1711,6 +1722,82 @@ static uint32_t get_subgroup_size(const std::string &pipeline_name, const vk_dev
     return 0; // If no matching configuration is found
 }
 
+// The pipeline cache of a device is kept in $GGML_VK_PIPELINE_CACHE/ggml-vulkan-<vendor>-<device>-<driver>-<uuid>.bin,
+// so that the pipelines compiled by a process are not compiled again by the next one. The driver validates the data
+// as well, the header is checked here so that the data of another device or driver is not even passed to it.
+static void ggml_vk_pipeline_cache_init(vk_device& device) {
+    std::vector<char> data;
+
+    const char * dir = getenv("GGML_VK_PIPELINE_CACHE");
+    if (dir != nullptr && dir[0] != '\0') {
+        const auto & props = device->properties;
+
+        std::stringstream ss;
+        ss << dir << "/ggml-vulkan-" << std::hex << std::setfill('0')
+           << std::setw(4) << props.vendorID << "-" << std::setw(4) << props.deviceID << "-" << std::setw(8) << props.driverVersion << "-";
+        for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+            ss << std::setw(2) << (uint32_t) props.pipelineCacheUUID[i];
+        }
+        ss << ".bin";
+
+        device->pipeline_cache_path = ss.str();
+
+        std::ifstream fin(device->pipeline_cache_path, std::ios::binary);
+        if (fin) {
+            data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+        }
+
+        // VkPipelineCacheHeaderVersionOne: header size, header version, vendor ID, device ID, pipeline cache UUID
+        const size_t header_size = 16 + VK_UUID_SIZE;
+
+        uint32_t header[4] = {};
+        if (data.size() >= header_size) {
+            memcpy(header, data.data(), sizeof(header));
+        }
+
+        if (data.size() < header_size || header[0] < header_size || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header[2] != props.vendorID || header[3] != props.deviceID ||
+            memcmp(data.data() + 16, props.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0) {
+            data.clear();
+        }
+
+        VK_LOG_DEBUG("ggml_vk_pipeline_cache_init(" << device->name << ", " << device->pipeline_cache_path << ", " << data.size() << " bytes)");
+    }
+
+    vk::PipelineCacheCreateInfo pipeline_cache_create_info({}, data.size(), data.data());
+    device->pipeline_cache = device->device.createPipelineCache(pipeline_cache_create_info);
+}
+
+// written to a temporary file first, so that a concurrent process never reads a partial cache
+static void ggml_vk_pipeline_cache_save(vk_device& device) {
+    if (!device->pipeline_cache || device->pipeline_cache_path.empty()) {
+        return;
+    }
+
+    const std::vector<uint8_t> data = device->device.getPipelineCacheData(device->pipeline_cache);
+
+    const std::string path_tmp = device->pipeline_cache_path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    {
+        std::ofstream fout(path_tmp, std::ios::binary);
+        if (!fout) {
+            std::cerr << "ggml_vulkan: failed to write the pipeline cache " << path_tmp << std::endl;
+            return;
+        }
+        fout.write((const char *) data.data(), data.size());
+        if (!fout) {
+            fout.close();
+            std::remove(path_tmp.c_str());
+            return;
+        }
+    }
+
+    std::remove(device->pipeline_cache_path.c_str());
+    if (std::rename(path_tmp.c_str(), device->pipeline_cache_path.c_str()) != 0) {
+        std::remove(path_tmp.c_str());
+    }
+}
+
 static void ggml_vk_load_shaders(vk_device& device) {
     VK_LOG_DEBUG("ggml_vk_load_shaders(" << device->name << ")");
 
@@ -2662,10 +2749,16 @@ static void ggml_vk_load_shaders(vk_device& device) {
     ggml_vk_create_pipeline(device, device->pipeline_conv2d_dw_whcn_f32, "conv2d_dw_whcn_f32", conv2d_dw_whcn_f32_len, conv2d_dw_whcn_f32_data, "main", 3, sizeof(vk_op_conv2d_dw_push_constants), {512, 1, 1}, {}, 1);
     ggml_vk_create_pipeline(device, device->pipeline_conv2d_dw_cwhn_f32, "conv2d_dw_cwhn_f32", conv2d_dw_cwhn_f32_len, conv2d_dw_cwhn_f32_data, "main", 3, sizeof(vk_op_conv2d_dw_push_constants), {512, 1, 1}, {}, 1);
 
+    const bool compiled = !compiles.empty();
+
     for (auto &c : compiles) {
         c.wait();
     }
     device->need_compiles = false;
+
+    if (compiled) {
+        ggml_vk_pipeline_cache_save(device);
+    }
 }
 
 static bool ggml_vk_khr_cooperative_matrix_support(const vk::PhysicalDeviceProperties& props, const vk::PhysicalDeviceDriverProperties& driver_props, vk_device_architecture arch);
@@ -3227,6 +3320,7 @@ static vk_device ggml_vk_get_device(size_t idx) {
             }
         }
 
+        ggml_vk_pipeline_cache_init(device);
         ggml_vk_load_shaders(device);
 
         if (!device->single_queue) {
@@ -4419,6 +4513,14 @@ static vk_pipeline ggml_vk_guess_matmul_pipeline(ggml_backend_vk_context * ctx,
     if ((ctx->device->mul_mat_m[src0_type] && (m <= 64 || n <= 64)) || !ctx->device->mul_mat_l[src0_type]) {
         return aligned ? mmp->a_m : mmp->m;
     }
+    // Use the medium shader when the large tiles would not give every shader core a workgroup, e.g. the
+    // [n_state x 1500] products of the whisper encoder with n_state = 384 ... 1280
+    if (ctx->device->mul_mat_m[src0_type] && ctx->device->shader_core_count != 0 && mmp->l) {
+        const uint32_t tiles_l = CEIL_DIV(m, mmp->l->wg_denoms[0]) * CEIL_DIV(n, mmp->l->wg_denoms[1]);
+        if (tiles_l < ctx->device->shader_core_count) {
+            return aligned ? mmp->a_m : mmp->m;
+        }
+    }
     return aligned ? mmp->a_l : mmp->l;
 }
 
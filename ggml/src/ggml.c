@@ -951,9 +951,11 @@ static const char * GGML_OP_NAME[GGML_OP_COUNT] = {
     "CROSS_ENTROPY_LOSS",
     "CROSS_ENTROPY_LOSS_BACK",
     "OPT_STEP_ADAMW",
+
+    "NORM_AFFINE",
 };
 
-static_assert(GGML_OP_COUNT == 82, "GGML_OP_COUNT != 82");
+static_assert(GGML_OP_COUNT == 83, "GGML_OP_COUNT != 83");
 
 static const char * GGML_OP_SYMBOL[GGML_OP_COUNT] = {
     "none",
@@ -1046,9 +1048,11 @@ static const char * GGML_OP_SYMBOL[GGML_OP_COUNT] = {
     "cross_entropy_loss(x,y)",
     "cross_entropy_loss_back(x,y)",
     "adamw(x)",
+
+    "norm(x)*w+b",
 };
 
-static_assert(GGML_OP_COUNT == 82, "GGML_OP_COUNT != 82");
+static_assert(GGML_OP_COUNT == 83, "GGML_OP_COUNT != 83");
 
 static_assert(GGML_OP_POOL_COUNT == 2, "GGML_OP_POOL_COUNT != 2");
 
@@ -2574,6 +2578,29 @@ struct ggml_tensor * ggml_norm_inplace(
     return ggml_norm_impl(ctx, a, eps, true);
 }
 
+// ggml_norm_affine
+
+struct ggml_tensor * ggml_norm_affine(
+        struct ggml_context * ctx,
+        struct ggml_tensor  * a,
+        struct ggml_tensor  * w,
+        struct ggml_tensor  * b,
+        float                 eps) {
+    GGML_ASSERT(ggml_is_contiguous(w) && ggml_nelements(w) == a->ne[0]);
+    GGML_ASSERT(ggml_is_contiguous(b) && ggml_nelements(b) == a->ne[0]);
+
+    struct ggml_tensor * result = ggml_dup_tensor(ctx, a);
+
+    ggml_set_op_params(result, &eps, sizeof(eps));
+
+    result->op     = GGML_OP_NORM_AFFINE;
+    result->src[0] = a;
+    result->src[1] = w;
+    result->src[2] = b;
+
+    return result;
+}
+
 // ggml_rms_norm
 
 static struct ggml_tensor * ggml_rms_norm_impl(
@@ -6479,6 +6506,7 @@ void ggml_threadpool_params_init(struct ggml_threadpool_params * p, int n_thread
     p->n_threads  = n_threads;
     p->prio       = 0;     // default priority (usually means normal or inherited)
     p->poll       = 50;    // hybrid-polling enabled
+    p->poll_us    = 0;     // polling level in rounds
     p->strict_cpu = false; // no strict placement (all threads share same cpumask)
     p->paused     = false; // threads are ready to go
     memset(p->cpumask, 0, GGML_MAX_N_THREADS); // all-zero means use the default affinity (usually inherited)
@@ -6494,6 +6522,7 @@ bool ggml_threadpool_params_match(const struct ggml_threadpool_params * p0, cons
     if (p0->n_threads      != p1->n_threads  )    return false;
     if (p0->prio           != p1->prio       )    return false;
     if (p0->poll           != p1->poll       )    return false;
+    if (p0->poll_us        != p1->poll_us    )    return false;
     if (p0->strict_cpu     != p1->strict_cpu )    return false;
     return memcmp(p0->cpumask, p1->cpumask, GGML_MAX_N_THREADS) == 0;
 }
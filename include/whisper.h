@@ -80,6 +80,7 @@ extern "C" {
     struct whisper_context;
     struct whisper_state;
     struct whisper_full_params;
+    struct whisper_vad_context;
 
     typedef int32_t whisper_pos;
     typedef int32_t whisper_token;
@@ -125,7 +126,152 @@ extern "C" {
         int dtw_n_top;
         struct whisper_aheads dtw_aheads;
 
-        size_t dtw_mem_size; // TODO: remove
+        size_t dtw_mem_size; // TODO: remove (not used)
+
+        // [EXPERIMENTAL] type of the self- and cross-attention KV caches (default: GGML_TYPE_F16)
+        // quantized types (GGML_TYPE_Q8_0, GGML_TYPE_Q4_0, ...) require flash_attn
+        enum ggml_type type_kv;
+
+        // [EXPERIMENTAL] memory-map the model file in whisper_init_from_file_with_params() (default: false)
+        // the weights that stay in CPU memory are used directly from the page cache instead of being copied,
+        // so that processes loading the same model share its memory
+        bool use_mmap;
+
+        // [EXPERIMENTAL] do not load and allocate the weights of the encoder or of the decoder (default: false)
+        // skip_encoder: for an external (Core ML, OpenVINO) encoder - whisper_encode() fails without one
+        // skip_decoder: only whisper_encode() can be used, e.g. to get the encoder output with whisper_get_embd_enc()
+        bool skip_encoder;
+        bool skip_decoder;
+
+        // [EXPERIMENTAL] share the compute buffers between the states of the context (default: false)
+        // by default, each state has its own backends (e.g. its own Metal command queue) with the weights of the
+        // context, so that the computations of several states overlap on the GPU
+        // with shared_compute, the encoder and decoder computations of the states are serialized, so the memory used
+        // by the compute buffers does not grow with the number of states - useful when there are many mostly idle states
+        // the encoder output is not retained after whisper_encode() (whisper_get_embd_enc() returns -1)
+        // not supported with dtw_token_timestamps
+        bool shared_compute;
+
+        // [EXPERIMENTAL] NUMA strategy of the CPU backend (default: GGML_NUMA_STRATEGY_DISABLED)
+        // DISTRIBUTE, NUMACTL: passed to ggml_numa_init() - process-wide, the first context that sets it wins
+        // ISOLATE: the threads of a state are pinned to a single node - the node of the calling thread, or with
+        //          whisper_full_parallel() a different node for each processor (round-robin)
+        //          the pinning requires ggml without OpenMP (GGML_OPENMP=OFF)
+        // MIRROR: not supported (the weights are not replicated on each node) - same as ISOLATE
+        // no effect on a single node system or with whisper_full_params::threadpool
+        enum ggml_numa_strategy numa;
+
+        // [EXPERIMENTAL] record the time and the bytes of each node of the graphs of the states (default: false)
+        // the nodes are computed one at a time through the eval callback of the backend scheduler, so the profiled
+        // computations are slower - see whisper_print_profile() and whisper_profile_write_trace()
+        bool profile;
+
+        // [EXPERIMENTAL] replicate the weights on the GPU devices gpu_device .. gpu_device + n_gpu_devices - 1 (default: 1)
+        // each new state of whisper_init_state() is placed on the device with the most free memory, so that the states
+        // of a single context use all the devices - the default state of the context stays on gpu_device
+        // requires whisper_init_from_file_with_params() or whisper_init_from_buffer_with_params()
+        // the callbacks of whisper_full_with_state() receive the context of the device of the state
+        int n_gpu_devices;
+
+        // [EXPERIMENTAL] the devices of the encoder and of the decoder, by name: "CPU", "CUDA0", "CUDA1", "Metal", ...
+        // (default: NULL - gpu_device, with the CPU for the unsupported operations)
+        // the weights, the KV caches and the graphs of each stage are placed on its device, so that the encoder of one
+        // state and the decoder of another can run at the same time on different hardware - the encoder output is
+        // copied to the device of the decoder when the cross-attention KV cache is computed
+        // an unknown name falls back to the default; not combined with n_gpu_devices > 1
+        const char * encoder_device;
+        const char * decoder_device;
+
+        // [EXPERIMENTAL] split the layers of the encoder over the GPU devices gpu_device .. gpu_device + encoder_split - 1
+        // (default: 1) - for models that do not fit a single device; the encoder batches of whisper_encode_batch_with_states()
+        // are computed in micro-batches that are pipelined over the devices
+        // not combined with encoder_device
+        int encoder_split;
+
+        // [EXPERIMENTAL] comma-separated host:port of ggml RPC servers (default: NULL)
+        // the servers are added as the devices "RPC[host:port]" for encoder_device and decoder_device - without
+        // encoder_device, the encoder runs on the first server, so that only the mel spectrogram and the encoder
+        // output cross the network for each window
+        // the weights are sent when the context is created - a server with a cache directory (rpc-server -c)
+        // receives only the hashes of the weights it already has
+        // requires ggml built with GGML_RPC=ON
+        const char * rpc_servers;
+
+        // [EXPERIMENTAL] collect the importance matrix of the weights for the quantization (default: false)
+        // the mean of the squares of the activations of each input column of the weights is accumulated over the
+        // encoder, cross and decoder graphs of the states, through the eval callback of the backend scheduler - the
+        // computations are slower and are not profiled, see whisper_imatrix_write()
+        bool imatrix;
+
+        // [EXPERIMENTAL] with a Core ML encoder, start the prediction of the next window as soon as a window is
+        // encoded (default: false) - the ANE encodes it while the current window is decoded on the GPU/CPU
+        // the prediction is used if the next window starts right after the current one, which is always the case
+        // with no_timestamps or single_segment, otherwise it is discarded
+        bool coreml_prefetch;
+
+        // [EXPERIMENTAL] decode with the stateful Core ML decoder ggml-<model>-decoder.mlmodelc (default: false)
+        // generated with models/generate-coreml-model.sh <model> --decoder, requires macOS 15 / iOS 18
+        // it is used for a single decoder (greedy sampling with best_of = 1) without dtw_token_timestamps,
+        // otherwise and if the model cannot be loaded the ggml decoder is used
+        bool coreml_decoder;
+
+        // [EXPERIMENTAL] GPU backend to compute the graphs with, instead of a new backend for each state (default: NULL)
+        // not owned - it must outlive the context and its states, e.g. a backend that the application also uses for
+        // another model (llama.cpp) on the same device, so that there is a single instance (queues, memory pools) of
+        // the backend of the device; the weights are placed on its device, use_gpu and gpu_device are not used
+        // not combined with n_gpu_devices > 1 - see also whisper_state_release_compute()
+        struct ggml_backend * backend;
+
+        // [EXPERIMENTAL] compute the log mel spectrogram of the 16 kHz audio as a graph on the GPU of the encoder
+        // (default: false) - the audio is uploaded once and the STFT, the mel filterbank and the log run on the device,
+        // only the normalization is done on the CPU; without a GPU, the spectrogram is computed on the CPU
+        bool mel_gpu;
+
+        // [EXPERIMENTAL] block-causal self-attention of the encoder in blocks of encoder_block frames of 20 ms
+        // (default: 0 - full attention) - for checkpoints fine-tuned for streaming, in which each frame attends only to
+        // the frames of its block and of the previous blocks; see whisper_encode_block_with_state() for encoding the
+        // blocks one at a time - not used by an external (Core ML, OpenVINO) encoder
+        int encoder_block;
+
+        // [EXPERIMENTAL] tune the number of threads of the decoder graphs of each state (default: false)
+        // the first prompts and single-token decodes are timed with n_threads, n_threads/2, ..., 1 threads and the
+        // fastest count is used from then on - n_threads is the upper bound, the encoder always uses n_threads
+        // not used with an external threadpool (see whisper_full_params::threadpool)
+        bool tune_threads;
+
+        // [EXPERIMENTAL] read the weights in a background thread (default: false) - whisper_init_from_file_with_params()
+        // returns once the tensors are allocated, and the stages become usable as their weights are read (see
+        // whisper_model_ready()): the mel spectrogram and the encoder of the first window run while the decoder is
+        // still loading - the computations wait for the weights they need
+        // the other loaders (buffer, custom) read the weights before returning
+        bool load_async;
+
+        // [EXPERIMENTAL] the audio_ctx sizes for which the states reserve compute buffers, comma-separated
+        // (default: NULL - the buffers are reserved once, for the full n_audio_ctx), e.g. "384,768"
+        // a state reserves the buffers of the smallest size when it is created, and the buffers of the smallest size
+        // that fits the audio_ctx of a window (see whisper_full_params::audio_ctx) the first time it encodes one - the
+        // reserved sizes are kept and switching between them does not allocate; the windows above the largest size
+        // use buffers for the full n_audio_ctx. the states that only see short audio keep small compute buffers
+        // the buffers of the decoder are reserved once for the full n_audio_ctx. not used with shared_compute
+        const char * audio_ctx_buckets;
+
+        // [EXPERIMENTAL] compute the convolutions, the encoder and the cross-attention keys and values of a window as a
+        // single graph (default: false) - one scheduling and synchronization per window instead of three, and no
+        // separate compute buffers for the convolutions and the cross-attention; with load_async, the encoding waits
+        // for the decoder weights. not used by an external (Core ML, OpenVINO) encoder, or with skip_encoder/skip_decoder
+        bool fused_encode;
+
+        // [EXPERIMENTAL] size in MB of the huge pages of the CPU buffers: 0 (default, off), 2 or 1024
+        // the CPU weights, the KV caches and the compute buffers of the CPU backend are allocated on huge pages: from
+        // the hugetlbfs pool of that size when it has enough free pages (vm.nr_hugepages), else on 2 MB transparent huge
+        // pages - fewer TLB misses when the large weights are streamed by the matrix multiplications. the weights are
+        // copied to the huge pages instead of being used from the mapping of the model file (use_mmap)
+        int cpu_hugepages;
+
+        // [EXPERIMENTAL] whisper_full_parallel() pins the threads of each processor to a disjoint part of the CPUs the
+        // process can run on, with at most one thread per CPU of the part (default: false) - the processors do not
+        // oversubscribe the cores or evict the caches of each other. see whisper_state_set_cpu_part()
+        bool cpu_partition;
     };
 
     typedef struct whisper_token_data {
@@ -200,6 +346,7 @@ extern "C" {
 
     // Various functions for loading a ggml whisper model.
     // Allocate (almost) all memory needed for the model.
+    // GGUF model files (see models/convert-ggml-to-gguf.py) are supported only by the *_from_file_* functions.
     // Return NULL on failure
     WHISPER_API struct whisper_context * whisper_init_from_file_with_params  (const char * path_model,              struct whisper_context_params params);
     WHISPER_API struct whisper_context * whisper_init_from_buffer_with_params(void * buffer, size_t buffer_size,    struct whisper_context_params params);
@@ -211,6 +358,43 @@ extern "C" {
     WHISPER_API struct whisper_context * whisper_init_from_buffer_with_params_no_state(void * buffer, size_t buffer_size,    struct whisper_context_params params);
     WHISPER_API struct whisper_context * whisper_init_with_params_no_state            (struct whisper_model_loader * loader, struct whisper_context_params params);
 
+    // [EXPERIMENTAL] Shared model store
+    // Copy the model file once per host to path_store on a shared memory file system: tmpfs (e.g. /dev/shm/model.gguf)
+    // or hugetlbfs (e.g. /dev/hugepages/model.gguf). All the processes that load path_store with use_mmap then map the
+    // same physical memory for the CPU weights instead of allocating a copy each, and the store is not evicted like the
+    // page cache. Use a GGUF model so that all the tensors can be mapped. Remove the store by deleting the file.
+    // Not supported on Windows.
+    // Returns 0 on success
+    WHISPER_API int whisper_model_store_create(const char * path_model, const char * path_store);
+
+    // [EXPERIMENTAL] Snapshot of the weights of a context
+    // Write the weights of ctx as they are stored in their buffers (e.g. repacked for AMX, with the padded copy of the
+    // token embedding) together with the hparams, mel filters and vocab to path_snapshot. The *_from_snapshot_* functions
+    // map the file: the weights of the CPU buffer type are used from the page cache, the others are copied into their
+    // buffers without conversion - there is nothing to read, convert or repack at startup.
+    // The snapshot is specific to the build of ggml and to the params that place the weights (use_gpu, gpu_device,
+    // encoder_device, decoder_device, encoder_split, skip_encoder, skip_decoder) - loading it with others fails.
+    // use_mmap, load_async and n_gpu_devices are not used. Not supported on big-endian platforms.
+    // whisper_snapshot_create() returns 0 on success
+    WHISPER_API int whisper_snapshot_create(struct whisper_context * ctx, const char * path_snapshot);
+
+    WHISPER_API struct whisper_context * whisper_init_from_snapshot_with_params         (const char * path_snapshot, struct whisper_context_params params);
+    WHISPER_API struct whisper_context * whisper_init_from_snapshot_with_params_no_state(const char * path_snapshot, struct whisper_context_params params);
+
+    // [EXPERIMENTAL] Stages of the model that become usable one after the other with whisper_context_params::load_async
+    enum whisper_model_stage {
+        WHISPER_MODEL_STAGE_ENCODER = 1, // the conv and the encoder layers - whisper_pcm_to_mel() does not need weights
+        WHISPER_MODEL_STAGE_DECODER = 2, // the decoder layers, also used for the cross-attention KV cache of whisper_encode()
+        WHISPER_MODEL_STAGE_ALL     = 3,
+    };
+
+    // true once the weights of the stages are loaded (always true without load_async)
+    WHISPER_API bool whisper_model_ready(struct whisper_context * ctx, enum whisper_model_stage stage);
+
+    // Block until the weights of the stages are loaded
+    // Returns 0 on success, -1 if the weights failed to load (the context cannot be used then)
+    WHISPER_API int whisper_model_wait(struct whisper_context * ctx, enum whisper_model_stage stage);
+
     WHISPER_DEPRECATED(
         WHISPER_API struct whisper_context * whisper_init_from_file(const char * path_model),
         "use whisper_init_from_file_with_params instead"
@@ -238,6 +422,28 @@ extern "C" {
 
     WHISPER_API struct whisper_state * whisper_init_state(struct whisper_context * ctx);
 
+    // [EXPERIMENTAL] Pool of reusable states
+    // Creating a state reserves the compute graphs and allocates the KV caches and the compute buffers, which
+    // costs a few milliseconds on the CPU and more with GPU backends. For short-lived states (e.g. one per
+    // request in a server) acquire them from the pool of the context instead and release them when done.
+    // A released state is reset (results, KV cache, mel, timings) but keeps its buffers, so the next
+    // whisper_state_pool_acquire() returns it without any allocation. A new state is created when the pool is empty.
+    // The pooled states are freed by whisper_free(). Both functions are thread-safe.
+    WHISPER_API struct whisper_state * whisper_state_pool_acquire(struct whisper_context * ctx);
+    WHISPER_API void                   whisper_state_pool_release(struct whisper_context * ctx, struct whisper_state * state);
+
+    // [EXPERIMENTAL] Snapshot of the decoding context of a state
+    // Contains the language, the prompt of the next window (prompt_past), the cross-attention KV cache of the last
+    // encoded window and the used cells of the self-attention KV cache. Restoring it into a state of a context
+    // with the same model and KV cache type continues the decoding without re-encoding the audio, e.g. on another
+    // worker.
+    // whisper_state_get_size() returns the size of the snapshot in bytes.
+    // whisper_state_get_data() returns the number of bytes written to dst, or 0 if size is too small.
+    // whisper_state_set_data() returns the number of bytes read from src, or 0 if the data does not match the context.
+    WHISPER_API size_t whisper_state_get_size(struct whisper_context * ctx, struct whisper_state * state);
+    WHISPER_API size_t whisper_state_get_data(struct whisper_context * ctx, struct whisper_state * state,       uint8_t * dst, size_t size);
+    WHISPER_API size_t whisper_state_set_data(struct whisper_context * ctx, struct whisper_state * state, const uint8_t * src, size_t size);
+
     // Given a context, enable use of OpenVINO for encode inference.
     // model_path: Optional path to OpenVINO encoder IR model. If set to nullptr,
     //                      the path will be generated from the ggml model path that was passed
@@ -247,7 +453,9 @@ extern "C" {
     // device: OpenVINO device to run inference on ("CPU", "GPU", etc.)
     // cache_dir: Optional cache directory that can speed up init time, especially for
     //                     GPU, by caching compiled 'blobs' there.
-    //                     Set to nullptr if not used.
+    //                     If set to nullptr, "/path/to/ggml-base.en-encoder-openvino-cache" is used.
+    // The states using the same model, device and cache_dir share one compiled model, each state has an
+    // infer request of its own.
     // Returns 0 on success. If OpenVINO is not enabled in build, this simply returns 1.
     WHISPER_API int whisper_ctx_init_openvino_encoder_with_state(
         struct whisper_context * ctx,
@@ -284,6 +492,93 @@ extern "C" {
                                int   n_samples,
                                int   n_threads);
 
+    // [EXPERIMENTAL] Convert RAW PCM audio of another sample rate to log mel spectrogram.
+    // 8 kHz audio is not upsampled: the frames of the spectrogram are computed at 8 kHz, with the bins up to 4 kHz.
+    // The other rates are converted with whisper_resample() first.
+    // Returns 0 on success
+    WHISPER_API int whisper_pcm_to_mel_rate(
+            struct whisper_context * ctx,
+                       const float * samples,
+                               int   n_samples,
+                               int   sample_rate,
+                               int   n_threads);
+
+    WHISPER_API int whisper_pcm_to_mel_rate_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                       const float * samples,
+                               int   n_samples,
+                               int   sample_rate,
+                               int   n_threads);
+
+    // [EXPERIMENTAL] Resample mono PCM audio of sample_rate to WHISPER_SAMPLE_RATE
+    // Polyphase windowed-sinc filter for the reduced ratio of the rates (e.g. 2/1 for 8 kHz, 1/3 for 48 kHz).
+    // The pointer out must be large enough to hold the resulting samples, no more than n_out_max.
+    // Returns the number of samples on success,
+    // a negative number if out is NULL or too small - the number of samples that would have been returned,
+    // INT_MIN on invalid input
+    WHISPER_API int whisper_resample(
+                       const float * samples,
+                               int   n_samples,
+                               int   sample_rate,
+                             float * out,
+                               int   n_out_max);
+
+    // [EXPERIMENTAL] Convert signed 16-bit PCM samples to float in [-1, 1)
+    WHISPER_API void whisper_pcm_s16_to_f32(
+                     const int16_t * samples,
+                             float * out,
+                               int   n_samples);
+
+    // Sample formats of the RAW PCM audio accepted by the *_typed functions
+    enum whisper_pcm_type {
+        WHISPER_PCM_F32,   // float in [-1, 1]
+        WHISPER_PCM_S16,   // signed 16-bit
+        WHISPER_PCM_MULAW, // 8-bit G.711 mu-law
+    };
+
+    // [EXPERIMENTAL] Same as whisper_pcm_to_mel_with_state() for samples of the given type
+    // The samples are converted to float by the mel workers, frame by frame, without a float copy of the input.
+    // Returns 0 on success
+    WHISPER_API int whisper_pcm_to_mel_typed_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                        const void * samples,
+               enum whisper_pcm_type type,
+                               int   n_samples,
+                               int   n_threads);
+
+    // Append RAW PCM audio to the log mel spectrogram of the state.
+    // Only the frames that depend on the new samples are computed. The resulting spectrogram is the same as the one
+    // computed by whisper_pcm_to_mel() from all samples appended so far (minus the ones discarded with whisper_pcm_append_trim()).
+    // The appended audio is kept separately from the audio passed to whisper_pcm_to_mel().
+    // To transcribe the spectrogram, call whisper_full() with n_samples = 0.
+    // Returns 0 on success
+    WHISPER_API int whisper_pcm_append(
+            struct whisper_context * ctx,
+                       const float * samples,
+                               int   n_samples,
+                               int   n_threads);
+
+    WHISPER_API int whisper_pcm_append_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                       const float * samples,
+                               int   n_samples,
+                               int   n_threads);
+
+    // Discard the beginning of the audio appended with whisper_pcm_append(), keeping the last n_samples_keep samples.
+    // The log mel spectrogram of the state is updated accordingly.
+    // Returns 0 on success
+    WHISPER_API int whisper_pcm_append_trim(
+            struct whisper_context * ctx,
+                               int   n_samples_keep);
+
+    WHISPER_API int whisper_pcm_append_trim_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                               int   n_samples_keep);
+
     // This can be used to set a custom log mel spectrogram inside the default state of the provided whisper context.
     // Use this instead of whisper_pcm_to_mel() if you want to provide your own log mel spectrogram.
     // n_mel must be 80
@@ -301,6 +596,16 @@ extern "C" {
                                int   n_len,
                                int   n_mel);
 
+    // [EXPERIMENTAL] Use a log mel spectrogram that lives in a ggml backend buffer (e.g. computed on the GPU)
+    // The tensor is F32 with ne = [n_len, n_mel] and contiguous rows, the same layout as the data of whisper_set_mel().
+    // It is not copied: the encoder reads the window of each segment from it, so it must stay valid and unchanged
+    // until the state is given another spectrogram.
+    // Returns 0 on success
+    WHISPER_API int whisper_set_mel_tensor_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+          const struct ggml_tensor * mel);
+
     // Run the Whisper encoder on the log mel spectrogram stored inside the default state in the provided whisper context.
     // Make sure to call whisper_pcm_to_mel() or whisper_set_mel() first.
     // offset can be used to specify the offset of the first frame in the spectrogram.
@@ -316,6 +621,53 @@ extern "C" {
                                int   offset,
                                int   n_threads);
 
+    // [EXPERIMENTAL] Copy the output of the last whisper_encode() into embd.
+    // embd must have room for n_ctx*whisper_model_n_audio_state() floats - one row of n_audio_state values per frame,
+    // where n_ctx is whisper_n_audio_ctx() or the audio_ctx override of the encoding.
+    // Returns n_ctx, or -1 if there is no encoder output
+    WHISPER_API int whisper_get_embd_enc(struct whisper_context * ctx, float * embd);
+    WHISPER_API int whisper_get_embd_enc_from_state(struct whisper_state * state, float * embd);
+
+    // [EXPERIMENTAL] Batched encoder
+    // Run the Whisper encoder for several states in a single graph.
+    // The mel windows of all states are processed together, so that the model weights are read once per batch.
+    // offsets[i] is the offset of the first frame of the window in the spectrogram of states[i].
+    // Make sure to call whisper_pcm_to_mel_with_state() or whisper_set_mel_with_state() for each state first.
+    // All states must be created from ctx, use the same audio_ctx and appear only once in the batch.
+    // With a Core ML encoder, the windows are predicted in a single Core ML batch. With OpenVINO, the windows are
+    // encoded concurrently with the infer request of each state.
+    // The compute buffers of the batched graph are owned by states[0].
+    // Returns 0 on success
+    WHISPER_API int whisper_encode_batch_with_states(
+            struct whisper_context * ctx,
+             struct whisper_state ** states,
+                         const int * offsets,
+                                 int n_states,
+                                 int n_threads);
+
+    // [EXPERIMENTAL] Streaming encoder with block-causal attention
+    // For checkpoints fine-tuned for streaming (see whisper_context_params::encoder_block): the keys and values of the
+    // self-attention of the blocks encoded so far are cached in the state, so each call encodes only the newest block
+    // of n_block frames, which attends to itself and to the previous blocks instead of re-encoding the whole window.
+    // The block is read from the spectrogram of the state at the mel frame offset (2 mel frames per encoder frame).
+    // The convolutions also read the 2 mel frames before and after the block, so that the frames at the edges of the
+    // blocks are the same as in a single window - the frames after the end of the spectrogram are zero.
+    // The cross-attention KV cache then covers all the frames encoded since the last reset and the audio_ctx of the
+    // state is set to their number, so that whisper_decode_with_state() attends to all of them;
+    // whisper_get_embd_enc_from_state() returns their encoder output.
+    // At most whisper_n_audio_ctx() frames can be encoded until whisper_encode_block_reset() starts a new stream.
+    // Not supported with an external (Core ML, OpenVINO) encoder, skip_encoder or skip_decoder.
+    // Returns the number of encoded frames, or a negative value on failure
+    WHISPER_API int whisper_encode_block_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                               int   offset,
+                               int   n_block,
+                               int   n_threads);
+
+    // Start a new stream - the next block is the first one, and the audio_ctx of the state is reset to the default
+    WHISPER_API void whisper_encode_block_reset(struct whisper_state * state);
+
     // Run the Whisper decoder to obtain the logits and probabilities for the next token.
     // Make sure to call whisper_encode() first.
     // tokens + n_tokens is the provided context for the decoder.
@@ -337,11 +689,77 @@ extern "C" {
                                int   n_past,
                                int   n_threads);
 
+    // [EXPERIMENTAL] Compute the encoder, prompt and single-token decoder graphs of the state once on silence, so that
+    // the first transcription does not pay for the one-time costs of the backends: the pipelines of the GPU backends
+    // are compiled (Vulkan: only those of the ops of whisper, and with GGML_VK_PIPELINE_CACHE=<dir> they are also
+    // kept on disk for the next process) and the weights are paged in
+    // The state is reset afterwards (results, KV cache and timings). Returns 0 on success
+    WHISPER_API int whisper_warmup(
+            struct whisper_context * ctx,
+                               int   n_threads);
+
+    WHISPER_API int whisper_warmup_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+                               int   n_threads);
+
+    // [EXPERIMENTAL] Continuous batching
+    // Run the Whisper decoder for several independent states in a single graph.
+    // All projections and the MLP are computed once for the tokens of all states, while the self- and
+    // cross-attention use the KV caches of each state. This allows to step many audio streams together.
+    // For state i, tokens[i] + n_tokens[i] are appended to the decoder context after n_past[i] tokens.
+    // Make sure to call whisper_encode_with_state() for each state first.
+    // All states must be created from ctx and a state can appear only once in the batch.
+    // The compute buffers of the batched graph are owned by states[0].
+    // Only the logits for the last token of each state are computed:
+    //   whisper_get_logits_from_state(states[i]) returns a single row of n_vocab values
+    // Returns 0 on success
+    WHISPER_API int whisper_decode_batch_with_states(
+            struct whisper_context * ctx,
+             struct whisper_state ** states,
+       const whisper_token * const * tokens,
+                         const int * n_tokens,
+                         const int * n_past,
+                                 int n_states,
+                                 int n_threads);
+
+    // [EXPERIMENTAL] Constrained scoring
+    // Score several continuations of the same decoder prompt, e.g. the phrases of a command set.
+    // The prompt is decoded once and its KV cache cells are shared by all continuations, which are evaluated as
+    // separate sequences in a single decoder pass.
+    // Make sure to call whisper_encode() first.
+    // prompt + n_prompt is the decoder context, e.g. <|startoftranscript|> <|en|> <|transcribe|> <|notimestamps|>
+    // logprobs[i] is the log-probability of tokens[i] + n_tokens[i] after the prompt, with the probabilities
+    // normalized over the tokens of all continuations and the special tokens
+    // The prompt without its last token is kept in the KV cache, the decoder can continue at n_past = n_prompt - 1
+    // Returns 0 on success
+    WHISPER_API int whisper_score(
+            struct whisper_context * ctx,
+               const whisper_token * prompt,
+                               int   n_prompt,
+       const whisper_token * const * tokens,
+                         const int * n_tokens,
+                               int   n_seqs,
+                             float * logprobs,
+                               int   n_threads);
+
+    WHISPER_API int whisper_score_with_state(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+               const whisper_token * prompt,
+                               int   n_prompt,
+       const whisper_token * const * tokens,
+                         const int * n_tokens,
+                               int   n_seqs,
+                             float * logprobs,
+                               int   n_threads);
+
     // Convert the provided text into tokens.
     // The tokens pointer must be large enough to hold the resulting tokens.
     // Returns the number of tokens on success, no more than n_max_tokens
     // Returns a negative number on failure - the number of tokens that would have been returned
-    // TODO: not sure if correct
+    // The text is split and merged as the byte-level BPE of the tiktoken tokenizer of the model; the tokens of the
+    // words are cached in the context, so tokenizing many phrases with the same words is cheap
     WHISPER_API int whisper_tokenize(
             struct whisper_context * ctx,
                         const char * text,
@@ -386,6 +804,23 @@ extern "C" {
                                int   n_threads,
                              float * lang_probs);
 
+    // [EXPERIMENTAL] Detect the spoken language of several clips at once
+    // The first window of each state goes through a single batched encoder pass (see whisper_encode_batch_with_states)
+    // audio_ctx limits the encoded window (e.g. 500 = the first 10 s, 0 = the full 30 s) - a few seconds of speech
+    // are usually enough to identify the language
+    // Make sure to call whisper_pcm_to_mel_with_state() or whisper_set_mel_with_state() for each state first
+    // lang_ids must have room for n_states values
+    // If not null, lang_probs is filled with n_states arrays of whisper_lang_max_id() + 1 probabilities
+    // Returns 0 on success
+    WHISPER_API int whisper_lang_auto_detect_batch(
+            struct whisper_context * ctx,
+             struct whisper_state ** states,
+                                 int n_states,
+                                 int audio_ctx,
+                                 int n_threads,
+                               int * lang_ids,
+                             float * lang_probs);
+
     WHISPER_API int whisper_n_len           (struct whisper_context * ctx); // mel length
     WHISPER_API int whisper_n_len_from_state(struct whisper_state * state); // mel length
     WHISPER_API int whisper_n_vocab         (struct whisper_context * ctx);
@@ -433,20 +868,128 @@ extern "C" {
     WHISPER_API whisper_token whisper_token_transcribe(struct whisper_context * ctx);
 
     // Performance information from the default state.
+    // The _from_state / _with_state variants are for the states of whisper_init_state()
+    // The returned struct is allocated with new and owned by the caller
     struct whisper_timings {
-        float sample_ms;
+        float sample_ms; // per run
         float encode_ms;
         float decode_ms;
         float batchd_ms;
         float prompt_ms;
+
+        float mel_ms;    // total
+        float vad_ms;    // total, without the mel of the speech segments
+
+        int32_t n_fail_p;    // temperature fallbacks because of the logprob threshold
+        int32_t n_fail_h;    // temperature fallbacks because of the entropy threshold
+        int32_t kv_self_max; // most cells of the self-attention KV cache used by a decoder call
     };
-    WHISPER_API struct whisper_timings * whisper_get_timings(struct whisper_context * ctx);
+    WHISPER_API struct whisper_timings * whisper_get_timings           (struct whisper_context * ctx);
+    WHISPER_API struct whisper_timings * whisper_get_timings_from_state(struct whisper_state   * state);
     WHISPER_API void whisper_print_timings(struct whisper_context * ctx);
-    WHISPER_API void whisper_reset_timings(struct whisper_context * ctx);
+    WHISPER_API void whisper_reset_timings           (struct whisper_context * ctx);
+    WHISPER_API void whisper_reset_timings_with_state(struct whisper_state   * state);
+
+    // [EXPERIMENTAL] Per-node profile of the conv, encoder, cross and decoder graphs (whisper_context_params::profile)
+    // whisper_print_profile() prints the time and the bytes moved by op and by part of the layers (attn, mlp, ...)
+    // of the default state, whisper_profile_write_trace() writes all the nodes as Chrome trace JSON (Perfetto)
+    // The batched graphs of whisper_*_batch_with_states() are not profiled
+    WHISPER_API void whisper_print_profile(struct whisper_context * ctx);
+    WHISPER_API int  whisper_profile_write_trace           (struct whisper_context * ctx,   const char * fname);
+    WHISPER_API int  whisper_profile_write_trace_from_state(struct whisper_state   * state, const char * fname);
+
+    // [EXPERIMENTAL] Importance matrix of the weights (whisper_context_params::imatrix)
+    // Writes the statistics collected by the default state, for the --imatrix option of examples/quantize
+    // The format is the legacy imatrix.dat of llama.cpp: the number of entries, then for each weight its name, the
+    // number of calls and the mean squared activation of each column multiplied by the number of calls
+    // Returns the number of entries or a negative value on failure
+    WHISPER_API int whisper_imatrix_write(struct whisper_context * ctx, const char * fname);
+
+    // [EXPERIMENTAL] Performance counters of a state, accumulated since it was created or reset
+    // Meant for exporting metrics: take a snapshot before and after whisper_full_with_state() to get the cost of one call
+    // The state must not be used by another thread at the same time
+    struct whisper_state_counters {
+        int64_t t_mel_us;
+        int64_t t_sample_us;
+        int64_t t_encode_us;
+        int64_t t_decode_us;
+        int64_t t_batchd_us;
+        int64_t t_prompt_us;
+        int64_t t_vad_us;
+
+        int32_t n_sample;    // sampling runs
+        int32_t n_encode;    // encoder calls
+        int32_t n_decode;    // decoder calls with a single token
+        int32_t n_batchd;    // decoder calls with a small batch of tokens
+        int32_t n_prompt;    // decoder calls for the prompt
+        int32_t n_fail_p;    // temperature fallbacks because of the logprob threshold
+        int32_t n_fail_h;    // temperature fallbacks because of the entropy threshold
+        int32_t n_draft;     // tokens proposed by the draft model
+        int32_t n_draft_acc; // draft tokens accepted
+        int32_t n_cascade;   // windows transcribed by the cascade model (see whisper_full_params::cascade_ctx)
+
+        int32_t kv_self_size; // cells of the self-attention KV cache
+        int32_t kv_self_used; // cells used by the last decoder call
+        int32_t kv_self_max;  // most cells used by a decoder call
+    };
+
+    WHISPER_API void whisper_get_state_counters(struct whisper_state * state, struct whisper_state_counters * counters);
+
+    // [EXPERIMENTAL] Memory used by a context and by a state, for capacity planning
+    // Each entry is a buffer of a backend (buft is the name of the backend buffer or of the backend), or "host" memory
+    // Context: the weights ("model"), and with shared_compute the shared compute buffers ("compute_*")
+    // State: the KV caches ("kv_self", "kv_cross", "kv_pad"), the compute buffers of each graph ("compute_conv",
+    //        "compute_encode", ...), the host vectors ("logits", "inp_mel", "mel", "decoders", ...)
+    // The functions write up to n_max entries to buffers (can be NULL) and return the number of entries
+    // The sizes can grow after the first whisper_full() calls, e.g. with more decoders or longer audio
+    struct whisper_mem_buffer {
+        const char * name;
+        const char * buft;
+        size_t       size; // bytes
+    };
+
+    WHISPER_API int  whisper_model_mem_usage(struct whisper_context * ctx,   struct whisper_mem_buffer * buffers, int n_max);
+    WHISPER_API int  whisper_state_mem_usage(struct whisper_state   * state, struct whisper_mem_buffer * buffers, int n_max);
+
+    // Print the buffers of the context and of the state (NULL - the default state), with the totals by buffer type
+    WHISPER_API void whisper_print_mem_usage(struct whisper_context * ctx, struct whisper_state * state);
+
+    // [EXPERIMENTAL] Free the compute buffers of the state (NULL - the default state) until its next computation,
+    // e.g. to lend the memory of the device to another model between two transcriptions - the next computation
+    // allocates them again, for the size of its graphs (the KV caches and the results of the state are kept)
+    // the host work buffers of the additional decoders (best_of, beam_size) are freed as well
+    // with shared_compute, the shared compute buffers of the context are freed
+    WHISPER_API void whisper_state_release_compute(struct whisper_context * ctx, struct whisper_state * state);
 
     // Print system information
     WHISPER_API const char * whisper_print_system_info(void);
 
+    // [EXPERIMENTAL] CPU threadpools (see whisper_full_params::threadpool)
+    // Create and free a ggml threadpool through the CPU backend - also works with dynamically loaded backends
+    // The threads are pinned to params->cpumask and run with params->prio (not applied when ggml uses OpenMP)
+    WHISPER_API struct ggml_threadpool * whisper_threadpool_new(struct ggml_threadpool_params * params);
+    WHISPER_API void                     whisper_threadpool_free(struct ggml_threadpool * threadpool);
+
+    // [EXPERIMENTAL] Pin the CPU threads of a state to part i_part of n_parts disjoint parts of the CPUs the process can
+    // run on (contiguous ranges of CPU ids), e.g. one part per worker state of a server - the graphs of the state are
+    // computed with at most one thread per CPU of its part, in a threadpool of the state
+    // n_parts <= 1 removes the pinning. not used with whisper_full_params::threadpool, takes precedence over the
+    // NUMA isolate strategy. the pinning requires ggml without OpenMP (GGML_OPENMP=OFF)
+    WHISPER_API void whisper_state_set_cpu_part(struct whisper_state * state, int i_part, int n_parts);
+
+    // [EXPERIMENTAL] Hybrid polling: with params->poll_us > 0, the threads of the pool spin for at most poll_us
+    // microseconds for the next graph and then sleep - the pool stays awake between the graphs of whisper (e.g. while
+    // the next token is sampled) instead of being paused, trading the wake-up latency for the cores of the spin
+    // The polling statistics of the threads since the creation of the pool: the time spent spinning, and the number of
+    // times the work was found while spinning or the threads went to sleep - returns -1 if they are not available
+    // (all zero when ggml uses OpenMP, which has no threadpool threads)
+    WHISPER_API int whisper_threadpool_poll_stats(struct ggml_threadpool * threadpool, int64_t * t_spin_us, int64_t * n_spin, int64_t * n_sleep);
+
+    // [EXPERIMENTAL] Set the performance cores of a hybrid CPU (Intel P-cores, ARM big cores) in cpumask
+    // cpumask must have GGML_MAX_N_THREADS entries (e.g. ggml_threadpool_params::cpumask), it can be NULL
+    // Returns the number of performance cores, or 0 if all cores are the same or the topology is not known
+    WHISPER_API int whisper_cpu_perf_cores(bool * cpumask);
+
     ////////////////////////////////////////////////////////////////////////////
 
     // Available sampling strategies
@@ -479,6 +1022,38 @@ extern "C" {
                              float * logits,
                               void * user_data);
 
+    // [EXPERIMENTAL] Stages of whisper_full() reported to the trace callback
+    enum whisper_trace_stage {
+        WHISPER_TRACE_VAD,      // speech detection of the samples (params.vad)
+        WHISPER_TRACE_MEL,      // log mel spectrogram of the samples (of the speech segments with VAD)
+        WHISPER_TRACE_ENCODE,   // encoder of a window
+        WHISPER_TRACE_PROMPT,   // decode of the prompt of a window, at each temperature
+        WHISPER_TRACE_DECODE,   // a step of the decoders: the sampling of the last tokens and the decode of the next ones
+        WHISPER_TRACE_FALLBACK, // a window decoded again at a higher temperature - the PROMPT and DECODE events of the
+                                // attempt are nested in it
+    };
+
+    struct whisper_trace_event {
+        enum whisper_trace_stage stage;
+
+        bool    begin;       // true at the start of the stage, false at its end (also sent when the stage fails)
+        int64_t t_us;        // time of the event, in the clock of ggml_time_us()
+        int     i_window;    // index of the encoded window in the call (-1 for VAD and MEL)
+        int     seek;        // start of the window, in frames of 10 ms (-1 for VAD and MEL)
+        float   temperature; // temperature of the attempt (PROMPT, DECODE and FALLBACK, else 0)
+        int     i_step;      // index of the step in the attempt (DECODE, else -1)
+        int     n_tokens;    // tokens decoded by the stage (PROMPT and DECODE, set in the end event)
+    };
+
+    // [EXPERIMENTAL] Trace callback
+    // Called at the begin and at the end of each stage, from the thread of the whisper_full() call - e.g. to build the
+    // spans of a tracing system. The events of a stage are properly nested in the events of the enclosing stage
+    typedef void (*whisper_trace_callback)(
+            struct whisper_context * ctx,
+              struct whisper_state * state,
+    const struct whisper_trace_event * event,
+                              void * user_data);
+
     // Parameters for the whisper_full() function
     // If you change the order or add new parameters, make sure to update the default values in whisper.cpp:
     // whisper_full_default_params()
@@ -510,7 +1085,7 @@ extern "C" {
         // [EXPERIMENTAL] speed-up techniques
         // note: these can significantly reduce the quality of the output
         bool debug_mode;        // enable debug_mode provides extra info (eg. Dump log_mel)
-        int  audio_ctx;         // overwrite the audio context size (0 = use default)
+        int  audio_ctx;         // overwrite the audio context size (0 = use default, < 0 = [EXPERIMENTAL] fit to the length of each window)
 
         // [EXPERIMENTAL] [TDRZ] tinydiarize
         bool tdrz_enable;       // enable tinydiarize speaker turn detection
@@ -522,6 +1097,8 @@ extern "C" {
         // these are prepended to any existing text context from a previous call
         // use whisper_tokenize() to convert text to tokens
         // maximum of whisper_n_text_ctx()/2 tokens are used (typically 224)
+        // the prompt is decoded again for each window - the decoder KV cache depends on the audio of the window
+        // through the cross-attention, so it cannot be shared across windows or calls (see n_max_text_ctx)
         const char * initial_prompt;
         const whisper_token * prompt_tokens;
         int prompt_n_tokens;
@@ -583,8 +1160,103 @@ extern "C" {
         // Voice Activity Detection (VAD) params
         bool         vad;                         // Enable VAD
         const char * vad_model_path;              // Path to VAD model
+        struct whisper_vad_context * vad_ctx;     // VAD context to use instead of loading vad_model_path (optional, not owned)
 
         whisper_vad_params vad_params;
+
+        // [EXPERIMENTAL] speculative temperature fallback (greedy sampling only)
+        // the next fallback temperature is decoded together with the current one in the same batch
+        // its result is used only if the current temperature fails
+        bool speculative_fallback;
+
+        // [EXPERIMENTAL] speculative decoding with a draft model (greedy sampling at temperature 0 only)
+        // the draft model proposes n_draft tokens that are verified with a single batched decode of the model
+        // it must have the same vocabulary and number of mel bins (e.g. distil-large-v3 for large-v3)
+        // the default state of draft_ctx is used (not owned)
+        struct whisper_context * draft_ctx;
+        int n_draft;
+
+        // [EXPERIMENTAL] greedy and beam search sampling in the decoder graph (temperature 0 only)
+        // the logit filters and the argmax are evaluated by the backend and only the sampled token is read back
+        // with beam search, only the beam_size most probable tokens of each beam are read back and they are the
+        // candidates of the beam (instead of beam_size tokens sampled from the probabilities on the CPU)
+        // not used with logits_filter_callback, grammar rules or a draft model
+        bool sample_on_device;
+
+        // [EXPERIMENTAL] encode the next 30 s window while the current one is decoded
+        // the next window is guessed to start where the current one ends - the encoding is discarded if the
+        // decoded timestamps move the window elsewhere
+        // uses a second state with its own compute buffers and KV cache, created on first use
+        // the encoder and the decoder share the CPU threads - pays off mostly with a GPU backend
+        bool pipeline_encode;
+
+        // [EXPERIMENTAL] compute the log mel spectrogram of each 30 s window when it is encoded, normalized with the
+        // maximum of the window instead of the maximum of the whole audio
+        // only one window of the spectrogram is kept in memory and the encoding starts without waiting for the
+        // spectrogram of the whole audio - the spectrogram is not kept after whisper_full() returns
+        // not used with VAD (the spectrogram of the speech segments is computed by the VAD), computed on the CPU
+        bool mel_window;
+
+        // [EXPERIMENTAL] 30 s windows with a signal RMS <= silence_thold are skipped without running the encoder
+        // and the decoder (0 = only digital silence, < 0 = disabled)
+        // not used with VAD (the speech segments are already free of silence)
+        float silence_thold;
+
+        // [EXPERIMENTAL] speech gate: the VAD model (vad_ctx or vad_model_path) computes the speech probabilities of
+        // the audio once, and the 30 s windows whose highest probability is below speech_gate_thold are skipped
+        // without running the encoder and the decoder (0 = disabled, e.g. 0.2)
+        // unlike vad, the audio is not cut - the windows with speech are transcribed as without the gate
+        // not used with VAD, needs the samples (not with whisper_full_from_mel() or whisper_full_stream())
+        float speech_gate_thold;
+
+        // [EXPERIMENTAL] audio_ctx of the language auto-detection pass (0 = same as audio_ctx)
+        // e.g. 500 detects the language from the first 10 s only
+        int lang_detect_audio_ctx;
+
+        // [EXPERIMENTAL] CPU threadpool to compute the graphs with (optional, not owned)
+        // created with whisper_threadpool_new() - the number, the affinity and the priority of the threads come from
+        // its ggml_threadpool_params (n_threads above is not used for the CPU backend)
+        // several contexts can share the same pool - their graphs are computed one at a time instead of
+        // oversubscribing the cores
+        struct ggml_threadpool * threadpool;
+
+        // [EXPERIMENTAL] compute the logits of the decoder only for these tokens (nullptr = all tokens)
+        // the special and the timestamp tokens are always included, the other tokens are never sampled
+        // the probabilities are normalized over the subset - e.g. a language, a command set or the tokens of a grammar
+        // the output projection costs n_text_state*(allowed_n_tokens + 1.6k) instead of n_text_state*n_vocab per token
+        // sample_on_device is not used with a subset, whisper_decode() always computes all logits
+        const whisper_token * allowed_tokens;
+        int allowed_n_tokens;
+
+        // [EXPERIMENTAL] a decoder fails as soon as its last 32 text tokens are the repetition of an n-gram that is too
+        // short for them to pass entropy_thold (default: false) - the temperature fallback starts right away instead of
+        // after decoding the rest of the repetition loop
+        // the timestamp tokens are not counted, so this also fails some loops that the entropy check lets through
+        bool repetition_stop;
+
+        // [EXPERIMENTAL] ceiling of the speech rate, in tokens per second of audio (default: 0 = off, e.g. 12)
+        // the decoders of a window of d seconds stop after 32 + max_tokens_per_sec*d tokens instead of n_text_ctx/2 - 4,
+        // so that the loops of the short windows are caught early - the budget of a full 30 s window is not reduced
+        float max_tokens_per_sec;
+
+        // [EXPERIMENTAL] rolling window of the results of whisper_full_stream() (0 = keep all the segments)
+        // only the last n_max_segments segments are kept in the default state - the older ones are dropped once
+        // new_segment_callback has seen them, so an endless stream runs in constant memory
+        // the dropped segments are reused for the new ones instead of being freed and allocated again
+        int n_max_segments;
+
+        // [EXPERIMENTAL] cascade decoding with a second, more accurate model (e.g. tiny or base -> large)
+        // a window whose result at the first temperature fails the thresholds of the temperature fallback
+        // (entropy_thold, logprob_thold and no_speech_thold) is transcribed by cascade_ctx instead of being decoded
+        // again at the next temperatures - the clean windows only cost the fast model
+        // the spectrogram is reused if both models have the same number of mel bins, else it is computed again from
+        // the samples (not available with VAD). Both models must be multilingual, or both English-only
+        // the default state of cascade_ctx is used (not owned)
+        struct whisper_context * cascade_ctx;
+
+        // [EXPERIMENTAL] called at the begin and at the end of the stages of the call (see whisper_trace_event)
+        whisper_trace_callback trace_callback;
+        void * trace_callback_user_data;
     };
 
     // NOTE: this function allocates memory, and it is the responsibility of the caller to free the pointer - see whisper_free_context_params & whisper_free_params()
@@ -610,8 +1282,55 @@ extern "C" {
                            const float * samples,
                                    int   n_samples);
 
+    // [EXPERIMENTAL] Run the entire model on a precomputed log mel spectrogram instead of the PCM audio
+    // The spectrogram is set as with whisper_set_mel() / whisper_set_mel_tensor_with_state() and is not recomputed.
+    // The options that need the samples (the energy of token_timestamps, silence_thold, speech_gate_thold) act as if
+    // there was no audio, params.vad is ignored.
+    WHISPER_API int whisper_full_from_mel(
+                struct whisper_context * ctx,
+            struct whisper_full_params   params,
+                           const float * data,
+                                   int   n_len,
+                                   int   n_mel);
+
+    WHISPER_API int whisper_full_from_mel_with_state(
+                struct whisper_context * ctx,
+                  struct whisper_state * state,
+            struct whisper_full_params   params,
+                           const float * data,
+                                   int   n_len,
+                                   int   n_mel);
+
+    WHISPER_API int whisper_full_from_mel_tensor_with_state(
+                struct whisper_context * ctx,
+                  struct whisper_state * state,
+            struct whisper_full_params   params,
+              const struct ggml_tensor * mel);
+
+    // [EXPERIMENTAL] Same as whisper_full() for 16 kHz samples of the given type (see whisper_pcm_type)
+    // With params.vad, the samples are converted to float for the VAD model.
+    WHISPER_API int whisper_full_typed(
+                struct whisper_context * ctx,
+            struct whisper_full_params   params,
+                            const void * samples,
+                   enum whisper_pcm_type type,
+                                   int   n_samples);
+
+    WHISPER_API int whisper_full_typed_with_state(
+                struct whisper_context * ctx,
+                  struct whisper_state * state,
+            struct whisper_full_params   params,
+                            const void * samples,
+                   enum whisper_pcm_type type,
+                                   int   n_samples);
+
     // Split the input audio in chunks and process each chunk separately using whisper_full_with_state()
     // Result is stored in the default state of the context
+    // With params.vad, the audio is split in the silences into several jobs per processor with the same duration of
+    // speech, and each processor takes the next job when it is done.
+    // The new_segment_callback is called in time order: the segments of the earliest unfinished job are delivered while
+    // it is being decoded, the segments of later jobs as soon as all earlier jobs are done. The callbacks are called
+    // one at a time, but from the worker threads.
     // Not thread safe if executed in parallel on the same context.
     // It seems this approach can offer some speedup in some cases.
     // However, the transcription accuracy can be worse at the beginning and end of each chunk.
@@ -622,6 +1341,82 @@ extern "C" {
                                    int   n_samples,
                                    int   n_processors);
 
+    // Same as whisper_full_parallel() with one processor for each of the given states.
+    // whisper_full_parallel() takes its states from the pool of the context (see whisper_state_pool_acquire()),
+    // so repeated calls do not allocate either - this variant is for callers that manage the states themselves.
+    // The states must be created from ctx, appear only once and not include the default state.
+    // Result is stored in the default state of the context.
+    WHISPER_API int whisper_full_parallel_with_states(
+                struct whisper_context * ctx,
+                 struct whisper_state ** states,
+                                   int   n_states,
+            struct whisper_full_params   params,
+                           const float * samples,
+                                   int   n_samples);
+
+    // [EXPERIMENTAL] Batched transcription of independent clips
+    // Clip i is transcribed with whisper_full_with_state(ctx, states[i], params[i], samples[i], n_samples[i]),
+    // in parallel for all clips. The first windows of the clips are encoded together with a single
+    // whisper_encode_batch_with_states() call, which pays off for many short clips (e.g. voice commands).
+    // The clips of the encoder batch use the same audio context: with audio_ctx < 0, the one of the longest clip.
+    // The clips that use VAD or a different explicit audio_ctx are encoded on their own.
+    // The decoder steps of the clips that sample a window with a single decoder (e.g. greedy at temperature 0,
+    // without a draft model, allowed_tokens or sample_on_device) are batched with whisper_decode_batch_with_states():
+    // each step waits for the other clips that are sampling a window and all of them are decoded with one graph.
+    // The results are the same as with whisper_full_with_state() up to the numerical differences of the batched graph.
+    // The states must be created from ctx and appear only once. rets[i] is the result of clip i (can be NULL).
+    // Returns 0 if all clips succeeded
+    WHISPER_API int whisper_full_batch(
+                struct whisper_context * ctx,
+                 struct whisper_state ** states,
+      const struct whisper_full_params * params,
+                   const float * const * samples,
+                             const int * n_samples,
+                                   int   n_states,
+                                   int * rets);
+
+    // [EXPERIMENTAL] Chunked long-form transcription
+    // Split the input audio in 30 s chunks at fixed offsets that overlap by overlap_ms and transcribe them
+    // independently, instead of moving the window by the decoded timestamps.
+    // The chunks are processed in groups of n_batch: the windows of a group are encoded with a single
+    // whisper_encode_batch_with_states() call and decoded in parallel, each with params.n_threads/n_batch threads.
+    // Of the segments in an overlap, the ones with the middle before the middle of the overlap are taken from the
+    // first chunk, the others from the second one.
+    // The context of the previous chunk is not used as a prompt (as with no_context).
+    // Result is stored in the default state of the context. Not supported with VAD.
+    // Returns 0 on success
+    WHISPER_API int whisper_full_chunked(
+                struct whisper_context * ctx,
+            struct whisper_full_params   params,
+                           const float * samples,
+                                   int   n_samples,
+                                   int   n_batch,
+                                   int   overlap_ms);
+
+    // [EXPERIMENTAL] Pull-based audio input of whisper_full_stream()
+    // Fill pcm with up to n_max samples of mono 16 kHz audio
+    // Return the number of samples, 0 at the end of the stream or < 0 on error
+    typedef int (*whisper_audio_read_callback)(float * pcm, int n_max, void * user_data);
+
+    // [EXPERIMENTAL] Streaming long-form transcription
+    // Pull the audio from read_callback in blocks of block_ms (at least 30 s, e.g. 5 min) and transcribe each block
+    // with whisper_full_with_state() as soon as it is read, so that the memory is bounded by the block and the
+    // transcription starts without waiting for the whole recording.
+    // The last segment of a block is not kept when it starts in the second half of the block - its audio is
+    // transcribed again at the start of the next block, so the words at the boundaries are not cut.
+    // The text of the kept segments is the prompt of the next block (unless no_context).
+    // Result is stored in the default state of the context, with the timestamps from the start of the stream.
+    // new_segment_callback is called for each kept segment. duration_ms and the progress are not used.
+    // offset_ms is the position in the recording of the first sample of read_callback - the reader skips it (e.g. by
+    // seeking the decoder) and the timestamps are from the start of the recording.
+    // Returns 0 on success
+    WHISPER_API int whisper_full_stream(
+                struct whisper_context * ctx,
+            struct whisper_full_params   params,
+           whisper_audio_read_callback   read_callback,
+                                  void * read_callback_user_data,
+                                   int   block_ms);
+
     // Number of generated text segments
     // A segment can be a few words, a sentence, or even a paragraph.
     WHISPER_API int whisper_full_n_segments           (struct whisper_context * ctx);
@@ -668,6 +1463,42 @@ extern "C" {
     WHISPER_API float whisper_full_get_token_p           (struct whisper_context * ctx, int i_segment, int i_token);
     WHISPER_API float whisper_full_get_token_p_from_state(struct whisper_state * state, int i_segment, int i_token);
 
+    // [EXPERIMENTAL] Bulk export of the results
+    // Copies all the segments and tokens of the last whisper_full() call in one call, instead of calling the accessors
+    // above once per segment and per token (e.g. to serialize the results or to pass them to the bindings).
+    //
+    // The tokens of all the segments are stored back to back in a single array, and the texts of all the segments in a
+    // single UTF-8 blob, each text followed by a null terminator.
+    typedef struct whisper_segment_data {
+        int64_t t0;              // start time of the segment
+        int64_t t1;              //   end time of the segment
+
+        size_t text_offs;        // offset of the text of the segment in the text blob
+        size_t text_len;         // length of the text in bytes, without the null terminator
+
+        int32_t token_offs;      // index of the first token of the segment in the tokens array
+        int32_t n_tokens;        // number of tokens of the segment
+
+        float no_speech_prob;
+        bool  speaker_turn_next;
+    } whisper_segment_data;
+
+    // Number of segments, tokens and bytes of text (terminators included) needed for the export
+    WHISPER_API void whisper_full_get_result_size           (struct whisper_context * ctx, int * n_segments, int * n_tokens, size_t * text_size);
+    WHISPER_API void whisper_full_get_result_size_from_state(struct whisper_state * state, int * n_segments, int * n_tokens, size_t * text_size);
+
+    // Fill the caller-provided arrays with the results
+    // tokens and text can be NULL to skip them (their sizes are ignored then)
+    // Returns the number of segments, or -1 if one of the arrays is too small
+    WHISPER_API int whisper_full_get_result           (struct whisper_context * ctx,
+                                                        whisper_segment_data * segments, int    n_segments_max,
+                                                          whisper_token_data * tokens,   int    n_tokens_max,
+                                                                        char * text,     size_t text_size);
+    WHISPER_API int whisper_full_get_result_from_state(struct whisper_state * state,
+                                                        whisper_segment_data * segments, int    n_segments_max,
+                                                          whisper_token_data * tokens,   int    n_tokens_max,
+                                                                        char * text,     size_t text_size);
+
     //
     // Voice Activity Detection (VAD)
     //
@@ -695,6 +1526,29 @@ extern "C" {
     WHISPER_API int     whisper_vad_n_probs(struct whisper_vad_context * vctx);
     WHISPER_API float * whisper_vad_probs  (struct whisper_vad_context * vctx);
 
+    // Incremental VAD for live audio
+    // The pushed samples are evaluated in windows of 512 samples, the incomplete window is kept for the next call.
+    // The LSTM state is kept from one call to the next, so the audio is evaluated only once.
+    // After each call, whisper_vad_probs() has the probabilities of the new windows and whisper_vad_events() the
+    // starts and ends of speech that they completed. A start is reported after min_speech_duration_ms of speech and
+    // an end after min_silence_duration_ms of silence, or when the speech reaches max_speech_duration_s.
+    // whisper_vad_reset() starts a new stream - whisper_vad_detect_speech() resets it too.
+    struct whisper_vad_event {
+        bool    speech; // true if the speech starts, false if it ends
+        int64_t sample; // position in samples since the start of the stream, with speech_pad_ms of padding
+    };
+
+    WHISPER_API bool whisper_vad_push(
+            struct whisper_vad_context * vctx,
+            struct whisper_vad_params    params,
+                           const float * samples,
+                                   int   n_samples);
+
+    WHISPER_API void whisper_vad_reset(struct whisper_vad_context * vctx);
+
+    WHISPER_API int                              whisper_vad_n_events(struct whisper_vad_context * vctx);
+    WHISPER_API const struct whisper_vad_event * whisper_vad_events  (struct whisper_vad_context * vctx);
+
     struct whisper_vad_segments;
 
     WHISPER_API struct whisper_vad_segments * whisper_vad_segments_from_probs(
@@ -0,0 +1,174 @@
+# Convert a Whisper model from the ggml format to GGUF
+#
+# Usage: python convert-ggml-to-gguf.py ./models/ggml-base.en.bin ./models/ggml-base.en.gguf
+#
+# The hparams, the mel filters and the tokenizer vocab are stored as GGUF key-value pairs:
+#
+#  - general.architecture            string   "whisper"
+#  - general.file_type               int32    ftype of the ggml file (including the quantization version)
+#  - whisper.vocab_size              int32
+#  - whisper.audio.context_length    int32
+#  - whisper.audio.embedding_length  int32
+#  - whisper.audio.head_count        int32
+#  - whisper.audio.block_count       int32
+#  - whisper.audio.mel_count         int32
+#  - whisper.text.context_length     int32
+#  - whisper.text.embedding_length   int32
+#  - whisper.text.head_count         int32
+#  - whisper.text.block_count        int32
+#  - whisper.mel_filters.n_mel       int32
+#  - whisper.mel_filters.n_fft       int32
+#  - whisper.mel_filters             float32[n_mel*n_fft]
+#  - tokenizer.ggml.tokens           string[n_vocab]
+#
+# The tensors keep their names, shapes and types. The tensor data is aligned to 32 bytes, so it can be
+# memory-mapped (see whisper_context_params.use_mmap).
+#
+# No dependencies besides the Python standard library are needed.
+#
+
+import sys
+import struct
+
+GGML_FILE_MAGIC = 0x67676d6c
+
+GGUF_MAGIC     = b"GGUF"
+GGUF_VERSION   = 3
+GGUF_ALIGNMENT = 32
+
+GGUF_TYPE_INT32   = 5
+GGUF_TYPE_FLOAT32 = 6
+GGUF_TYPE_STRING  = 8
+GGUF_TYPE_ARRAY   = 9
+
+# ggml type -> (block size, type size)
+GGML_TYPE_SIZE = {
+     0: (  1,   4), # F32
+     1: (  1,   2), # F16
+     2: ( 32,  18), # Q4_0
+     3: ( 32,  20), # Q4_1
+     6: ( 32,  22), # Q5_0
+     7: ( 32,  24), # Q5_1
+     8: ( 32,  34), # Q8_0
+     9: ( 32,  36), # Q8_1
+    10: (256,  84), # Q2_K
+    11: (256, 110), # Q3_K
+    12: (256, 144), # Q4_K
+    13: (256, 176), # Q5_K
+    14: (256, 210), # Q6_K
+    15: (256, 292), # Q8_K
+    30: (  1,   2), # BF16
+}
+
+def read_i32(f):
+    return struct.unpack("<i", f.read(4))[0]
+
+def pack_str(s):
+    return struct.pack("<Q", len(s)) + s
+
+def pack_kv_i32(key, val):
+    return pack_str(key.encode()) + struct.pack("<Ii", GGUF_TYPE_INT32, val)
+
+def pack_kv_str(key, val):
+    return pack_str(key.encode()) + struct.pack("<I", GGUF_TYPE_STRING) + pack_str(val)
+
+def pack_kv_arr(key, type, vals):
+    data = pack_str(key.encode()) + struct.pack("<IIQ", GGUF_TYPE_ARRAY, type, len(vals))
+    if type == GGUF_TYPE_STRING:
+        return data + b"".join(pack_str(v) for v in vals)
+    return data + struct.pack("<%df" % len(vals), *vals)
+
+def pad(n):
+    return (GGUF_ALIGNMENT - n % GGUF_ALIGNMENT) % GGUF_ALIGNMENT
+
+if len(sys.argv) < 3:
+    print("Usage: convert-ggml-to-gguf.py model.bin model.gguf\n")
+    sys.exit(1)
+
+fname_inp = sys.argv[1]
+fname_out = sys.argv[2]
+
+with open(fname_inp, "rb") as fin:
+    if read_i32(fin) != GGML_FILE_MAGIC:
+        print("Error: '%s' is not a ggml model file" % fname_inp)
+        sys.exit(1)
+
+    hparams = [read_i32(fin) for _ in range(11)]
+
+    n_vocab, n_audio_ctx, n_audio_state, n_audio_head, n_audio_layer, \
+        n_text_ctx, n_text_state, n_text_head, n_text_layer, n_mels, ftype = hparams
+
+    filters_n_mel = read_i32(fin)
+    filters_n_fft = read_i32(fin)
+    filters = list(struct.unpack("<%df" % (filters_n_mel*filters_n_fft), fin.read(4*filters_n_mel*filters_n_fft)))
+
+    tokens = []
+    for _ in range(read_i32(fin)):
+        tokens.append(fin.read(read_i32(fin)))
+
+    # scan the tensor headers and remember where the data is
+    tensors = []
+    while True:
+        header = fin.read(12)
+        if len(header) < 12:
+            break
+
+        n_dims, length, ttype = struct.unpack("<iii", header)
+        ne = [read_i32(fin) for _ in range(n_dims)]
+        name = fin.read(length)
+
+        if ttype not in GGML_TYPE_SIZE:
+            print("Error: tensor '%s' has unsupported type %d" % (name.decode(), ttype))
+            sys.exit(1)
+
+        blck, size = GGML_TYPE_SIZE[ttype]
+        if ne[0] % blck != 0:
+            print("Error: tensor '%s' has %d columns, which is not a multiple of the block size %d" % (name.decode(), ne[0], blck))
+            sys.exit(1)
+
+        nbytes = ne[0]//blck*size
+        for n in ne[1:]:
+            nbytes *= n
+
+        tensors.append((name, ne, ttype, fin.tell(), nbytes))
+        fin.seek(nbytes, 1)
+
+    kv = [
+        pack_kv_str("general.architecture",           b"whisper"),
+        pack_kv_i32("general.file_type",              ftype),
+        pack_kv_i32("whisper.vocab_size",             n_vocab),
+        pack_kv_i32("whisper.audio.context_length",   n_audio_ctx),
+        pack_kv_i32("whisper.audio.embedding_length", n_audio_state),
+        pack_kv_i32("whisper.audio.head_count",       n_audio_head),
+        pack_kv_i32("whisper.audio.block_count",      n_audio_layer),
+        pack_kv_i32("whisper.audio.mel_count",        n_mels),
+        pack_kv_i32("whisper.text.context_length",    n_text_ctx),
+        pack_kv_i32("whisper.text.embedding_length",  n_text_state),
+        pack_kv_i32("whisper.text.head_count",        n_text_head),
+        pack_kv_i32("whisper.text.block_count",       n_text_layer),
+        pack_kv_i32("whisper.mel_filters.n_mel",      filters_n_mel),
+        pack_kv_i32("whisper.mel_filters.n_fft",      filters_n_fft),
+        pack_kv_arr("whisper.mel_filters",            GGUF_TYPE_FLOAT32, filters),
+        pack_kv_arr("tokenizer.ggml.tokens",          GGUF_TYPE_STRING,  tokens),
+    ]
+
+    infos = []
+    offset = 0
+    for name, ne, ttype, _, nbytes in tensors:
+        infos.append(pack_str(name) + struct.pack("<I", len(ne)) + struct.pack("<%dq" % len(ne), *ne) + struct.pack("<IQ", ttype, offset))
+        offset += nbytes + pad(nbytes)
+
+    with open(fname_out, "wb") as fout:
+        meta = GGUF_MAGIC + struct.pack("<IQQ", GGUF_VERSION, len(tensors), len(kv)) + b"".join(kv) + b"".join(infos)
+        fout.write(meta)
+        fout.write(b"\0" * pad(len(meta)))
+
+        for name, ne, ttype, pos, nbytes in tensors:
+            fin.seek(pos)
+            fout.write(fin.read(nbytes))
+            fout.write(b"\0" * pad(nbytes))
+
+            print("%48s - [%s], type = %d" % (name.decode(), ", ".join(str(n) for n in ne), ttype))
+
+print("Done. Output file: " + fname_out)
+print("")
@@ -1,4 +1,5 @@
 import argparse
+import numpy as np
 import torch
 import torch.nn.functional as F
 import coremltools as ct
@@ -290,6 +291,108 @@ def convert_decoder(hparams, model, quantize=False):
 
     return model
 
+class TextDecoderStateful(nn.Module):
+    """
+    Decoder of one token with the self-attention KV cache and the cross-attention K/V as Core ML states.
+    The cross-attention K/V are computed from the rows of audio_data: all n_audio_ctx rows with the first token of
+    a window and only the first row after that, which writes the same values again.
+    The length of causal_mask is the position of the token + 1.
+    """
+    def __init__(self, decoder: TextDecoder, n_audio_ctx: int):
+        super().__init__()
+        self.decoder = decoder
+
+        n_layer    = len(decoder.blocks)
+        n_text_ctx = decoder.positional_embedding.shape[0]
+        n_state    = decoder.positional_embedding.shape[1]
+
+        self.register_buffer("k_cache", torch.zeros((n_layer, n_text_ctx, n_state), dtype=torch.float16))
+        self.register_buffer("v_cache", torch.zeros((n_layer, n_text_ctx, n_state), dtype=torch.float16))
+        self.register_buffer("cross_k", torch.zeros((n_layer, n_audio_ctx, n_state), dtype=torch.float16))
+        self.register_buffer("cross_v", torch.zeros((n_layer, n_audio_ctx, n_state), dtype=torch.float16))
+
+    @staticmethod
+    def attention(q: Tensor, k: Tensor, v: Tensor, n_head: int, mask: Optional[Tensor] = None):
+        n_state = q.shape[-1]
+        q = q.view(1, -1, n_head, n_state // n_head).permute(0, 2, 1, 3)
+        k = k.view(1, -1, n_head, n_state // n_head).permute(0, 2, 3, 1)
+        v = v.view(1, -1, n_head, n_state // n_head).permute(0, 2, 1, 3)
+
+        qk = (q @ k) * (n_state // n_head) ** -0.5
+        if mask is not None:
+            qk = qk + mask
+        w = F.softmax(qk.float(), dim=-1).to(q.dtype)
+
+        return (w @ v).permute(0, 2, 1, 3).flatten(start_dim=2)
+
+    def forward(self, token_data: Tensor, causal_mask: Tensor, audio_data: Tensor):
+        d = self.decoder
+
+        end = causal_mask.shape[-1]
+        beg = end - 1
+        n_audio = audio_data.shape[1]
+
+        x = d.token_embedding(token_data) + d.positional_embedding[beg:end]
+
+        for il, block in enumerate(d.blocks):
+            n_head = block.attn.n_head
+
+            self.cross_k[il:il + 1, :n_audio] = block.cross_attn.key(audio_data).to(torch.float16)
+            self.cross_v[il:il + 1, :n_audio] = block.cross_attn.value(audio_data).to(torch.float16)
+
+            a = block.attn_ln(x)
+            self.k_cache[il:il + 1, beg:end] = block.attn.key(a).to(torch.float16)
+            self.v_cache[il:il + 1, beg:end] = block.attn.value(a).to(torch.float16)
+
+            k = self.k_cache[il:il + 1, :end].to(x.dtype)
+            v = self.v_cache[il:il + 1, :end].to(x.dtype)
+            x = x + block.attn.out(self.attention(block.attn.query(a), k, v, n_head, causal_mask.to(x.dtype)))
+
+            a = block.cross_attn_ln(x)
+            k = self.cross_k[il:il + 1].to(x.dtype)
+            v = self.cross_v[il:il + 1].to(x.dtype)
+            x = x + block.cross_attn.out(self.attention(block.cross_attn.query(a), k, v, n_head))
+
+            x = x + block.mlp(block.mlp_ln(x))
+
+        x = d.ln(x)
+
+        return (x @ d.token_embedding.weight.to(x.dtype).T).float()
+
+def convert_decoder_stateful(hparams, model, quantize=False):
+    decoder = TextDecoderStateful(model, hparams.n_audio_ctx).eval()
+
+    token_data  = torch.zeros((1, 1), dtype=torch.int32)
+    causal_mask = torch.zeros((1, 2), dtype=torch.float16)
+    audio_data  = torch.zeros((1, hparams.n_audio_ctx, hparams.n_audio_state))
+
+    traced_model = torch.jit.trace(decoder, (token_data, causal_mask, audio_data))
+
+    model = ct.convert(
+        traced_model,
+        inputs=[
+            ct.TensorType(name="token_data", shape=(1, 1), dtype=np.int32),
+            ct.TensorType(name="causal_mask", shape=(1, ct.RangeDim(1, hparams.n_text_ctx)), dtype=np.float16),
+            ct.TensorType(name="audio_data", shape=ct.EnumeratedShapes(shapes=[
+                (1, hparams.n_audio_ctx, hparams.n_audio_state),
+                (1, 1,                   hparams.n_audio_state)])),
+        ],
+        outputs=[ct.TensorType(name="logits", dtype=np.float32)],
+        states=[
+            ct.StateType(wrapped_type=ct.TensorType(shape=decoder.k_cache.shape), name="k_cache"),
+            ct.StateType(wrapped_type=ct.TensorType(shape=decoder.v_cache.shape), name="v_cache"),
+            ct.StateType(wrapped_type=ct.TensorType(shape=decoder.cross_k.shape), name="cross_k"),
+            ct.StateType(wrapped_type=ct.TensorType(shape=decoder.cross_v.shape), name="cross_v"),
+        ],
+        minimum_deployment_target=ct.target.macOS15,
+        compute_units=ct.ComputeUnit.ALL,
+    )
+
+    if quantize:
+        model = quantize_weights(model, nbits=16)
+
+    return model
+
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()
@@ -297,6 +400,7 @@ if __name__ == "__main__":
     parser.add_argument("--encoder-only", type=bool, help="only convert encoder", default=False)
     parser.add_argument("--quantize",     type=bool, help="quantize weights to F16", default=False)
     parser.add_argument("--optimize-ane", type=bool, help="optimize for ANE execution (currently broken)", default=False)
+    parser.add_argument("--decoder-stateful", type=bool, help="convert the decoder with the KV cache as Core ML states (requires coremltools 8, macOS 15 / iOS 18)", default=False)
     args = parser.parse_args()
 
     if args.model not in ["tiny", "tiny.en", "base", "base.en", "small", "small.en", "small.en-tdrz", "medium", "medium.en", "large-v1", "large-v2", "large-v3", "large-v3-turbo"]:
@@ -320,7 +424,11 @@ if __name__ == "__main__":
     encoder = convert_encoder(hparams, encoder, quantize=args.quantize)
     encoder.save(f"models/coreml-encoder-{args.model}.mlpackage")
 
-    if args.encoder_only is False:
+    if args.decoder_stateful:
+        # Convert the decoder used by whisper.cpp (whisper_context_params::coreml_decoder)
+        decoder = convert_decoder_stateful(hparams, whisper.decoder, quantize=args.quantize)
+        decoder.save(f"models/coreml-decoder-{args.model}.mlpackage")
+    elif args.encoder_only is False:
         # Convert decoder
         decoder = convert_decoder(hparams, decoder, quantize=args.quantize)
         decoder.save(f"models/coreml-decoder-{args.model}.mlpackage")
@@ -5,7 +5,7 @@ set -e
 # Usage: ./generate-coreml-model.sh <model-name>
 if [ $# -eq 0 ]; then
   echo "No model name supplied"
-  echo "Usage for Whisper models: ./generate-coreml-model.sh <model-name>"
+  echo "Usage for Whisper models: ./generate-coreml-model.sh <model-name> [--decoder]"
   echo "Usage for HuggingFace models: ./generate-coreml-model.sh -h5 <model-name> <model-path>"
   exit 1
 elif [ "$1" = "-h5" ] && [ $# != 3 ]; then
@@ -24,6 +24,8 @@ if [ "$mname" = "-h5" ]; then
   mpath="$3"
   echo "$mpath"
   python3 models/convert-h5-to-coreml.py --model-name "$mname" --model-path "$mpath" --encoder-only True
+elif [ "$2" = "--decoder" ]; then
+  python3 models/convert-whisper-to-coreml.py --model "$mname" --optimize-ane True --decoder-stateful True
 else
   python3 models/convert-whisper-to-coreml.py --model "$mname" --encoder-only True --optimize-ane True
 fi
@@ -32,7 +34,9 @@ xcrun coremlc compile models/coreml-encoder-"${mname}".mlpackage models/
 rm -rf models/ggml-"${mname}"-encoder.mlmodelc
 mv -v models/coreml-encoder-"${mname}".mlmodelc models/ggml-"${mname}"-encoder.mlmodelc
 
-# TODO: decoder (sometime in the future maybe)
-#xcrun coremlc compile models/whisper-decoder-${mname}.mlpackage models/
-#rm -rf models/ggml-${mname}-decoder.mlmodelc
-#mv -v models/coreml_decoder_${mname}.mlmodelc models/ggml-${mname}-decoder.mlmodelc
+if [ "$2" = "--decoder" ]; then
+  # stateful decoder, used with whisper_context_params::coreml_decoder (macOS 15 / iOS 18)
+  xcrun coremlc compile models/coreml-decoder-"${mname}".mlpackage models/
+  rm -rf models/ggml-"${mname}"-decoder.mlmodelc
+  mv -v models/coreml-decoder-"${mname}".mlmodelc models/ggml-"${mname}"-decoder.mlmodelc
+fi
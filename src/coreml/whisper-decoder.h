@@ -0,0 +1,39 @@
+// Wrapper of the stateful Core ML Whisper Decoder model
+//
+// The model is generated with models/convert-whisper-to-coreml.py --decoder-stateful True and keeps the
+// self-attention KV cache and the cross-attention K/V as Core ML states (macOS 15 / iOS 18).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+struct whisper_coreml_decoder_context;
+
+// returns NULL if the model cannot be loaded or if the OS does not support stateful models
+struct whisper_coreml_decoder_context * whisper_coreml_decoder_init(const char * path_model);
+void whisper_coreml_decoder_free(struct whisper_coreml_decoder_context * ctx);
+
+// set the encoder output of the window to decode, n_ctx x n_state values
+// the next whisper_coreml_decoder_decode() with n_past == 0 computes the cross-attention K/V from it
+void whisper_coreml_decoder_set_audio(
+        struct whisper_coreml_decoder_context * ctx,
+                                      int64_t   n_ctx,
+                                      int64_t   n_state,
+                                  const float * embd);
+
+// decode token at position n_past and write the n_vocab logits to out
+// n_past == 0 starts a new sequence, otherwise the tokens must follow each other
+// returns false if the prediction failed
+bool whisper_coreml_decoder_decode(
+        struct whisper_coreml_decoder_context * ctx,
+                                      int32_t   token,
+                                          int   n_past,
+                                          int   n_vocab,
+                                        float * out);
+
+#if __cplusplus
+}
+#endif
@@ -0,0 +1,151 @@
+#if !__has_feature(objc_arc)
+#error This file must be compiled with automatic reference counting enabled (-fobjc-arc)
+#endif
+
+#import "whisper-decoder.h"
+#import "whisper-decoder-impl.h"
+
+#import <CoreML/CoreML.h>
+
+#include <stdlib.h>
+
+#include <vector>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+struct whisper_coreml_decoder_context {
+    const void * model; // MLModel
+
+    const void * state; // MLState of the current sequence
+
+    int64_t n_ctx;
+    int64_t n_state;
+
+    std::vector<float> audio;
+};
+
+struct whisper_coreml_decoder_context * whisper_coreml_decoder_init(const char * path_model) {
+    if (@available(macOS 15.0, iOS 18.0, tvOS 18.0, watchOS 11.0, *)) {
+        NSString * path_model_str = [[NSString alloc] initWithUTF8String:path_model];
+
+        NSURL * url_model = [NSURL fileURLWithPath: path_model_str];
+
+        MLModelConfiguration *config = [[MLModelConfiguration alloc] init];
+        config.computeUnits = MLComputeUnitsAll;
+
+        whisper_decoder_impl * impl = [[whisper_decoder_impl alloc] initWithContentsOfURL:url_model configuration:config error:nil];
+        if (impl == nil || impl.model == nil) {
+            return NULL;
+        }
+
+        // the stateless export of the decoder (token_data + audio_data -> cast_76) cannot be used incrementally
+        if (impl.model.modelDescription.stateDescriptionsByName.count == 0) {
+            return NULL;
+        }
+
+        whisper_coreml_decoder_context * ctx = new whisper_coreml_decoder_context;
+
+        ctx->model   = CFBridgingRetain(impl.model);
+        ctx->state   = NULL;
+        ctx->n_ctx   = 0;
+        ctx->n_state = 0;
+
+        return ctx;
+    }
+
+    return NULL;
+}
+
+void whisper_coreml_decoder_free(struct whisper_coreml_decoder_context * ctx) {
+    if (ctx->state) {
+        CFRelease(ctx->state);
+    }
+    CFRelease(ctx->model);
+    delete ctx;
+}
+
+void whisper_coreml_decoder_set_audio(
+        struct whisper_coreml_decoder_context * ctx,
+                                      int64_t   n_ctx,
+                                      int64_t   n_state,
+                                  const float * embd) {
+    ctx->n_ctx   = n_ctx;
+    ctx->n_state = n_state;
+    ctx->audio.assign(embd, embd + n_ctx*n_state);
+}
+
+bool whisper_coreml_decoder_decode(
+        struct whisper_coreml_decoder_context * ctx,
+                                      int32_t   token,
+                                          int   n_past,
+                                          int   n_vocab,
+                                        float * out) {
+    if (@available(macOS 15.0, iOS 18.0, tvOS 18.0, watchOS 11.0, *)) {
+        if (ctx->audio.empty()) {
+            return false;
+        }
+
+        MLModel * model = (__bridge MLModel *) ctx->model;
+
+        @autoreleasepool {
+            if (n_past == 0) {
+                if (ctx->state) {
+                    CFRelease(ctx->state);
+                }
+                ctx->state = CFBridgingRetain([model newState]);
+            } else if (ctx->state == NULL) {
+                return false;
+            }
+
+            MLState * state = (__bridge MLState *) ctx->state;
+
+            MLMultiArray * token_data = [[MLMultiArray alloc] initWithShape: @[@1, @1] dataType: MLMultiArrayDataTypeInt32 error: nil];
+            token_data[0] = @(token);
+
+            // the length of the mask gives the position of the token
+            MLMultiArray * causal_mask = [[MLMultiArray alloc] initWithShape: @[@1, @(n_past + 1)] dataType: MLMultiArrayDataTypeFloat16 error: nil];
+            memset(causal_mask.dataPointer, 0, (n_past + 1)*sizeof(uint16_t));
+
+            // the cross-attention K/V are computed once per window, later tokens only rewrite the first row
+            const int64_t n_audio = n_past == 0 ? ctx->n_ctx : 1;
+
+            MLMultiArray * audio_data = [
+                [MLMultiArray alloc] initWithDataPointer: ctx->audio.data()
+                                                   shape: @[@1, @(n_audio), @(ctx->n_state)]
+                                                dataType: MLMultiArrayDataTypeFloat32
+                                                 strides: @[@(n_audio*ctx->n_state), @(ctx->n_state), @1]
+                                             deallocator: nil
+                                                   error: nil
+            ];
+
+            MLDictionaryFeatureProvider * input = [[MLDictionaryFeatureProvider alloc] initWithDictionary: @{
+                @"token_data"  : token_data,
+                @"causal_mask" : causal_mask,
+                @"audio_data"  : audio_data,
+            } error: nil];
+
+            id<MLFeatureProvider> output = [model predictionFromFeatures: input usingState: state error: nil];
+            if (output == nil) {
+                return false;
+            }
+
+            MLMultiArray * logits = [output featureValueForName: @"logits"].multiArrayValue;
+            if (logits == nil || logits.count < n_vocab) {
+                return false;
+            }
+
+            // the logits of the last token are at the end of the output
+            memcpy(out, (const float *) logits.dataPointer + (logits.count - n_vocab), n_vocab*sizeof(float));
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+#if __cplusplus
+}
+#endif
@@ -3,6 +3,7 @@
 // Code is derived from the work of Github user @wangchou
 // ref: https://github.com/wangchou/callCoreMLFromCpp
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #if __cplusplus
@@ -21,6 +22,25 @@ void whisper_coreml_encode(
                                float * mel,
                                float * out);
 
+// Asynchronous prediction of n_batch windows, e.g. to run the encoder on the ANE while the decoder runs on the GPU.
+// The n_batch windows of n_mel x n_ctx values are contiguous in mel and copied, so mel can be reused right away.
+// The requests of a context are predicted in order on a queue of their own.
+struct whisper_coreml_request;
+
+struct whisper_coreml_request * whisper_coreml_encode_async(
+        const whisper_coreml_context * ctx,
+                                 int   n_batch,
+                             int64_t   n_ctx,
+                             int64_t   n_mel,
+                         const float * mel);
+
+// wait for the prediction and copy the output of window i to out
+// returns false if the prediction failed
+bool whisper_coreml_request_get(struct whisper_coreml_request * req, int i, float * out);
+
+// free the request - a pending prediction finishes in the background
+void whisper_coreml_request_free(struct whisper_coreml_request * req);
+
 #if __cplusplus
 }
 #endif
@@ -9,12 +9,30 @@
 
 #include <stdlib.h>
 
+#include <vector>
+
 #if __cplusplus
 extern "C" {
 #endif
 
 struct whisper_coreml_context {
     const void * data;
+
+    // serial queue of the asynchronous predictions
+    dispatch_queue_t queue;
+};
+
+struct whisper_coreml_request {
+    dispatch_group_t group;
+
+    int     n_batch;
+    int64_t n_ctx;
+    int64_t n_mel;
+
+    std::vector<float> mel;
+    std::vector<std::vector<float>> out;
+
+    bool ok;
 };
 
 struct whisper_coreml_context * whisper_coreml_init(const char * path_model) {
@@ -36,12 +54,16 @@ struct whisper_coreml_context * whisper_coreml_init(const char * path_model) {
 
     whisper_coreml_context * ctx = new whisper_coreml_context;
 
-    ctx->data = data;
+    ctx->data  = data;
+    ctx->queue = dispatch_queue_create("whisper.coreml.encoder", DISPATCH_QUEUE_SERIAL);
 
     return ctx;
 }
 
 void whisper_coreml_free(struct whisper_coreml_context * ctx) {
+    // wait for the pending asynchronous predictions
+    dispatch_sync(ctx->queue, ^{});
+
     CFRelease(ctx->data);
     delete ctx;
 }
@@ -68,6 +90,90 @@ void whisper_coreml_encode(
     }
 }
 
+struct whisper_coreml_request * whisper_coreml_encode_async(
+        const whisper_coreml_context * ctx,
+                                 int   n_batch,
+                             int64_t   n_ctx,
+                             int64_t   n_mel,
+                         const float * mel) {
+    whisper_coreml_request * req = new whisper_coreml_request;
+
+    req->group   = dispatch_group_create();
+    req->n_batch = n_batch;
+    req->n_ctx   = n_ctx;
+    req->n_mel   = n_mel;
+    req->mel.assign(mel, mel + n_batch*n_ctx*n_mel);
+    req->out.resize(n_batch);
+    req->ok      = false;
+
+    id model = (__bridge id) ctx->data;
+
+    dispatch_group_async(req->group, ctx->queue, ^{
+        @autoreleasepool {
+            NSMutableArray<whisper_encoder_implInput *> * inputs = [NSMutableArray arrayWithCapacity: req->n_batch];
+
+            for (int i = 0; i < req->n_batch; ++i) {
+                MLMultiArray * inMultiArray = [
+                    [MLMultiArray alloc] initWithDataPointer: req->mel.data() + i*req->n_ctx*req->n_mel
+                                                       shape: @[@1, @(req->n_mel), @(req->n_ctx)]
+                                                    dataType: MLMultiArrayDataTypeFloat32
+                                                     strides: @[@(req->n_ctx*req->n_mel), @(req->n_ctx), @1]
+                                                 deallocator: nil
+                                                       error: nil
+                ];
+
+                [inputs addObject: [[whisper_encoder_implInput alloc] initWithLogmel_data: inMultiArray]];
+            }
+
+            // a single window goes through the regular prediction, the batch prediction lets Core ML pipeline
+            // the windows on the ANE
+            NSArray<whisper_encoder_implOutput *> * outputs = nil;
+            if (req->n_batch == 1) {
+                whisper_encoder_implOutput * output = [model predictionFromFeatures: inputs[0] error: nil];
+                if (output != nil) {
+                    outputs = @[output];
+                }
+            } else {
+                outputs = [model predictionsFromInputs: inputs options: [[MLPredictionOptions alloc] init] error: nil];
+            }
+
+            if (outputs == nil || (int) outputs.count != req->n_batch) {
+                return;
+            }
+
+            for (int i = 0; i < req->n_batch; ++i) {
+                MLMultiArray * output = outputs[i].output;
+
+                req->out[i].resize(output.count);
+                memcpy(req->out[i].data(), output.dataPointer, output.count * sizeof(float));
+            }
+
+            req->ok = true;
+        }
+    });
+
+    return req;
+}
+
+bool whisper_coreml_request_get(struct whisper_coreml_request * req, int i, float * out) {
+    dispatch_group_wait(req->group, DISPATCH_TIME_FOREVER);
+
+    if (!req->ok || i < 0 || i >= req->n_batch) {
+        return false;
+    }
+
+    memcpy(out, req->out[i].data(), req->out[i].size() * sizeof(float));
+
+    return true;
+}
+
+void whisper_coreml_request_free(struct whisper_coreml_request * req) {
+    // a pending prediction is not waited for, the request is deleted once it is done
+    dispatch_group_notify(req->group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+        delete req;
+    });
+}
+
 #if __cplusplus
 }
 #endif
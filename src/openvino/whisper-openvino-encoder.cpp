@@ -1,12 +1,79 @@
 #include "openvino/whisper-openvino-encoder.h"
 #include "ggml.h"
 #include <openvino/openvino.hpp>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// compiled model shared by the contexts of the same model, device and cache_dir
+struct whisper_openvino_model {
+    ov::CompiledModel compiledModel;
+};
 
 struct whisper_openvino_context {
+    // declared first - released after the infer request
+    std::shared_ptr<whisper_openvino_model> model;
+
     ov::InferRequest inferRequest;
+
+    // input and output of the asynchronous encoding - must outlive the request
+    std::vector<float> input;
+    std::vector<float> output;
+    bool pending = false;
 };
 
+using whisper_openvino_model_key = std::tuple<std::string, std::string, std::string>;
+
+static std::mutex g_openvino_mutex;
+static std::map<whisper_openvino_model_key, std::weak_ptr<whisper_openvino_model>> g_openvino_models;
+
+static ov::Core & whisper_openvino_core() {
+    // creating a Core loads the device plugins, which is slow
+    static ov::Core core;
+    return core;
+}
+
+static std::shared_ptr<whisper_openvino_model> whisper_openvino_get_model(const char* path_model,
+    const char* device,
+    const char* cache_dir)
+{
+    std::lock_guard<std::mutex> lock(g_openvino_mutex);
+
+    const whisper_openvino_model_key key = { path_model, device, cache_dir ? cache_dir : "" };
+
+    auto model = g_openvino_models[key].lock();
+    if (model) {
+        return model;
+    }
+
+    ov::Core & core = whisper_openvino_core();
+
+    ov::AnyMap config;
+    if (cache_dir) {
+        // enables caching of device-specific 'blobs' during core.compile_model
+        // routine. This speeds up calls to compile_model for successive runs.
+        config.emplace(ov::cache_dir(cache_dir));
+    }
+
+    // the model is shared by the infer requests of several states - let the device run them in parallel streams
+    config.emplace(ov::hint::performance_mode(ov::hint::PerformanceMode::THROUGHPUT));
+
+    model = std::make_shared<whisper_openvino_model>();
+
+    // Produce a compiled-model object from the encoder IR (.xml/.bin), given the device ("CPU", "GPU", etc.)
+    // With a cached blob, the IR is not read at all.
+    model->compiledModel = core.compile_model(path_model, device, config);
+
+    g_openvino_models[key] = model;
+
+    return model;
+}
+
 struct whisper_openvino_context * whisper_openvino_init(const char* path_model,
     const char* device,
     const char* cache_dir)
@@ -21,23 +88,11 @@ struct whisper_openvino_context * whisper_openvino_init(const char* path_model,
 
 	whisper_openvino_context *context = new whisper_openvino_context;
     try {
-        ov::Core core;
-
-        if (cache_dir) {
-            // enables caching of device-specific 'blobs' during core.compile_model
-            // routine. This speeds up calls to compile_model for successive runs.
-            core.set_property(ov::cache_dir(cache_dir));
-        }
-
-        //Read the OpenVINO encoder IR (.xml/.bin) from disk, producing an ov::Model object.
-        std::shared_ptr<ov::Model> model = core.read_model(path_model);
-
-        // Produce a compiled-model object, given the device ("CPU", "GPU", etc.)
-        auto compiledModel = core.compile_model(model, device);
+        context->model = whisper_openvino_get_model(path_model, device, cache_dir);
 
         // From the compiled model object, create an infer request. This is the thing that we
         //  we will use later on to trigger inference execution.
-        context->inferRequest = compiledModel.create_infer_request();
+        context->inferRequest = context->model->compiledModel.create_infer_request();
     }
     catch (const std::exception& error) {
         std::cout << "in openvino encoder compile routine: exception: " << error.what() << std::endl;
@@ -50,6 +105,14 @@ struct whisper_openvino_context * whisper_openvino_init(const char* path_model,
 
 void whisper_openvino_free(struct whisper_openvino_context * ctx) {
     if( ctx ) {
+        if (ctx->pending) {
+            try {
+                ctx->inferRequest.wait();
+            }
+            catch (const std::exception&) {
+            }
+        }
+
         delete ctx;
     }
 }
@@ -77,6 +140,11 @@ int whisper_openvino_encode(
     }
 
     try {
+        // the infer request cannot be used while an asynchronous encoding is running
+        if (ctx->pending) {
+            ctx->pending = false;
+            ctx->inferRequest.wait();
+        }
 
         //wrap the passed-in mel ggml_tensor as an OpenVINO Tensor object, and set as input tensor to infer request
         {
@@ -106,3 +174,78 @@ int whisper_openvino_encode(
 
     return 1;
 }
+
+int whisper_openvino_encode_async(
+    whisper_openvino_context* ctx,
+    const float* mel,
+    int64_t n_ctx,
+    int64_t n_mel,
+    int64_t n_state) {
+
+    if (!ctx || !mel) {
+        fprintf(stderr, "%s: Error! ctx / mel is null\n", __func__);
+        return 0;
+    }
+
+    try {
+        if (ctx->pending) {
+            ctx->pending = false;
+            ctx->inferRequest.wait();
+        }
+
+        ctx->input.assign(mel, mel + n_ctx*n_mel);
+
+        {
+            ov::Shape input_shape = { 1, (unsigned long long)n_mel, (unsigned long long)n_ctx };
+            ov::Tensor input_tensor(ov::element::f32, input_shape, ctx->input.data());
+            ctx->inferRequest.set_input_tensor(input_tensor);
+        }
+
+        // the encoder halves the number of frames
+        ctx->output.resize((n_ctx/2)*n_state);
+
+        {
+            ov::Shape output_shape = { 1, (unsigned long long)(n_ctx/2), (unsigned long long)n_state };
+            ov::Tensor out_tensor(ov::element::f32, output_shape, ctx->output.data());
+            ctx->inferRequest.set_output_tensor(out_tensor);
+        }
+
+        ctx->inferRequest.start_async();
+        ctx->pending = true;
+    }
+    catch (const std::exception& error) {
+        std::cout << "in openvino encode async routine: exception: " << error.what() << std::endl;
+        return 0;
+    }
+
+    return 1;
+}
+
+int whisper_openvino_encode_wait(
+    whisper_openvino_context* ctx,
+    float* out,
+    size_t n_out) {
+
+    if (!ctx || !out || !ctx->pending) {
+        return 0;
+    }
+
+    try {
+        ctx->pending = false;
+        ctx->inferRequest.wait();
+
+        if (ctx->output.size() != n_out) {
+            fprintf(stderr, "%s: Error! the output has %zu values, expected %zu\n",
+                __func__, ctx->output.size(), n_out);
+            return 0;
+        }
+
+        memcpy(out, ctx->output.data(), n_out*sizeof(float));
+    }
+    catch (const std::exception& error) {
+        std::cout << "in openvino encode wait routine: exception: " << error.what() << std::endl;
+        return 0;
+    }
+
+    return 1;
+}
@@ -1,5 +1,11 @@
 // Wrapper of the OpenVINO Whisper Encoder model
 //
+// The contexts of the same model, device and cache_dir share one compiled model and each context has an
+// infer request of its own, so that the encodings of several whisper_state run concurrently on the device.
+//
+
+#include <stddef.h>
+#include <stdint.h>
 
 #if __cplusplus
 extern "C" {
@@ -9,6 +15,8 @@ struct whisper_openvino_context;
 
 // initialize openvino encoder, given path to model xml, device ("CPU", "GPU", etc.), and
 // path to cache_dir. Returns null upon failure.
+// The model is compiled on the first call only - with a cache_dir, it is imported from the cached blob
+// without reading the IR.
 struct whisper_openvino_context * whisper_openvino_init(const char * path_model,
                                                         const char * device,
                                                         const char * cache_dir);
@@ -26,6 +34,26 @@ int whisper_openvino_encode(
     ggml_tensor* mel,
     ggml_tensor* out);
 
+// Start the encoding of n_mel x n_ctx values in the background, mel is copied.
+// The output has n_state x n_ctx/2 values.
+// A pending encoding of the context is waited for first.
+// Returns 1 on success
+// Returns 0 on failure
+int whisper_openvino_encode_async(
+    whisper_openvino_context* ctx,
+    const float* mel,
+    int64_t n_ctx,
+    int64_t n_mel,
+    int64_t n_state);
+
+// Wait for the encoding started with whisper_openvino_encode_async() and copy n_out values of the output to out.
+// Returns 1 on success
+// Returns 0 on failure or if there is no pending encoding
+int whisper_openvino_encode_wait(
+    whisper_openvino_context* ctx,
+    float* out,
+    size_t n_out);
+
 #if __cplusplus
 }
 #endif
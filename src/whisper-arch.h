@@ -111,9 +111,8 @@ static const std::map<asr_system, std::map<asr_tensor, const char *>> ASR_TENSOR
 static const std::map<asr_tensor, ggml_op> ASR_TENSOR_INFO = {
     {ASR_TENSOR_ENC_POS_EMBD,          GGML_OP_ADD},
     {ASR_TENSOR_DEC_POS_EMBD,          GGML_OP_GET_ROWS},
-    // Note: ASR_TENSOR_DEC_TOKEN_EMBD_WEIGHT is also used by GGML_OP_MAT_MUL. Need to figure out a way how to handle
-    // weight tensors that are used by multiple different operators when extra_buffer_type implementations accelerate
-    // more than just GGML_OP_MUL_MAT.
+    // Note: ASR_TENSOR_DEC_TOKEN_EMBD_WEIGHT is also used by GGML_OP_MUL_MAT for the logits - when an extra buffer type
+    // accelerates it, the matrix multiplication uses a copy of the tensor in that buffer type (see whisper_model::d_te_out)
     {ASR_TENSOR_DEC_TOKEN_EMBD_WEIGHT, GGML_OP_GET_ROWS},
     {ASR_TENSOR_LN_WEIGHT,             GGML_OP_MUL},
     {ASR_TENSOR_LN_BIAS,               GGML_OP_ADD},
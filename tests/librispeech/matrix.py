@@ -0,0 +1,160 @@
+import os
+import re
+import glob
+import json
+import argparse
+import itertools
+import subprocess
+import jiwer
+from normalizers import EnglishTextNormalizer
+from eval import get_reference
+
+# Run whisper-cli over the LibriSpeech subset for every combination of
+# models, quantization types, backends and flash attention, and report
+# the WER and the real-time factor of each.
+#
+# With --baseline, the results are compared with those of a previous run:
+# the harness fails when the WER gets worse, or when the RTF gets worse by
+# more than --threshold at equal WER.
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--prefix', default='../../')
+    parser.add_argument('--models', default='tiny')
+    parser.add_argument('--quants', default='f16', help='f16 is the original model')
+    parser.add_argument('--backends', default='cpu', help='cpu, gpu')
+    parser.add_argument('--flash-attn', default='off', help='off, on')
+    parser.add_argument('--threads', type=int, default=4)
+    parser.add_argument('--limit', type=int, default=0, help='number of audio files (0 - all)')
+    parser.add_argument('--chunk', type=int, default=100, help='audio files per whisper-cli run')
+    parser.add_argument('--output', default='matrix.json')
+    parser.add_argument('--baseline', default='')
+    parser.add_argument('--threshold', type=float, default=0.10, help='maximum relative RTF regression')
+    parser.add_argument('--wer-tolerance', type=float, default=0.10, help='WER difference in percentage points that counts as equal')
+    return parser.parse_args()
+
+def flac_duration(path):
+    # STREAMINFO is the first metadata block: 20 bits of sample rate and
+    # 36 bits of total samples, 10 bytes into the block
+    with open(path, 'rb') as fp:
+        head = fp.read(42)
+    if head[:4] != b'fLaC':
+        raise ValueError(f'{path}: not a FLAC file')
+    info = int.from_bytes(head[18:26], 'big')
+    sample_rate = info >> 44
+    n_samples = info & ((1 << 36) - 1)
+    return n_samples / sample_rate
+
+def get_model(args, model, quant):
+    fname = os.path.join(args.prefix, 'models', f'ggml-{model}.bin')
+    if quant == 'f16':
+        return fname
+    fname_q = os.path.join(args.prefix, 'models', f'ggml-{model}-{quant}.bin')
+    if not os.path.exists(fname_q):
+        quantize = os.path.join(args.prefix, 'build', 'bin', 'quantize')
+        subprocess.run([quantize, fname, fname_q, quant], check=True, stdout=subprocess.DEVNULL)
+    return fname_q
+
+def run_config(args, audio, model_path, backend, flash_attn, out_dir):
+    cli = os.path.join(args.prefix, 'build', 'bin', 'whisper-cli')
+
+    # the time of the model load is not counted
+    t_compute_ms = 0.0
+    for i in range(0, len(audio), args.chunk):
+        cmd = [cli, '--model', model_path, '--threads', str(args.threads), '--language', 'en', '--output-txt']
+        if backend == 'cpu':
+            cmd.append('--no-gpu')
+        if flash_attn == 'on':
+            cmd.append('--flash-attn')
+        for path in audio[i:i + args.chunk]:
+            code = os.path.basename(path).replace('.flac', '')
+            cmd += ['--file', path, '--output-file', os.path.join(out_dir, code)]
+
+        proc = subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+
+        load_ms  = float(re.search(r'load time =\s*([0-9.]+) ms', proc.stderr).group(1))
+        total_ms = float(re.search(r'total time =\s*([0-9.]+) ms', proc.stderr).group(1))
+        t_compute_ms += total_ms - load_ms
+
+    return t_compute_ms
+
+def get_wer(audio, out_dir):
+    normalizer = EnglishTextNormalizer()
+    ref_orig = get_reference()
+
+    ref_clean = []
+    hyp_clean = []
+    for path in audio:
+        code = os.path.basename(path).replace('.flac', '')
+        with open(os.path.join(out_dir, code + '.txt')) as fp:
+            hyp = fp.read().strip()
+        ref_clean.append(normalizer(ref_orig[code]))
+        hyp_clean.append(normalizer(hyp))
+
+    return jiwer.wer(ref_clean, hyp_clean) * 100
+
+def compare(results, baseline, args):
+    base = {r['config']: r for r in baseline['results']}
+
+    failed = False
+    for r in results:
+        b = base.get(r['config'])
+        if b is None:
+            print(f"{r['config']}: no baseline")
+            continue
+
+        d_wer = r['wer'] - b['wer']
+        d_rtf = r['rtf'] / b['rtf'] - 1 if b['rtf'] > 0 else 0.0
+
+        status = 'ok'
+        if d_wer > args.wer_tolerance:
+            status = 'FAIL (WER)'
+        elif d_rtf > args.threshold and d_wer >= -args.wer_tolerance:
+            status = 'FAIL (RTF)'
+        failed = failed or status != 'ok'
+
+        print(f"{r['config']}: WER {b['wer']:.2f}% -> {r['wer']:.2f}%, RTF {b['rtf']:.4f} -> {r['rtf']:.4f} ({d_rtf * 100:+.1f}%) {status}")
+
+    return not failed
+
+def main():
+    args = parse_args()
+
+    audio = sorted(glob.glob('LibriSpeech/*/*/*/*.flac'))
+    if args.limit > 0:
+        audio = audio[:args.limit]
+    if not audio:
+        raise SystemExit('no audio files, run "make get-audio" first')
+
+    audio_s = sum(flac_duration(path) for path in audio)
+
+    results = []
+    for model, quant, backend, flash_attn in itertools.product(
+            args.models.split(','), args.quants.split(','), args.backends.split(','), args.flash_attn.split(',')):
+        config = f'{model}-{quant}-{backend}-fa_{flash_attn}'
+
+        out_dir = os.path.join('matrix', config)
+        os.makedirs(out_dir, exist_ok=True)
+
+        model_path = get_model(args, model, quant)
+
+        t_compute_ms = run_config(args, audio, model_path, backend, flash_attn, out_dir)
+
+        wer = get_wer(audio, out_dir)
+        rtf = t_compute_ms / 1000 / audio_s
+
+        print(f'{config}: WER {wer:.2f}%, RTF {rtf:.4f}')
+        results.append({'config': config, 'model': model, 'quant': quant, 'backend': backend,
+                        'flash_attn': flash_attn == 'on', 'wer': wer, 'rtf': rtf})
+
+    with open(args.output, 'w') as fp:
+        json.dump({'files': len(audio), 'audio_s': audio_s, 'threads': args.threads, 'results': results}, fp, indent=2)
+
+    if args.baseline:
+        with open(args.baseline) as fp:
+            baseline = json.load(fp)
+        if not compare(results, baseline, args):
+            raise SystemExit(1)
+
+if __name__ == '__main__':
+    main()
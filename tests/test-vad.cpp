@@ -1,8 +1,10 @@
 #include "whisper.h"
 #include "common-whisper.h"
 
+#include <cmath>
 #include <cstdio>
 #include <string>
+#include <vector>
 
 #ifdef NDEBUG
 #undef NDEBUG
@@ -47,6 +49,45 @@ struct whisper_vad_segments * test_detect_timestamps(
     return timestamps;
 }
 
+// pushing the audio in small chunks gives the probabilities of whisper_vad_detect_speech()
+void test_push(
+        struct whisper_vad_context * vctx,
+        struct whisper_vad_params params,
+        const float * pcmf32,
+        int n_samples) {
+    assert(whisper_vad_detect_speech(vctx, pcmf32, n_samples));
+    const std::vector<float> probs_ref(whisper_vad_probs(vctx), whisper_vad_probs(vctx) + whisper_vad_n_probs(vctx));
+
+    whisper_vad_reset(vctx);
+
+    std::vector<float> probs;
+    int n_start = 0;
+    int n_end   = 0;
+    int64_t t_last = 0;
+
+    for (int i = 0; i < n_samples; i += 1000) {
+        assert(whisper_vad_push(vctx, params, pcmf32 + i, std::min(1000, n_samples - i)));
+        probs.insert(probs.end(), whisper_vad_probs(vctx), whisper_vad_probs(vctx) + whisper_vad_n_probs(vctx));
+
+        for (int j = 0; j < whisper_vad_n_events(vctx); ++j) {
+            const whisper_vad_event & event = whisper_vad_events(vctx)[j];
+            assert(event.sample >= t_last);
+            assert(event.speech == (n_start == n_end));
+            event.speech ? n_start++ : n_end++;
+            t_last = event.sample;
+        }
+    }
+
+    // the last, incomplete window is not evaluated
+    assert(probs.size() == (size_t) n_samples/512);
+    for (size_t i = 0; i < probs.size(); ++i) {
+        assert(std::fabs(probs[i] - probs_ref[i]) < 1e-3f);
+    }
+
+    printf("VAD push: %d speech starts, %d ends\n", n_start, n_end);
+    assert(n_start >= 5 && n_start - n_end <= 1);
+}
+
 int main() {
     std::string vad_model_path = "../../models/for-tests-silero-v5.1.2-ggml.bin";
     std::string sample_path    = "../../samples/jfk.wav";
@@ -76,6 +117,9 @@ int main() {
     // Test speech timestamps (uses speech probabilities from above)
     struct whisper_vad_segments * timestamps = test_detect_timestamps(vctx, params);
 
+    // Test incremental VAD
+    test_push(vctx, params, pcmf32.data(), pcmf32.size());
+
     whisper_vad_free_segments(timestamps);
     whisper_vad_free(vctx);
 